@@ -9,4 +9,7 @@ constexpr int         PROJECT_VER_MAJOR = @PROJECT_VERSION_MAJOR @;
 constexpr int         PROJECT_VER_MINOR = @PROJECT_VERSION_MINOR @;
 constexpr int         PROJECT_VER_PATCH = @PROJECT_VERSION_PATCH @;
 
+// Shaders are compiled at runtime from the source tree:
+constexpr const char* SHADER_DIRECTORY = "@PROJECT_SOURCE_DIR@/shaders";
+
 } // namespace polar
\ No newline at end of file
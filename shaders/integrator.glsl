@@ -0,0 +1,147 @@
+// Interface between the integrators (see integrator.hpp and wavefront_integrator.hpp) and their shaders. The layouts mirror
+// IntegratorConstants and GPUWavefrontQueues on the host.
+
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_scalar_block_layout : require
+
+float luminance(const vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+#include "light_tree.glsl"
+#include "restir.glsl"
+#include "scene.glsl"
+
+struct QueueHeader
+{
+    uint count;
+    uint groupCountX; // groupCountX to groupCountZ are the arguments of the indirect dispatch over the queue
+    uint groupCountY;
+    uint groupCountZ;
+};
+
+layout(buffer_reference, scalar) buffer QueueHeaders { QueueHeader headers[]; };
+layout(buffer_reference, scalar) buffer Vec4s        { vec4 values[];         };
+layout(buffer_reference, scalar) buffer UVec4s       { uvec4 values[];        };
+layout(buffer_reference, scalar) buffer Uints        { uint values[];         };
+layout(buffer_reference, scalar) buffer Floats       { float values[];        };
+
+// Pixels that haven't converged yet, see ActivePixelsHeader on the host:
+layout(buffer_reference, scalar) buffer ActivePixels
+{
+    QueueHeader header;          // Count and dispatch arguments over the pixels
+    uvec3       traceRaysExtent; // vkCmdTraceRaysIndirectKHR over the pixels
+    uint        pixels[];
+};
+
+struct PathQueue
+{
+    Vec4s  origins;     // xyz, tMin
+    Vec4s  directions;  // xyz, tMax
+    Vec4s  throughputs; // rgb, pdf of the last BSDF sample (for MIS)
+    UVec4s states;      // pixel, RNG state, free for the integrator
+};
+
+struct ShadowQueue
+{
+    Vec4s origins;       // xyz, tMin
+    Vec4s directions;    // xyz, tMax
+    Vec4s contributions; // rgb, pixel (as uintBitsToFloat)
+};
+
+layout(buffer_reference, scalar) buffer WavefrontQueues
+{
+    QueueHeaders headers;         // See the *_QUEUE constants below
+    PathQueue    paths[2];        // The bounce reads paths[bounce % 2] and appends to paths[(bounce + 1) % 2]
+    UVec4s       hits;            // Indexed like the path queue that is read: instance custom index, geometry index, primitive index,
+                                  // packUnorm2x16(barycentrics). The instance custom index is ~0u for misses.
+    Uints        materials;       // Indexed like hits: material index of the hit (the number of materials without one), for ray sorting
+    Uints        buckets;         // capacity path indices per material bucket
+    ShadowQueue  shadows;
+    Vec4s        radiance;        // Per pixel, of the current sample
+    Uints        materialBuckets; // Bucket of every material, the entry after the last material is for geometry without one
+    uint         capacity;
+    uint         bucketCount;
+};
+
+// Kernels with push constants of their own (e.g. the ray sorting kernels) #define CUSTOM_PUSH_CONSTANTS and only use the declarations above.
+#ifndef CUSTOM_PUSH_CONSTANTS
+
+layout(push_constant, scalar) uniform IntegratorConstants
+{
+    WavefrontQueues queues;         // Wavefront only
+    Vec4s           accumulation;   // Per pixel: sum of radiance, sample count
+    Floats          moments;        // Per pixel: sum of squared luminance
+    ActivePixels    activePixels;
+    LightTree       lightTree;      // See sampleLight(), 0 if the scene has no emitters
+    Restir          restir;         // See restirLightSample(), 0 without ReSTIR DI
+    SceneTable      scene;          // See scene.glsl, 0 if the kernels don't need it
+    uvec2           extent;         // Of the rendered region, all per pixel buffers are indexed within it
+    uvec2           imageOffset;    // Of the rendered region in the image
+    uvec2           imageExtent;
+    uint            frameIndex;
+    uint            sampleIndex;    // Number of samples accumulated so far
+    uint            sampleCount;    // Samples to take per pixel in this dispatch (megakernel only, the wavefront takes one per pass)
+    uint            maxPathLength;
+    uint            bounce;         // Wavefront only
+    uint            adaptive;       // Whether only the pixels in activePixels are rendered
+    float           errorThreshold; // Convergence kernel only
+    uint            minSamples;     // Convergence kernel only
+} constants;
+
+// Number of pixels a pass renders. Raygen shaders and kernels that run per pixel map their launch index to the pixel with launchPixel().
+uint launchCount()
+{
+    return constants.adaptive != 0 ? constants.activePixels.header.count : constants.extent.x * constants.extent.y;
+}
+
+uint launchPixel(const uint launchIndex)
+{
+    return constants.adaptive != 0 ? constants.activePixels.pixels[launchIndex] : launchIndex;
+}
+
+// Pixel of the image that a pixel of the rendered region corresponds to, e.g. to generate its camera ray from.
+uvec2 imagePixel(const uint pixel)
+{
+    return constants.imageOffset + uvec2(pixel % constants.extent.x, pixel / constants.extent.x);
+}
+
+// Adds a sample to the accumulation of a pixel, including the moments that the convergence kernel estimates its error from.
+void accumulateSample(const uint pixel, const vec3 radiance)
+{
+    const float sampleLuminance = luminance(radiance);
+    constants.accumulation.values[pixel] += vec4(radiance, 1.0);
+    constants.moments.values[pixel] += sampleLuminance * sampleLuminance;
+}
+
+#endif
+
+const uint PATH_QUEUE_0       = 0;
+const uint PATH_QUEUE_1       = 1;
+const uint SHADOW_QUEUE       = 2;
+const uint FIRST_BUCKET_QUEUE = 3;
+
+#ifdef WAVEFRONT_KERNEL
+
+layout(constant_id = 0) const uint WORKGROUP_SIZE = 64;
+layout(local_size_x_id = 0) in;
+
+// Reserves an entry in the queue. Whoever appends the first entry of a workgroup also adds the workgroup to the indirect dispatch, so
+// that the next kernel can be dispatched without another pass over the counts.
+uint appendToQueue(const uint queue)
+{
+    const uint index = atomicAdd(constants.queues.headers.headers[queue].count, 1);
+    if (index % WORKGROUP_SIZE == 0)
+    {
+        atomicAdd(constants.queues.headers.headers[queue].groupCountX, 1);
+    }
+    return index;
+}
+
+uint queueCount(const uint queue)
+{
+    return constants.queues.headers.headers[queue].count;
+}
+
+#endif
@@ -0,0 +1,318 @@
+// Shader side of LightTree (see light_tree.hpp), whose layouts the declarations below mirror. Shaders that sample lights get the address
+// of the tree from IntegratorConstants::lightTree (0 if the scene has no emitters) and pick an emitter for a shading point with
+// sampleLight(). Paths that hit an emissive triangle get the probability that sampleLight() would have picked it (for multiple importance
+// sampling) from lightPmf() with the emitter of triangleEmitter().
+
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_scalar_block_layout : require
+
+const uint LIGHT_NODE_LEAF      = 1u << 0;
+const uint LIGHT_NODE_TWO_SIDED = 1u << 1;
+
+const uint EMITTER_TRIANGLE    = 0;
+const uint EMITTER_POINT       = 1;
+const uint EMITTER_SPOT        = 2;
+const uint EMITTER_DIRECTIONAL = 3;
+const uint EMITTER_TWO_SIDED   = 1u << 8;
+
+struct LightNode
+{
+    vec3  boundsMin;
+    float power;
+    vec3  boundsMax;
+    float cosThetaO;
+    vec3  axis;
+    float cosThetaE;
+    uint  index; // Leaves: the emitter, internal nodes: the right child (the left one follows the node)
+    uint  flags;
+    uint  parent;
+    uint  padding;
+};
+
+struct LightEmitter
+{
+    vec3  p0;       // Triangles: first vertex, point and spot lights: position
+    uint  type;     // EMITTER_*, EMITTER_TWO_SIDED
+    vec3  p1;       // Triangles: second vertex, spot and directional lights: direction they shine along
+    uint  source;   // Triangles: instance of the scene, lights: light of the scene
+    vec3  p2;       // Triangles: third vertex
+    uint  triangle;
+    vec3  emission; // Triangles: emissive factor (times the average of the emissive texture), lights: intensity (color times intensity)
+    uint  geometry;
+    float cosInner;
+    float cosOuter;
+    float range;    // 0 for infinite
+    uint  leaf;
+};
+
+layout(buffer_reference, scalar) buffer LightNodes    { LightNode nodes[];       };
+layout(buffer_reference, scalar) buffer LightEmitters { LightEmitter emitters[]; };
+layout(buffer_reference, scalar) buffer LightIndices  { uint values[];           };
+
+layout(buffer_reference, scalar) buffer LightTree
+{
+    LightNodes    nodes;
+    LightEmitters emitters;           // The emitters in the tree, followed by the directional lights
+    LightIndices  instanceGeometries; // Per instance of the scene: its first entry of geometryEmitters, or ~0u
+    LightIndices  geometryEmitters;   // Per geometry of an instance: the emitter of its first triangle, or ~0u
+    uint          nodeCount;
+    uint          treeEmitterCount;
+    uint          directionalCount;
+    uint          padding;
+};
+
+// A sampled emitter as seen from a shading point.
+struct LightSample
+{
+    vec3  direction; // Towards the emitter
+    float distance;  // Infinite for directional lights
+    vec3  radiance;  // Incident radiance (triangles) or irradiance (lights), without the emissive texture of triangles
+    float pdf;       // Solid angle density for triangles, probability for lights (which are delta distributions), 0 if invalid
+    vec3  normal;    // Of triangles
+    uint  emitter;
+    vec2  barycentrics; // Of triangles, e.g. to look up the emissive texture
+};
+
+// Estimates how much the emitters below a node can contribute to a point with the given normal (0 for points in volumes), from an upper
+// bound on the cosine at the emitters and at the point.
+float lightNodeImportance(const LightNode node, const vec3 p, const vec3 n)
+{
+    if (node.power <= 0.0)
+    {
+        return 0.0;
+    }
+
+    const vec3  center   = 0.5 * (node.boundsMin + node.boundsMax);
+    const float radius   = 0.5 * length(node.boundsMax - node.boundsMin);
+    const vec3  toPoint  = p - center;
+    const float distance = length(toPoint);
+
+    // Up close, the squared distance mostly underestimates how far the emitters are, so it's clamped:
+    const float d2 = max(distance * distance, radius);
+
+    // Angle between the axis and the direction towards the point, less the spread of the normals:
+    const vec3  wi        = distance > 0.0 ? toPoint / distance : node.axis;
+    float       cosThetaW = dot(node.axis, wi);
+    cosThetaW             = (node.flags & LIGHT_NODE_TWO_SIDED) != 0 ? abs(cosThetaW) : cosThetaW;
+    const float sinThetaW = sqrt(max(1.0 - cosThetaW * cosThetaW, 0.0));
+    const float sinThetaO = sqrt(max(1.0 - node.cosThetaO * node.cosThetaO, 0.0));
+    const float cosThetaX = cosThetaW > node.cosThetaO ? 1.0 : cosThetaW * node.cosThetaO + sinThetaW * sinThetaO;
+    const float sinThetaX = cosThetaW > node.cosThetaO ? 0.0 : sinThetaW * node.cosThetaO - cosThetaW * sinThetaO;
+
+    // Less the angle the bounds subtend from the point (the whole sphere from within them):
+    const bool  inside    = all(greaterThanEqual(p, node.boundsMin)) && all(lessThanEqual(p, node.boundsMax));
+    const float sin2B     = distance > 0.0 ? radius * radius / (distance * distance) : 1.0;
+    const float cosThetaB = inside || sin2B >= 1.0 ? -1.0 : sqrt(1.0 - sin2B);
+    const float sinThetaB = sqrt(max(1.0 - cosThetaB * cosThetaB, 0.0));
+    const float cosTheta  = cosThetaX > cosThetaB ? 1.0 : cosThetaX * cosThetaB + sinThetaX * sinThetaB;
+    if (cosTheta <= node.cosThetaE)
+    {
+        return 0.0;
+    }
+
+    float importance = node.power * cosTheta / d2;
+    if (n != vec3(0.0))
+    {
+        const float cosThetaI = abs(dot(wi, n));
+        const float sinThetaI = sqrt(max(1.0 - cosThetaI * cosThetaI, 0.0));
+        importance *= cosThetaI > cosThetaB ? 1.0 : cosThetaI * cosThetaB + sinThetaI * sinThetaB;
+    }
+    return max(importance, 0.0);
+}
+
+// Probability of sampling a directional light rather than descending into the tree:
+float directionalProbability(const LightTree tree)
+{
+    return float(tree.directionalCount) / float(tree.directionalCount + (tree.nodeCount > 0 ? 1 : 0));
+}
+
+// Picks an emitter for a point, ~0u if none can contribute. Directional lights are picked uniformly, the tree is descended by the
+// importance of the children at every level.
+uint sampleLightTree(const LightTree tree, const vec3 p, const vec3 n, float u, out float pmf)
+{
+    pmf = 0.0;
+
+    const float pDirectional = directionalProbability(tree);
+    if (u < pDirectional)
+    {
+        const uint directional = min(uint(u / pDirectional * float(tree.directionalCount)), tree.directionalCount - 1);
+        pmf                    = pDirectional / float(tree.directionalCount);
+        return tree.treeEmitterCount + directional;
+    }
+    if (tree.nodeCount == 0)
+    {
+        return ~0u;
+    }
+
+    // Reuse the random number at every level:
+    u             = min((u - pDirectional) / (1.0 - pDirectional), 0.99999994);
+    float treePmf = 1.0 - pDirectional;
+
+    uint      nodeIndex = 0;
+    LightNode node      = tree.nodes.nodes[0];
+    if (lightNodeImportance(node, p, n) <= 0.0)
+    {
+        return ~0u;
+    }
+
+    while ((node.flags & LIGHT_NODE_LEAF) == 0)
+    {
+        const LightNode left        = tree.nodes.nodes[nodeIndex + 1];
+        const LightNode right       = tree.nodes.nodes[node.index];
+        const float     leftWeight  = lightNodeImportance(left, p, n);
+        const float     rightWeight = lightNodeImportance(right, p, n);
+        if (leftWeight + rightWeight <= 0.0)
+        {
+            return ~0u;
+        }
+
+        const float pLeft = leftWeight / (leftWeight + rightWeight);
+        if (u < pLeft)
+        {
+            u = min(u / pLeft, 0.99999994);
+            treePmf *= pLeft;
+            nodeIndex = nodeIndex + 1;
+            node      = left;
+        }
+        else
+        {
+            u = min((u - pLeft) / (1.0 - pLeft), 0.99999994);
+            treePmf *= 1.0 - pLeft;
+            nodeIndex = node.index;
+            node      = right;
+        }
+    }
+
+    pmf = treePmf;
+    return node.index;
+}
+
+// Probability that sampleLightTree() picks the emitter for the point.
+float lightPmf(const LightTree tree, const vec3 p, const vec3 n, const uint emitter)
+{
+    const float pDirectional = directionalProbability(tree);
+    if (emitter >= tree.treeEmitterCount)
+    {
+        return pDirectional / float(tree.directionalCount);
+    }
+
+    // The probability of every step down is independent of the others, so it can be gathered bottom up:
+    float pmf       = 1.0 - pDirectional;
+    uint  nodeIndex = tree.emitters.emitters[emitter].leaf;
+    while (nodeIndex != 0)
+    {
+        const uint      parentIndex = tree.nodes.nodes[nodeIndex].parent;
+        const LightNode parent      = tree.nodes.nodes[parentIndex];
+        const float     leftWeight  = lightNodeImportance(tree.nodes.nodes[parentIndex + 1], p, n);
+        const float     rightWeight = lightNodeImportance(tree.nodes.nodes[parent.index], p, n);
+        if (leftWeight + rightWeight <= 0.0)
+        {
+            return 0.0;
+        }
+
+        pmf *= (nodeIndex == parentIndex + 1 ? leftWeight : rightWeight) / (leftWeight + rightWeight);
+        nodeIndex = parentIndex;
+    }
+    return lightNodeImportance(tree.nodes.nodes[0], p, n) > 0.0 ? pmf : 0.0;
+}
+
+// The emitter of a triangle of an instance of the scene, ~0u if it doesn't emit. The geometry and triangle are those of the instance's own
+// mesh, which LodSelector never swaps for a level of detail if it's emissive.
+uint triangleEmitter(const LightTree tree, const uint instance, const uint geometry, const uint triangle)
+{
+    const uint first = tree.instanceGeometries.values[instance];
+    if (first == ~0u)
+    {
+        return ~0u;
+    }
+    const uint emitter = tree.geometryEmitters.values[first + geometry];
+    return emitter == ~0u ? ~0u : emitter + triangle;
+}
+
+// Samples a point on the emitter (triangles) or the emitter itself (lights), as seen from p.
+LightSample sampleEmitter(const LightTree tree, const uint emitterIndex, const vec3 p, const vec2 u)
+{
+    const LightEmitter emitter = tree.emitters.emitters[emitterIndex];
+    const uint         type    = emitter.type & 0xFF;
+
+    LightSample s;
+    s.emitter      = emitterIndex;
+    s.normal       = vec3(0.0);
+    s.barycentrics = vec2(0.0);
+    s.pdf          = 1.0;
+
+    if (type == EMITTER_DIRECTIONAL)
+    {
+        s.direction = -emitter.p1;
+        s.distance  = uintBitsToFloat(0x7F800000);
+        s.radiance  = emitter.emission;
+        return s;
+    }
+
+    if (type == EMITTER_TRIANGLE)
+    {
+        // Uniformly distributed over the area:
+        const float su = sqrt(u.x);
+        s.barycentrics = vec2(u.y * su, 1.0 - su);
+
+        const vec3  position = emitter.p0 + s.barycentrics.x * (emitter.p1 - emitter.p0) + s.barycentrics.y * (emitter.p2 - emitter.p0);
+        const vec3  normal   = cross(emitter.p1 - emitter.p0, emitter.p2 - emitter.p0);
+        const float area     = 0.5 * length(normal);
+        const vec3  toLight  = position - p;
+
+        s.distance  = length(toLight);
+        s.direction = toLight / s.distance;
+        s.normal    = normal / (2.0 * area);
+
+        float cosLight = -dot(s.normal, s.direction);
+        cosLight       = (emitter.type & EMITTER_TWO_SIDED) != 0 ? abs(cosLight) : cosLight;
+        if (area <= 0.0 || cosLight <= 0.0 || s.distance <= 0.0)
+        {
+            s.pdf = 0.0;
+            return s;
+        }
+
+        s.radiance = emitter.emission;
+        s.pdf      = s.distance * s.distance / (cosLight * area);
+        return s;
+    }
+
+    // Point and spot lights, with the attenuation that KHR_lights_punctual recommends:
+    const vec3 toLight = emitter.p0 - p;
+    s.distance         = length(toLight);
+    s.direction        = toLight / s.distance;
+
+    float attenuation = 1.0 / max(s.distance * s.distance, 1e-8);
+    if (emitter.range > 0.0)
+    {
+        const float ratio = s.distance / emitter.range;
+        attenuation *= clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    }
+    if (type == EMITTER_SPOT)
+    {
+        const float cosAngle = dot(emitter.p1, -s.direction);
+        const float angular  = clamp((cosAngle - emitter.cosOuter) / max(emitter.cosInner - emitter.cosOuter, 1e-3), 0.0, 1.0);
+        attenuation *= angular * angular;
+    }
+
+    s.radiance = emitter.emission * attenuation;
+    return s;
+}
+
+// Picks an emitter for the point (with normal n, or vec3(0) in volumes) and samples it. The pdf of the sample includes the probability
+// of picking the emitter, it's 0 if no emitter was picked (or the sample is invalid).
+LightSample sampleLight(const LightTree tree, const vec3 p, const vec3 n, const float uEmitter, const vec2 u)
+{
+    float      pmf;
+    const uint emitter = sampleLightTree(tree, p, n, uEmitter, pmf);
+    if (emitter == ~0u)
+    {
+        LightSample s;
+        s.pdf = 0.0;
+        return s;
+    }
+
+    LightSample s = sampleEmitter(tree, emitter, p, u);
+    s.pdf *= pmf;
+    return s;
+}
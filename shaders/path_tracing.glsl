@@ -0,0 +1,258 @@
+// Path tracing on the scene table (see scene.glsl), shared by the kernels that ship with the integrators (wavefront/ and megakernel/).
+// Included after integrator.glsl, whose push constants it reads. Materials are shaded as Lambertian with their base color factor and
+// emit their emissive factor, as the textures are bound by the descriptor sets of the application. Direct light is sampled from the
+// light tree and combined with the emission that BSDF sampling hits by multiple importance sampling (power heuristic).
+
+#extension GL_EXT_ray_query : require
+
+const float PI = 3.14159265359;
+
+// Paths are continued with Russian roulette from this bounce on:
+const uint ROULETTE_BOUNCE = 3;
+
+// BSDF pdf of the paths whose previous vertex took its direct light from ReSTIR DI. Its samples cover all emitters of the light tree, so
+// hitting one of them adds nothing.
+const float RESTIR_BSDF_PDF = -1.0;
+
+// Different random numbers for every pixel and sample:
+uint pathSeed(const uint pixel, const uint sampleIndex)
+{
+    return restirHash(pixel ^ restirHash(sampleIndex ^ restirHash(constants.frameIndex)));
+}
+
+// PCG:
+float pathRandom(inout uint state)
+{
+    state           = state * 747796405u + 2891336453u;
+    const uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return float(((word >> 22u) ^ word) >> 8) * (1.0 / 16777216.0);
+}
+
+// Ray through the pixel (of the rendered region), at the offset within the pixel.
+void cameraRay(const SceneTable scene, const uint pixel, const vec2 offset, out vec3 origin, out vec3 direction)
+{
+    const vec2  ndc    = (vec2(imagePixel(pixel)) + offset) / vec2(constants.imageExtent) * 2.0 - 1.0;
+    const float aspect = float(constants.imageExtent.x) / float(constants.imageExtent.y);
+
+    origin    = scene.cameraToWorld[3].xyz;
+    direction = normalize(mat3(scene.cameraToWorld) * vec3(ndc.x * aspect * scene.tanHalfFovY, -ndc.y * scene.tanHalfFovY, -1.0));
+}
+
+// Moves the origin of a ray off the surface, to the side of the normal.
+vec3 offsetRay(const vec3 position, const vec3 normal)
+{
+    const float scale = max(max(abs(position.x), abs(position.y)), max(abs(position.z), 1.0));
+    return position + normal * (1e-4 * scale);
+}
+
+// Octahedral encoding of unit vectors, e.g. to keep the normal of the previous vertex in the state of a path:
+uint packNormal(const vec3 n)
+{
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    p      = n.z < 0.0 ? (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0) : p;
+    return packSnorm2x16(p);
+}
+
+vec3 unpackNormal(const uint packed)
+{
+    const vec2  p = unpackSnorm2x16(packed);
+    vec3        n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    const float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec3 sampleCosineHemisphere(const vec3 n, const vec2 u, out float pdf)
+{
+    // Orthonormal basis around the normal (Duff et al., "Building an Orthonormal Basis, Revisited"):
+    const float signZ = n.z >= 0.0 ? 1.0 : -1.0;
+    const float a     = -1.0 / (signZ + n.z);
+    const float b     = n.x * n.y * a;
+    const vec3  t     = vec3(1.0 + signZ * n.x * n.x * a, signZ * b, -signZ * n.x);
+    const vec3  s     = vec3(b, signZ + n.y * n.y * a, -n.y);
+
+    const float r        = sqrt(u.x);
+    const float phi      = 2.0 * PI * u.y;
+    const float cosTheta = sqrt(max(1.0 - u.x, 0.0));
+
+    pdf = cosTheta / PI;
+    return normalize(r * cos(phi) * t + r * sin(phi) * s + cosTheta * n);
+}
+
+float powerHeuristic(const float pdf, const float otherPdf)
+{
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+// Traces a ray through the TLAS of the scene and returns its hit (see integrator.glsl), or ~0u as the instance if it missed. Hits on the
+// proxies of meshes that aren't resident (see GeometryResidency) are reported through the feedback buffer and passed through.
+uvec4 traceClosest(const SceneTable scene, const vec3 origin, const float tMin, const vec3 direction, const float tMax)
+{
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, accelerationStructureEXT(scene.tlas), gl_RayFlagsNoneEXT, 0xFF, origin, tMin, direction, tMax);
+    while (rayQueryProceedEXT(query))
+    {
+        const uint instance = rayQueryGetIntersectionInstanceCustomIndexEXT(query, false);
+        if (rayQueryGetIntersectionTypeEXT(query, false) == gl_RayQueryCandidateIntersectionAABBEXT)
+        {
+            sceneFeedback(scene, instance);
+        }
+        else if (!sceneAlphaCutout(scene, instance, rayQueryGetIntersectionGeometryIndexEXT(query, false)))
+        {
+            rayQueryConfirmIntersectionEXT(query);
+        }
+    }
+
+    if (rayQueryGetIntersectionTypeEXT(query, true) == gl_RayQueryCommittedIntersectionNoneEXT)
+    {
+        return uvec4(~0u, 0, 0, 0);
+    }
+
+    const uint instance = rayQueryGetIntersectionInstanceCustomIndexEXT(query, true);
+    sceneFeedback(scene, instance);
+    return uvec4(instance, rayQueryGetIntersectionGeometryIndexEXT(query, true), rayQueryGetIntersectionPrimitiveIndexEXT(query, true),
+                 packUnorm2x16(rayQueryGetIntersectionBarycentricsEXT(query, true)));
+}
+
+// Whether anything is in the way of a shadow ray. Alpha tested geometry counts as opaque, and meshes that aren't resident don't occlude.
+bool occluded(const SceneTable scene, const vec3 origin, const float tMin, const vec3 direction, const float tMax)
+{
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, accelerationStructureEXT(scene.tlas), gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT, 0xFF,
+                          origin, tMin, direction, tMax);
+    while (rayQueryProceedEXT(query))
+    {
+    }
+    return rayQueryGetIntersectionTypeEXT(query, true) != gl_RayQueryCommittedIntersectionNoneEXT;
+}
+
+// Radiance that misses the scene contributes, none as the scene table has no environment.
+vec3 environment(const vec3 direction)
+{
+    return vec3(0.0);
+}
+
+// Radiance the hit surface emits towards the ray. Emissive triangles of the light tree emit what the tree samples them with, weighted
+// against next event estimation if the ray was sampled from a BSDF with the given pdf (0 for camera rays, which next event estimation
+// can't sample, or RESTIR_BSDF_PDF). previousPosition and previousNormal are those of the vertex the ray left from.
+vec3 hitEmission(const uvec4 hit, const SceneSurface surface, const SceneMaterial material, const vec3 previousPosition,
+                 const vec3 previousNormal, const float bsdfPdf)
+{
+    if (material.emissiveFactor == vec3(0.0))
+    {
+        return vec3(0.0);
+    }
+
+    const LightTree tree    = constants.lightTree;
+    const uint      emitter = uint64_t(tree) != 0 ? triangleEmitter(tree, hit.x, hit.y, hit.z) : ~0u;
+    if (emitter == ~0u)
+    {
+        return surface.frontFace || (material.flags & SCENE_MATERIAL_DOUBLE_SIDED) != 0 ? material.emissiveFactor : vec3(0.0);
+    }
+
+    const LightEmitter e = tree.emitters.emitters[emitter];
+    if (!surface.frontFace && (e.type & EMITTER_TWO_SIDED) == 0)
+    {
+        return vec3(0.0);
+    }
+    if (bsdfPdf == RESTIR_BSDF_PDF)
+    {
+        return vec3(0.0);
+    }
+    if (bsdfPdf <= 0.0)
+    {
+        return e.emission;
+    }
+
+    // Solid angle density of next event estimation picking the same point:
+    const vec3  toHit    = surface.position - previousPosition;
+    const float area     = 0.5 * length(cross(e.p1 - e.p0, e.p2 - e.p0));
+    const float cosLight = abs(dot(surface.geometricNormal, normalize(toHit)));
+    const float lightPdf = lightPmf(tree, previousPosition, previousNormal, emitter) * dot(toHit, toHit) / max(cosLight * area, 1e-12);
+    return e.emission * powerHeuristic(bsdfPdf, lightPdf);
+}
+
+// Shadow ray of next event estimation towards a light sample, with the contribution it makes to the path if it's unoccluded (weighted
+// against BSDF sampling for triangles if mis is set, lights are delta distributions that BSDF sampling can't hit). Returns false if the
+// sample can't contribute.
+bool lightRay(const SceneSurface surface, const vec3 albedo, const LightSample s, const bool mis, out vec3 origin, out vec3 direction,
+              out float tMax, out vec3 contribution)
+{
+    const float cosTheta = dot(surface.normal, s.direction);
+    if (s.pdf <= 0.0 || cosTheta <= 0.0 || dot(surface.geometricNormal, s.direction) <= 0.0)
+    {
+        return false;
+    }
+
+    const bool  triangle = (constants.lightTree.emitters.emitters[s.emitter].type & 0xFF) == EMITTER_TRIANGLE;
+    const float weight   = triangle && mis ? powerHeuristic(s.pdf, cosTheta / PI) : 1.0;
+
+    contribution = albedo / PI * s.radiance * cosTheta / s.pdf * weight;
+    origin       = offsetRay(surface.position, surface.geometricNormal);
+    direction    = s.direction;
+
+    // Stop short of emissive triangles, to not hit them:
+    tMax = isinf(s.distance) ? 1e30 : max(s.distance - 2.0 * distance(origin, surface.position), 0.0);
+    return contribution != vec3(0.0);
+}
+
+// Next event estimation from the light tree, see lightRay().
+bool sampleDirectLight(const SceneSurface surface, const vec3 albedo, inout uint rng, out vec3 origin, out vec3 direction, out float tMax,
+                       out vec3 contribution)
+{
+    if (uint64_t(constants.lightTree) == 0)
+    {
+        return false;
+    }
+
+    const float       uEmitter = pathRandom(rng);
+    const vec2        u        = vec2(pathRandom(rng), pathRandom(rng));
+    const LightSample s        = sampleLight(constants.lightTree, surface.position, surface.normal, uEmitter, u);
+    return lightRay(surface, albedo, s, true, origin, direction, tMax, contribution);
+}
+
+// Whether a sample takes its direct light at the primary hit from the reservoir of its pixel (see restirLightSample()). Only the first
+// sample of the frame does: the contribution weight of the reservoir is only valid at the surface of the pixel, which is the primary hit
+// of that sample alone, and reusing one light sample for all samples of the frame would only correlate them.
+bool useRestir(const uint sampleIndex, const uint bounce)
+{
+    return bounce == 0 && uint64_t(constants.restir) != 0 && sampleIndex == constants.restir.firstSample;
+}
+
+// The direct light of the pixel's reservoir, which the visibility pass of ReSTIR DI already found unoccluded, so that it needs no shadow
+// ray. It isn't weighted against BSDF sampling, paths continue with RESTIR_BSDF_PDF instead.
+vec3 restirDirectLight(const SceneSurface surface, const vec3 albedo, const uint pixel)
+{
+    const LightSample s = restirLightSample(constants.restir, constants.lightTree, pixel);
+
+    vec3  origin;
+    vec3  direction;
+    float tMax;
+    vec3  contribution;
+    return lightRay(surface, albedo, s, false, origin, direction, tMax, contribution) ? contribution : vec3(0.0);
+}
+
+// Samples the direction a path continues in from the surface and updates its throughput, with Russian roulette from ROULETTE_BOUNCE on.
+// Returns false if the path terminates.
+bool continuePath(const SceneSurface surface, const vec3 albedo, const uint bounce, inout uint rng, inout vec3 throughput, out vec3 direction,
+                  out float pdf)
+{
+    direction = sampleCosineHemisphere(surface.normal, vec2(pathRandom(rng), pathRandom(rng)), pdf);
+    if (pdf <= 0.0 || dot(direction, surface.geometricNormal) <= 0.0)
+    {
+        return false;
+    }
+
+    // The cosine and 1/pi of the BSDF cancel with the pdf:
+    throughput *= albedo;
+    if (bounce + 1 >= ROULETTE_BOUNCE)
+    {
+        const float survival = min(max(throughput.r, max(throughput.g, throughput.b)), 0.95);
+        if (pathRandom(rng) >= survival)
+        {
+            return false;
+        }
+        throughput /= survival;
+    }
+    return throughput != vec3(0.0);
+}
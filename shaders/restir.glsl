@@ -0,0 +1,139 @@
+// Shader side of RestirDI (see restir_di.hpp), whose layouts the declarations below mirror. The surface kernel writes the primary
+// surface of every pixel to surfaces. Afterwards, the first sample of the frame (firstSample) takes the direct light at its primary hit
+// from restirLightSample() instead of sampleLight().
+//
+// Light samples are stored as an emitter of the light tree and a point on it (uv, as passed to sampleEmitter()). Their target function
+// and contribution weights are in the measure of that sample space, i.e. uniform over uv on every triangle, so that the samples of
+// neighbouring pixels can be reused without a Jacobian.
+// The target function leaves out visibility, so that the reservoirs stay valid for reuse after the visibility pass, which only marks
+// whether the sample is unoccluded at the pixel.
+
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_scalar_block_layout : require
+
+struct Surface
+{
+    vec3  position;
+    float depth;  // Distance from the camera, 0 if the camera ray missed
+    vec3  normal; // Shading normal
+    vec3  albedo; // Estimate of the reflectance (e.g. the base color) for the target function
+    vec2  motion; // From the pixel to where the surface was in the previous frame, in pixels
+};
+
+struct Reservoir
+{
+    uint  emitter;     // ~0u if empty
+    vec2  uv;
+    float targetPdf;   // Of the sample at the reservoir's pixel
+    float weightSum;   // Of the resampling weights of all candidates
+    float sampleCount; // Number of candidates (M)
+    float weight;      // Unbiased contribution weight of the sample (W)
+    uint  visible;     // Whether the visibility pass found the sample unoccluded at the pixel
+};
+
+layout(buffer_reference, scalar) buffer Surfaces   { Surface values[];   };
+layout(buffer_reference, scalar) buffer Reservoirs { Reservoir values[]; };
+
+layout(buffer_reference, scalar) buffer Restir
+{
+    Surfaces   surfaces;           // Per pixel of the rendered region, of this frame
+    Surfaces   previousSurfaces;
+    Reservoirs candidates;         // Initial candidates, combined with the previous frame
+    Reservoirs reservoirs;         // After spatial reuse and visibility, of this frame
+    Reservoirs previousReservoirs;
+    uvec2      tlas;               // Device address of the TLAS for the visibility rays
+    uint       initialCandidates;
+    float      maxHistory;         // Relative to the candidates of the current frame
+    uint       spatialSamples;
+    float      spatialRadius;      // In pixels
+    float      depthThreshold;     // Relative difference of the depth of surfaces that may reuse each other's samples
+    float      normalThreshold;    // Smallest cosine between their normals
+    uint       temporal;           // Whether the previous frame may be reused
+    uint       firstSample;        // Sample index of the first sample of the frame, whose primary hits the surfaces are
+};
+
+Reservoir emptyReservoir()
+{
+    return Reservoir(~0u, vec2(0.0), 0.0, 0.0, 0.0, 0.0, 0);
+}
+
+// Target function of a light sample at a surface: the luminance of the reflected light it contributes (without visibility).
+float restirTargetPdf(const LightTree tree, const Surface surface, const uint emitter, const vec2 uv, out LightSample s)
+{
+    s = sampleEmitter(tree, emitter, surface.position, uv);
+    if (s.pdf <= 0.0)
+    {
+        return 0.0;
+    }
+
+    // Dividing by the density of sampleEmitter() converts from solid angle to the uv measure of the sample space:
+    return luminance(s.radiance * surface.albedo) * max(dot(surface.normal, s.direction), 0.0) / s.pdf;
+}
+
+// Streams a candidate into the reservoir, which it replaces with probability weight / weightSum.
+bool updateReservoir(inout Reservoir r, const uint emitter, const vec2 uv, const float targetPdf, const float weight, const float u)
+{
+    r.weightSum += weight;
+    if (weight > 0.0 && u * r.weightSum < weight)
+    {
+        r.emitter   = emitter;
+        r.uv        = uv;
+        r.targetPdf = targetPdf;
+        return true;
+    }
+    return false;
+}
+
+// Combines a reservoir whose sample has the given target function at the pixel of r (the sample counts of both are summed up by the
+// caller).
+void mergeReservoir(inout Reservoir r, const Reservoir other, const float targetPdf, const float sampleCount, const float u)
+{
+    updateReservoir(r, other.emitter, other.uv, targetPdf, targetPdf * other.weight * sampleCount, u);
+}
+
+// Sets the contribution weight from the sample count that normalizes it. For the candidates of a single distribution, that's all of
+// them. Combined reservoirs only count those that could have produced the selected sample, i.e. whose surface has a non-zero target
+// function for it (the 1/Z weights of Bitterli et al.), as counting the others would darken the result.
+void finalizeReservoir(inout Reservoir r, const float normalization)
+{
+    r.weight = r.targetPdf > 0.0 && normalization > 0.0 ? r.weightSum / (normalization * r.targetPdf) : 0.0;
+}
+
+// Whether two surfaces are similar enough to reuse each other's samples.
+bool similarSurfaces(const Restir restir, const Surface a, const Surface b)
+{
+    return a.depth > 0.0 && b.depth > 0.0 && abs(a.depth - b.depth) <= restir.depthThreshold * a.depth &&
+           dot(a.normal, b.normal) >= restir.normalThreshold;
+}
+
+// The light sample of the pixel's reservoir, with a pdf that makes it a drop-in replacement for the result of sampleLight() (i.e. its
+// contribution is the BSDF times radiance times cosine, divided by pdf). The visibility pass already found it unoccluded, so it needs no
+// shadow ray. The pdf is 0 if the pixel has no (unoccluded) sample.
+LightSample restirLightSample(const Restir restir, const LightTree tree, const uint pixel)
+{
+    const Reservoir r = restir.reservoirs.values[pixel];
+    if (r.emitter == ~0u || r.weight <= 0.0 || r.visible == 0)
+    {
+        LightSample s;
+        s.pdf = 0.0;
+        return s;
+    }
+
+    LightSample s = sampleEmitter(tree, r.emitter, restir.surfaces.values[pixel].position, r.uv);
+    s.pdf /= r.weight;
+    return s;
+}
+
+// Random numbers from a PCG hash:
+uint restirHash(const uint value)
+{
+    const uint state = value * 747796405u + 2891336453u;
+    const uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float restirRandom(inout uint state)
+{
+    state = restirHash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
@@ -0,0 +1,163 @@
+// Shader side of SceneTable (see scene_table.hpp), whose layouts the declarations below mirror. Kernels get the address of the table
+// from IntegratorConstants::scene and turn the hits of the integrators (instance custom index, geometry index, primitive index and
+// barycentrics) into surfaces with sceneSurface().
+
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+const uint SCENE_GEOMETRY_NORMALS    = 1u << 0;
+const uint SCENE_GEOMETRY_TEX_COORDS = 1u << 1;
+
+const uint SCENE_MATERIAL_DOUBLE_SIDED = 1u << 0;
+const uint SCENE_MATERIAL_ALPHA_MASK   = 1u << 1;
+const uint SCENE_MATERIAL_ALPHA_BLEND  = 1u << 2;
+
+struct SceneInstance
+{
+    mat4x3 objectToWorld;
+    uint   firstGeometry; // Of the mesh the instance uses, in the geometries of the table
+    uint   geometryCount;
+};
+
+layout(buffer_reference, scalar) buffer ScenePositions { vec3 values[]; };
+layout(buffer_reference, scalar) buffer SceneNormals   { vec3 values[]; };
+layout(buffer_reference, scalar) buffer SceneTexCoords { vec2 values[]; };
+layout(buffer_reference, scalar) buffer SceneIndices   { uint values[]; };
+
+struct SceneGeometry
+{
+    ScenePositions positions;
+    SceneNormals   normals;
+    SceneTexCoords texCoords;
+    SceneIndices   indices;
+    uint           triangleCount; // 0 while the mesh isn't resident
+    uint           materialIndex; // ~0u without a material
+    uint           attributes;    // SCENE_GEOMETRY_*
+    uint           padding;
+};
+
+struct SceneMaterial
+{
+    vec4  baseColorFactor;
+    vec3  emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    float alphaCutoff;
+    uint  flags; // SCENE_MATERIAL_*
+    uint  padding;
+};
+
+layout(buffer_reference, scalar) buffer SceneInstances  { SceneInstance values[]; };
+layout(buffer_reference, scalar) buffer SceneGeometries { SceneGeometry values[]; };
+layout(buffer_reference, scalar) buffer SceneMaterials  { SceneMaterial values[]; };
+layout(buffer_reference, scalar) buffer SceneFeedback   { uint values[];          };
+
+layout(buffer_reference, scalar) buffer SceneTable
+{
+    mat4            cameraToWorld;         // The camera looks along -Z, with +Y up
+    mat4            previousWorldToCamera; // Of the previous frame, for motion vectors
+    float           tanHalfFovY;           // Of the vertical field of view
+    float           previousTanHalfFovY;
+    uint            materialCount;
+    uint            padding;
+    uvec2           tlas;                  // Device address of the TLAS
+    SceneInstances  instances;             // Indexed by the custom index of the TLAS instances
+    SceneGeometries geometries;
+    SceneMaterials  materials;
+    SceneFeedback   feedback;              // Per instance, see GeometryResidency::feedbackBuffer(), 0 without
+};
+
+// A hit, reconstructed from the vertex data of its triangle.
+struct SceneSurface
+{
+    vec3 position;
+    vec3 normal;          // Shading normal, on the side of the geometric normal
+    vec3 geometricNormal; // Facing the ray
+    vec2 texCoord;
+    uint materialIndex;   // ~0u without a material
+    bool frontFace;       // Whether the ray hit the side that the winding of the triangle faces
+};
+
+// The material of a surface, the glTF defaults for geometry without one.
+SceneMaterial sceneMaterial(const SceneTable scene, const uint materialIndex)
+{
+    if (materialIndex >= scene.materialCount)
+    {
+        return SceneMaterial(vec4(1.0), vec3(0.0), 1.0, 1.0, 0.5, 0, 0);
+    }
+    return scene.materials.values[materialIndex];
+}
+
+// Reconstructs the surface of a hit (as stored in the hit queue, see integrator.glsl) seen along the ray direction. Returns false if the
+// mesh of the instance isn't resident.
+bool sceneSurface(const SceneTable scene, const uvec4 hit, const vec3 rayDirection, out SceneSurface surface)
+{
+    const SceneInstance instance = scene.instances.values[hit.x];
+    if (hit.y >= instance.geometryCount)
+    {
+        return false;
+    }
+
+    const SceneGeometry geometry = scene.geometries.values[instance.firstGeometry + hit.y];
+    if (hit.z >= geometry.triangleCount)
+    {
+        return false;
+    }
+
+    const uvec3 indices = uvec3(geometry.indices.values[3 * hit.z], geometry.indices.values[3 * hit.z + 1],
+                                geometry.indices.values[3 * hit.z + 2]);
+    const vec2  uv      = unpackUnorm2x16(hit.w);
+    const vec3  weights = vec3(1.0 - uv.x - uv.y, uv.x, uv.y);
+
+    // In world space, so that the winding (and with it the front face) is the same as that of the emitters of the light tree:
+    const vec3 p0 = instance.objectToWorld * vec4(geometry.positions.values[indices.x], 1.0);
+    const vec3 p1 = instance.objectToWorld * vec4(geometry.positions.values[indices.y], 1.0);
+    const vec3 p2 = instance.objectToWorld * vec4(geometry.positions.values[indices.z], 1.0);
+
+    surface.position        = weights.x * p0 + weights.y * p1 + weights.z * p2;
+    surface.geometricNormal = normalize(cross(p1 - p0, p2 - p0));
+    surface.frontFace       = dot(surface.geometricNormal, rayDirection) <= 0.0;
+    surface.geometricNormal = surface.frontFace ? surface.geometricNormal : -surface.geometricNormal;
+    surface.normal          = surface.geometricNormal;
+    surface.texCoord        = vec2(0.0);
+    surface.materialIndex   = geometry.materialIndex;
+
+    if ((geometry.attributes & SCENE_GEOMETRY_NORMALS) != 0)
+    {
+        const vec3 n = weights.x * geometry.normals.values[indices.x] + weights.y * geometry.normals.values[indices.y] +
+                       weights.z * geometry.normals.values[indices.z];
+        // Normals transform with the inverse transpose, which is only needed up to scale:
+        const vec3 normal = normalize(transpose(inverse(mat3(instance.objectToWorld))) * n);
+        surface.normal    = dot(normal, surface.geometricNormal) < 0.0 ? -normal : normal;
+    }
+    if ((geometry.attributes & SCENE_GEOMETRY_TEX_COORDS) != 0)
+    {
+        surface.texCoord = weights.x * geometry.texCoords.values[indices.x] + weights.y * geometry.texCoords.values[indices.y] +
+                           weights.z * geometry.texCoords.values[indices.z];
+    }
+    return true;
+}
+
+// Whether the hit triangle is cut out by the alpha cutoff of its material. Only the factor of the base color is tested, as the textures
+// are bound by the descriptor sets of the application.
+bool sceneAlphaCutout(const SceneTable scene, const uint instance, const uint geometry)
+{
+    const SceneInstance sceneInstance = scene.instances.values[instance];
+    if (geometry >= sceneInstance.geometryCount)
+    {
+        return false;
+    }
+
+    const SceneMaterial material = sceneMaterial(scene, scene.geometries.values[sceneInstance.firstGeometry + geometry].materialIndex);
+    return (material.flags & SCENE_MATERIAL_ALPHA_MASK) != 0 && material.baseColorFactor.a < material.alphaCutoff;
+}
+
+// Marks an instance as hit for GeometryResidency, which keeps its mesh resident (or streams it in if the hit was on its proxy).
+void sceneFeedback(const SceneTable scene, const uint instance)
+{
+    if (uint64_t(scene.feedback) != 0 && scene.feedback.values[instance] == 0)
+    {
+        scene.feedback.values[instance] = 1;
+    }
+}
@@ -0,0 +1,272 @@
+#include "acceleration_structure.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace polar
+{
+
+// Serialized acceleration structures have to be at this alignment in device memory:
+constexpr vk::DeviceSize SERIALIZED_ALIGNMENT = 256;
+
+static std::vector<vk::AccelerationStructureKHR>
+getHandles(const std::vector<AccelerationStructure>& accelerationStructures)
+{
+    std::vector<vk::AccelerationStructureKHR> handles;
+    handles.reserve(accelerationStructures.size());
+    for (const auto& accelerationStructure : accelerationStructures)
+    {
+        handles.emplace_back(*accelerationStructure.handle);
+    }
+    return handles;
+}
+
+// Returns the offsets of consecutive aligned ranges of the given sizes, followed by the total size.
+static std::vector<vk::DeviceSize>
+alignedOffsets(const std::vector<vk::DeviceSize>& sizes)
+{
+    std::vector<vk::DeviceSize> offsets;
+    offsets.reserve(sizes.size() + 1);
+
+    vk::DeviceSize offset = 0;
+    for (const auto size : sizes)
+    {
+        offsets.emplace_back(offset);
+        offset = alignUp(offset + size, SERIALIZED_ALIGNMENT);
+    }
+    offsets.emplace_back(offset);
+
+    return offsets;
+}
+
+static vk::UniqueCommandBuffer
+beginCommandBuffer(const Context& context, const vk::CommandPool& commandPool)
+{
+    auto commandBuffers = context.device().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+
+    commandBuffers.front()->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    return std::move(commandBuffers.front());
+}
+
+AccelerationStructure createAccelerationStructure(const Context& context, const GPUAllocator& allocator, const vk::AccelerationStructureTypeKHR type,
+                                                  const vk::DeviceSize size, const VmaMemoryUsage memoryUsage)
+{
+    AccelerationStructure accelerationStructure{
+        .buffer = allocator.allocate(size, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                     memoryUsage),
+        .size   = size,
+    };
+
+    accelerationStructure.handle = context.device().createAccelerationStructureKHRUnique(vk::AccelerationStructureCreateInfoKHR{
+        .buffer = *accelerationStructure.buffer,
+        .offset = 0,
+        .size   = size,
+        .type   = type,
+    });
+
+    accelerationStructure.address = context.device().getAccelerationStructureAddressKHR(vk::AccelerationStructureDeviceAddressInfoKHR{
+        .accelerationStructure = *accelerationStructure.handle,
+    });
+
+    return accelerationStructure;
+}
+
+std::vector<SerializedAccelerationStructure> serializeOnHost(const Context& context, const std::vector<AccelerationStructure>& accelerationStructures)
+{
+    const auto& device  = context.device();
+    const auto  handles = getHandles(accelerationStructures);
+
+    const auto sizes = device.writeAccelerationStructuresPropertiesKHR<vk::DeviceSize>(
+        handles, vk::QueryType::eAccelerationStructureSerializationSizeKHR, handles.size() * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize));
+
+    std::vector<SerializedAccelerationStructure> serialized;
+    serialized.reserve(handles.size());
+
+    for (std::size_t i = 0; i < handles.size(); ++i)
+    {
+        auto& entry = serialized.emplace_back(SerializedAccelerationStructure{
+            .size = accelerationStructures[i].size,
+            .data = std::vector<std::byte>(sizes[i]),
+        });
+
+        const auto result = device.copyAccelerationStructureToMemoryKHR(nullptr, vk::CopyAccelerationStructureToMemoryInfoKHR{
+                                                                                     .src  = handles[i],
+                                                                                     .dst  = {.hostAddress = entry.data.data()},
+                                                                                     .mode = vk::CopyAccelerationStructureModeKHR::eSerialize,
+                                                                                 });
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error(fmt::format("Failed to serialize acceleration structure on the host: {}", vk::to_string(result)));
+        }
+    }
+
+    return serialized;
+}
+
+std::vector<SerializedAccelerationStructure> serializeOnDevice(const Context& context, const GPUAllocator& allocator,
+                                                               const std::vector<AccelerationStructure>& accelerationStructures)
+{
+    if (accelerationStructures.empty())
+    {
+        return {};
+    }
+
+    const auto& device  = context.device();
+    const auto  handles = getHandles(accelerationStructures);
+    const auto  count   = static_cast<std::uint32_t>(handles.size());
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = context.queueFamilyIndex(),
+    });
+
+    // The serialized sizes are needed to size the readback buffer, so they are queried in a separate submission:
+    const auto queryPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+        .queryType  = vk::QueryType::eAccelerationStructureSerializationSizeKHR,
+        .queryCount = count,
+    });
+
+    {
+        const auto commandBuffer = beginCommandBuffer(context, *commandPool);
+        commandBuffer->resetQueryPool(*queryPool, 0, count);
+        commandBuffer->writeAccelerationStructuresPropertiesKHR(handles, vk::QueryType::eAccelerationStructureSerializationSizeKHR, *queryPool, 0);
+        submitAndWait(context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "acceleration structure serialization size query");
+    }
+
+    const auto sizes = device.getQueryPoolResults<vk::DeviceSize>(*queryPool, 0, count, count * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize),
+                                                                  vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (sizes.result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Failed to query acceleration structure serialization sizes: {}", vk::to_string(sizes.result)));
+    }
+
+    const auto offsets = alignedOffsets(sizes.value);
+
+    // The device writes straight into host memory (which is coherent, so there is no need to invalidate it). The base address has to
+    // be aligned as well, which the allocation doesn't guarantee.
+    const auto readbackBuffer =
+        allocator.allocate(offsets.back() + SERIALIZED_ALIGNMENT, vk::BufferUsageFlagBits::eShaderDeviceAddress, VMA_MEMORY_USAGE_CPU_ONLY);
+    const auto bufferAddress  = readbackBuffer.deviceAddress(context);
+    const auto readbackOffset = alignUp(bufferAddress, SERIALIZED_ALIGNMENT) - bufferAddress;
+
+    {
+        const auto commandBuffer = beginCommandBuffer(context, *commandPool);
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            commandBuffer->copyAccelerationStructureToMemoryKHR(vk::CopyAccelerationStructureToMemoryInfoKHR{
+                .src  = handles[i],
+                .dst  = {.deviceAddress = bufferAddress + readbackOffset + offsets[i]},
+                .mode = vk::CopyAccelerationStructureModeKHR::eSerialize,
+            });
+        }
+        submitAndWait(context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "acceleration structure serialization");
+    }
+
+    std::vector<SerializedAccelerationStructure> serialized;
+    serialized.reserve(count);
+
+    const auto readbackData = static_cast<const std::byte*>(readbackBuffer.map()) + readbackOffset;
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        serialized.emplace_back(SerializedAccelerationStructure{
+            .size = accelerationStructures[i].size,
+            .data = std::vector<std::byte>(readbackData + offsets[i], readbackData + offsets[i] + sizes.value[i]),
+        });
+    }
+    readbackBuffer.unmap();
+
+    return serialized;
+}
+
+std::vector<AccelerationStructure> deserialize(const Context& context, const GPUAllocator& allocator, const vk::AccelerationStructureTypeKHR type,
+                                               const std::vector<SerializedAccelerationStructure>& serialized)
+{
+    if (serialized.empty())
+    {
+        return {};
+    }
+
+    const auto& device = context.device();
+
+    std::vector<vk::DeviceSize> sizes;
+    sizes.reserve(serialized.size());
+    for (const auto& entry : serialized)
+    {
+        sizes.emplace_back(entry.data.size());
+    }
+
+    const auto offsets        = alignedOffsets(sizes);
+    const auto serializedSize = offsets.back();
+
+    // The base address of the buffer has to be aligned as well, which the allocation doesn't guarantee:
+    const auto serializedBuffer = allocator.allocate(serializedSize + SERIALIZED_ALIGNMENT,
+                                                     vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                                                     VMA_MEMORY_USAGE_GPU_ONLY);
+    const auto bufferAddress    = serializedBuffer.deviceAddress(context);
+    const auto serializedOffset = alignUp(bufferAddress, SERIALIZED_ALIGNMENT) - bufferAddress;
+
+    const auto stagingBuffer = allocator.allocate(serializedSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+    const auto stagingData   = static_cast<std::byte*>(stagingBuffer.map());
+    for (std::size_t i = 0; i < serialized.size(); ++i)
+    {
+        std::memcpy(stagingData + offsets[i], serialized[i].data.data(), serialized[i].data.size());
+    }
+    stagingBuffer.unmap();
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = context.queueFamilyIndex(),
+    });
+    const auto commandBuffer = beginCommandBuffer(context, *commandPool);
+
+    commandBuffer->copyBuffer(*stagingBuffer, *serializedBuffer, vk::BufferCopy{.srcOffset = 0, .dstOffset = serializedOffset, .size = serializedSize});
+
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR,
+    };
+    commandBuffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, {},
+                                   {});
+
+    std::vector<AccelerationStructure> accelerationStructures;
+    accelerationStructures.reserve(serialized.size());
+
+    for (std::size_t i = 0; i < serialized.size(); ++i)
+    {
+        auto& accelerationStructure = accelerationStructures.emplace_back(createAccelerationStructure(context, allocator, type, serialized[i].size));
+
+        commandBuffer->copyMemoryToAccelerationStructureKHR(vk::CopyMemoryToAccelerationStructureInfoKHR{
+            .src  = {.deviceAddress = bufferAddress + serializedOffset + offsets[i]},
+            .dst  = *accelerationStructure.handle,
+            .mode = vk::CopyAccelerationStructureModeKHR::eDeserialize,
+        });
+    }
+
+    submitAndWait(context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "acceleration structure deserialization");
+
+    return accelerationStructures;
+}
+
+bool isCompatible(const Context& context, const SerializedAccelerationStructure& serialized)
+{
+    // The version data consists of the driver UUID followed by the compatibility UUID:
+    if (serialized.data.size() < 2 * VK_UUID_SIZE)
+    {
+        return false;
+    }
+
+    const vk::AccelerationStructureVersionInfoKHR versionInfo{
+        .pVersionData = reinterpret_cast<const std::uint8_t*>(serialized.data.data()),
+    };
+
+    return context.device().getAccelerationStructureCompatibilityKHR(versionInfo) == vk::AccelerationStructureCompatibilityKHR::eCompatible;
+}
+
+} // namespace polar
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+
+namespace polar
+{
+
+struct AccelerationStructure
+{
+    GPUBufferUnique                    buffer;
+    vk::UniqueAccelerationStructureKHR handle;
+    vk::DeviceAddress                  address = 0;
+    vk::DeviceSize                     size    = 0;
+
+    operator bool() const { return static_cast<bool>(handle); }
+};
+
+// An acceleration structure in the format of vkCopyAccelerationStructureToMemoryKHR. The data starts with the driver and compatibility
+// UUIDs, so it can only be deserialized on devices for which isCompatible() holds.
+struct SerializedAccelerationStructure
+{
+    vk::DeviceSize         size = 0; // Size of the deserialized acceleration structure
+    std::vector<std::byte> data;
+};
+
+// Allocates memory for an acceleration structure of the given size and creates it. Acceleration structures that are built or copied by
+// host commands need host visible memory.
+AccelerationStructure createAccelerationStructure(const Context& context, const GPUAllocator& allocator, vk::AccelerationStructureTypeKHR type,
+                                                  vk::DeviceSize size, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY);
+
+// Serializes acceleration structures that live in host memory with host commands.
+std::vector<SerializedAccelerationStructure> serializeOnHost(const Context& context, const std::vector<AccelerationStructure>& accelerationStructures);
+
+// Serializes device local acceleration structures and reads them back.
+std::vector<SerializedAccelerationStructure> serializeOnDevice(const Context& context, const GPUAllocator& allocator,
+                                                               const std::vector<AccelerationStructure>& accelerationStructures);
+
+// Uploads serialized acceleration structures and deserializes them into device local ones.
+std::vector<AccelerationStructure> deserialize(const Context& context, const GPUAllocator& allocator, vk::AccelerationStructureTypeKHR type,
+                                               const std::vector<SerializedAccelerationStructure>& serialized);
+
+bool isCompatible(const Context& context, const SerializedAccelerationStructure& serialized);
+
+// Rounds size up to the next multiple of alignment (which has to be a power of two).
+constexpr vk::DeviceSize alignUp(const vk::DeviceSize size, const vk::DeviceSize alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace polar
@@ -0,0 +1,304 @@
+#include "alpha_classifier.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <block_compression.hpp>
+#include <mesh_splitter.hpp>
+#include <util.hpp>
+
+namespace polar
+{
+
+// The footprint is looked up on the most detailed level on which it covers at most this many texels along either axis:
+constexpr std::int64_t MAX_FOOTPRINT_TEXELS = 4;
+
+struct TexelRange
+{
+    std::int64_t begin = 0; // Inclusive
+    std::int64_t end   = 0; // Inclusive
+};
+
+// Returns the texels a bilinear lookup within [min, max] can touch with the given addressing. Falls back to the whole axis if the
+// texels don't form a single range after wrapping.
+static TexelRange
+footprint(const float min, const float max, const std::uint32_t size, const vk::SamplerAddressMode addressMode)
+{
+    const auto begin = static_cast<std::int64_t>(std::floor(min * size - 0.5f));
+    const auto end   = static_cast<std::int64_t>(std::floor(max * size - 0.5f)) + 1;
+    const auto last  = static_cast<std::int64_t>(size) - 1;
+
+    if (addressMode == vk::SamplerAddressMode::eClampToEdge)
+    {
+        return {std::clamp<std::int64_t>(begin, 0, last), std::clamp<std::int64_t>(end, 0, last)};
+    }
+
+    if (end - begin + 1 >= size)
+    {
+        return {0, last};
+    }
+
+    if (addressMode == vk::SamplerAddressMode::eMirroredRepeat)
+    {
+        // Every other repetition is mirrored. As the range is shorter than the texture, it crosses at most one of the edges, where
+        // it folds back onto itself:
+        const auto mirror = [&](const std::int64_t texel) {
+            const auto wrapped = ((texel % (2 * size)) + 2 * size) % (2 * size);
+            return wrapped < size ? wrapped : 2 * size - 1 - wrapped;
+        };
+        const auto repetition = [&](const std::int64_t texel) { return texel >= 0 ? texel / size : (texel + 1) / std::int64_t(size) - 1; };
+
+        const auto mirroredBegin = mirror(begin);
+        const auto mirroredEnd   = mirror(end);
+        if (repetition(begin) == repetition(end))
+        {
+            return {std::min(mirroredBegin, mirroredEnd), std::max(mirroredBegin, mirroredEnd)};
+        }
+
+        // Folds at the last texel when leaving a repetition that isn't mirrored, at the first one otherwise:
+        if (repetition(begin) % 2 == 0)
+        {
+            return {std::min(mirroredBegin, mirroredEnd), last};
+        }
+        return {0, std::max(mirroredBegin, mirroredEnd)};
+    }
+
+    const auto wrappedBegin = ((begin % size) + size) % size;
+    const auto wrappedEnd   = ((end % size) + size) % size;
+    if (wrappedBegin > wrappedEnd)
+    {
+        return {0, last};
+    }
+
+    return {wrappedBegin, wrappedEnd};
+}
+
+AlphaClassifier::AlphaPyramid AlphaClassifier::buildPyramid(const Texture& texture)
+{
+    const auto& source = texture.levels.front();
+
+    AlphaLevel level{
+        .width  = source.width,
+        .height = source.height,
+        .ranges = std::vector<AlphaRange>(static_cast<std::size_t>(source.width) * source.height),
+    };
+
+    switch (texture.format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+        for (std::size_t i = 0; i < level.ranges.size(); ++i)
+        {
+            const auto alpha = std::to_integer<std::uint8_t>(source.data[i * 4 + 3]);
+            level.ranges[i]  = {alpha, alpha};
+        }
+        break;
+    case vk::Format::eR16G16B16A16Unorm:
+        for (std::size_t i = 0; i < level.ranges.size(); ++i)
+        {
+            // Round outwards, so that the ranges stay conservative:
+            std::uint16_t alpha;
+            std::memcpy(&alpha, source.data.data() + (i * 4 + 3) * sizeof(alpha), sizeof(alpha));
+            level.ranges[i] = {static_cast<std::uint8_t>(alpha / 257), static_cast<std::uint8_t>((alpha + 256) / 257)};
+        }
+        break;
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        parallelFor((source.height + 3) / 4, [&](const std::size_t blockY) {
+            const auto blocksX = (source.width + 3) / 4;
+            for (std::uint32_t blockX = 0; blockX < blocksX; ++blockX)
+            {
+                // Blocks in modes we don't decode could have any alpha:
+                std::array<std::uint8_t, 16> alpha;
+                const auto                   decoded = decodeBc7Alpha(source.data.data() + (blockY * blocksX + blockX) * BC7_BLOCK_SIZE, alpha);
+
+                for (std::uint32_t y = 0; y < 4 && blockY * 4 + y < source.height; ++y)
+                {
+                    for (std::uint32_t x = 0; x < 4 && blockX * 4 + x < source.width; ++x)
+                    {
+                        auto& range = level.ranges[(blockY * 4 + y) * source.width + blockX * 4 + x];
+                        range       = decoded ? AlphaRange{alpha[y * 4 + x], alpha[y * 4 + x]} : AlphaRange{0, 255};
+                    }
+                }
+            }
+        });
+        break;
+    case vk::Format::eBc6HUfloatBlock:
+        // Has no alpha channel, so it samples as 1:
+        std::ranges::fill(level.ranges, AlphaRange{255, 255});
+        break;
+    default:
+        throw std::runtime_error(fmt::format("Can't classify alpha of texture {} with format {}", texture.name, vk::to_string(texture.format)));
+    }
+
+    AlphaPyramid pyramid{
+        .addressModeU = texture.addressModeU,
+        .addressModeV = texture.addressModeV,
+    };
+    pyramid.levels.emplace_back(std::move(level));
+
+    // Rounding the sizes up makes every texel of a level covered by a texel of the next one:
+    while (pyramid.levels.back().width > 1 || pyramid.levels.back().height > 1)
+    {
+        const auto& fine = pyramid.levels.back();
+
+        AlphaLevel coarse{
+            .width  = (fine.width + 1) / 2,
+            .height = (fine.height + 1) / 2,
+        };
+        coarse.ranges.resize(static_cast<std::size_t>(coarse.width) * coarse.height);
+
+        parallelFor(coarse.height, [&](const std::size_t y) {
+            for (std::uint32_t x = 0; x < coarse.width; ++x)
+            {
+                auto& range = coarse.ranges[y * coarse.width + x];
+                for (std::uint32_t fineY = y * 2; fineY < std::min<std::uint32_t>(y * 2 + 2, fine.height); ++fineY)
+                {
+                    for (std::uint32_t fineX = x * 2; fineX < std::min(x * 2 + 2, fine.width); ++fineX)
+                    {
+                        const auto& fineRange = fine.ranges[fineY * fine.width + fineX];
+                        range.min             = std::min(range.min, fineRange.min);
+                        range.max             = std::max(range.max, fineRange.max);
+                    }
+                }
+            }
+        });
+
+        pyramid.levels.emplace_back(std::move(coarse));
+    }
+
+    return pyramid;
+}
+
+AlphaClassifier::AlphaClassifier(const std::vector<Material>& materials, const std::vector<Texture>& textures) : m_materials(materials)
+{
+    for (const auto& material : materials)
+    {
+        const auto textureIndex = material.baseColorTexture;
+        if (material.alphaMode != AlphaMode::eMask || textureIndex == INVALID_INDEX || m_pyramids.contains(textureIndex) ||
+            textures[textureIndex].levels.empty())
+        {
+            continue;
+        }
+
+        m_pyramids.emplace(textureIndex, buildPyramid(textures[textureIndex]));
+    }
+}
+
+AlphaClassifier::Coverage AlphaClassifier::classifyTriangle(const AlphaPyramid& pyramid, const Material& material, const glm::vec2& uv0,
+                                                            const glm::vec2& uv1, const glm::vec2& uv2) const
+{
+    const auto uvMin = glm::min(uv0, glm::min(uv1, uv2));
+    const auto uvMax = glm::max(uv0, glm::max(uv1, uv2));
+    if (!std::isfinite(uvMin.x) || !std::isfinite(uvMin.y) || !std::isfinite(uvMax.x) || !std::isfinite(uvMax.y))
+    {
+        return Coverage::eMixed;
+    }
+
+    auto rangeX = footprint(uvMin.x, uvMax.x, pyramid.levels.front().width, pyramid.addressModeU);
+    auto rangeY = footprint(uvMin.y, uvMax.y, pyramid.levels.front().height, pyramid.addressModeV);
+
+    std::size_t levelIndex = 0;
+    while (levelIndex + 1 < pyramid.levels.size() &&
+           std::max(rangeX.end - rangeX.begin, rangeY.end - rangeY.begin) + 1 > MAX_FOOTPRINT_TEXELS)
+    {
+        rangeX = {rangeX.begin / 2, rangeX.end / 2};
+        rangeY = {rangeY.begin / 2, rangeY.end / 2};
+        ++levelIndex;
+    }
+
+    const auto& level = pyramid.levels[levelIndex];
+
+    AlphaRange alpha;
+    for (auto y = rangeY.begin; y <= rangeY.end; ++y)
+    {
+        for (auto x = rangeX.begin; x <= rangeX.end; ++x)
+        {
+            const auto& range = level.ranges[y * level.width + x];
+            alpha.min         = std::min(alpha.min, range.min);
+            alpha.max         = std::max(alpha.max, range.max);
+        }
+    }
+
+    // The alpha test discards everything below the cutoff:
+    const auto factor = material.baseColorFactor.a / 255.f;
+    if (alpha.min * factor >= material.alphaCutoff)
+    {
+        return Coverage::eOpaque;
+    }
+    if (alpha.max * factor < material.alphaCutoff)
+    {
+        return Coverage::eTransparent;
+    }
+    return Coverage::eMixed;
+}
+
+std::vector<Geometry> AlphaClassifier::classify(Geometry geometry, Stats& stats) const
+{
+    std::vector<Geometry> parts;
+
+    if (geometry.materialIndex == INVALID_INDEX || m_materials[geometry.materialIndex].alphaMode != AlphaMode::eMask)
+    {
+        parts.emplace_back(std::move(geometry));
+        return parts;
+    }
+
+    const auto& material = m_materials[geometry.materialIndex];
+    const auto  pyramid  = m_pyramids.find(material.baseColorTexture);
+
+    std::vector<std::uint32_t> opaqueTriangles, mixedTriangles;
+    for (std::uint32_t triangle = 0; triangle < geometry.triangleCount(); ++triangle)
+    {
+        // Without a texture the alpha is constant, which is the same as a footprint on a single white texel:
+        auto coverage = Coverage::eMixed;
+        if (pyramid == m_pyramids.end())
+        {
+            coverage = material.baseColorFactor.a >= material.alphaCutoff ? Coverage::eOpaque : Coverage::eTransparent;
+        }
+        else
+        {
+            const auto uv = [&](const std::uint32_t corner) {
+                return geometry.texCoords.empty() ? glm::vec2(0.f) : geometry.texCoords[geometry.indices[triangle * 3 + corner]];
+            };
+            coverage = classifyTriangle(pyramid->second, material, uv(0), uv(1), uv(2));
+        }
+
+        switch (coverage)
+        {
+        case Coverage::eOpaque:
+            opaqueTriangles.emplace_back(triangle);
+            break;
+        case Coverage::eTransparent:
+            ++stats.transparentTriangles;
+            break;
+        case Coverage::eMixed:
+            mixedTriangles.emplace_back(triangle);
+            break;
+        }
+    }
+
+    stats.opaqueTriangles += opaqueTriangles.size();
+    stats.mixedTriangles  += mixedTriangles.size();
+
+    std::vector<std::uint32_t> remap(geometry.vertexCount(), INVALID_INDEX);
+
+    geometry.opaque = true;
+    if (!opaqueTriangles.empty())
+    {
+        parts.emplace_back(extractTriangles(geometry, opaqueTriangles, remap));
+    }
+
+    geometry.opaque = false;
+    if (!mixedTriangles.empty())
+    {
+        parts.emplace_back(extractTriangles(geometry, mixedTriangles, remap));
+    }
+
+    return parts;
+}
+
+} // namespace polar
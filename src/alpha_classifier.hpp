@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Splits alpha tested geometry by what the alpha test does to each triangle. Triangles whose footprint in the base color texture is
+// entirely at or above the alpha cutoff are fully opaque and don't need any-hit shaders, while those that are entirely below it can never
+// be hit and are dropped. Only the remaining (mixed) triangles are left to the alpha test.
+// The footprint is the bounding box of the triangle's texture coordinates, grown by a texel for bilinear filtering and wrapped by the
+// address modes of the texture, so the classification is conservative as long as the alpha test samples the most detailed level. The
+// texels are taken as they are rendered, i.e. decoded from BC7 for compressed textures. To keep the cost per triangle constant, the
+// footprint is looked up in a pyramid of the minimum and maximum alpha values.
+class AlphaClassifier
+{
+  public:
+    struct Stats
+    {
+        std::size_t opaqueTriangles      = 0;
+        std::size_t transparentTriangles = 0;
+        std::size_t mixedTriangles       = 0;
+    };
+
+    // Builds the pyramids of the base color textures of all alpha tested materials. The textures have to be uncompressed, or compressed
+    // by TextureCompressor.
+    AlphaClassifier(const std::vector<Material>& materials, const std::vector<Texture>& textures);
+
+    // Returns the opaque triangles of the geometry (if any) followed by the mixed ones (if any). Geometry that doesn't use an alpha tested
+    // material is returned as is.
+    std::vector<Geometry> classify(Geometry geometry, Stats& stats) const;
+
+  private:
+    struct AlphaRange
+    {
+        std::uint8_t min = 255;
+        std::uint8_t max = 0;
+    };
+
+    struct AlphaLevel
+    {
+        std::uint32_t           width  = 0;
+        std::uint32_t           height = 0;
+        std::vector<AlphaRange> ranges;
+    };
+
+    struct AlphaPyramid
+    {
+        vk::SamplerAddressMode  addressModeU = vk::SamplerAddressMode::eRepeat;
+        vk::SamplerAddressMode  addressModeV = vk::SamplerAddressMode::eRepeat;
+        std::vector<AlphaLevel> levels;
+    };
+
+    enum class Coverage
+    {
+        eOpaque,
+        eTransparent,
+        eMixed,
+    };
+
+    static AlphaPyramid buildPyramid(const Texture& texture);
+
+    Coverage classifyTriangle(const AlphaPyramid& pyramid, const Material& material, const glm::vec2& uv0, const glm::vec2& uv1,
+                              const glm::vec2& uv2) const;
+
+    std::vector<Material>                           m_materials;
+    std::unordered_map<std::uint32_t, AlphaPyramid> m_pyramids; // Indexed by texture
+};
+
+} // namespace polar
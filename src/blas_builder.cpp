@@ -0,0 +1,787 @@
+#include "blas_builder.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <thread>
+
+#include <util.hpp>
+
+namespace polar
+{
+
+constexpr std::uint32_t CACHE_MAGIC = 0x53414250; // "PBAS"
+
+// Has to be bumped whenever the geometry that is built changes in a way that isn't covered by the content hash of the mesh:
+constexpr std::uint32_t CACHE_VERSION = 2;
+
+// The payload of a cache entry (see readCacheEntry()): this header, followed by the serialized data.
+struct CacheHeader
+{
+    std::uint64_t size = 0;
+};
+
+static void
+joinDeferredOperation(const vk::Device& device, const vk::DeferredOperationKHR& operation, const std::uint32_t threadCount)
+{
+    const auto concurrency = std::max(1u, std::min(threadCount, device.getDeferredOperationMaxConcurrencyKHR(operation)));
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(concurrency);
+        for (std::uint32_t i = 0; i < concurrency; ++i)
+        {
+            threads.emplace_back([&]() {
+                // Idle means that there currently is no work for this thread, but there might be later on:
+                while (device.deferredOperationJoinKHR(operation) == vk::Result::eThreadIdleKHR)
+                {
+                    std::this_thread::yield();
+                }
+            });
+        }
+    }
+
+    const auto result = device.getDeferredOperationResultKHR(operation);
+    if (result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Deferred host operation failed: {}", vk::to_string(result)));
+    }
+}
+
+BlasBuilder::BlasBuilder(const Context& context, const GPUAllocator& allocator, BlasPolicy& policy, const Param& param)
+    : m_context(context), m_allocator(allocator), m_policy(policy), m_param(param), m_buildFlags(param.buildFlags)
+{
+    if (m_param.compact)
+    {
+        m_buildFlags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
+    }
+
+    if (!m_param.cacheDirectory.empty())
+    {
+        std::filesystem::create_directories(m_param.cacheDirectory);
+    }
+}
+
+void BlasBuilder::addTriangles(BuildInput& input, const vk::DeviceOrHostAddressConstKHR vertices, const std::uint32_t vertexCount,
+                               const vk::DeviceOrHostAddressConstKHR indices, const std::uint32_t triangleCount, const bool opaque)
+{
+    // Non-opaque geometry invokes the any-hit shader (for the alpha test), so only the triangles that actually need it should be:
+    input.geometries.emplace_back(vk::AccelerationStructureGeometryKHR{
+        .geometryType = vk::GeometryTypeKHR::eTriangles,
+        .geometry     = {.triangles =
+                         vk::AccelerationStructureGeometryTrianglesDataKHR{
+                             .vertexFormat = vk::Format::eR32G32B32Sfloat,
+                             .vertexData   = vertices,
+                             .vertexStride = sizeof(glm::vec3),
+                             .maxVertex    = vertexCount - 1,
+                             .indexType    = vk::IndexType::eUint32,
+                             .indexData    = indices,
+                         }},
+        .flags        = opaque ? vk::GeometryFlagsKHR(vk::GeometryFlagBitsKHR::eOpaque) : vk::GeometryFlagsKHR(),
+    });
+
+    input.ranges.emplace_back(vk::AccelerationStructureBuildRangeInfoKHR{
+        .primitiveCount  = triangleCount,
+        .primitiveOffset = 0,
+        .firstVertex     = 0,
+        .transformOffset = 0,
+    });
+}
+
+void BlasBuilder::initBuildInput(BuildInput& input, const BuildHints& hints, const vk::AccelerationStructureBuildTypeKHR buildType) const
+{
+    std::vector<std::uint32_t> primitiveCounts;
+    primitiveCounts.reserve(input.ranges.size());
+    for (const auto& range : input.ranges)
+    {
+        primitiveCounts.emplace_back(range.primitiveCount);
+        input.triangleCount += range.primitiveCount;
+    }
+
+    input.preference = m_policy.select(hints, input.triangleCount);
+    input.flags      = m_buildFlags | BlasPolicy::buildFlags(input.preference);
+
+    const vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+        .type          = vk::AccelerationStructureTypeKHR::eBottomLevel,
+        .flags         = input.flags,
+        .mode          = vk::BuildAccelerationStructureModeKHR::eBuild,
+        .geometryCount = static_cast<std::uint32_t>(input.geometries.size()),
+        .pGeometries   = input.geometries.data(),
+    };
+
+    input.sizes = m_context.device().getAccelerationStructureBuildSizesKHR(buildType, buildInfo, primitiveCounts);
+}
+
+BlasBuilder::BuildInput BlasBuilder::createBuildInput(const GPUMesh& mesh) const
+{
+    BuildInput input;
+    input.geometries.reserve(mesh.geometries.size());
+    input.ranges.reserve(mesh.geometries.size());
+
+    for (const auto& geometry : mesh.geometries)
+    {
+        addTriangles(input, {.deviceAddress = geometry.positions}, geometry.vertexCount, {.deviceAddress = geometry.indices}, geometry.triangleCount,
+                     geometry.opaque);
+    }
+
+    initBuildInput(input, mesh.buildHints, vk::AccelerationStructureBuildTypeKHR::eDevice);
+
+    return input;
+}
+
+BlasBuilder::BuildInput BlasBuilder::createBuildInput(const Mesh& mesh) const
+{
+    BuildInput input;
+    input.geometries.reserve(mesh.geometries.size());
+    input.ranges.reserve(mesh.geometries.size());
+
+    for (const auto& geometry : mesh.geometries)
+    {
+        addTriangles(input, {.hostAddress = geometry.positions.data()}, geometry.vertexCount(), {.hostAddress = geometry.indices.data()},
+                     geometry.triangleCount(), geometry.opaque);
+    }
+
+    initBuildInput(input, mesh.buildHints, vk::AccelerationStructureBuildTypeKHR::eHost);
+
+    return input;
+}
+
+std::vector<BlasBuilder::Batch> BlasBuilder::createBatches(const std::vector<BuildInput>& inputs, const vk::DeviceSize scratchSize) const
+{
+    const vk::DeviceSize scratchAlignment = m_context.accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    // Sorting by scratch size puts meshes of similar size next to each other, so that a batch doesn't end up with a single large mesh
+    // next to a lot of unused scratch memory. Batches don't mix preferences, so that their build times can be told apart:
+    std::vector<std::uint32_t> order(inputs.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::ranges::stable_sort(order, std::greater{}, [&](const std::uint32_t index) { return inputs[index].sizes.buildScratchSize; });
+    std::ranges::stable_sort(order, {}, [&](const std::uint32_t index) { return inputs[index].preference; });
+
+    std::vector<Batch> batches;
+    for (const auto index : order)
+    {
+        const auto size = alignUp(inputs[index].sizes.buildScratchSize, scratchAlignment);
+        if (batches.empty() || batches.back().scratchSize + size > scratchSize || batches.back().preference != inputs[index].preference)
+        {
+            batches.emplace_back(Batch{.preference = inputs[index].preference});
+        }
+
+        auto& batch = batches.back();
+        batch.meshIndices.emplace_back(index);
+        batch.scratchOffsets.emplace_back(batch.scratchSize);
+        batch.scratchSize += size;
+    }
+
+    return batches;
+}
+
+vk::UniqueCommandBuffer BlasBuilder::beginCommandBuffer(const vk::CommandPool& commandPool) const
+{
+    auto commandBuffers = m_context.device().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+
+    commandBuffers.front()->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    return std::move(commandBuffers.front());
+}
+
+BlasBuilder::Submission BlasBuilder::submit(vk::UniqueCommandBuffer commandBuffer) const
+{
+    commandBuffer->end();
+
+    Submission submission{
+        .commandBuffer = std::move(commandBuffer),
+        .fence         = m_context.device().createFenceUnique(vk::FenceCreateInfo()),
+    };
+
+    m_context.queue().submit(vk::SubmitInfo().setCommandBuffers(*submission.commandBuffer), *submission.fence);
+
+    return submission;
+}
+
+void BlasBuilder::wait(const Submission& submission) const
+{
+    if (m_context.device().waitForFences(*submission.fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT) == vk::Result::eTimeout)
+    {
+        throw std::runtime_error("Fence timed out waiting on command submission for BLAS build");
+    }
+}
+
+void BlasBuilder::recordBuild(const vk::CommandBuffer& commandBuffer, const Batch& batch, const std::vector<BuildInput>& inputs,
+                              const std::vector<AccelerationStructure>& accelerationStructures, const vk::DeviceAddress scratchAddress,
+                              const vk::QueryPool& queryPool, const vk::QueryPool& timestampPool, const std::uint32_t firstTimestamp) const
+{
+    // The previous batch (which was submitted before this one) uses the same scratch memory:
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+        .dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                                  {}, barrier, {}, {});
+
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRanges;
+    std::vector<vk::AccelerationStructureKHR>                      handles;
+    buildInfos.reserve(batch.meshIndices.size());
+    buildRanges.reserve(batch.meshIndices.size());
+    handles.reserve(batch.meshIndices.size());
+
+    for (std::size_t i = 0; i < batch.meshIndices.size(); ++i)
+    {
+        const auto& input  = inputs[batch.meshIndices[i]];
+        const auto  handle = *accelerationStructures[batch.meshIndices[i]].handle;
+
+        buildInfos.emplace_back(vk::AccelerationStructureBuildGeometryInfoKHR{
+            .type                     = vk::AccelerationStructureTypeKHR::eBottomLevel,
+            .flags                    = input.flags,
+            .mode                     = vk::BuildAccelerationStructureModeKHR::eBuild,
+            .dstAccelerationStructure = handle,
+            .geometryCount            = static_cast<std::uint32_t>(input.geometries.size()),
+            .pGeometries              = input.geometries.data(),
+            .scratchData              = {.deviceAddress = scratchAddress + batch.scratchOffsets[i]},
+        });
+        buildRanges.emplace_back(input.ranges.data());
+        handles.emplace_back(handle);
+    }
+
+    // Both timestamps wait for the preceding builds, so they enclose exactly the builds of this batch:
+    commandBuffer.resetQueryPool(timestampPool, firstTimestamp, 2);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, timestampPool, firstTimestamp);
+    commandBuffer.buildAccelerationStructuresKHR(buildInfos, buildRanges);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, timestampPool, firstTimestamp + 1);
+
+    if (m_param.compact)
+    {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                                      vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, {}, {});
+        commandBuffer.resetQueryPool(queryPool, 0, static_cast<std::uint32_t>(handles.size()));
+        commandBuffer.writeAccelerationStructuresPropertiesKHR(handles, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool, 0);
+    }
+}
+
+BlasBuilder::Submission BlasBuilder::compact(const vk::CommandPool& commandPool, const Batch& batch,
+                                             std::vector<AccelerationStructure>& accelerationStructures, const vk::QueryPool& queryPool) const
+{
+    const auto count = static_cast<std::uint32_t>(batch.meshIndices.size());
+    const auto sizes = m_context.device().getQueryPoolResults<vk::DeviceSize>(queryPool, 0, count, count * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize),
+                                                                              vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (sizes.result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Failed to query compacted BLAS sizes: {}", vk::to_string(sizes.result)));
+    }
+
+    auto commandBuffer = beginCommandBuffer(commandPool);
+
+    std::vector<AccelerationStructure> retired;
+    retired.reserve(count);
+
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        auto& accelerationStructure = accelerationStructures[batch.meshIndices[i]];
+        auto  compacted = createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, sizes.value[i]);
+
+        commandBuffer->copyAccelerationStructureKHR(vk::CopyAccelerationStructureInfoKHR{
+            .src  = *accelerationStructure.handle,
+            .dst  = *compacted.handle,
+            .mode = vk::CopyAccelerationStructureModeKHR::eCompact,
+        });
+
+        retired.emplace_back(std::move(accelerationStructure));
+        accelerationStructure = std::move(compacted);
+    }
+
+    auto submission    = submit(std::move(commandBuffer));
+    submission.retired = std::move(retired);
+
+    return submission;
+}
+
+std::vector<AccelerationStructure> BlasBuilder::buildOnDevice(const std::vector<const GPUMesh*>& meshes) const
+{
+    if (meshes.empty())
+    {
+        return {};
+    }
+
+    const auto& device = m_context.device();
+
+    std::vector<BuildInput>            inputs;
+    std::vector<AccelerationStructure> accelerationStructures;
+    inputs.reserve(meshes.size());
+    accelerationStructures.reserve(meshes.size());
+
+    const vk::DeviceSize scratchAlignment = m_context.accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    vk::DeviceSize buildSize = 0, totalScratchSize = 0, largestScratchSize = 0;
+    for (const auto* mesh : meshes)
+    {
+        auto& input = inputs.emplace_back(createBuildInput(*mesh));
+        accelerationStructures.emplace_back(
+            createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, input.sizes.accelerationStructureSize));
+
+        const auto scratchSize = alignUp(input.sizes.buildScratchSize, scratchAlignment);
+        buildSize          += input.sizes.accelerationStructureSize;
+        totalScratchSize   += scratchSize;
+        largestScratchSize  = std::max(largestScratchSize, scratchSize);
+    }
+
+    // No need to allocate the whole budget if everything fits into less:
+    const auto scratchSize = std::max(largestScratchSize, std::min(m_param.scratchBudget, totalScratchSize));
+    const auto batches     = createBatches(inputs, scratchSize);
+
+    // The base address of the scratch buffer has to be aligned as well, which the allocation doesn't guarantee:
+    const auto scratchBuffer =
+        m_allocator.allocate(scratchSize + scratchAlignment, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                             VMA_MEMORY_USAGE_GPU_ONLY);
+    const auto scratchAddress = alignUp(scratchBuffer.deviceAddress(m_context), scratchAlignment);
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.queueFamilyIndex(),
+    });
+
+    // The sizes of a batch are read back while the next one writes its own, so we alternate between two query pools:
+    std::array<vk::UniqueQueryPool, 2> queryPools;
+    if (m_param.compact)
+    {
+        const auto largestBatch = std::ranges::max(batches, {}, [](const Batch& batch) { return batch.meshIndices.size(); }).meshIndices.size();
+        for (auto& queryPool : queryPools)
+        {
+            queryPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+                .queryType  = vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+                .queryCount = static_cast<std::uint32_t>(largestBatch),
+            });
+        }
+    }
+
+    const auto timestampPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+        .queryType  = vk::QueryType::eTimestamp,
+        .queryCount = static_cast<std::uint32_t>(batches.size() * 2),
+    });
+
+    std::deque<Submission> builds, compactions;
+    for (std::size_t i = 0; i <= batches.size(); ++i)
+    {
+        if (i < batches.size())
+        {
+            auto commandBuffer = beginCommandBuffer(*commandPool);
+            recordBuild(*commandBuffer, batches[i], inputs, accelerationStructures, scratchAddress, *queryPools[i % 2], *timestampPool,
+                        static_cast<std::uint32_t>(i * 2));
+            builds.emplace_back(submit(std::move(commandBuffer)));
+        }
+
+        // Compact the previous batch while the current one is being built:
+        if (m_param.compact && i > 0)
+        {
+            wait(builds.front());
+            builds.pop_front();
+
+            compactions.emplace_back(compact(*commandPool, batches[i - 1], accelerationStructures, *queryPools[(i - 1) % 2]));
+        }
+
+        // Release the originals of finished compactions:
+        while (!compactions.empty() && device.getFenceStatus(*compactions.front().fence) == vk::Result::eSuccess)
+        {
+            compactions.pop_front();
+        }
+    }
+
+    for (const auto& submission : builds)
+    {
+        wait(submission);
+    }
+    for (const auto& submission : compactions)
+    {
+        wait(submission);
+    }
+
+    const auto timestampCount = static_cast<std::uint32_t>(batches.size() * 2);
+    const auto timestamps     = device.getQueryPoolResults<std::uint64_t>(*timestampPool, 0, timestampCount, timestampCount * sizeof(std::uint64_t),
+                                                                      sizeof(std::uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (timestamps.result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error(fmt::format("Failed to query BLAS build timestamps: {}", vk::to_string(timestamps.result)));
+    }
+
+    const double timestampPeriod = m_context.physicalDevice().getProperties().limits.timestampPeriod;
+
+    std::vector<double> milliseconds;
+    milliseconds.reserve(batches.size());
+    for (std::size_t i = 0; i < batches.size(); ++i)
+    {
+        milliseconds.emplace_back((timestamps.value[i * 2 + 1] - timestamps.value[i * 2]) * timestampPeriod * 1e-6);
+    }
+
+    recordStats(batches, inputs, accelerationStructures, milliseconds);
+
+    vk::DeviceSize totalSize = 0;
+    for (const auto& accelerationStructure : accelerationStructures)
+    {
+        totalSize += accelerationStructure.size;
+    }
+
+    spdlog::info("Built {} BLAS in {} batches ({} MiB, {} MiB before compaction, {} MiB scratch).", meshes.size(), batches.size(), totalSize >> 20,
+                 buildSize >> 20, scratchSize >> 20);
+
+    return accelerationStructures;
+}
+
+void BlasBuilder::compactOnHost(std::vector<AccelerationStructure>& accelerationStructures) const
+{
+    const auto& device = m_context.device();
+
+    std::vector<vk::AccelerationStructureKHR> handles;
+    handles.reserve(accelerationStructures.size());
+    for (const auto& accelerationStructure : accelerationStructures)
+    {
+        handles.emplace_back(*accelerationStructure.handle);
+    }
+
+    const auto sizes = device.writeAccelerationStructuresPropertiesKHR<vk::DeviceSize>(
+        handles, vk::QueryType::eAccelerationStructureCompactedSizeKHR, handles.size() * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize));
+
+    for (std::size_t i = 0; i < accelerationStructures.size(); ++i)
+    {
+        auto compacted =
+            createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, sizes[i], VMA_MEMORY_USAGE_CPU_ONLY);
+
+        const auto result = device.copyAccelerationStructureKHR(nullptr, vk::CopyAccelerationStructureInfoKHR{
+                                                                             .src  = handles[i],
+                                                                             .dst  = *compacted.handle,
+                                                                             .mode = vk::CopyAccelerationStructureModeKHR::eCompact,
+                                                                         });
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error(fmt::format("Failed to compact BLAS on the host: {}", vk::to_string(result)));
+        }
+
+        accelerationStructures[i] = std::move(compacted);
+    }
+}
+
+std::vector<AccelerationStructure> BlasBuilder::buildHostStructures(const std::vector<const Mesh*>& meshes) const
+{
+    if (meshes.empty())
+    {
+        return {};
+    }
+
+    const auto& device      = m_context.device();
+    const auto  threadCount = m_param.hostThreadCount > 0 ? m_param.hostThreadCount : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<BuildInput>            inputs;
+    std::vector<AccelerationStructure> hostStructures;
+    inputs.reserve(meshes.size());
+    hostStructures.reserve(meshes.size());
+
+    const vk::DeviceSize scratchAlignment = m_context.accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    vk::DeviceSize totalScratchSize = 0, largestScratchSize = 0;
+    for (const auto* mesh : meshes)
+    {
+        auto& input = inputs.emplace_back(createBuildInput(*mesh));
+        hostStructures.emplace_back(createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel,
+                                                                input.sizes.accelerationStructureSize, VMA_MEMORY_USAGE_CPU_ONLY));
+
+        const auto scratchSize = alignUp(input.sizes.buildScratchSize, scratchAlignment);
+        totalScratchSize   += scratchSize;
+        largestScratchSize  = std::max(largestScratchSize, scratchSize);
+    }
+
+    const auto scratchSize = std::max(largestScratchSize, std::min(m_param.scratchBudget, totalScratchSize));
+    const auto batches     = createBatches(inputs, scratchSize);
+
+    std::vector<std::byte> scratch(scratchSize);
+    std::vector<double>    milliseconds;
+    milliseconds.reserve(batches.size());
+
+    // Every batch is a single deferred operation that all threads work on:
+    for (const auto& batch : batches)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<vk::AccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRanges;
+        buildInfos.reserve(batch.meshIndices.size());
+        buildRanges.reserve(batch.meshIndices.size());
+
+        for (std::size_t i = 0; i < batch.meshIndices.size(); ++i)
+        {
+            const auto& input = inputs[batch.meshIndices[i]];
+
+            buildInfos.emplace_back(vk::AccelerationStructureBuildGeometryInfoKHR{
+                .type                     = vk::AccelerationStructureTypeKHR::eBottomLevel,
+                .flags                    = input.flags,
+                .mode                     = vk::BuildAccelerationStructureModeKHR::eBuild,
+                .dstAccelerationStructure = *hostStructures[batch.meshIndices[i]].handle,
+                .geometryCount            = static_cast<std::uint32_t>(input.geometries.size()),
+                .pGeometries              = input.geometries.data(),
+                .scratchData              = {.hostAddress = scratch.data() + batch.scratchOffsets[i]},
+            });
+            buildRanges.emplace_back(input.ranges.data());
+        }
+
+        const auto deferredOperation = device.createDeferredOperationKHRUnique();
+
+        const auto result = device.buildAccelerationStructuresKHR(*deferredOperation, buildInfos, buildRanges);
+        if (result == vk::Result::eOperationDeferredKHR)
+        {
+            joinDeferredOperation(device, *deferredOperation, threadCount);
+        }
+        else if (result != vk::Result::eOperationNotDeferredKHR && result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error(fmt::format("Failed to build BLAS on the host: {}", vk::to_string(result)));
+        }
+
+        milliseconds.emplace_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    if (m_param.compact)
+    {
+        compactOnHost(hostStructures);
+    }
+
+    recordStats(batches, inputs, hostStructures, milliseconds);
+
+    vk::DeviceSize totalSize = 0;
+    for (const auto& accelerationStructure : hostStructures)
+    {
+        totalSize += accelerationStructure.size;
+    }
+
+    spdlog::info("Built {} BLAS on the host with {} threads in {} batches ({} MiB).", meshes.size(), threadCount, batches.size(), totalSize >> 20);
+
+    return hostStructures;
+}
+
+void BlasBuilder::recordStats(const std::vector<Batch>& batches, const std::vector<BuildInput>& inputs,
+                              const std::vector<AccelerationStructure>& accelerationStructures, const std::vector<double>& milliseconds) const
+{
+    for (std::size_t i = 0; i < batches.size(); ++i)
+    {
+        BlasPolicy::BuildStats stats{
+            .meshCount    = batches[i].meshIndices.size(),
+            .milliseconds = milliseconds[i],
+        };
+
+        for (const auto index : batches[i].meshIndices)
+        {
+            stats.triangleCount += inputs[index].triangleCount;
+            stats.size          += accelerationStructures[index].size;
+        }
+
+        m_policy.recordBuild(batches[i].preference, stats);
+    }
+}
+
+static bool
+readCache(const std::filesystem::path& path, SerializedAccelerationStructure& serialized)
+{
+    std::vector<std::byte> payload;
+    if (!readCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, payload) || payload.size() < sizeof(CacheHeader))
+    {
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, payload.data(), sizeof(header));
+
+    // The serialized data starts with the driver and compatibility UUIDs, followed by its own size and the size it deserializes to, which
+    // have to fit the entry before the driver gets to read it:
+    constexpr std::size_t serializedSizeOffset = sizeof(header) + 2 * VK_UUID_SIZE;
+    if (payload.size() < serializedSizeOffset + 2 * sizeof(std::uint64_t))
+    {
+        return false;
+    }
+
+    std::uint64_t sizes[2];
+    std::memcpy(sizes, payload.data() + serializedSizeOffset, sizeof(sizes));
+    if (sizes[0] > payload.size() - sizeof(header) || sizes[1] > header.size)
+    {
+        return false;
+    }
+
+    payload.erase(payload.begin(), payload.begin() + sizeof(header));
+    serialized.size = header.size;
+    serialized.data = std::move(payload);
+
+    return true;
+}
+
+static void
+writeCache(const std::filesystem::path& path, const SerializedAccelerationStructure& serialized)
+{
+    const CacheHeader header{
+        .size = serialized.size,
+    };
+
+    const std::span<const std::byte> parts[] = {std::as_bytes(std::span(&header, 1)), serialized.data};
+    writeCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, parts);
+}
+
+std::uint64_t BlasBuilder::cacheKey(const std::uint64_t contentHash, const BuildHints& hints, const std::uint32_t triangleCount) const
+{
+    // Different build flags result in different acceleration structures for the same geometry:
+    const auto preference = m_policy.select(hints, triangleCount);
+    const auto flags      = static_cast<VkBuildAccelerationStructureFlagsKHR>(m_buildFlags | BlasPolicy::buildFlags(preference));
+    return hashBytes(&flags, sizeof(flags), contentHash);
+}
+
+std::filesystem::path BlasBuilder::cachePath(const std::uint64_t key) const
+{
+    return m_param.cacheDirectory / fmt::format("{:016x}.blas", key);
+}
+
+std::vector<std::uint32_t> BlasBuilder::loadCached(const std::vector<std::uint64_t>& keys, std::vector<AccelerationStructure>& accelerationStructures) const
+{
+    std::vector<std::uint32_t>                   missing, hits;
+    std::vector<SerializedAccelerationStructure> serialized;
+
+    std::size_t incompatibleCount = 0;
+    for (std::uint32_t i = 0; i < keys.size(); ++i)
+    {
+        SerializedAccelerationStructure entry;
+        if (m_param.cacheDirectory.empty() || !readCache(cachePath(keys[i]), entry))
+        {
+            missing.emplace_back(i);
+            continue;
+        }
+
+        // Entries written by another driver or device can't be deserialized, they are rebuilt (and overwritten) instead:
+        if (!isCompatible(m_context, entry))
+        {
+            ++incompatibleCount;
+            missing.emplace_back(i);
+            continue;
+        }
+
+        hits.emplace_back(i);
+        serialized.emplace_back(std::move(entry));
+    }
+
+    if (incompatibleCount > 0)
+    {
+        spdlog::warn("{} cached BLAS are incompatible with the current driver or device and are rebuilt.", incompatibleCount);
+    }
+
+    if (hits.empty())
+    {
+        return missing;
+    }
+
+    auto loaded = deserialize(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, serialized);
+    for (std::size_t i = 0; i < hits.size(); ++i)
+    {
+        accelerationStructures[hits[i]] = std::move(loaded[i]);
+    }
+
+    spdlog::info("Loaded {} of {} BLAS from the cache.", hits.size(), keys.size());
+
+    return missing;
+}
+
+void BlasBuilder::storeCached(const std::vector<std::uint64_t>& keys, const std::vector<std::uint32_t>& indices,
+                              const std::vector<SerializedAccelerationStructure>& serialized) const
+{
+    for (std::size_t i = 0; i < indices.size(); ++i)
+    {
+        writeCache(cachePath(keys[indices[i]]), serialized[i]);
+    }
+}
+
+std::vector<AccelerationStructure> BlasBuilder::build(const std::vector<GPUMesh>& meshes) const
+{
+    std::vector<std::uint64_t> keys;
+    keys.reserve(meshes.size());
+    for (const auto& mesh : meshes)
+    {
+        keys.emplace_back(cacheKey(mesh.contentHash, mesh.buildHints, mesh.triangleCount()));
+    }
+
+    std::vector<AccelerationStructure> accelerationStructures(meshes.size());
+
+    const auto missing = loadCached(keys, accelerationStructures);
+    if (missing.empty())
+    {
+        return accelerationStructures;
+    }
+
+    std::vector<const GPUMesh*> buildMeshes;
+    buildMeshes.reserve(missing.size());
+    for (const auto index : missing)
+    {
+        buildMeshes.emplace_back(&meshes[index]);
+    }
+
+    auto built = buildOnDevice(buildMeshes);
+
+    if (!m_param.cacheDirectory.empty())
+    {
+        storeCached(keys, missing, serializeOnDevice(m_context, m_allocator, built));
+    }
+
+    for (std::size_t i = 0; i < missing.size(); ++i)
+    {
+        accelerationStructures[missing[i]] = std::move(built[i]);
+    }
+
+    return accelerationStructures;
+}
+
+std::vector<AccelerationStructure> BlasBuilder::buildOnHost(const std::vector<Mesh>& meshes) const
+{
+    if (!m_context.hostAccelerationStructureCommands())
+    {
+        throw std::runtime_error("Can't build BLAS on the host, the device doesn't support host acceleration structure commands");
+    }
+
+    std::vector<std::uint64_t> keys;
+    keys.reserve(meshes.size());
+    for (const auto& mesh : meshes)
+    {
+        keys.emplace_back(cacheKey(contentHash(mesh), mesh.buildHints, mesh.triangleCount()));
+    }
+
+    std::vector<AccelerationStructure> accelerationStructures(meshes.size());
+
+    const auto missing = loadCached(keys, accelerationStructures);
+    if (missing.empty())
+    {
+        return accelerationStructures;
+    }
+
+    std::vector<const Mesh*> buildMeshes;
+    buildMeshes.reserve(missing.size());
+    for (const auto index : missing)
+    {
+        buildMeshes.emplace_back(&meshes[index]);
+    }
+
+    // The acceleration structures are uploaded by deserializing them on the device, so we get the cache entries for free:
+    const auto serialized = serializeOnHost(m_context, buildHostStructures(buildMeshes));
+    auto       built      = deserialize(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, serialized);
+
+    if (!m_param.cacheDirectory.empty())
+    {
+        storeCached(keys, missing, serialized);
+    }
+
+    for (std::size_t i = 0; i < missing.size(); ++i)
+    {
+        accelerationStructures[missing[i]] = std::move(built[i]);
+    }
+
+    return accelerationStructures;
+}
+
+} // namespace polar
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <acceleration_structure.hpp>
+#include <blas_policy.hpp>
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <mesh_uploader.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Builds one bottom level acceleration structure per mesh, for fast tracing or fast building as picked by the BlasPolicy. Meshes are
+// grouped into batches of the same kind whose scratch memory fits into a single shared scratch buffer, and each batch is built with a
+// single vkCmdBuildAccelerationStructuresKHR call. Batches alias the same scratch memory, so they are separated by a barrier. The time
+// each batch took to build is reported to the policy.
+// Each batch is submitted on its own. If compaction is enabled, the compacted sizes of a batch are read back while the next batch is
+// being built, after which the batch is copied into allocations of exactly that size. The original acceleration structures are released
+// as soon as their copies have finished.
+// Alternatively, if the device supports host commands, the acceleration structures can be built on the CPU in host memory and uploaded
+// by serializing them (which keeps the GPU free, e.g. to keep rendering while the next scene is loaded).
+// Built acceleration structures can be cached on disk in serialized form, keyed by the content hash of the mesh and the build flags.
+// Entries are only used if the device reports that they are compatible, everything else is rebuilt.
+class BlasBuilder
+{
+  public:
+    struct Param
+    {
+        // Size of the shared scratch buffer. It is grown to fit the largest single mesh if necessary.
+        vk::DeviceSize scratchBudget = 256ull << 20;
+
+        // Added to the flags picked by the policy (e.g. eLowMemory).
+        vk::BuildAccelerationStructureFlagsKHR buildFlags;
+
+        // Adds eAllowCompaction to the build flags and compacts all acceleration structures after they are built.
+        bool compact = true;
+
+        // Number of threads that join the deferred operations of host builds, 0 uses all hardware threads.
+        std::uint32_t hostThreadCount = 0;
+
+        // Directory in which serialized acceleration structures are cached. Leave empty to disable the cache.
+        std::filesystem::path cacheDirectory;
+    };
+
+    BlasBuilder(const Context& context, const GPUAllocator& allocator, BlasPolicy& policy, const Param& param);
+
+    BlasBuilder(const BlasBuilder&)            = delete;
+    BlasBuilder(BlasBuilder&&)                 = delete;
+    BlasBuilder& operator=(const BlasBuilder&) = delete;
+    BlasBuilder& operator=(BlasBuilder&&)      = delete;
+
+    // Returns the acceleration structures in the same order as the meshes.
+    std::vector<AccelerationStructure> build(const std::vector<GPUMesh>& meshes) const;
+
+    // Builds on the host and uploads the results (which end up in device local memory). Requires
+    // Context::hostAccelerationStructureCommands().
+    std::vector<AccelerationStructure> buildOnHost(const std::vector<Mesh>& meshes) const;
+
+  private:
+    struct BuildInput
+    {
+        std::vector<vk::AccelerationStructureGeometryKHR>       geometries;
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR> ranges;
+        vk::AccelerationStructureBuildSizesInfoKHR              sizes;
+        BuildPreference                                         preference    = BuildPreference::eFastTrace;
+        vk::BuildAccelerationStructureFlagsKHR                  flags;
+        std::uint32_t                                           triangleCount = 0;
+    };
+
+    // Indices of the meshes that are built together and the scratch offset of each of them. All of them share the same preference.
+    struct Batch
+    {
+        std::vector<std::uint32_t>  meshIndices;
+        std::vector<vk::DeviceSize> scratchOffsets;
+        vk::DeviceSize              scratchSize = 0;
+        BuildPreference             preference  = BuildPreference::eFastTrace;
+    };
+
+    struct Submission
+    {
+        vk::UniqueCommandBuffer            commandBuffer;
+        vk::UniqueFence                    fence;
+        std::vector<AccelerationStructure> retired; // Released once the submission has finished
+    };
+
+    static void addTriangles(BuildInput& input, vk::DeviceOrHostAddressConstKHR vertices, std::uint32_t vertexCount,
+                             vk::DeviceOrHostAddressConstKHR indices, std::uint32_t triangleCount, bool opaque);
+
+    void               initBuildInput(BuildInput& input, const BuildHints& hints, vk::AccelerationStructureBuildTypeKHR buildType) const;
+    BuildInput         createBuildInput(const GPUMesh& mesh) const;
+    BuildInput         createBuildInput(const Mesh& mesh) const;
+    std::vector<Batch> createBatches(const std::vector<BuildInput>& inputs, vk::DeviceSize scratchSize) const;
+
+    vk::UniqueCommandBuffer beginCommandBuffer(const vk::CommandPool& commandPool) const;
+    Submission              submit(vk::UniqueCommandBuffer commandBuffer) const;
+    void                    wait(const Submission& submission) const;
+
+    void       recordBuild(const vk::CommandBuffer& commandBuffer, const Batch& batch, const std::vector<BuildInput>& inputs,
+                           const std::vector<AccelerationStructure>& accelerationStructures, vk::DeviceAddress scratchAddress,
+                           const vk::QueryPool& queryPool, const vk::QueryPool& timestampPool, std::uint32_t firstTimestamp) const;
+    Submission compact(const vk::CommandPool& commandPool, const Batch& batch, std::vector<AccelerationStructure>& accelerationStructures,
+                       const vk::QueryPool& queryPool) const;
+
+    std::vector<AccelerationStructure> buildOnDevice(const std::vector<const GPUMesh*>& meshes) const;
+
+    void recordStats(const std::vector<Batch>& batches, const std::vector<BuildInput>& inputs,
+                     const std::vector<AccelerationStructure>& accelerationStructures, const std::vector<double>& milliseconds) const;
+
+    void                               compactOnHost(std::vector<AccelerationStructure>& accelerationStructures) const;
+    std::vector<AccelerationStructure> buildHostStructures(const std::vector<const Mesh*>& meshes) const;
+
+    std::uint64_t         cacheKey(std::uint64_t contentHash, const BuildHints& hints, std::uint32_t triangleCount) const;
+    std::filesystem::path cachePath(std::uint64_t key) const;
+
+    // Deserializes the cached acceleration structures into their slots and returns the indices of those that aren't cached.
+    std::vector<std::uint32_t> loadCached(const std::vector<std::uint64_t>& keys, std::vector<AccelerationStructure>& accelerationStructures) const;
+    void                       storeCached(const std::vector<std::uint64_t>& keys, const std::vector<std::uint32_t>& indices,
+                                           const std::vector<SerializedAccelerationStructure>& serialized) const;
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    BlasPolicy&         m_policy;
+    Param               m_param;
+
+    vk::BuildAccelerationStructureFlagsKHR m_buildFlags;
+};
+
+} // namespace polar
@@ -0,0 +1,82 @@
+#include "blas_policy.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace polar
+{
+
+BlasPolicy::BlasPolicy(const Param& param) : m_param(param)
+{
+}
+
+BuildPreference BlasPolicy::select(const BuildHints& hints, const std::uint32_t triangleCount) const
+{
+    if (hints.preference != BuildPreference::eAuto)
+    {
+        return hints.preference;
+    }
+
+    if (hints.dynamic)
+    {
+        return triangleCount <= m_param.maxFastTraceDynamicTriangles ? BuildPreference::eFastTrace : BuildPreference::eFastBuild;
+    }
+
+    if (triangleCount >= m_param.minFastBuildStaticTriangles && hints.coverage < m_param.minFastTraceCoverage)
+    {
+        return BuildPreference::eFastBuild;
+    }
+
+    return BuildPreference::eFastTrace;
+}
+
+vk::BuildAccelerationStructureFlagsKHR BlasPolicy::buildFlags(const BuildPreference preference)
+{
+    return preference == BuildPreference::eFastBuild ? vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastBuild
+                                                     : vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+}
+
+void BlasPolicy::recordBuild(const BuildPreference preference, const BuildStats& stats)
+{
+    auto& total = preference == BuildPreference::eFastBuild ? m_stats.fastBuild : m_stats.fastTrace;
+
+    total.meshCount     += stats.meshCount;
+    total.triangleCount += stats.triangleCount;
+    total.size          += stats.size;
+    total.milliseconds  += stats.milliseconds;
+}
+
+void BlasPolicy::recordTrace(const double milliseconds)
+{
+    m_stats.traceMilliseconds += milliseconds;
+    ++m_stats.traceSamples;
+}
+
+void BlasPolicy::logStats() const
+{
+    const auto log = [](const char* name, const BuildStats& stats) {
+        if (stats.meshCount == 0)
+        {
+            return;
+        }
+
+        const auto millions = stats.triangleCount / 1e6;
+        spdlog::info("{}: {} BLAS, {:.2f}M triangles, {} MiB, {:.2f} ms ({:.2f} ms per million triangles, {:.1f} bytes per triangle).", name,
+                     stats.meshCount, millions, stats.size >> 20, stats.milliseconds, stats.milliseconds / std::max(millions, 1e-6),
+                     static_cast<double>(stats.size) / std::max<std::uint64_t>(stats.triangleCount, 1));
+    };
+
+    log("Fast trace builds", m_stats.fastTrace);
+    log("Fast build builds", m_stats.fastBuild);
+
+    if (m_stats.traceSamples > 0)
+    {
+        const auto total = m_stats.fastTrace.triangleCount + m_stats.fastBuild.triangleCount;
+        spdlog::info("Tracing: {:.2f} ms per sample over {} samples ({:.1f}% of the triangles built for fast building).",
+                     m_stats.traceMilliseconds / m_stats.traceSamples, m_stats.traceSamples,
+                     total > 0 ? 100.0 * m_stats.fastBuild.triangleCount / total : 0.0);
+    }
+}
+
+} // namespace polar
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Decides per mesh whether its BLAS is built for fast tracing or for fast building. Static meshes are generally worth the slower, higher
+// quality build, while dynamic meshes that are rebuilt frequently aren't. Explicit preferences in the build hints always win.
+// It also accumulates how long the builds of either kind took and how long tracing took, to tune the thresholds with.
+class BlasPolicy
+{
+  public:
+    struct Param
+    {
+        // Dynamic meshes up to this many triangles are still built for fast tracing, their builds are cheap either way.
+        std::uint32_t maxFastTraceDynamicTriangles = 1u << 14;
+
+        // Static meshes with at least this many triangles and a coverage below minFastTraceCoverage are built for fast building, as a
+        // slow build is unlikely to pay off for something that barely gets hit.
+        std::uint32_t minFastBuildStaticTriangles = 1u << 20;
+        float         minFastTraceCoverage        = 0.01f;
+    };
+
+    struct BuildStats
+    {
+        std::size_t    meshCount     = 0;
+        std::uint64_t  triangleCount = 0;
+        vk::DeviceSize size          = 0; // After compaction (if enabled)
+        double         milliseconds  = 0.0;
+    };
+
+    struct Stats
+    {
+        BuildStats fastTrace;
+        BuildStats fastBuild;
+
+        // Tracing can't be attributed to individual BLAS, so this is the total over whole samples (see recordTrace()):
+        double      traceMilliseconds = 0.0;
+        std::size_t traceSamples      = 0;
+    };
+
+    BlasPolicy(const Param& param);
+
+    BlasPolicy(const BlasPolicy&)            = delete;
+    BlasPolicy(BlasPolicy&&)                 = delete;
+    BlasPolicy& operator=(const BlasPolicy&) = delete;
+    BlasPolicy& operator=(BlasPolicy&&)      = delete;
+
+    // Returns either eFastTrace or eFastBuild.
+    BuildPreference select(const BuildHints& hints, std::uint32_t triangleCount) const;
+
+    static vk::BuildAccelerationStructureFlagsKHR buildFlags(BuildPreference preference);
+
+    void recordBuild(BuildPreference preference, const BuildStats& stats);
+
+    // Called by the wavefront integrator (see Integrator::setBlasPolicy) with the GPU time its trace kernel took for one sample per
+    // pixel, summed over all bounces.
+    void recordTrace(double milliseconds);
+
+    const Stats& stats() const { return m_stats; }
+
+    // Logs the build time per million triangles for either kind and the average trace time per sample.
+    void logStats() const;
+
+  private:
+    Param m_param;
+    Stats m_stats;
+};
+
+} // namespace polar
@@ -0,0 +1,423 @@
+#include "block_compression.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace polar
+{
+
+// Interpolation weights (out of 64) of 4 bit indices as defined by both BC6H and BC7:
+constexpr std::array<int, 16> WEIGHTS_4BIT = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+class BitWriter
+{
+  public:
+    BitWriter(std::byte* const output, const std::size_t size) : m_output(output)
+    {
+        std::memset(output, 0, size);
+    }
+
+    // Bits are written starting at the least significant bit of the first byte:
+    void write(const std::uint32_t value, const int count)
+    {
+        for (int i = 0; i < count; ++i, ++m_offset)
+        {
+            if ((value >> i) & 1)
+            {
+                m_output[m_offset / 8] |= std::byte(1 << (m_offset % 8));
+            }
+        }
+    }
+
+  private:
+    std::byte* m_output = nullptr;
+    int        m_offset = 0;
+};
+
+// Bits are read starting at the least significant bit of the first byte, like BitWriter writes them:
+static std::uint32_t
+readBits(const std::byte* const input, const int offset, const int count)
+{
+    std::uint32_t value = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        value |= std::to_integer<std::uint32_t>((input[(offset + i) / 8] >> ((offset + i) % 8)) & std::byte(1)) << i;
+    }
+    return value;
+}
+
+//
+// Endpoint Fitting
+//
+
+template <int N> using Vec = glm::vec<N, float>;
+
+template <int N> struct Points
+{
+    std::array<Vec<N>, 16> points;
+};
+
+// Returns the endpoints of the segment along the principal axis of the points that covers all of them.
+template <int N>
+static std::array<Vec<N>, 2>
+fitEndpoints(const Points<N>& block)
+{
+    Vec<N> mean(0.f), minPoint(std::numeric_limits<float>::max()), maxPoint(std::numeric_limits<float>::lowest());
+    for (const auto& point : block.points)
+    {
+        mean += point;
+        minPoint = glm::min(minPoint, point);
+        maxPoint = glm::max(maxPoint, point);
+    }
+    mean /= 16.f;
+
+    glm::mat<N, N, float> covariance(0.f);
+    for (const auto& point : block.points)
+    {
+        const auto d = point - mean;
+        for (int i = 0; i < N; ++i)
+        {
+            covariance[i] += d * d[i];
+        }
+    }
+
+    // Power iteration, starting with the diagonal of the bounding box which is usually a good guess already:
+    auto axis = maxPoint - minPoint;
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        axis = covariance * axis;
+
+        float maxComponent = 0.f;
+        for (int i = 0; i < N; ++i)
+        {
+            maxComponent = std::max(maxComponent, std::abs(axis[i]));
+        }
+        if (maxComponent == 0.f)
+        {
+            return {mean, mean};
+        }
+        axis /= maxComponent;
+    }
+    axis = glm::normalize(axis);
+
+    float minT = std::numeric_limits<float>::max(), maxT = std::numeric_limits<float>::lowest();
+    for (const auto& point : block.points)
+    {
+        const auto t = glm::dot(point - mean, axis);
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    return {mean + axis * minT, mean + axis * maxT};
+}
+
+// Given the palette indices of every point, returns the endpoints that minimize the squared error (with 4 bit weights).
+template <int N>
+static std::array<Vec<N>, 2>
+refineEndpoints(const Points<N>& block, const std::array<int, 16>& indices, const std::array<Vec<N>, 2>& fallback)
+{
+    float  a = 0.f, b = 0.f, c = 0.f;
+    Vec<N> x0(0.f), x1(0.f);
+    for (int i = 0; i < 16; ++i)
+    {
+        const auto w = WEIGHTS_4BIT[indices[i]] / 64.f;
+        a  += (1.f - w) * (1.f - w);
+        b  += (1.f - w) * w;
+        c  += w * w;
+        x0 += block.points[i] * (1.f - w);
+        x1 += block.points[i] * w;
+    }
+
+    const auto det = a * c - b * b;
+    if (std::abs(det) < 1e-6f)
+    {
+        return fallback;
+    }
+
+    return {(x0 * c - x1 * b) / det, (x1 * a - x0 * b) / det};
+}
+
+// Assigns every point to the closest palette entry of the (decoded) endpoints and returns the total squared error.
+template <int N>
+static float
+assignIndices(const Points<N>& block, const Vec<N>& e0, const Vec<N>& e1, std::array<int, 16>& indices)
+{
+    std::array<Vec<N>, 16> palette;
+    for (int i = 0; i < 16; ++i)
+    {
+        palette[i] = glm::floor((e0 * float(64 - WEIGHTS_4BIT[i]) + e1 * float(WEIGHTS_4BIT[i]) + 32.f) / 64.f);
+    }
+
+    float error = 0.f;
+    for (int t = 0; t < 16; ++t)
+    {
+        float bestError = std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; ++i)
+        {
+            const auto d = palette[i] - block.points[t];
+            const auto e = glm::dot(d, d);
+            if (e < bestError)
+            {
+                bestError  = e;
+                indices[t] = i;
+            }
+        }
+        error += bestError;
+    }
+
+    return error;
+}
+
+// Writes the 4 bit indices of a single subset block. The most significant bit of the first index is implied to be zero, so the caller
+// has to make sure to swap the endpoints if that isn't the case.
+static void
+writeIndices(BitWriter& writer, const std::array<int, 16>& indices)
+{
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+    {
+        writer.write(indices[i], 4);
+    }
+}
+
+//
+// BC4 and BC5
+//
+
+static void
+encodeBc4Channel(const TexelBlock& texels, const int channel, std::byte* const output)
+{
+    std::array<float, 16> values;
+    float                 minValue = 255.f, maxValue = 0.f;
+    for (int i = 0; i < 16; ++i)
+    {
+        values[i] = glm::clamp(texels[i][channel], 0.f, 1.f) * 255.f;
+        minValue  = std::min(minValue, values[i]);
+        maxValue  = std::max(maxValue, values[i]);
+    }
+
+    const auto r0 = static_cast<int>(maxValue + 0.5f);
+    const auto r1 = static_cast<int>(minValue + 0.5f);
+
+    BitWriter writer(output, BC4_BLOCK_SIZE);
+    writer.write(r0, 8);
+    writer.write(r1, 8);
+
+    if (r0 == r1)
+    {
+        return;
+    }
+
+    // With r0 > r1 the palette is r0, r1 followed by 6 evenly spaced values between them:
+    std::array<float, 8> palette{float(r0), float(r1)};
+    for (int i = 2; i < 8; ++i)
+    {
+        palette[i] = float(((8 - i) * r0 + (i - 1) * r1) / 7);
+    }
+
+    for (const auto value : values)
+    {
+        int   bestIndex = 0;
+        float bestError = std::numeric_limits<float>::max();
+        for (int i = 0; i < 8; ++i)
+        {
+            const auto error = std::abs(palette[i] - value);
+            if (error < bestError)
+            {
+                bestError = error;
+                bestIndex = i;
+            }
+        }
+        writer.write(bestIndex, 3);
+    }
+}
+
+void encodeBc4Block(const TexelBlock& texels, std::byte* const output)
+{
+    encodeBc4Channel(texels, 0, output);
+}
+
+void encodeBc5Block(const TexelBlock& texels, std::byte* const output)
+{
+    encodeBc4Channel(texels, 0, output);
+    encodeBc4Channel(texels, 1, output + BC4_BLOCK_SIZE);
+}
+
+//
+// BC6H
+//
+
+// Unquantizes a 10 bit endpoint of an unsigned BC6H block into the 16 bit interpolation domain.
+static float
+unquantizeBc6h(const int value)
+{
+    if (value == 0)
+    {
+        return 0.f;
+    }
+    if (value == 1023)
+    {
+        return 65535.f;
+    }
+    return float(((value << 16) + 0x8000) >> 10);
+}
+
+void encodeBc6hBlock(const TexelBlock& texels, std::byte* const output)
+{
+    // Interpolation happens on the bit pattern of the half floats (scaled by 64 / 31), so that's the domain we fit endpoints in:
+    Points<3> block;
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            const auto half     = glm::packHalf1x16(glm::clamp(texels[i][c], 0.f, 65504.f));
+            block.points[i][c]  = float(half) * 64.f / 31.f;
+        }
+    }
+
+    const auto quantize = [](const Vec<3>& endpoint) {
+        return glm::ivec3(glm::clamp(glm::round((endpoint - 32.f) / 64.f), glm::vec3(0.f), glm::vec3(1023.f)));
+    };
+    const auto unquantize = [](const glm::ivec3& endpoint) {
+        return Vec<3>(unquantizeBc6h(endpoint.x), unquantizeBc6h(endpoint.y), unquantizeBc6h(endpoint.z));
+    };
+
+    std::array<glm::ivec3, 2> bestEndpoints;
+    std::array<int, 16>       bestIndices;
+    float                     bestError = std::numeric_limits<float>::max();
+
+    const auto tryEndpoints = [&](const std::array<Vec<3>, 2>& endpoints) {
+        const std::array<glm::ivec3, 2> quantized = {quantize(endpoints[0]), quantize(endpoints[1])};
+
+        std::array<int, 16> indices;
+        const auto          error = assignIndices(block, unquantize(quantized[0]), unquantize(quantized[1]), indices);
+        if (error < bestError)
+        {
+            bestError     = error;
+            bestEndpoints = quantized;
+            bestIndices   = indices;
+        }
+    };
+
+    const auto endpoints = fitEndpoints(block);
+    tryEndpoints(endpoints);
+    tryEndpoints(refineEndpoints(block, bestIndices, endpoints));
+
+    if (bestIndices[0] & 0x8)
+    {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        for (auto& index : bestIndices)
+        {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter writer(output, BC6H_BLOCK_SIZE);
+    writer.write(0x03, 5); // Mode 11: single region, 10 bit endpoints, no delta encoding
+    for (const auto& endpoint : bestEndpoints)
+    {
+        writer.write(endpoint.x, 10);
+        writer.write(endpoint.y, 10);
+        writer.write(endpoint.z, 10);
+    }
+    writeIndices(writer, bestIndices);
+}
+
+//
+// BC7
+//
+
+void encodeBc7Block(const TexelBlock& texels, std::byte* const output)
+{
+    Points<4> block;
+    for (int i = 0; i < 16; ++i)
+    {
+        block.points[i] = glm::clamp(texels[i], 0.f, 1.f) * 255.f;
+    }
+
+    // Mode 6 endpoints are 7 bits per channel plus a shared least significant bit (p-bit) per endpoint:
+    const auto quantize = [](const Vec<4>& endpoint, const int pbit) {
+        return glm::ivec4(glm::clamp(glm::round((endpoint - float(pbit)) / 2.f), glm::vec4(0.f), glm::vec4(127.f)));
+    };
+    const auto unquantize = [](const glm::ivec4& endpoint, const int pbit) { return Vec<4>((endpoint << 1) | pbit); };
+
+    std::array<glm::ivec4, 2> bestEndpoints;
+    std::array<int, 2>        bestPbits;
+    std::array<int, 16>       bestIndices;
+    float                     bestError = std::numeric_limits<float>::max();
+
+    const auto tryEndpoints = [&](const std::array<Vec<4>, 2>& endpoints) {
+        for (int pbits = 0; pbits < 4; ++pbits)
+        {
+            const std::array<int, 2>        p         = {pbits & 1, pbits >> 1};
+            const std::array<glm::ivec4, 2> quantized = {quantize(endpoints[0], p[0]), quantize(endpoints[1], p[1])};
+
+            std::array<int, 16> indices;
+            const auto          error = assignIndices(block, unquantize(quantized[0], p[0]), unquantize(quantized[1], p[1]), indices);
+            if (error < bestError)
+            {
+                bestError     = error;
+                bestEndpoints = quantized;
+                bestPbits     = p;
+                bestIndices   = indices;
+            }
+        }
+    };
+
+    const auto endpoints = fitEndpoints(block);
+    tryEndpoints(endpoints);
+    tryEndpoints(refineEndpoints(block, bestIndices, endpoints));
+
+    if (bestIndices[0] & 0x8)
+    {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        std::swap(bestPbits[0], bestPbits[1]);
+        for (auto& index : bestIndices)
+        {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter writer(output, BC7_BLOCK_SIZE);
+    writer.write(1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.write(bestEndpoints[0][c], 7);
+        writer.write(bestEndpoints[1][c], 7);
+    }
+    writer.write(bestPbits[0], 1);
+    writer.write(bestPbits[1], 1);
+    writeIndices(writer, bestIndices);
+}
+
+bool decodeBc7Alpha(const std::byte* const input, std::array<std::uint8_t, 16>& alpha)
+{
+    if (readBits(input, 0, 7) != 1 << 6)
+    {
+        return false;
+    }
+
+    // The alpha endpoints follow the 7 mode bits and the six rgb endpoints, the p-bits and indices follow the alpha endpoints:
+    const std::array<std::uint32_t, 2> endpoints = {
+        (readBits(input, 49, 7) << 1) | readBits(input, 63, 1),
+        (readBits(input, 56, 7) << 1) | readBits(input, 64, 1),
+    };
+
+    // The index of the first texel is one bit shorter, its most significant bit is implicitly 0:
+    int offset = 65;
+    for (int i = 0; i < 16; ++i)
+    {
+        const auto bits   = i == 0 ? 3 : 4;
+        const auto weight = static_cast<std::uint32_t>(WEIGHTS_4BIT[readBits(input, offset, bits)]);
+        alpha[i]          = static_cast<std::uint8_t>((endpoints[0] * (64 - weight) + endpoints[1] * weight + 32) >> 6);
+        offset += bits;
+    }
+
+    return true;
+}
+
+} // namespace polar
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace polar
+{
+
+// Every encoder takes a single 4x4 block of texels in row-major order and writes one compressed block to output. The inner loops work
+// on fixed size arrays of floats so that the compiler can vectorize them.
+using TexelBlock = std::array<glm::vec4, 16>;
+
+constexpr std::size_t BC4_BLOCK_SIZE  = 8;
+constexpr std::size_t BC5_BLOCK_SIZE  = 16;
+constexpr std::size_t BC6H_BLOCK_SIZE = 16;
+constexpr std::size_t BC7_BLOCK_SIZE  = 16;
+
+// Encodes the red channel (expected to be in [0, 1]).
+void encodeBc4Block(const TexelBlock& texels, std::byte* output);
+
+// Encodes the red and green channel (expected to be in [0, 1]), e.g. for tangent space normal maps.
+void encodeBc5Block(const TexelBlock& texels, std::byte* output);
+
+// Encodes the linear rgb channels as unsigned half floats (negative values are clamped to 0). Uses the single region mode 11.
+void encodeBc6hBlock(const TexelBlock& texels, std::byte* output);
+
+// Encodes all four channels (expected to be in [0, 1]). Uses the single subset rgba mode 6.
+void encodeBc7Block(const TexelBlock& texels, std::byte* output);
+
+// Decodes the alpha channel of a block written by encodeBc7Block. Returns false (leaving alpha untouched) for blocks that aren't mode 6.
+bool decodeBc7Alpha(const std::byte* input, std::array<std::uint8_t, 16>& alpha);
+
+} // namespace polar
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cmath>
+
+namespace polar
+{
+
+inline float srgbToLinear(const float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(const float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+} // namespace polar
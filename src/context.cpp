@@ -4,6 +4,8 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <cstring>
+#include <tuple>
 #include <vector>
 
 #include <configure.hpp>
@@ -82,7 +84,9 @@ getRequiredDeviceExtensions(const Context::Param& param)
     return {
         VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
         VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
-        VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME
+        VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+        VK_KHR_RAY_QUERY_EXTENSION_NAME,
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME
     };
 }
 
@@ -168,14 +172,23 @@ Context::Context(const Param& param)
         vk::PhysicalDeviceVulkan11Features,
         vk::PhysicalDeviceVulkan12Features,
         vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
-        vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>();
+        vk::PhysicalDeviceRayTracingPipelineFeaturesKHR,
+        vk::PhysicalDeviceRayQueryFeaturesKHR>();
 
     const auto properties = m_physicalDevice.getProperties2<
         vk::PhysicalDeviceProperties2,
         vk::PhysicalDeviceVulkan11Properties,
         vk::PhysicalDeviceVulkan12Properties,
+        vk::PhysicalDeviceAccelerationStructurePropertiesKHR,
         vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
 
+    m_accelerationStructureProperties       = properties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+    m_accelerationStructureProperties.pNext = nullptr;
+    m_rayTracingPipelineProperties          = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+    m_rayTracingPipelineProperties.pNext    = nullptr;
+
+    m_hostAccelerationStructureCommands = features.get<vk::PhysicalDeviceAccelerationStructureFeaturesKHR>().accelerationStructureHostCommands;
+
     spdlog::info("Found compatible physical device: {}", properties.get<vk::PhysicalDeviceProperties2>().properties.deviceName.data());
 
     //
@@ -192,7 +205,7 @@ Context::Context(const Param& param)
     for (const auto& queueFamilyProperty : queueFamilyProperties)
     {
         queueCreateInfos.emplace_back(vk::DeviceQueueCreateInfo{
-            .queueFamilyIndex = queueFamilyIndex,
+            .queueFamilyIndex = queueFamilyIndex++,
             .queueCount       = queueFamilyProperty.queueCount,
         });
         maxQueueCount = std::max(maxQueueCount, queueFamilyProperty.queueCount);
@@ -260,69 +273,64 @@ Context::Context(const Param& param)
     // Sort in such a way to give priority to queues with a low score:
     std::ranges::sort(queueScores, [&](const QueueScore& a, const QueueScore& b) { return a.score < b.score; });
 
-    // Find a transfer, compute, and general queue:
-    const auto findQueue = [&](const vk::QueueFlags& flags) {
-        auto itr = std::ranges::find_if(queueScores, [&](const QueueScore& score) { return score.flags & flags; });
+    // Find a general, compute, and transfer queue. Families with fewer capabilities are preferred (those are usually backed by dedicated
+    // hardware, e.g. DMA engines for transfer-only families). If no unused queue is left we share an existing one:
+    const auto findQueue = [&](const vk::QueueFlags& flags, const char* const description) -> std::pair<std::uint32_t, vk::Queue> {
+        const auto supports = [&](const QueueScore& score) { return (score.flags & flags) == flags; };
+
+        auto itr = std::ranges::find_if(queueScores, [&](const QueueScore& score) { return supports(score) && score.currQueueCount < score.queueCount; });
+        if (itr != queueScores.end())
+        {
+            return {itr->familyIndex, m_device->getQueue(itr->familyIndex, itr->currQueueCount++)};
+        }
+
+        itr = std::ranges::find_if(queueScores, supports);
+        if (itr == queueScores.end())
+        {
+            throw std::runtime_error(fmt::format("Could not find a queue that supports {}.", description));
+        }
 
+        return {itr->familyIndex, m_device->getQueue(itr->familyIndex, 0)};
     };
 
-    const auto queueItr = std::find_if(queueFamilyProperties.begin(), queueFamilyProperties.end(),
-        [&](const vk::QueueFamilyProperties& queueFamilyProperty) {
-            const auto flags = queueFamilyProperty.queueFlags;
-            return (vk::QueueFlagBits::eCompute & flags) && (vk::QueueFlagBits::eGraphics & flags) && (vk::QueueFlagBits::eTransfer & flags);
-        });
+    std::tie(m_queueFamilyIndex, m_queue) =
+        findQueue(vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer, "graphics, compute, and transfer");
+    std::tie(m_computeQueueFamilyIndex, m_computeQueue)   = findQueue(vk::QueueFlagBits::eCompute, "compute");
+    std::tie(m_transferQueueFamilyIndex, m_transferQueue) = findQueue(vk::QueueFlagBits::eTransfer, "transfer");
+
+    spdlog::info("Found graphics, compute, and transfer queue (families: {}, {}, {}).", m_queueFamilyIndex, m_computeQueueFamilyIndex,
+                 m_transferQueueFamilyIndex);
 
-    if (queueItr == queueFamilyProperties.end())
+    for (const auto familyIndex : {m_queueFamilyIndex, m_computeQueueFamilyIndex, m_transferQueueFamilyIndex})
     {
-        throw std::runtime_error("Could not find a queue that supports graphics, compute, and transfer.");
+        if (std::ranges::find(m_queueFamilyIndices, familyIndex) == m_queueFamilyIndices.end())
+        {
+            m_queueFamilyIndices.emplace_back(familyIndex);
+        }
     }
 
-    m_queueFamilyIndex = std::distance(queueFamilyProperties.begin(), queueItr);
-    m_queue = m_device->getQueue(m_queueFamilyIndex, 0);
-
-    spdlog::info("Found graphics, compute, and transfer queue.");
-
     spdlog::info("Finished creating Vulkan context.");
 }
 
-const vk::Instance& Context::instance() const
-{
-    return *m_instance;
-}
-
-const vk::Device& Context::device() const
-{
-    return *m_device;
-}
-
-const vk::PhysicalDevice& Context::physicalDevice() const
-{
-    return m_physicalDevice;
-}
-
-std::uint32_t Context::queueFamilyIndex() const
-{
-    return m_queueFamilyIndex;
-}
-
-const vk::Queue& Context::queue() const
+void submitAndWait(const Context& context, const vk::ArrayProxyNoTemporaries<const vk::CommandBuffer> commandBuffers, const std::uint64_t timeout,
+                   const std::string_view description)
 {
-    return m_queue;
+    submitAndWait(context, context.queue(), commandBuffers, timeout, description);
 }
 
-void submitAndWait(const Context& context, const vk::ArrayProxyNoTemporaries<const vk::CommandBuffer> commandBuffers, const std::uint64_t timeout,
-                   const std::string_view description)
+void submitAndWait(const Context& context, const vk::Queue& queue, const vk::ArrayProxyNoTemporaries<const vk::CommandBuffer> commandBuffers,
+                   const std::uint64_t timeout, const std::string_view description)
 {
     for (const auto& commandBuffer : commandBuffers)
     {
         commandBuffer.end();
     }
 
-    const auto fence = context.device().createFence(vk::FenceCreateInfo());
+    const auto fence = context.device().createFenceUnique(vk::FenceCreateInfo());
 
-    context.queue().submit(vk::SubmitInfo().setCommandBuffers(commandBuffers), fence);
+    queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffers), *fence);
 
-    if (context.device().waitForFences(fence, VK_TRUE, timeout) == vk::Result::eTimeout)
+    if (context.device().waitForFences(*fence, VK_TRUE, timeout) == vk::Result::eTimeout)
     {
         throw std::runtime_error(fmt::format("Fence timed out waiting on command submission for {}", description));
     }
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string_view>
+#include <vector>
 
 #include <vulkan/vulkan.hpp>
 
@@ -33,10 +34,20 @@ class Context
     const vk::Queue& transferQueue() const { return m_transferQueue; }
     const vk::Queue& computeQueue()  const { return m_computeQueue;  }
 
+    const vk::PhysicalDeviceAccelerationStructurePropertiesKHR& accelerationStructureProperties() const { return m_accelerationStructureProperties; }
+    const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR&    rayTracingPipelineProperties()    const { return m_rayTracingPipelineProperties;    }
+
+    // Whether acceleration structures can be built and copied on the host (accelerationStructureHostCommands).
+    bool hostAccelerationStructureCommands() const { return m_hostAccelerationStructureCommands; }
+
     std::uint32_t queueFamilyIndex()         const { return m_queueFamilyIndex;         }
     std::uint32_t transferQueueFamilyIndex() const { return m_transferQueueFamilyIndex; }
     std::uint32_t computeQueueFamilyIndex()  const { return m_computeQueueFamilyIndex;  }
 
+    // The distinct families of the general, transfer and compute queues. Resources written by one queue and read by another are
+    // shared concurrently between all of them when there is more than one.
+    const std::vector<std::uint32_t>& queueFamilyIndices() const { return m_queueFamilyIndices; }
+
   private:
     vk::DynamicLoader m_dynamicLoader;
 
@@ -45,6 +56,10 @@ class Context
     vk::UniqueDevice                 m_device;
     vk::PhysicalDevice               m_physicalDevice;
 
+    vk::PhysicalDeviceAccelerationStructurePropertiesKHR m_accelerationStructureProperties;
+    vk::PhysicalDeviceRayTracingPipelinePropertiesKHR    m_rayTracingPipelineProperties;
+    bool                                                 m_hostAccelerationStructureCommands = false;
+
     vk::Queue m_queue;
     vk::Queue m_transferQueue;
     vk::Queue m_computeQueue;
@@ -52,10 +67,14 @@ class Context
     std::uint32_t m_queueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
     std::uint32_t m_transferQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     std::uint32_t m_computeQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+
+    std::vector<std::uint32_t> m_queueFamilyIndices;
 };
 
 constexpr std::uint64_t DEFAULT_FENCE_TIMEOUT = 6e+10;
 void submitAndWait(const Context& context, vk::ArrayProxyNoTemporaries<const vk::CommandBuffer> commandBuffers, std::uint64_t timeout,
                    std::string_view description);
+void submitAndWait(const Context& context, const vk::Queue& queue, vk::ArrayProxyNoTemporaries<const vk::CommandBuffer> commandBuffers,
+                   std::uint64_t timeout, std::string_view description);
 
 } // namespace polar
\ No newline at end of file
@@ -0,0 +1,663 @@
+#include "geometry_residency.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+namespace polar
+{
+
+// Number of meshes that are made resident together during load():
+constexpr std::size_t LOAD_BATCH_SIZE = 64;
+
+template <typename T>
+static void
+writeArray(std::ofstream& file, const std::vector<T>& values)
+{
+    const std::uint64_t size = values.size();
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+static void
+readArray(std::ifstream& file, std::vector<T>& values)
+{
+    std::uint64_t size = 0;
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    values.resize(size);
+    file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+}
+
+static void
+memoryBarrier(const vk::CommandBuffer& commandBuffer, const vk::PipelineStageFlags srcStages, const vk::AccessFlags srcAccess,
+              const vk::PipelineStageFlags dstStages, const vk::AccessFlags dstAccess)
+{
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    commandBuffer.pipelineBarrier(srcStages, dstStages, {}, barrier, {}, {});
+}
+
+GeometryResidency::GeometryResidency(const Context& context, const GPUAllocator& allocator, const BlasBuilder& blasBuilder,
+                                     TlasManager& tlasManager, const Param& param)
+    : m_context(context), m_allocator(allocator), m_blasBuilder(blasBuilder), m_tlasManager(tlasManager), m_param(param)
+{
+    // Every instance gets its own file, so that neither concurrent processes nor several instances in one process overwrite each other's:
+    if (m_param.pageFile.empty())
+    {
+        std::random_device random;
+        const auto         suffix = (static_cast<std::uint64_t>(random()) << 32) | random();
+        m_param.pageFile          = std::filesystem::temp_directory_path() / fmt::format("polar_geometry_{:016x}.pages", suffix);
+    }
+}
+
+GeometryResidency::~GeometryResidency()
+{
+    std::error_code error;
+    std::filesystem::remove(m_param.pageFile, error);
+}
+
+//
+// Paging
+//
+
+void GeometryResidency::writePages(const std::vector<Mesh>& meshes)
+{
+    std::ofstream file(m_param.pageFile, std::ios::binary | std::ios::trunc);
+
+    m_meshes.resize(meshes.size());
+    for (std::size_t i = 0; i < meshes.size(); ++i)
+    {
+        const auto& mesh  = meshes[i];
+        auto&       paged = m_meshes[i];
+
+        paged.header = Mesh{
+            .name       = mesh.name,
+            .bounds     = mesh.bounds,
+            .buildHints = mesh.buildHints,
+        };
+        paged.pageOffset = static_cast<std::uint64_t>(file.tellp());
+
+        const std::uint64_t geometryCount = mesh.geometries.size();
+        file.write(reinterpret_cast<const char*>(&geometryCount), sizeof(geometryCount));
+
+        for (const auto& geometry : mesh.geometries)
+        {
+            const std::uint32_t values[] = {geometry.materialIndex, geometry.opaque};
+            file.write(reinterpret_cast<const char*>(values), sizeof(values));
+            file.write(reinterpret_cast<const char*>(&geometry.bounds), sizeof(geometry.bounds));
+
+            writeArray(file, geometry.positions);
+            writeArray(file, geometry.normals);
+            writeArray(file, geometry.texCoords);
+            writeArray(file, geometry.indices);
+        }
+    }
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::format("Failed to write geometry page file {}", m_param.pageFile.string()));
+    }
+
+    spdlog::info("Paged {} meshes ({} MiB) to {}.", meshes.size(), static_cast<std::uint64_t>(file.tellp()) >> 20, m_param.pageFile.string());
+}
+
+Mesh GeometryResidency::readMesh(const std::uint32_t meshIndex) const
+{
+    const auto& paged = m_meshes[meshIndex];
+
+    std::ifstream file(m_param.pageFile, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(paged.pageOffset));
+
+    auto mesh = paged.header;
+
+    std::uint64_t geometryCount = 0;
+    file.read(reinterpret_cast<char*>(&geometryCount), sizeof(geometryCount));
+
+    mesh.geometries.resize(geometryCount);
+    for (auto& geometry : mesh.geometries)
+    {
+        std::uint32_t values[2] = {};
+        file.read(reinterpret_cast<char*>(values), sizeof(values));
+        file.read(reinterpret_cast<char*>(&geometry.bounds), sizeof(geometry.bounds));
+
+        geometry.materialIndex = values[0];
+        geometry.opaque        = values[1] != 0;
+
+        readArray(file, geometry.positions);
+        readArray(file, geometry.normals);
+        readArray(file, geometry.texCoords);
+        readArray(file, geometry.indices);
+    }
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::format("Failed to read mesh {} from geometry page file {}", mesh.name, m_param.pageFile.string()));
+    }
+
+    return mesh;
+}
+
+//
+// Proxies
+//
+
+std::vector<GPUBufferUnique> GeometryResidency::buildProxies(const vk::CommandBuffer& commandBuffer)
+{
+    const auto& device = m_context.device();
+
+    std::vector<vk::AabbPositionsKHR> aabbs;
+    aabbs.reserve(m_meshes.size());
+    for (const auto& paged : m_meshes)
+    {
+        const auto& bounds = paged.header.bounds;
+        aabbs.emplace_back(vk::AabbPositionsKHR{
+            .minX = bounds.min.x,
+            .minY = bounds.min.y,
+            .minZ = bounds.min.z,
+            .maxX = bounds.max.x,
+            .maxY = bounds.max.y,
+            .maxZ = bounds.max.z,
+        });
+    }
+
+    // The AABB buffer (and the staging buffer it is copied from) only has to live until the builds have finished:
+    auto aabbBuffer = m_allocator.allocate(aabbs.size() * sizeof(vk::AabbPositionsKHR),
+                                           vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                               vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                                           VMA_MEMORY_USAGE_GPU_ONLY);
+    auto stagingBuffer = m_allocator.addCopyStagingToBuffer(commandBuffer, aabbBuffer, aabbs.data(), aabbs.size() * sizeof(vk::AabbPositionsKHR));
+
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+                  vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::AccessFlagBits::eAccelerationStructureReadKHR);
+
+    const auto aabbAddress = aabbBuffer.deviceAddress(m_context);
+
+    std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+    geometries.reserve(m_meshes.size());
+    for (std::size_t i = 0; i < m_meshes.size(); ++i)
+    {
+        geometries.emplace_back(vk::AccelerationStructureGeometryKHR{
+            .geometryType = vk::GeometryTypeKHR::eAabbs,
+            .geometry     = {.aabbs =
+                             vk::AccelerationStructureGeometryAabbsDataKHR{
+                                 .data   = {.deviceAddress = aabbAddress + i * sizeof(vk::AabbPositionsKHR)},
+                                 .stride = sizeof(vk::AabbPositionsKHR),
+                             }},
+            .flags        = vk::GeometryFlagBitsKHR::eOpaque,
+        });
+    }
+
+    // All proxies have the same size:
+    const auto buildFlags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastBuild;
+
+    const vk::AccelerationStructureBuildGeometryInfoKHR sizeInfo{
+        .type          = vk::AccelerationStructureTypeKHR::eBottomLevel,
+        .flags         = buildFlags,
+        .mode          = vk::BuildAccelerationStructureModeKHR::eBuild,
+        .geometryCount = 1,
+        .pGeometries   = geometries.data(),
+    };
+
+    const std::uint32_t primitiveCount = 1;
+    const auto sizes = device.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, sizeInfo, primitiveCount);
+
+    const vk::DeviceSize scratchAlignment = m_context.accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+    const auto           scratchSize      = alignUp(sizes.buildScratchSize, scratchAlignment);
+
+    auto scratchBuffer = m_allocator.allocate(scratchSize * m_meshes.size() + scratchAlignment,
+                                              vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                              VMA_MEMORY_USAGE_GPU_ONLY);
+    const auto scratchAddress = alignUp(scratchBuffer.deviceAddress(m_context), scratchAlignment);
+
+    const vk::AccelerationStructureBuildRangeInfoKHR range{
+        .primitiveCount  = primitiveCount,
+        .primitiveOffset = 0,
+        .firstVertex     = 0,
+        .transformOffset = 0,
+    };
+
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRanges;
+    buildInfos.reserve(m_meshes.size());
+    buildRanges.reserve(m_meshes.size());
+
+    for (std::size_t i = 0; i < m_meshes.size(); ++i)
+    {
+        auto& proxy = m_meshes[i].proxy;
+        proxy = createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eBottomLevel, sizes.accelerationStructureSize);
+
+        buildInfos.emplace_back(vk::AccelerationStructureBuildGeometryInfoKHR{
+            .type                     = vk::AccelerationStructureTypeKHR::eBottomLevel,
+            .flags                    = buildFlags,
+            .mode                     = vk::BuildAccelerationStructureModeKHR::eBuild,
+            .dstAccelerationStructure = *proxy.handle,
+            .geometryCount            = 1,
+            .pGeometries              = &geometries[i],
+            .scratchData              = {.deviceAddress = scratchAddress + i * scratchSize},
+        });
+        buildRanges.emplace_back(&range);
+    }
+
+    commandBuffer.buildAccelerationStructuresKHR(buildInfos, buildRanges);
+
+    std::vector<GPUBufferUnique> buffers;
+    buffers.emplace_back(std::move(aabbBuffer));
+    buffers.emplace_back(std::move(stagingBuffer));
+    buffers.emplace_back(std::move(scratchBuffer));
+
+    return buffers;
+}
+
+//
+// Residency
+//
+
+std::uint32_t GeometryResidency::selectedMesh(const std::uint32_t instanceIndex) const
+{
+    return m_lodSelector ? m_lodSelector->meshIndex(instanceIndex) : m_instances[instanceIndex].meshIndex;
+}
+
+TlasInstance GeometryResidency::tlasInstance(const std::uint32_t instanceIndex) const
+{
+    const auto& instance = m_instances[instanceIndex];
+    const auto& paged    = m_meshes[m_instanceMeshes[instanceIndex]];
+
+    return TlasInstance{
+        .blasAddress     = paged.resident() ? paged.blas.address : paged.proxy.address,
+        .bounds          = paged.header.bounds,
+        .transform       = instance.transform,
+        .customIndex     = instanceIndex,
+        .sbtRecordOffset = paged.resident() ? m_param.sbtRecordOffset : m_param.proxySbtRecordOffset,
+    };
+}
+
+void GeometryResidency::updateInstances(const std::uint32_t meshIndex)
+{
+    for (const auto instanceIndex : m_meshes[meshIndex].instances)
+    {
+        m_tlasManager.updateInstance(instanceIndex, tlasInstance(instanceIndex));
+    }
+}
+
+void GeometryResidency::updateSceneTable()
+{
+    if (!m_sceneTable || !m_feedbackBuffer)
+    {
+        return;
+    }
+
+    m_sceneTable->setFeedback(m_feedbackBuffer.deviceAddress(m_context));
+    for (std::uint32_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex)
+    {
+        m_sceneTable->setMesh(meshIndex, mesh(meshIndex));
+    }
+    for (std::uint32_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        m_sceneTable->setInstanceMesh(instanceIndex, m_instanceMeshes[instanceIndex]);
+    }
+}
+
+void GeometryResidency::request(const std::uint32_t meshIndex)
+{
+    auto& paged = m_meshes[meshIndex];
+    if (!paged.resident() && !paged.requested)
+    {
+        paged.requested = true;
+        m_requests.emplace_back(meshIndex);
+    }
+}
+
+void GeometryResidency::setLodSelector(const LodSelector* lodSelector)
+{
+    m_lodSelector = lodSelector;
+
+    std::vector<std::uint32_t> instanceIndices(m_instances.size());
+    std::iota(instanceIndices.begin(), instanceIndices.end(), 0u);
+    updateLods(instanceIndices);
+}
+
+void GeometryResidency::setSceneTable(SceneTable* sceneTable)
+{
+    m_sceneTable = sceneTable;
+    updateSceneTable();
+}
+
+void GeometryResidency::updateLods(const std::vector<std::uint32_t>& instanceIndices)
+{
+    for (const auto instanceIndex : instanceIndices)
+    {
+        const auto previous = m_instanceMeshes[instanceIndex];
+        const auto selected = selectedMesh(instanceIndex);
+        if (selected == previous)
+        {
+            continue;
+        }
+
+        std::erase(m_meshes[previous].instances, instanceIndex);
+        m_meshes[selected].instances.emplace_back(instanceIndex);
+        m_instanceMeshes[instanceIndex] = selected;
+
+        // Until the level is streamed in, the instance is represented by the proxy of that level, which would only request it once hit:
+        request(selected);
+        m_tlasManager.updateInstance(instanceIndex, tlasInstance(instanceIndex));
+        if (m_sceneTable)
+        {
+            m_sceneTable->setInstanceMesh(instanceIndex, selected);
+        }
+    }
+}
+
+void GeometryResidency::stream(const std::vector<std::uint32_t>& meshIndices, const std::uint64_t frameIndex)
+{
+    if (meshIndices.empty())
+    {
+        return;
+    }
+
+    std::vector<Mesh> meshes;
+    meshes.reserve(meshIndices.size());
+    for (const auto meshIndex : meshIndices)
+    {
+        meshes.emplace_back(readMesh(meshIndex));
+    }
+
+    auto gpuMeshes = uploadMeshes(m_context, m_allocator, meshes);
+    auto blases    = m_blasBuilder.build(gpuMeshes);
+
+    for (std::size_t i = 0; i < meshIndices.size(); ++i)
+    {
+        auto& paged = m_meshes[meshIndices[i]];
+
+        paged.gpuMesh   = std::move(gpuMeshes[i]);
+        paged.blas      = std::move(blases[i]);
+        paged.lastHit   = frameIndex;
+        paged.requested = false;
+
+        m_residentSize += paged.residentSize();
+        ++m_stats.residentMeshes;
+
+        updateInstances(meshIndices[i]);
+        if (m_sceneTable)
+        {
+            m_sceneTable->setMesh(meshIndices[i], &paged.gpuMesh);
+        }
+    }
+}
+
+void GeometryResidency::evict(const std::uint32_t meshIndex, const std::uint64_t frameIndex)
+{
+    auto& paged = m_meshes[meshIndex];
+
+    m_residentSize -= paged.residentSize();
+    --m_stats.residentMeshes;
+
+    m_retired.emplace_back(RetiredMesh{
+        .frameIndex = frameIndex,
+        .gpuMesh    = std::move(paged.gpuMesh),
+        .blas       = std::move(paged.blas),
+    });
+    paged.gpuMesh = {};
+    paged.blas    = {};
+
+    updateInstances(meshIndex);
+    if (m_sceneTable)
+    {
+        m_sceneTable->setMesh(meshIndex, nullptr);
+    }
+}
+
+void GeometryResidency::readFeedback(const std::uint64_t frameIndex)
+{
+    // The readback buffer of this frame was last written by the frame framesInFlight frames ago, which has finished by now (unless it
+    // hasn't been written since the last load()):
+    if (m_feedbackCopies < m_param.framesInFlight)
+    {
+        return;
+    }
+
+    const auto& readbackBuffer = m_readbackBuffers[frameIndex % m_readbackBuffers.size()];
+    const auto* feedback       = static_cast<const std::uint32_t*>(readbackBuffer.map());
+
+    for (std::uint32_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        if (feedback[instanceIndex] == 0)
+        {
+            continue;
+        }
+
+        const auto meshIndex = m_instanceMeshes[instanceIndex];
+
+        m_meshes[meshIndex].lastHit = frameIndex;
+        request(meshIndex);
+    }
+
+    readbackBuffer.unmap();
+}
+
+void GeometryResidency::recordFeedbackCopy(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    const auto traceStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+    const auto size        = m_instances.size() * sizeof(std::uint32_t);
+
+    memoryBarrier(commandBuffer, traceStages, vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer,
+                  vk::AccessFlagBits::eTransferRead);
+
+    commandBuffer.copyBuffer(*m_feedbackBuffer, *m_readbackBuffers[frameIndex % m_readbackBuffers.size()],
+                             vk::BufferCopy{.srcOffset = 0, .dstOffset = 0, .size = size});
+    ++m_feedbackCopies;
+
+    // readFeedback() maps the copy once the frame has finished:
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eHost,
+                  vk::AccessFlagBits::eHostRead);
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer,
+                  vk::AccessFlagBits::eTransferWrite);
+
+    commandBuffer.fillBuffer(*m_feedbackBuffer, 0, size, 0);
+
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, traceStages,
+                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+}
+
+void GeometryResidency::unload()
+{
+    // Frames in flight may still trace the BLAS and proxies, and write the feedback buffer:
+    for (auto& paged : m_meshes)
+    {
+        m_retired.emplace_back(RetiredMesh{
+            .frameIndex = m_frameIndex,
+            .gpuMesh    = std::move(paged.gpuMesh),
+            .blas       = std::move(paged.blas),
+            .proxy      = std::move(paged.proxy),
+        });
+    }
+
+    RetiredMesh retired{.frameIndex = m_frameIndex};
+    if (m_feedbackBuffer)
+    {
+        retired.buffers.emplace_back(std::move(m_feedbackBuffer));
+    }
+    for (auto& readbackBuffer : m_readbackBuffers)
+    {
+        retired.buffers.emplace_back(std::move(readbackBuffer));
+    }
+    m_retired.emplace_back(std::move(retired));
+
+    m_meshes.clear();
+    m_instances.clear();
+    m_instanceMeshes.clear();
+    m_readbackBuffers.clear();
+    m_requests.clear();
+    m_feedbackCopies = 0;
+    m_residentSize   = 0;
+    m_stats          = {};
+}
+
+void GeometryResidency::load(std::vector<Mesh> meshes, const std::vector<Instance>& instances)
+{
+    const auto& device = m_context.device();
+
+    unload();
+    writePages(meshes);
+    meshes.clear();
+
+    m_instances = instances;
+    m_instanceMeshes.resize(m_instances.size());
+    for (std::uint32_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        m_instanceMeshes[instanceIndex] = selectedMesh(instanceIndex);
+        m_meshes[m_instanceMeshes[instanceIndex]].instances.emplace_back(instanceIndex);
+    }
+
+    // Feedback buffers are never empty, so that they can always be bound:
+    const auto feedbackSize = std::max<std::size_t>(m_instances.size(), 1) * sizeof(std::uint32_t);
+
+    m_feedbackBuffer = m_allocator.allocate(feedbackSize,
+                                            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                                vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                                            VMA_MEMORY_USAGE_GPU_ONLY);
+
+    m_readbackBuffers.reserve(m_param.framesInFlight);
+    for (std::uint32_t i = 0; i < m_param.framesInFlight; ++i)
+    {
+        m_readbackBuffers.emplace_back(m_allocator.allocate(feedbackSize, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_CPU_ONLY));
+    }
+
+    {
+        const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+            .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+            .queueFamilyIndex = m_context.queueFamilyIndex(),
+        });
+
+        auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+            .commandPool        = *commandPool,
+            .level              = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1,
+        });
+        const auto& commandBuffer = *commandBuffers.front();
+
+        commandBuffer.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+        commandBuffer.fillBuffer(*m_feedbackBuffer, 0, feedbackSize, 0);
+        const auto temporaryBuffers = m_meshes.empty() ? std::vector<GPUBufferUnique>() : buildProxies(commandBuffer);
+
+        submitAndWait(m_context, commandBuffer, DEFAULT_FENCE_TIMEOUT, "geometry proxy build");
+    }
+
+    // All instances start out with their proxy, streaming then points them to their meshes:
+    std::vector<TlasInstance> tlasInstances;
+    tlasInstances.reserve(m_instances.size());
+    for (std::uint32_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        tlasInstances.emplace_back(tlasInstance(instanceIndex));
+    }
+    m_tlasManager.setInstances(tlasInstances);
+
+    // Start out with the instanced meshes that are most likely to be hit:
+    std::vector<std::uint32_t> order;
+    for (std::uint32_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex)
+    {
+        if (!m_meshes[meshIndex].instances.empty())
+        {
+            order.emplace_back(meshIndex);
+        }
+    }
+    std::ranges::stable_sort(order, std::greater{}, [&](const std::uint32_t meshIndex) { return m_meshes[meshIndex].header.buildHints.coverage; });
+
+    // The size of a mesh is only known once it is built, so the meshes of the batch that exceeded the budget are evicted again, starting
+    // with the least covered one:
+    for (std::size_t begin = 0; begin < order.size() && m_residentSize < m_param.budget; begin += LOAD_BATCH_SIZE)
+    {
+        const auto end = std::min(begin + LOAD_BATCH_SIZE, order.size());
+        stream(std::vector<std::uint32_t>(order.begin() + begin, order.begin() + end), m_frameIndex);
+
+        for (auto i = end; i > begin && m_residentSize > m_param.budget; --i)
+        {
+            evict(order[i - 1], m_frameIndex);
+        }
+    }
+
+    updateSceneTable();
+
+    spdlog::info("{} of {} meshes are resident ({} MiB).", m_stats.residentMeshes, m_meshes.size(), m_residentSize >> 20);
+}
+
+void GeometryResidency::update(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    m_frameIndex           = frameIndex;
+    m_stats.streamedMeshes = 0;
+    m_stats.evictedMeshes  = 0;
+
+    while (!m_retired.empty() && m_retired.front().frameIndex + m_param.framesInFlight <= frameIndex)
+    {
+        m_retired.pop_front();
+    }
+
+    readFeedback(frameIndex);
+
+    std::vector<std::uint32_t> streamed;
+    while (!m_requests.empty() && streamed.size() < m_param.streamsPerUpdate)
+    {
+        streamed.emplace_back(m_requests.front());
+        m_requests.pop_front();
+    }
+    stream(streamed, frameIndex);
+    m_stats.streamedMeshes = static_cast<std::uint32_t>(streamed.size());
+
+    std::vector<std::uint32_t> resident;
+    for (std::uint32_t meshIndex = 0; meshIndex < m_meshes.size(); ++meshIndex)
+    {
+        if (!m_meshes[meshIndex].resident())
+        {
+            continue;
+        }
+
+        if (m_meshes[meshIndex].lastHit + m_param.evictionFrames < frameIndex)
+        {
+            evict(meshIndex, frameIndex);
+            ++m_stats.evictedMeshes;
+        }
+        else
+        {
+            resident.emplace_back(meshIndex);
+        }
+    }
+
+    // Over budget, evict the least recently hit meshes (but never those that were just streamed in):
+    if (m_residentSize > m_param.budget)
+    {
+        std::ranges::stable_sort(resident, {}, [&](const std::uint32_t meshIndex) { return m_meshes[meshIndex].lastHit; });
+        for (const auto meshIndex : resident)
+        {
+            if (m_residentSize <= m_param.budget || m_meshes[meshIndex].lastHit == frameIndex)
+            {
+                break;
+            }
+
+            evict(meshIndex, frameIndex);
+            ++m_stats.evictedMeshes;
+        }
+    }
+
+    recordFeedbackCopy(commandBuffer, frameIndex);
+
+    m_stats.residentSize    = m_residentSize;
+    m_stats.pendingRequests = static_cast<std::uint32_t>(m_requests.size());
+}
+
+const GPUMesh* GeometryResidency::mesh(const std::uint32_t meshIndex) const
+{
+    const auto& paged = m_meshes[meshIndex];
+    return paged.resident() ? &paged.gpuMesh : nullptr;
+}
+
+} // namespace polar
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <vector>
+
+#include <acceleration_structure.hpp>
+#include <blas_builder.hpp>
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <lod_selector.hpp>
+#include <mesh_uploader.hpp>
+#include <scene.hpp>
+#include <scene_table.hpp>
+#include <tlas_manager.hpp>
+
+namespace polar
+{
+
+// Keeps only the geometry that is actually being hit on the GPU, for scenes whose meshes don't fit into device memory all at once.
+// All meshes are written to a page file on load. Meshes that aren't resident are represented in the TLAS by a proxy BLAS that holds a
+// single AABB around the mesh, so every instance is always part of the TLAS (with the same slot, transform and bounds).
+// Hit shaders report which instances they hit through the feedback buffer. Resident meshes none of whose instances were hit in the last
+// evictionFrames frames are evicted (as are the least recently hit ones if the budget is exceeded), and proxy hits stream the mesh back
+// in from the page file.
+// Owns all instances of the TLAS manager, whose slots are the instance indices of the scene. With a LodSelector, every instance uses the
+// mesh of its selected level of detail, and each level is resident (or represented by its own proxy) independently of the others.
+class GeometryResidency
+{
+  public:
+    struct Param
+    {
+        // Meshes none of whose instances were hit in this many frames are evicted.
+        std::uint32_t evictionFrames = 120;
+
+        // Device memory for the vertex data and BLAS of resident meshes. The least recently hit meshes are evicted to stay below it.
+        vk::DeviceSize budget = 2ull << 30;
+
+        // Upper bound on the number of meshes that are streamed in by a single update(), as it blocks until they are built.
+        std::uint32_t streamsPerUpdate = 8;
+
+        // Number of frames that may still use an evicted mesh, or still write the feedback of a frame.
+        std::uint32_t framesInFlight = 2;
+
+        // Shader binding table offsets of the instances of resident meshes and of proxies. The intersection shader of the proxy hit
+        // group has to write the feedback (and usually reports no hit).
+        std::uint32_t sbtRecordOffset      = 0;
+        std::uint32_t proxySbtRecordOffset = 1;
+
+        // Where the geometry is paged to, a uniquely named file in the temporary directory if empty. The file is deleted again on
+        // destruction.
+        std::filesystem::path pageFile;
+    };
+
+    // What the last update() did.
+    struct Stats
+    {
+        std::uint32_t  residentMeshes  = 0;
+        vk::DeviceSize residentSize    = 0;
+        std::uint32_t  streamedMeshes  = 0;
+        std::uint32_t  evictedMeshes   = 0;
+        std::uint32_t  pendingRequests = 0;
+    };
+
+    GeometryResidency(const Context& context, const GPUAllocator& allocator, const BlasBuilder& blasBuilder, TlasManager& tlasManager,
+                      const Param& param);
+    ~GeometryResidency();
+
+    GeometryResidency(const GeometryResidency&)            = delete;
+    GeometryResidency(GeometryResidency&&)                 = delete;
+    GeometryResidency& operator=(const GeometryResidency&) = delete;
+    GeometryResidency& operator=(GeometryResidency&&)      = delete;
+
+    // Pages out all meshes, builds their proxies and makes the instanced meshes with the largest coverage resident as far as the budget
+    // allows. Meshes that no instance uses (e.g. levels of detail that aren't selected) are only streamed in once an instance does.
+    // Loading another scene replaces everything of the previous one, whose meshes, proxies and feedback buffers are kept alive for
+    // framesInFlight frames. The LOD selector and the scene table have to be those of the new scene by then (or nullptr).
+    void load(std::vector<Mesh> meshes, const std::vector<Instance>& instances);
+
+    // Resolves the mesh of every instance through the selector (or uses the mesh of the instance if nullptr), which has to have the same
+    // instances. Whenever LodSelector::update() returns instances, they have to be passed to updateLods() before the next update().
+    void setLodSelector(const LodSelector* lodSelector);
+    void updateLods(const std::vector<std::uint32_t>& instanceIndices);
+
+    // Keeps the vertex data of the meshes and the selected mesh of every instance in the scene table up to date (and points it at the
+    // feedback buffer), so that the kernels that ship with the integrators see the same geometry as the TLAS. Pass nullptr to stop.
+    void setSceneTable(SceneTable* sceneTable);
+
+    // Processes the feedback of the frame that last finished, streams in requested meshes, evicts unused ones and points the affected
+    // TLAS instances at their new BLAS. Has to be called before the TLAS manager's update() and before tracing, which is when the feedback
+    // of the previous frame is read back and cleared.
+    void update(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    // Returns nullptr if the mesh isn't resident.
+    const GPUMesh* mesh(std::uint32_t meshIndex) const;
+
+    // One std::uint32_t per instance (indexed by the custom index of the TLAS instance), which hit shaders set to a non-zero value.
+    const GPUBufferUnique& feedbackBuffer() const { return m_feedbackBuffer; }
+
+    const Stats& stats() const { return m_stats; }
+
+  private:
+    struct PagedMesh
+    {
+        Mesh                       header;         // Everything but the geometries
+        std::uint64_t              pageOffset = 0; // Of the geometries in the page file
+        std::vector<std::uint32_t> instances;      // That currently select this mesh
+
+        GPUMesh               gpuMesh;
+        AccelerationStructure blas;
+        AccelerationStructure proxy;
+
+        std::uint64_t lastHit   = 0; // Frame index
+        bool          requested = false;
+
+        bool           resident()     const { return static_cast<bool>(blas);  }
+        vk::DeviceSize residentSize() const { return gpuMesh.size + blas.size; }
+    };
+
+    // Freed once the GPU can't be using them anymore, an evicted mesh or what a load() replaced:
+    struct RetiredMesh
+    {
+        std::uint64_t                frameIndex = 0;
+        GPUMesh                      gpuMesh;
+        AccelerationStructure        blas;
+        AccelerationStructure        proxy;
+        std::vector<GPUBufferUnique> buffers; // Feedback and readback buffers
+    };
+
+    void writePages(const std::vector<Mesh>& meshes);
+    Mesh readMesh(std::uint32_t meshIndex) const;
+
+    // Returns the temporary buffers of the builds, which have to be kept alive until the command buffer has finished.
+    std::vector<GPUBufferUnique> buildProxies(const vk::CommandBuffer& commandBuffer);
+
+    // The mesh the instance currently uses, i.e. its selected level of detail:
+    std::uint32_t selectedMesh(std::uint32_t instanceIndex) const;
+
+    TlasInstance tlasInstance(std::uint32_t instanceIndex) const;
+    void         updateInstances(std::uint32_t meshIndex);
+    void         updateSceneTable();
+    void         request(std::uint32_t meshIndex);
+
+    void stream(const std::vector<std::uint32_t>& meshIndices, std::uint64_t frameIndex);
+    void evict(std::uint32_t meshIndex, std::uint64_t frameIndex);
+
+    void readFeedback(std::uint64_t frameIndex);
+    void recordFeedbackCopy(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    // Retires everything of the scene of the last load():
+    void unload();
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    const BlasBuilder&  m_blasBuilder;
+    TlasManager&        m_tlasManager;
+    Param               m_param;
+
+    std::vector<PagedMesh>     m_meshes;
+    std::vector<Instance>      m_instances;
+    std::vector<std::uint32_t> m_instanceMeshes; // Selected mesh per instance, which lists the instance in PagedMesh::instances
+    const LodSelector*         m_lodSelector = nullptr;
+    SceneTable*                m_sceneTable  = nullptr;
+
+    GPUBufferUnique              m_feedbackBuffer;
+    std::vector<GPUBufferUnique> m_readbackBuffers;    // One per frame in flight
+    std::uint64_t                m_feedbackCopies = 0; // Recorded since the last load()
+
+    std::deque<std::uint32_t> m_requests; // Mesh indices
+    std::deque<RetiredMesh>   m_retired;
+    vk::DeviceSize            m_residentSize = 0;
+    std::uint64_t             m_frameIndex   = 0; // Of the last update()
+    Stats                     m_stats;
+};
+
+} // namespace polar
@@ -1,11 +1,14 @@
 #include "gpu_allocator.hpp"
 
+#include <algorithm>
+
 #include <util.hpp>
 
 namespace polar
 {
 
-GPUBufferUnique::GPUBufferUnique(const vk::Buffer& buffer, const VmaAllocation allocation) : m_buffer(buffer), m_allocation(allocation)
+GPUBufferUnique::GPUBufferUnique(const vk::Buffer& buffer, const VmaAllocation allocation, const VmaAllocator allocator)
+    : m_buffer(buffer), m_allocation(allocation), m_allocator(allocator)
 {
 }
 
@@ -18,6 +21,7 @@ GPUBufferUnique::GPUBufferUnique(GPUBufferUnique&& other)
 
     m_buffer       = other.m_buffer;
     m_allocation   = other.m_allocation;
+    m_allocator    = other.m_allocator;
     other.m_buffer = VK_NULL_HANDLE;
 }
 
@@ -29,7 +33,7 @@ GPUBufferUnique ::~GPUBufferUnique()
     }
 }
 
-GPUBufferUnique& prism::GPUBufferUnique::operator=(GPUBufferUnique&& other)
+GPUBufferUnique& GPUBufferUnique::operator=(GPUBufferUnique&& other)
 {
     if (this == &other)
     {
@@ -44,6 +48,7 @@ GPUBufferUnique& prism::GPUBufferUnique::operator=(GPUBufferUnique&& other)
 
     m_buffer       = other.m_buffer;
     m_allocation   = other.m_allocation;
+    m_allocator    = other.m_allocator;
     other.m_buffer = VK_NULL_HANDLE;
 
     return *this;
@@ -86,6 +91,73 @@ void GPUBufferUnique::unmap() const
     vmaUnmapMemory(m_allocator, m_allocation);
 }
 
+GPUImageUnique::GPUImageUnique(const vk::Image& image, const VmaAllocation allocation, const VmaAllocator allocator)
+    : m_image(image), m_allocation(allocation), m_allocator(allocator)
+{
+}
+
+GPUImageUnique::GPUImageUnique(GPUImageUnique&& other)
+{
+    if (this == &other)
+    {
+        return;
+    }
+
+    m_image       = other.m_image;
+    m_allocation  = other.m_allocation;
+    m_allocator   = other.m_allocator;
+    other.m_image = VK_NULL_HANDLE;
+}
+
+GPUImageUnique::~GPUImageUnique()
+{
+    if (m_image)
+    {
+        vmaDestroyImage(m_allocator, m_image, m_allocation);
+    }
+}
+
+GPUImageUnique& GPUImageUnique::operator=(GPUImageUnique&& other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    // Free current memory first (if present):
+    if (m_image)
+    {
+        vmaDestroyImage(m_allocator, m_image, m_allocation);
+    }
+
+    m_image       = other.m_image;
+    m_allocation  = other.m_allocation;
+    m_allocator   = other.m_allocator;
+    other.m_image = VK_NULL_HANDLE;
+
+    return *this;
+}
+
+const vk::Image* GPUImageUnique::operator->() const
+{
+    return &m_image;
+}
+
+const vk::Image& GPUImageUnique::operator*() const
+{
+    return m_image;
+}
+
+const vk::Image& GPUImageUnique::get() const
+{
+    return m_image;
+}
+
+GPUImageUnique::operator bool() const
+{
+    return m_image;
+}
+
 GPUAllocator::GPUAllocator(const Context& context)
 {
     // We want to use the functions loaded from the dynamic dispatcher. I'm not a big fan of this implementation, I need
@@ -146,7 +218,20 @@ GPUBufferUnique GPUAllocator::allocate(const vk::DeviceSize size, const vk::Buff
     VK_CALL(
         vmaCreateBuffer(m_allocator.get(), &static_cast<VkBufferCreateInfo>(bufferCreateInfo), &allocationCreateInfo, &buffer, &allocation, nullptr));
 
-    return GPUBufferUnique(buffer, allocation);
+    return GPUBufferUnique(buffer, allocation, m_allocator.get());
+}
+
+GPUImageUnique GPUAllocator::allocateImage(const vk::ImageCreateInfo& imageCreateInfo, const VmaMemoryUsage memoryUsage) const
+{
+    VmaAllocationCreateInfo allocationCreateInfo{};
+    allocationCreateInfo.usage = memoryUsage;
+
+    VkImage       image{};
+    VmaAllocation allocation{};
+    VK_CALL(
+        vmaCreateImage(m_allocator.get(), &static_cast<const VkImageCreateInfo&>(imageCreateInfo), &allocationCreateInfo, &image, &allocation, nullptr));
+
+    return GPUImageUnique(image, allocation, m_allocator.get());
 }
 
 GPUBufferUnique GPUAllocator::addCopyStagingToBuffer(const vk::CommandBuffer& commandBuffer, const GPUBufferUnique& dstBuffer, void* const data,
@@ -162,4 +247,79 @@ GPUBufferUnique GPUAllocator::addCopyStagingToBuffer(const vk::CommandBuffer& co
     return stagingBuffer;
 }
 
+StagingUploader::StagingUploader(const GPUAllocator& allocator, const std::uint32_t framesInFlight) : m_allocator(allocator)
+{
+    m_stagingBuffers.resize(std::max(framesInFlight, 1u));
+    m_stagingSizes.resize(m_stagingBuffers.size(), 0);
+}
+
+void StagingUploader::add(const void* const data, const vk::DeviceSize size, const vk::DeviceSize offset)
+{
+    if (size > 0)
+    {
+        m_ranges.emplace_back(Range{.data = data, .size = size, .offset = offset});
+    }
+}
+
+void StagingUploader::upload(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex, const vk::Buffer& dstBuffer,
+                             const vk::PipelineStageFlags readerStages)
+{
+    if (m_ranges.empty())
+    {
+        return;
+    }
+
+    vk::DeviceSize uploadSize = 0;
+    for (const auto& range : m_ranges)
+    {
+        uploadSize += range.size;
+    }
+
+    const auto slot = static_cast<std::size_t>(frameIndex % m_stagingBuffers.size());
+    if (m_stagingSizes[slot] < uploadSize)
+    {
+        m_stagingBuffers[slot] = m_allocator.allocate(uploadSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+        m_stagingSizes[slot]   = uploadSize;
+    }
+
+    std::vector<vk::BufferCopy> regions;
+    regions.reserve(m_ranges.size());
+
+    vk::DeviceSize stagingOffset = 0;
+    const auto     stagingData   = static_cast<std::byte*>(m_stagingBuffers[slot].map());
+    for (const auto& range : m_ranges)
+    {
+        std::memcpy(stagingData + stagingOffset, range.data, range.size);
+        regions.emplace_back(vk::BufferCopy{
+            .srcOffset = stagingOffset,
+            .dstOffset = range.offset,
+            .size      = range.size,
+        });
+        stagingOffset += range.size;
+    }
+    m_stagingBuffers[slot].unmap();
+    m_ranges.clear();
+
+    // The previous frame may still be reading the buffer:
+    if (readerStages)
+    {
+        const vk::MemoryBarrier beforeUpload{
+            .srcAccessMask = vk::AccessFlagBits::eShaderRead,
+            .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+        };
+        commandBuffer.pipelineBarrier(readerStages, vk::PipelineStageFlagBits::eTransfer, {}, beforeUpload, {}, {});
+    }
+
+    commandBuffer.copyBuffer(*m_stagingBuffers[slot], dstBuffer, regions);
+
+    if (readerStages)
+    {
+        const vk::MemoryBarrier afterUpload{
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readerStages, {}, afterUpload, {}, {});
+    }
+}
+
 } // namespace polar
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include <vk_mem_alloc.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <vector>
 
 #include <context.hpp>
 #include <util.hpp>
@@ -15,7 +17,7 @@ class GPUBufferUnique
 {
   public:
     GPUBufferUnique() = default;
-    GPUBufferUnique(const vk::Buffer& buffer, VmaAllocation allocation);
+    GPUBufferUnique(const vk::Buffer& buffer, VmaAllocation allocation, VmaAllocator allocator);
     GPUBufferUnique(GPUBufferUnique&& buffer);
     ~GPUBufferUnique();
 
@@ -40,6 +42,31 @@ class GPUBufferUnique
     VmaAllocator  m_allocator  = nullptr;
 };
 
+class GPUImageUnique
+{
+  public:
+    GPUImageUnique() = default;
+    GPUImageUnique(const vk::Image& image, VmaAllocation allocation, VmaAllocator allocator);
+    GPUImageUnique(GPUImageUnique&& image);
+    ~GPUImageUnique();
+
+    GPUImageUnique& operator=(GPUImageUnique&& other);
+
+    const vk::Image* operator->() const;
+    const vk::Image& operator*() const;
+    const vk::Image& get() const;
+
+    operator bool() const;
+
+    GPUImageUnique(const GPUImageUnique&) = delete;
+    GPUImageUnique& operator=(const GPUImageUnique&) = delete;
+
+  private:
+    vk::Image     m_image      = {};
+    VmaAllocation m_allocation = nullptr;
+    VmaAllocator  m_allocator  = nullptr;
+};
+
 class GPUAllocator
 {
   public:
@@ -51,6 +78,7 @@ class GPUAllocator
     GPUAllocator& operator=(GPUAllocator&&) = delete;
 
     GPUBufferUnique allocate(vk::DeviceSize size, vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage) const;
+    GPUImageUnique  allocateImage(const vk::ImageCreateInfo& imageCreateInfo, VmaMemoryUsage memoryUsage) const;
 
     // Adds copy operation by allocating a host staging buffer, copying data to it, and then adding the command that copies data from this
     // staging buffer to the destination buffer. Note that the staging buffer gets returned.
@@ -62,4 +90,71 @@ class GPUAllocator
     UniqueVmaAllocator m_allocator = {};
 };
 
+// Uploads the parts of host arrays that changed into a device buffer, through a staging buffer per frame in flight that grows as needed.
+// Ranges are added for the next upload(), which copies them into the staging buffer of the frame with a single vkCmdCopyBuffer.
+class StagingUploader
+{
+  public:
+    // The staging buffer of a frame is reused framesInFlight frames later.
+    StagingUploader(const GPUAllocator& allocator, std::uint32_t framesInFlight);
+
+    StagingUploader(const StagingUploader&)            = delete;
+    StagingUploader(StagingUploader&&)                 = delete;
+    StagingUploader& operator=(const StagingUploader&) = delete;
+    StagingUploader& operator=(StagingUploader&&)      = delete;
+
+    // The data has to stay unchanged until upload(). Empty ranges are ignored.
+    void add(const void* data, vk::DeviceSize size, vk::DeviceSize offset);
+
+    // Adds every run of consecutive dirty values (with values starting at offset in the buffer) as a single range and clears their
+    // flags. Returns the number of dirty values.
+    template <typename T>
+    std::uint32_t addDirty(std::vector<bool>& dirty, const std::vector<T>& values, vk::DeviceSize offset);
+
+    bool empty() const { return m_ranges.empty(); }
+
+    // Records the copies of the added ranges into dstBuffer and clears them. With readerStages, the copies wait for the shader reads of
+    // earlier frames in those stages and are made visible to the shader reads that follow.
+    void upload(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex, const vk::Buffer& dstBuffer,
+                vk::PipelineStageFlags readerStages = {});
+
+  private:
+    struct Range
+    {
+        const void*    data   = nullptr;
+        vk::DeviceSize size   = 0;
+        vk::DeviceSize offset = 0;
+    };
+
+    const GPUAllocator& m_allocator;
+
+    std::vector<Range>           m_ranges;
+    std::vector<GPUBufferUnique> m_stagingBuffers; // One per frame in flight
+    std::vector<vk::DeviceSize>  m_stagingSizes;
+};
+
+template <typename T>
+std::uint32_t StagingUploader::addDirty(std::vector<bool>& dirty, const std::vector<T>& values, const vk::DeviceSize offset)
+{
+    std::uint32_t count = 0;
+    for (std::size_t begin = 0; begin < values.size();)
+    {
+        if (!dirty[begin])
+        {
+            ++begin;
+            continue;
+        }
+
+        auto end = begin;
+        while (end < values.size() && dirty[end])
+        {
+            dirty[end++] = false;
+        }
+        add(values.data() + begin, (end - begin) * sizeof(T), offset + begin * sizeof(T));
+        count += static_cast<std::uint32_t>(end - begin);
+        begin = end;
+    }
+    return count;
+}
+
 } // namespace polar
\ No newline at end of file
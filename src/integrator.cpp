@@ -0,0 +1,460 @@
+#include "integrator.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#include <configure.hpp>
+
+namespace polar
+{
+
+static const char*
+typeName(const IntegratorType type)
+{
+    switch (type)
+    {
+    case IntegratorType::eMegakernel:
+        return "Megakernel";
+    case IntegratorType::eWavefront:
+        return "Wavefront";
+    }
+    return "Unknown";
+}
+
+static vk::UniquePipelineLayout
+createPipelineLayout(const Context& context, const std::vector<vk::DescriptorSetLayout>& setLayouts)
+{
+    const vk::PushConstantRange pushConstantRange{
+        .stageFlags = vk::ShaderStageFlagBits::eAll,
+        .offset     = 0,
+        .size       = sizeof(IntegratorConstants),
+    };
+
+    return context.device().createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+        .setLayoutCount         = static_cast<std::uint32_t>(setLayouts.size()),
+        .pSetLayouts            = setLayouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange,
+    });
+}
+
+static WavefrontIntegrator::Param
+wavefrontParam(const Integrator::Param& param)
+{
+    auto wavefront           = param.wavefront;
+    wavefront.framesInFlight = param.framesInFlight;
+    wavefront.maxPathLength  = param.maxPathLength;
+    return wavefront;
+}
+
+static RestirDI::Param
+restirParam(const Integrator::Param& param)
+{
+    auto restir          = param.restir;
+    restir.workgroupSize = param.wavefront.workgroupSize;
+    return restir;
+}
+
+static void
+memoryBarrier(const vk::CommandBuffer& commandBuffer, const vk::PipelineStageFlags srcStages, const vk::AccessFlags srcAccess,
+              const vk::PipelineStageFlags dstStages, const vk::AccessFlags dstAccess)
+{
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    commandBuffer.pipelineBarrier(srcStages, dstStages, {}, barrier, {}, {});
+}
+
+// Stages and accesses of both integrators:
+constexpr auto RENDER_STAGES = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+constexpr auto RENDER_ACCESS = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+Integrator::Integrator(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param), m_pipelineLayout(createPipelineLayout(context, param.setLayouts)),
+      m_wavefront(context, allocator, compiler, *m_pipelineLayout, wavefrontParam(param)),
+      m_restir(context, allocator, compiler, *m_pipelineLayout, restirParam(param))
+{
+    const auto& device = m_context.device();
+
+    m_timestampPool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo{
+        .queryType  = vk::QueryType::eTimestamp,
+        .queryCount = 2 * m_param.framesInFlight,
+    });
+    m_pendingFrames.resize(m_param.framesInFlight);
+    m_timestampPeriod = m_context.physicalDevice().getProperties().limits.timestampPeriod;
+
+    m_readbackBuffer = m_allocator.allocate(m_param.framesInFlight * sizeof(std::uint32_t), vk::BufferUsageFlagBits::eTransferDst,
+                                            VMA_MEMORY_USAGE_CPU_ONLY);
+
+    const ShaderSource convergeSource{
+        .path  = std::filesystem::path(SHADER_DIRECTORY) / "converge.comp",
+        .stage = vk::ShaderStageFlagBits::eCompute,
+    };
+    const auto convergeModule = compiler.createModules(device, {&convergeSource, 1});
+
+    // The list of active pixels is dispatched over by the wavefront kernels, so it is compacted in workgroups of their size:
+    const vk::SpecializationMapEntry mapEntry{.constantID = 0, .offset = 0, .size = sizeof(std::uint32_t)};
+    const vk::SpecializationInfo specializationInfo{
+        .mapEntryCount = 1,
+        .pMapEntries   = &mapEntry,
+        .dataSize      = sizeof(std::uint32_t),
+        .pData         = &m_param.wavefront.workgroupSize,
+    };
+
+    const vk::ComputePipelineCreateInfo pipelineCreateInfo{
+        .stage =
+            vk::PipelineShaderStageCreateInfo{
+                .stage               = vk::ShaderStageFlagBits::eCompute,
+                .module              = *convergeModule.front(),
+                .pName               = "main",
+                .pSpecializationInfo = &specializationInfo,
+            },
+        .layout = *m_pipelineLayout,
+    };
+    m_convergePipeline = device.createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+}
+
+Integrator::MegakernelGroups Integrator::megakernelGroups()
+{
+    const auto shader = [](const char* name, const vk::ShaderStageFlagBits stage) {
+        return ShaderSource{
+            .path  = std::filesystem::path(SHADER_DIRECTORY) / "megakernel" / name,
+            .stage = stage,
+        };
+    };
+
+    return MegakernelGroups{
+        .raygen   = ShaderGroup{.shaders = {shader("raygen.rgen", vk::ShaderStageFlagBits::eRaygenKHR)}},
+        .miss     = ShaderGroup{.shaders = {shader("miss.rmiss", vk::ShaderStageFlagBits::eMissKHR)}},
+        .hit      = ShaderGroup{.shaders = {shader("closest_hit.rchit", vk::ShaderStageFlagBits::eClosestHitKHR),
+                                            shader("any_hit.rahit", vk::ShaderStageFlagBits::eAnyHitKHR)}},
+        .proxyHit = ShaderGroup{.shaders = {shader("proxy.rint", vk::ShaderStageFlagBits::eIntersectionKHR)}},
+    };
+}
+
+void Integrator::setType(const IntegratorType type)
+{
+    if (type == m_param.type)
+    {
+        return;
+    }
+
+    m_param.type = type;
+    spdlog::info("Switched to the {} integrator.", typeName(type));
+
+    // Only the wavefront integrator needs its queues:
+    m_wavefront.resize(type == IntegratorType::eWavefront ? m_reservedPixels : 0);
+}
+
+void Integrator::setSortRays(const bool sortRays)
+{
+    m_wavefront.setSortRays(sortRays);
+}
+
+void Integrator::setAdaptive(const AdaptiveParam& adaptive)
+{
+    m_param.adaptive = adaptive;
+}
+
+void Integrator::setMaterials(const Scene& scene)
+{
+    m_wavefront.setMaterials(scene);
+    reset();
+}
+
+void Integrator::resize(const glm::uvec2& extent)
+{
+    if (extent == m_target.extent)
+    {
+        return;
+    }
+
+    m_target             = createTarget(extent.x * extent.y);
+    m_target.imageExtent = extent;
+    m_target.extent      = extent;
+    reset(m_target);
+    reserve(extent.x * extent.y);
+}
+
+void Integrator::reserve(const std::uint32_t pixelCount)
+{
+    m_reservedPixels = pixelCount;
+    m_wavefront.resize(m_param.type == IntegratorType::eWavefront ? pixelCount : 0);
+}
+
+void Integrator::reset(RenderTarget& target)
+{
+    target.sampleIndex      = 0;
+    target.activePixelCount = target.extent.x * target.extent.y;
+    target.clear            = true;
+}
+
+RenderTarget Integrator::createTarget(const std::uint32_t capacity) const
+{
+    const auto usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                       vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+
+    RenderTarget target;
+    target.capacity     = capacity;
+    target.accumulation = m_allocator.allocate(capacity * 4 * sizeof(float), usage, VMA_MEMORY_USAGE_GPU_ONLY);
+    target.moments      = m_allocator.allocate(capacity * sizeof(float), usage, VMA_MEMORY_USAGE_GPU_ONLY);
+    target.activePixels = m_allocator.allocate(sizeof(ActivePixelsHeader) + capacity * sizeof(std::uint32_t),
+                                               usage | vk::BufferUsageFlagBits::eIndirectBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+    return target;
+}
+
+void Integrator::readResults(const std::uint32_t slot)
+{
+    auto pending = std::exchange(m_pendingFrames[slot], PendingFrame{});
+    if (!pending.target)
+    {
+        return;
+    }
+
+    auto& target = *pending.target;
+    if (pending.adaptive)
+    {
+        target.activePixelCount = static_cast<const std::uint32_t*>(m_readbackBuffer.map())[slot];
+        m_readbackBuffer.unmap();
+    }
+    else
+    {
+        target.activePixelCount = target.extent.x * target.extent.y;
+    }
+
+    // The frame finished framesInFlight frames ago, so the results should be available without waiting:
+    const auto timestamps = m_context.device().getQueryPoolResults<std::uint64_t>(*m_timestampPool, slot * 2, 2, 2 * sizeof(std::uint64_t),
+                                                                                  sizeof(std::uint64_t), vk::QueryResultFlagBits::e64);
+    if (timestamps.result != vk::Result::eSuccess)
+    {
+        spdlog::warn("Failed to query integrator timestamps: {}", vk::to_string(timestamps.result));
+        return;
+    }
+
+    auto& stats = m_stats[static_cast<std::size_t>(pending.type)];
+    stats.frames += 1;
+    stats.samples += static_cast<std::uint64_t>(target.activePixelCount) * pending.samplesPerPixel;
+    stats.milliseconds += (timestamps.value[1] - timestamps.value[0]) * m_timestampPeriod * 1e-6;
+}
+
+bool Integrator::recordConvergence(const vk::CommandBuffer& commandBuffer, const RenderTarget& target, IntegratorConstants& constants,
+                                   const std::uint32_t slot)
+{
+    // Pixels with too few samples can't have converged, so the list isn't built until all of them have enough:
+    if (!m_param.adaptive.enable || target.sampleIndex < std::max(m_param.adaptive.minSamples, 2u))
+    {
+        return false;
+    }
+
+    constants.adaptive       = 1;
+    constants.errorThreshold = m_param.adaptive.errorThreshold;
+    constants.minSamples     = m_param.adaptive.minSamples;
+
+    // The previous frame may still be reading the list:
+    const ActivePixelsHeader header{};
+    memoryBarrier(commandBuffer, RENDER_STAGES | vk::PipelineStageFlagBits::eDrawIndirect,
+                  RENDER_ACCESS | vk::AccessFlagBits::eIndirectCommandRead, vk::PipelineStageFlagBits::eTransfer,
+                  vk::AccessFlagBits::eTransferWrite);
+    commandBuffer.updateBuffer(*target.activePixels, 0, sizeof(header), &header);
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+                  vk::PipelineStageFlagBits::eComputeShader, RENDER_ACCESS);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *m_convergePipeline);
+    commandBuffer.pushConstants(*m_pipelineLayout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+    commandBuffer.dispatch((target.extent.x * target.extent.y + m_param.wavefront.workgroupSize - 1) / m_param.wavefront.workgroupSize, 1, 1);
+
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite,
+                  RENDER_STAGES | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer,
+                  RENDER_ACCESS | vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead);
+
+    const vk::BufferCopy region{
+        .srcOffset = offsetof(ActivePixelsHeader, pixels) + offsetof(QueueHeader, count),
+        .dstOffset = slot * sizeof(std::uint32_t),
+        .size      = sizeof(std::uint32_t),
+    };
+    commandBuffer.copyBuffer(*target.activePixels, *m_readbackBuffer, region);
+
+    return true;
+}
+
+void Integrator::render(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex, RenderTarget& target,
+                        const RayTracingPipeline& pipeline, const SbtBuilder& sbt, std::span<const vk::DescriptorSet> descriptorSets)
+{
+    if (target.extent.x * target.extent.y > target.capacity || target.extent.x * target.extent.y == 0)
+    {
+        throw std::runtime_error(fmt::format("Render target of {} pixels can't render a region of {}x{} pixels", target.capacity,
+                                             target.extent.x, target.extent.y));
+    }
+
+    const auto slot = static_cast<std::uint32_t>(frameIndex % m_param.framesInFlight);
+    readResults(slot);
+
+    // The pipeline may still be building in the background:
+    if (m_param.type == IntegratorType::eMegakernel && !pipeline.pipeline())
+    {
+        return;
+    }
+
+    if (target.clear)
+    {
+        commandBuffer.fillBuffer(*target.accumulation, 0, VK_WHOLE_SIZE, 0);
+        commandBuffer.fillBuffer(*target.moments, 0, VK_WHOLE_SIZE, 0);
+        memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, RENDER_STAGES, RENDER_ACCESS);
+        target.clear = false;
+    }
+
+    IntegratorConstants constants{
+        .accumulation  = target.accumulation.deviceAddress(m_context),
+        .moments       = target.moments.deviceAddress(m_context),
+        .activePixels  = target.activePixels.deviceAddress(m_context),
+        .lightTree     = m_lightTree,
+        .scene         = m_scene,
+        .extent        = target.extent,
+        .imageOffset   = target.offset,
+        .imageExtent   = target.imageExtent,
+        .frameIndex    = static_cast<std::uint32_t>(frameIndex),
+        .sampleIndex   = target.sampleIndex,
+        .sampleCount   = m_param.samplesPerFrame,
+        .maxPathLength = m_param.maxPathLength,
+    };
+
+    commandBuffer.resetQueryPool(*m_timestampPool, slot * 2, 2);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *m_timestampPool, slot * 2);
+
+    const bool adaptive = recordConvergence(commandBuffer, target, constants, slot);
+
+    // Picks the light sample of every pixel for the first sample, see restirLightSample():
+    if (m_restir.enabled() && m_lightTree)
+    {
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *m_pipelineLayout, 0, descriptorSets, {});
+        m_restir.render(commandBuffer, constants, target.restir, target.capacity);
+    }
+
+    if (m_param.type == IntegratorType::eMegakernel)
+    {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, pipeline.pipeline());
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *m_pipelineLayout, 0, descriptorSets, {});
+        commandBuffer.pushConstants(*m_pipelineLayout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+
+        const auto& miss     = sbt.region(SbtBuilder::Region::eMiss);
+        const auto& hit      = sbt.region(SbtBuilder::Region::eHit);
+        const auto& callable = sbt.region(SbtBuilder::Region::eCallable);
+        if (adaptive)
+        {
+            commandBuffer.traceRaysIndirectKHR(sbt.raygenRegion(), miss, hit, callable,
+                                               constants.activePixels + offsetof(ActivePixelsHeader, width));
+        }
+        else
+        {
+            commandBuffer.traceRaysKHR(sbt.raygenRegion(), miss, hit, callable, target.extent.x, target.extent.y, 1);
+        }
+    }
+    else
+    {
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *m_pipelineLayout, 0, descriptorSets, {});
+        m_wavefront.beginFrame(commandBuffer, slot);
+        for (std::uint32_t sample = 0; sample < m_param.samplesPerFrame; ++sample)
+        {
+            constants.sampleIndex = target.sampleIndex + sample;
+            m_wavefront.render(commandBuffer, constants, *target.activePixels);
+        }
+    }
+
+    // Whoever reads the accumulation next (e.g. tonemapping) has to wait for the samples:
+    memoryBarrier(commandBuffer, RENDER_STAGES, vk::AccessFlagBits::eShaderWrite,
+                  RENDER_STAGES | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eTransfer,
+                  RENDER_ACCESS | vk::AccessFlagBits::eTransferRead);
+
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *m_timestampPool, slot * 2 + 1);
+
+    // With adaptive sampling, the number of pixels that were sampled is only known once the frame is read back:
+    m_pendingFrames[slot] = PendingFrame{
+        .target          = &target,
+        .adaptive        = adaptive,
+        .type            = m_param.type,
+        .samplesPerPixel = m_param.samplesPerFrame,
+    };
+    target.sampleIndex += m_param.samplesPerFrame;
+}
+
+Integrator::BatchResult Integrator::renderBatch(const BatchParam& batchParam, RenderTarget& target, const RayTracingPipeline& pipeline,
+                                                const SbtBuilder& sbt, std::span<const vk::DescriptorSet> descriptorSets)
+{
+    if (m_param.type == IntegratorType::eMegakernel && !pipeline.pipeline())
+    {
+        throw std::runtime_error("The ray tracing pipeline has to be built before rendering a batch");
+    }
+
+    const auto& device = m_context.device();
+    const auto  start  = std::chrono::steady_clock::now();
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.queueFamilyIndex(),
+    });
+
+    BatchResult result;
+    for (std::uint64_t frameIndex = 0; target.sampleIndex < batchParam.maxSamples; ++frameIndex)
+    {
+        auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+            .commandPool        = *commandPool,
+            .level              = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1,
+        });
+        const auto& commandBuffer = commandBuffers.front();
+
+        commandBuffer->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        render(*commandBuffer, frameIndex, target, pipeline, sbt, descriptorSets);
+        submitAndWait(m_context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "batch render");
+
+        // The frame finished, so its results can be read back right away:
+        const auto slot     = static_cast<std::uint32_t>(frameIndex % m_param.framesInFlight);
+        const bool adaptive = m_pendingFrames[slot].adaptive;
+        readResults(slot);
+
+        result.converged = adaptive && target.activePixelCount == 0;
+        result.seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (result.converged || (batchParam.timeBudget > 0.0 && result.seconds >= batchParam.timeBudget))
+        {
+            break;
+        }
+    }
+
+    result.samples      = target.sampleIndex;
+    result.activePixels = target.activePixelCount;
+    return result;
+}
+
+void Integrator::logStats() const
+{
+    for (const auto type : {IntegratorType::eMegakernel, IntegratorType::eWavefront})
+    {
+        const auto& typeStats = stats(type);
+        if (typeStats.frames == 0)
+        {
+            continue;
+        }
+
+        spdlog::info("{} integrator: {:.2f} ms per frame, {:.1f} million samples per second over {} frames.", typeName(type),
+                     typeStats.milliseconds / typeStats.frames, typeStats.samples / (typeStats.milliseconds * 1e3), typeStats.frames);
+    }
+
+    // Whether sorting pays for itself shows in the time of sort and shade together, compared to shade alone without sorting:
+    const auto& stageStats = m_wavefront.stageStats();
+    if (stageStats.samples > 0)
+    {
+        spdlog::info("Wavefront stages per sample ({} sorting): trace {:.2f} ms, sort {:.2f} ms, shade {:.2f} ms.",
+                     m_wavefront.sortRays() ? "with" : "without", stageStats.traceMilliseconds / stageStats.samples,
+                     stageStats.sortMilliseconds / stageStats.samples, stageStats.shadeMilliseconds / stageStats.samples);
+    }
+}
+
+} // namespace polar
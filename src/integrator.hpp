@@ -0,0 +1,252 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <blas_policy.hpp>
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <integrator_interface.hpp>
+#include <ray_tracing_pipeline.hpp>
+#include <restir_di.hpp>
+#include <sbt_builder.hpp>
+#include <shader_compiler.hpp>
+#include <wavefront_integrator.hpp>
+
+namespace polar
+{
+
+enum class IntegratorType
+{
+    eMegakernel, // A single raygen shader traces whole paths
+    eWavefront,  // Separate compute kernels per stage of a path, see WavefrontIntegrator
+};
+
+// Accumulation of an image, or of a region (tile) of one. The buffers hold capacity pixels, of which the region uses extent.
+struct RenderTarget
+{
+    glm::uvec2 imageExtent = glm::uvec2(0);
+    glm::uvec2 offset      = glm::uvec2(0); // Of the region in the image
+    glm::uvec2 extent      = glm::uvec2(0); // Of the region
+
+    std::uint32_t   capacity = 0;
+    GPUBufferUnique accumulation;
+    GPUBufferUnique moments;
+    GPUBufferUnique activePixels; // ActivePixelsHeader followed by the pixel indices
+
+    std::uint32_t sampleIndex      = 0;
+    std::uint32_t activePixelCount = 0; // Unconverged in the last frame read back (all pixels without adaptive sampling)
+    bool          clear            = true;
+
+    RestirState restir; // Allocated by the first frame with ReSTIR DI
+};
+
+// Renders the scene progressively into the accumulation buffer of a render target (per pixel the sum of radiance and the number of
+// samples) with either the megakernel or the wavefront integrator, which can be switched at runtime. Both share the pipeline layout, i.e.
+// the descriptor sets of the scene and IntegratorConstants as push constants. The integrator has a target for the whole image, other
+// targets (e.g. the tiles of TiledRenderer) can be created and rendered into as well.
+// The GPU time of every frame is measured, so the throughput of both integrators can be compared per scene.
+//
+// With adaptive sampling, a convergence kernel (shaders/converge.comp) estimates the error of every pixel from the moments of its
+// luminance at the start of every frame and compacts the pixels that haven't converged yet into a list. The frame then only samples the
+// pixels in the list, with an indirect dispatch or trace rays over it. Raygen shaders launch over launchCount() pixels (2D over the extent
+// of the target, or 1D over the list), map their launch index to the pixel with launchPixel() and the pixel to the image with
+// imagePixel().
+//
+// Both integrators come with kernels that path trace the scene table (see setScene() and SceneTable): the wavefront integrator uses them
+// unless its Param names kernels of the application, and megakernelGroups() are the shader groups to build the megakernel pipeline from.
+//
+// With ReSTIR DI (see RestirDI), its passes run before the samples of every frame, and the first sample takes its direct light at the
+// primary hit from the reservoir of its pixel (restirLightSample(), as the shipped kernels do). The reservoirs are kept per target.
+class Integrator
+{
+  public:
+    struct AdaptiveParam
+    {
+        bool enable = false;
+
+        // A pixel has converged once the standard error of its mean luminance, relative to the square root of the mean, drops below this.
+        float errorThreshold = 0.01f;
+
+        // Samples every pixel takes before its error is estimated. The convergence kernel only runs once all pixels have this many.
+        std::uint32_t minSamples = 16;
+    };
+
+    struct BatchParam
+    {
+        std::uint32_t maxSamples = 1024; // Per pixel
+        double        timeBudget = 0.0;  // Seconds, 0 for no limit
+    };
+
+    struct BatchResult
+    {
+        std::uint32_t samples      = 0; // Per pixel, at most
+        std::uint32_t activePixels = 0; // That didn't converge
+        bool          converged    = false;
+        double        seconds      = 0.0;
+    };
+
+    struct Param
+    {
+        IntegratorType type            = IntegratorType::eMegakernel;
+        std::uint32_t  maxPathLength   = 8;
+        std::uint32_t  samplesPerFrame = 1;
+
+        // Number of frames that may be in flight, the timestamps of a frame are read back this many frames later.
+        std::uint32_t framesInFlight = 2;
+
+        // Scene resources (TLAS, geometry, materials, textures, camera) that the shaders of both integrators use.
+        std::vector<vk::DescriptorSetLayout> setLayouts;
+
+        AdaptiveParam              adaptive;
+        WavefrontIntegrator::Param wavefront;
+        RestirDI::Param            restir;
+    };
+
+    struct TypeStats
+    {
+        std::uint64_t frames       = 0;
+        std::uint64_t samples      = 0; // Summed over all pixels
+        double        milliseconds = 0.0;
+    };
+
+    // Shader groups of the megakernel that ships with the integrators (shaders/megakernel/). The raygen shader traces the closest hits
+    // through the pipeline (with the miss group as the only miss record) and its shadow rays with ray queries. The hit group is for the
+    // geometry of the scene and can be specialized by MaterialPermutations, the proxy group for the proxies of GeometryResidency (at
+    // its proxySbtRecordOffset).
+    struct MegakernelGroups
+    {
+        ShaderGroup raygen;
+        ShaderGroup miss;
+        ShaderGroup hit;
+        ShaderGroup proxyHit;
+    };
+
+    Integrator(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param);
+
+    Integrator(const Integrator&)            = delete;
+    Integrator(Integrator&&)                 = delete;
+    Integrator& operator=(const Integrator&) = delete;
+    Integrator& operator=(Integrator&&)      = delete;
+
+    // To create the ray tracing pipeline of the megakernel with.
+    const vk::PipelineLayout& pipelineLayout() const { return *m_pipelineLayout; }
+
+    static MegakernelGroups megakernelGroups();
+
+    // These have to be called while the GPU isn't rendering.
+    void setType(IntegratorType type);
+    void setMaterials(const Scene& scene);
+
+    // Resizes the target of the whole image, which also reserves its pixels.
+    void resize(const glm::uvec2& extent);
+
+    // The wavefront integrator can only render targets with up to this many pixels.
+    void          reserve(std::uint32_t pixelCount);
+    std::uint32_t reservedPixels() const { return m_reservedPixels; }
+
+    // Restarts the accumulation, e.g. when the camera moved.
+    void        reset() { reset(m_target); }
+    static void reset(RenderTarget& target);
+
+    void setAdaptive(const AdaptiveParam& adaptive);
+
+    // The light tree that the shaders sample lights from (see LightTree::deviceAddress()), 0 if there is none.
+    void setLightTree(vk::DeviceAddress lightTree) { m_lightTree = lightTree; }
+
+    // The scene table that the shipped kernels read (see SceneTable::deviceAddress()), 0 if the kernels of the application don't need it.
+    void setScene(vk::DeviceAddress scene) { m_scene = scene; }
+
+    // ReSTIR DI needs the TLAS of the scene for its visibility rays, and its default surface kernel needs the scene table (see setScene()).
+    // It is skipped while the scene has no light tree.
+    void setRestir(bool enable)          { m_restir.setEnable(enable); }
+    void setTlas(vk::DeviceAddress tlas) { m_restir.setTlas(tlas);     }
+    bool restir() const { return m_restir.enabled(); }
+
+    // Reports the trace time of the wavefront integrator to the policy, so that the BLAS build flags can be compared by what they cost
+    // when tracing. The megakernel traces and shades in the same shaders, so its frames aren't reported. Pass nullptr to stop reporting.
+    void setBlasPolicy(BlasPolicy* policy) { m_wavefront.setBlasPolicy(policy); }
+
+    // Sorts the hits of the wavefront integrator by material before shading, see RaySorter. logStats() shows whether it pays off.
+    void setSortRays(bool sortRays);
+
+    // Allocates a target for up to capacity pixels. Its region has to be set (and the target reset) before rendering into it.
+    RenderTarget createTarget(std::uint32_t capacity) const;
+
+    // Records a frame's worth of samples. The pipeline and shader binding table are only used by the megakernel, the table has to be
+    // built for the current pipeline (see SbtBuilder). The target has to stay alive until the frame has been read back, framesInFlight
+    // frames later.
+    void render(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex, RenderTarget& target, const RayTracingPipeline& pipeline,
+                const SbtBuilder& sbt, std::span<const vk::DescriptorSet> descriptorSets);
+    void render(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex, const RayTracingPipeline& pipeline, const SbtBuilder& sbt,
+                std::span<const vk::DescriptorSet> descriptorSets)
+    {
+        render(commandBuffer, frameIndex, m_target, pipeline, sbt, descriptorSets);
+    }
+
+    // Renders frames on the graphics queue and waits for each, until every pixel converged (with adaptive sampling), maxSamples were
+    // taken or the time budget ran out. The pipeline has to be built already if the megakernel is used, and no other frame may be in
+    // flight.
+    BatchResult renderBatch(const BatchParam& batchParam, RenderTarget& target, const RayTracingPipeline& pipeline, const SbtBuilder& sbt,
+                            std::span<const vk::DescriptorSet> descriptorSets);
+    BatchResult renderBatch(const BatchParam& batchParam, const RayTracingPipeline& pipeline, const SbtBuilder& sbt,
+                            std::span<const vk::DescriptorSet> descriptorSets)
+    {
+        return renderBatch(batchParam, m_target, pipeline, sbt, descriptorSets);
+    }
+
+    const RenderTarget&    target()             const { return m_target;              }
+    const GPUBufferUnique& accumulationBuffer() const { return m_target.accumulation; }
+    std::uint32_t          sampleIndex()        const { return m_target.sampleIndex;  }
+
+    // Number of pixels that hadn't converged in the last frame that was read back (all pixels without adaptive sampling).
+    std::uint32_t activePixelCount() const { return m_target.activePixelCount; }
+
+    const TypeStats& stats(IntegratorType type) const { return m_stats[static_cast<std::size_t>(type)]; }
+
+    // Logs the average GPU time per frame and the sample throughput of both integrators, and the time of the wavefront stages.
+    void logStats() const;
+
+  private:
+    // Results of a frame (timestamps and the number of active pixels) that haven't been read back yet:
+    struct PendingFrame
+    {
+        RenderTarget*  target          = nullptr;
+        bool           adaptive        = false;
+        IntegratorType type            = IntegratorType::eMegakernel;
+        std::uint32_t  samplesPerPixel = 0;
+    };
+
+    void readResults(std::uint32_t slot);
+
+    // Fills the list of active pixels of the target, returns whether the frame is adaptive:
+    bool recordConvergence(const vk::CommandBuffer& commandBuffer, const RenderTarget& target, IntegratorConstants& constants,
+                           std::uint32_t slot);
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    vk::UniquePipelineLayout m_pipelineLayout;
+    WavefrontIntegrator      m_wavefront;
+    RestirDI                 m_restir;
+
+    RenderTarget      m_target;
+    std::uint32_t     m_reservedPixels = 0;
+    GPUBufferUnique   m_readbackBuffer; // Number of active pixels per frame in flight
+    vk::DeviceAddress m_lightTree = 0;
+    vk::DeviceAddress m_scene     = 0;
+
+    vk::UniquePipeline m_convergePipeline;
+
+    vk::UniqueQueryPool       m_timestampPool; // Two per frame in flight
+    std::vector<PendingFrame> m_pendingFrames;
+    double                    m_timestampPeriod = 1.0; // Nanoseconds per tick
+    std::array<TypeStats, 2>  m_stats;
+};
+
+} // namespace polar
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+
+namespace polar
+{
+
+// Host side of shaders/integrator.glsl, which the layouts below mirror (scalar block layout).
+
+// Push constants of all integrator shaders.
+struct IntegratorConstants
+{
+    vk::DeviceAddress queues         = 0; // GPUWavefrontQueues, wavefront only
+    vk::DeviceAddress accumulation   = 0; // Per pixel: sum of radiance, sample count
+    vk::DeviceAddress moments        = 0; // Per pixel: sum of squared luminance
+    vk::DeviceAddress activePixels   = 0; // ActivePixelsHeader followed by the pixel indices
+    vk::DeviceAddress lightTree      = 0; // GPULightTree, 0 without emitters
+    vk::DeviceAddress restir         = 0; // GPURestir, 0 without ReSTIR DI
+    vk::DeviceAddress scene          = 0; // GPUSceneTable, which the shipped kernels need, 0 without
+    glm::uvec2        extent         = glm::uvec2(0); // Of the rendered region
+    glm::uvec2        imageOffset    = glm::uvec2(0); // Of the rendered region in the image
+    glm::uvec2        imageExtent    = glm::uvec2(0);
+    std::uint32_t     frameIndex     = 0;
+    std::uint32_t     sampleIndex    = 0; // Number of samples accumulated so far
+    std::uint32_t     sampleCount    = 0; // Megakernel only
+    std::uint32_t     maxPathLength  = 0;
+    std::uint32_t     bounce         = 0; // Wavefront only
+    std::uint32_t     adaptive       = 0; // Whether only the pixels in activePixels are rendered
+    float             errorThreshold = 0.0f;
+    std::uint32_t     minSamples     = 0;
+};
+
+// Count of a queue followed by the arguments of the indirect dispatch over it, which the kernels that append to the queue keep up to date.
+struct QueueHeader
+{
+    std::uint32_t count       = 0;
+    std::uint32_t groupCountX = 0;
+    std::uint32_t groupCountY = 1;
+    std::uint32_t groupCountZ = 1;
+};
+
+// Header of the list of pixels that haven't converged yet (see Integrator::AdaptiveParam), which the convergence kernel fills in. Both
+// the dispatch arguments (with the workgroup size of the wavefront kernels) and the trace rays dimensions cover the pixels in the list.
+struct ActivePixelsHeader
+{
+    QueueHeader   pixels;
+    std::uint32_t width  = 0;
+    std::uint32_t height = 1;
+    std::uint32_t depth  = 1;
+};
+
+constexpr std::uint32_t PATH_QUEUE_0       = 0;
+constexpr std::uint32_t PATH_QUEUE_1       = 1;
+constexpr std::uint32_t SHADOW_QUEUE       = 2;
+constexpr std::uint32_t FIRST_BUCKET_QUEUE = 3;
+
+struct GPUPathQueue
+{
+    vk::DeviceAddress origins     = 0;
+    vk::DeviceAddress directions  = 0;
+    vk::DeviceAddress throughputs = 0;
+    vk::DeviceAddress states      = 0;
+};
+
+struct GPUShadowQueue
+{
+    vk::DeviceAddress origins       = 0;
+    vk::DeviceAddress directions    = 0;
+    vk::DeviceAddress contributions = 0;
+};
+
+struct GPUWavefrontQueues
+{
+    vk::DeviceAddress headers         = 0;
+    GPUPathQueue      paths[2];
+    vk::DeviceAddress hits            = 0;
+    vk::DeviceAddress materials       = 0;
+    vk::DeviceAddress buckets         = 0;
+    GPUShadowQueue    shadows;
+    vk::DeviceAddress radiance        = 0;
+    vk::DeviceAddress materialBuckets = 0;
+    std::uint32_t     capacity        = 0;
+    std::uint32_t     bucketCount     = 0;
+};
+
+} // namespace polar
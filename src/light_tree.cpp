@@ -0,0 +1,658 @@
+#include "light_tree.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numbers>
+#include <numeric>
+
+#include <acceleration_structure.hpp>
+#include <color.hpp>
+
+namespace polar
+{
+
+constexpr float PI = std::numbers::pi_v<float>;
+
+static float
+luminance(const glm::vec3& color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+static float
+safeAcos(const float value)
+{
+    return std::acos(std::clamp(value, -1.f, 1.f));
+}
+
+// Average of the coarsest level of an uncompressed 8 bit texture, white for anything else.
+static glm::vec3
+averageColor(const Texture& texture)
+{
+    const bool srgb = texture.format == vk::Format::eR8G8B8A8Srgb;
+    if ((!srgb && texture.format != vk::Format::eR8G8B8A8Unorm) || texture.levels.empty())
+    {
+        return glm::vec3(1.f);
+    }
+
+    const auto& level      = texture.levels.back();
+    const auto  pixelCount = static_cast<std::size_t>(level.width) * level.height;
+    if (pixelCount == 0 || level.data.size() < pixelCount * 4)
+    {
+        return glm::vec3(1.f);
+    }
+
+    glm::vec3 sum(0.f);
+    for (std::size_t i = 0; i < pixelCount; ++i)
+    {
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            const auto value = static_cast<float>(level.data[4 * i + channel]) / 255.f;
+            sum[channel] += srgb ? srgbToLinear(value) : value;
+        }
+    }
+    return sum / static_cast<float>(pixelCount);
+}
+
+LightTree::LightTree(const Context& context, const GPUAllocator& allocator, const Scene& scene, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param), m_uploader(allocator, param.framesInFlight)
+{
+    m_param.framesInFlight = std::max(m_param.framesInFlight, 1u);
+    m_param.binCount       = std::max(m_param.binCount, 2u);
+
+    // The emission of every material (none for materials that don't emit):
+    std::vector<glm::vec3> textureAverages(scene.textures.size(), glm::vec3(-1.f));
+    std::vector<glm::vec3> emissions;
+    emissions.reserve(scene.materials.size());
+    for (const auto& material : scene.materials)
+    {
+        auto emission = material.emissiveFactor;
+        if (material.emissiveTexture != INVALID_INDEX && luminance(emission) > 0.f)
+        {
+            auto& average = textureAverages[material.emissiveTexture];
+            if (average.x < 0.f)
+            {
+                average = averageColor(scene.textures[material.emissiveTexture]);
+            }
+            emission *= average;
+        }
+        emissions.emplace_back(emission);
+    }
+
+    //
+    // Emitters, in the space of their source
+    //
+
+    m_instanceGeometries.assign(scene.instances.size(), INVALID_INDEX);
+    m_instances.reserve(scene.instances.size());
+    for (std::uint32_t instanceIndex = 0; instanceIndex < scene.instances.size(); ++instanceIndex)
+    {
+        const auto& instance = scene.instances[instanceIndex];
+        const auto& mesh     = scene.meshes[instance.meshIndex];
+
+        auto& source = m_instances.emplace_back(Source{
+            .firstEmitter = static_cast<std::uint32_t>(m_localEmitters.size()),
+            .transform    = instance.transform,
+        });
+
+        for (std::uint32_t geometryIndex = 0; geometryIndex < mesh.geometries.size(); ++geometryIndex)
+        {
+            const auto& geometry = mesh.geometries[geometryIndex];
+            if (geometry.materialIndex == INVALID_INDEX || luminance(emissions[geometry.materialIndex]) <= 0.f)
+            {
+                continue;
+            }
+
+            if (m_instanceGeometries[instanceIndex] == INVALID_INDEX)
+            {
+                m_instanceGeometries[instanceIndex] = static_cast<std::uint32_t>(m_geometryEmitters.size());
+                m_geometryEmitters.resize(m_geometryEmitters.size() + mesh.geometries.size(), INVALID_INDEX);
+            }
+            m_geometryEmitters[m_instanceGeometries[instanceIndex] + geometryIndex] = static_cast<std::uint32_t>(m_localEmitters.size());
+
+            const auto& material = scene.materials[geometry.materialIndex];
+            const auto  type     = static_cast<std::uint32_t>(EmitterType::eTriangle) | (material.doubleSided ? EMITTER_TWO_SIDED : 0);
+            for (std::uint32_t triangle = 0; triangle < geometry.triangleCount(); ++triangle)
+            {
+                m_localEmitters.emplace_back(GPULightEmitter{
+                    .p0       = geometry.positions[geometry.indices[3 * triangle + 0]],
+                    .type     = type,
+                    .p1       = geometry.positions[geometry.indices[3 * triangle + 1]],
+                    .source   = instanceIndex,
+                    .p2       = geometry.positions[geometry.indices[3 * triangle + 2]],
+                    .triangle = triangle,
+                    .emission = emissions[geometry.materialIndex],
+                    .geometry = geometryIndex,
+                });
+            }
+        }
+
+        source.emitterCount = static_cast<std::uint32_t>(m_localEmitters.size()) - source.firstEmitter;
+    }
+
+    // The lights in the tree come before the directional ones:
+    m_lights.resize(scene.lights.size());
+    for (const bool directional : {false, true})
+    {
+        for (std::uint32_t lightIndex = 0; lightIndex < scene.lights.size(); ++lightIndex)
+        {
+            const auto& light = scene.lights[lightIndex];
+            if ((light.type == LightType::eDirectional) != directional)
+            {
+                continue;
+            }
+
+            const auto type = light.type == LightType::ePoint ? EmitterType::ePoint
+                            : light.type == LightType::eSpot  ? EmitterType::eSpot
+                                                              : EmitterType::eDirectional;
+
+            m_lights[lightIndex] = Source{
+                .firstEmitter = static_cast<std::uint32_t>(m_localEmitters.size()),
+                .emitterCount = 1,
+                .transform    = light.transform,
+            };
+            m_localEmitters.emplace_back(GPULightEmitter{
+                .type     = static_cast<std::uint32_t>(type),
+                .p1       = glm::vec3(0.f, 0.f, -1.f),
+                .source   = lightIndex,
+                .emission = light.color * light.intensity,
+                .cosInner = std::cos(light.innerConeAngle),
+                .cosOuter = std::cos(light.outerConeAngle),
+                .range    = light.range,
+            });
+        }
+
+        if (!directional)
+        {
+            m_treeEmitterCount = static_cast<std::uint32_t>(m_localEmitters.size());
+        }
+    }
+
+    if (m_localEmitters.empty())
+    {
+        spdlog::info("The scene has no emitters.");
+        return;
+    }
+
+    m_emitters.resize(m_localEmitters.size());
+    m_emitterBounds.resize(m_localEmitters.size());
+    m_dirtyEmitters.assign(m_localEmitters.size(), false);
+    for (const auto& source : m_instances)
+    {
+        setTransform(source);
+    }
+    for (const auto& source : m_lights)
+    {
+        setTransform(source);
+    }
+    m_moved = false;
+
+    build();
+
+    //
+    // Buffer
+    //
+
+    const vk::DeviceSize nodesSize              = alignUp(m_nodes.size() * sizeof(GPULightNode), 16);
+    const vk::DeviceSize emittersSize           = alignUp(m_emitters.size() * sizeof(GPULightEmitter), 16);
+    const vk::DeviceSize instanceGeometriesSize = alignUp(m_instanceGeometries.size() * sizeof(std::uint32_t), 16);
+    const vk::DeviceSize geometryEmittersSize   = alignUp(m_geometryEmitters.size() * sizeof(std::uint32_t), 16);
+
+    m_nodeOffset               = alignUp(sizeof(GPULightTree), 16);
+    m_emitterOffset            = m_nodeOffset + nodesSize;
+    m_instanceGeometriesOffset = m_emitterOffset + emittersSize;
+    m_geometryEmittersOffset   = m_instanceGeometriesOffset + instanceGeometriesSize;
+
+    m_buffer = m_allocator.allocate(m_geometryEmittersOffset + std::max(geometryEmittersSize, vk::DeviceSize(16)),
+                                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                        vk::BufferUsageFlagBits::eTransferDst,
+                                    VMA_MEMORY_USAGE_GPU_ONLY);
+
+    m_tableAddress = m_buffer.deviceAddress(m_context);
+    m_table        = GPULightTree{
+        .nodes              = m_tableAddress + m_nodeOffset,
+        .emitters           = m_tableAddress + m_emitterOffset,
+        .instanceGeometries = m_tableAddress + m_instanceGeometriesOffset,
+        .geometryEmitters   = m_tableAddress + m_geometryEmittersOffset,
+        .nodeCount          = static_cast<std::uint32_t>(m_nodes.size()),
+        .treeEmitterCount   = m_treeEmitterCount,
+        .directionalCount   = static_cast<std::uint32_t>(m_emitters.size()) - m_treeEmitterCount,
+    };
+
+    spdlog::info("Built a light tree of {} nodes over {} emitters ({} directional lights next to it).", m_nodes.size(), m_treeEmitterCount,
+                 m_table.directionalCount);
+}
+
+//
+// Bounds
+//
+
+LightTree::LightBounds LightTree::emitterBounds(const GPULightEmitter& emitter)
+{
+    LightBounds bounds;
+    const auto  type = static_cast<EmitterType>(emitter.type & 0xFF);
+    const auto  lum  = luminance(emitter.emission);
+
+    switch (type)
+    {
+    case EmitterType::eTriangle:
+    {
+        const auto normal = glm::cross(emitter.p1 - emitter.p0, emitter.p2 - emitter.p0);
+        const auto area   = 0.5f * glm::length(normal);
+
+        bounds.bounds.extend(emitter.p0);
+        bounds.bounds.extend(emitter.p1);
+        bounds.bounds.extend(emitter.p2);
+        bounds.twoSided  = (emitter.type & EMITTER_TWO_SIDED) != 0;
+        bounds.power     = PI * lum * area * (bounds.twoSided ? 2.f : 1.f);
+        bounds.axis      = area > 0.f ? glm::normalize(normal) : glm::vec3(0.f, 0.f, 1.f);
+        bounds.cosThetaO = 1.f;
+        bounds.cosThetaE = 0.f;
+        break;
+    }
+    case EmitterType::ePoint:
+        bounds.bounds.extend(emitter.p0);
+        bounds.power     = 4.f * PI * lum;
+        bounds.cosThetaO = -1.f;
+        bounds.cosThetaE = 0.f;
+        break;
+    case EmitterType::eSpot:
+        // The cone of the spot light bounds its direction, so its power is that of a point light with the same intensity:
+        bounds.bounds.extend(emitter.p0);
+        bounds.power     = 4.f * PI * lum;
+        bounds.axis      = emitter.p1;
+        bounds.cosThetaO = emitter.cosInner;
+        bounds.cosThetaE = std::cos(std::max(safeAcos(emitter.cosOuter) - safeAcos(emitter.cosInner), 0.f));
+        break;
+    case EmitterType::eDirectional:
+        break;
+    }
+
+    return bounds;
+}
+
+LightTree::LightBounds LightTree::unite(const LightBounds& a, const LightBounds& b)
+{
+    if (a.power <= 0.f)
+    {
+        return b;
+    }
+    if (b.power <= 0.f)
+    {
+        return a;
+    }
+
+    LightBounds bounds{
+        .bounds    = a.bounds,
+        .power     = a.power + b.power,
+        .cosThetaE = std::min(a.cosThetaE, b.cosThetaE),
+        .twoSided  = a.twoSided || b.twoSided,
+    };
+    bounds.bounds.extend(b.bounds);
+
+    // The smallest cone around both normal cones:
+    const auto thetaA = safeAcos(a.cosThetaO);
+    const auto thetaB = safeAcos(b.cosThetaO);
+    const auto thetaD = safeAcos(glm::dot(a.axis, b.axis));
+    if (std::min(thetaD + thetaB, PI) <= thetaA)
+    {
+        bounds.axis      = a.axis;
+        bounds.cosThetaO = a.cosThetaO;
+        return bounds;
+    }
+    if (std::min(thetaD + thetaA, PI) <= thetaB)
+    {
+        bounds.axis      = b.axis;
+        bounds.cosThetaO = b.cosThetaO;
+        return bounds;
+    }
+
+    const auto thetaO = (thetaA + thetaD + thetaB) / 2.f;
+    const auto across = glm::cross(a.axis, b.axis);
+    if (thetaO >= PI || glm::dot(across, across) <= 0.f)
+    {
+        bounds.axis      = a.axis;
+        bounds.cosThetaO = -1.f;
+        return bounds;
+    }
+
+    bounds.axis      = glm::normalize(glm::angleAxis(thetaO - thetaA, glm::normalize(across)) * a.axis);
+    bounds.cosThetaO = std::cos(thetaO);
+    return bounds;
+}
+
+// The surface area orientation heuristic: power times the measure of the directions emitted into, times the surface area of the bounds.
+float LightTree::cost(const LightBounds& bounds)
+{
+    if (bounds.power <= 0.f)
+    {
+        return 0.f;
+    }
+
+    const auto thetaO    = safeAcos(bounds.cosThetaO);
+    const auto thetaE    = safeAcos(bounds.cosThetaE);
+    const auto thetaW    = std::min(thetaO + thetaE, PI);
+    const auto sinThetaO = std::sqrt(std::max(1.f - bounds.cosThetaO * bounds.cosThetaO, 0.f));
+    const auto solidAngle =
+        2.f * PI * (1.f - bounds.cosThetaO) +
+        PI / 2.f * (2.f * thetaW * sinThetaO - std::cos(thetaO - 2.f * thetaW) - 2.f * thetaO * sinThetaO + bounds.cosThetaO);
+
+    // Points and flat bounds have no surface area, so the squared diagonal is added to still tell them apart:
+    const auto extent = bounds.bounds.extent();
+    return bounds.power * solidAngle * (bounds.bounds.surfaceArea() + glm::dot(extent, extent));
+}
+
+//
+// Tree
+//
+
+void LightTree::setTransform(const Source& source)
+{
+    const glm::mat3 directionTransform(source.transform);
+    for (auto emitter = source.firstEmitter; emitter < source.firstEmitter + source.emitterCount; ++emitter)
+    {
+        const auto& local = m_localEmitters[emitter];
+        auto&       world = m_emitters[emitter];
+
+        const auto leaf = world.leaf;
+        world           = local;
+        world.leaf      = leaf;
+        world.p0        = glm::vec3(source.transform * glm::vec4(local.p0, 1.f));
+        if (static_cast<EmitterType>(local.type & 0xFF) == EmitterType::eTriangle)
+        {
+            world.p1 = glm::vec3(source.transform * glm::vec4(local.p1, 1.f));
+            world.p2 = glm::vec3(source.transform * glm::vec4(local.p2, 1.f));
+        }
+        else
+        {
+            world.p1 = glm::normalize(directionTransform * local.p1);
+        }
+
+        m_emitterBounds[emitter] = emitterBounds(world);
+        markDirty(emitter);
+    }
+    m_moved = true;
+}
+
+void LightTree::setInstanceTransform(const std::uint32_t instance, const glm::mat4& transform)
+{
+    m_instances[instance].transform = transform;
+    if (m_instances[instance].emitterCount > 0)
+    {
+        setTransform(m_instances[instance]);
+    }
+}
+
+void LightTree::setLightTransform(const std::uint32_t light, const glm::mat4& transform)
+{
+    m_lights[light].transform = transform;
+    setTransform(m_lights[light]);
+}
+
+void LightTree::markDirty(const std::uint32_t emitter)
+{
+    m_dirtyEmitters[emitter] = true;
+}
+
+void LightTree::writeNode(const std::uint32_t node)
+{
+    const auto& bounds = m_nodeBounds[node];
+    auto&       gpu    = m_nodes[node];
+
+    // Nodes without power are never sampled, but their bounds shouldn't turn into infinities on the GPU either:
+    const auto empty = bounds.bounds.empty();
+    gpu.boundsMin    = empty ? glm::vec3(0.f) : bounds.bounds.min;
+    gpu.boundsMax    = empty ? glm::vec3(0.f) : bounds.bounds.max;
+    gpu.power        = bounds.power;
+    gpu.axis         = bounds.axis;
+    gpu.cosThetaO    = bounds.cosThetaO;
+    gpu.cosThetaE    = bounds.cosThetaE;
+    gpu.flags        = (gpu.flags & LIGHT_NODE_LEAF) | (bounds.twoSided ? LIGHT_NODE_TWO_SIDED : 0);
+
+    m_dirtyNodes[node] = true;
+}
+
+void LightTree::build()
+{
+    const auto emitterCount = m_treeEmitterCount;
+    const auto nodeCount    = emitterCount > 0 ? 2 * emitterCount - 1 : 0;
+
+    m_nodes.clear();
+    m_nodeBounds.clear();
+    m_nodes.reserve(nodeCount);
+    m_nodeBounds.reserve(nodeCount);
+    m_dirtyNodes.assign(nodeCount, false);
+
+    std::vector<std::uint32_t> order(emitterCount);
+    std::iota(order.begin(), order.end(), 0u);
+
+    std::vector<glm::vec3> centroids(emitterCount);
+    for (std::uint32_t i = 0; i < emitterCount; ++i)
+    {
+        centroids[i] = m_emitterBounds[i].bounds.center();
+    }
+
+    const auto binCount = m_param.binCount;
+
+    struct Bin
+    {
+        LightBounds   bounds;
+        std::uint32_t count = 0;
+    };
+    std::vector<Bin>   bins(binCount);
+    std::vector<float> leftCosts(binCount);
+
+    // Builds the subtree over order[begin, end) depth first, so that the left child of every node follows it:
+    const auto buildNode = [&](const auto& self, const std::uint32_t begin, const std::uint32_t end,
+                               const std::uint32_t parent) -> std::uint32_t {
+        const auto node = static_cast<std::uint32_t>(m_nodes.size());
+        m_nodes.emplace_back(GPULightNode{.parent = parent});
+        m_nodeBounds.emplace_back();
+
+        if (end - begin == 1)
+        {
+            const auto emitter       = order[begin];
+            m_nodes[node].index      = emitter;
+            m_nodes[node].flags      = LIGHT_NODE_LEAF;
+            m_nodeBounds[node]       = m_emitterBounds[emitter];
+            m_emitters[emitter].leaf = node;
+            writeNode(node);
+            return node;
+        }
+
+        BoundingBox centroidBounds;
+        for (auto i = begin; i < end; ++i)
+        {
+            centroidBounds.extend(centroids[order[i]]);
+        }
+
+        const auto extent  = centroidBounds.extent();
+        const auto binning = [&](const glm::vec3& centroid, const int axis) {
+            const auto offset = (centroid[axis] - centroidBounds.min[axis]) / extent[axis];
+            const auto bin    = static_cast<std::uint32_t>(static_cast<float>(binCount) * offset);
+            return std::min(bin, binCount - 1);
+        };
+
+        // Find the cheapest split between the bins of every axis:
+        auto          bestCost = std::numeric_limits<float>::max();
+        int           bestAxis = -1;
+        std::uint32_t bestBin  = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0.f)
+            {
+                continue;
+            }
+
+            std::ranges::fill(bins, Bin{});
+            for (auto i = begin; i < end; ++i)
+            {
+                auto& bin  = bins[binning(centroids[order[i]], axis)];
+                bin.bounds = unite(bin.bounds, m_emitterBounds[order[i]]);
+                ++bin.count;
+            }
+
+            LightBounds   left;
+            std::uint32_t leftCount = 0;
+            for (std::uint32_t bin = 0; bin + 1 < binCount; ++bin)
+            {
+                left = unite(left, bins[bin].bounds);
+                leftCount += bins[bin].count;
+                leftCosts[bin] = cost(left);
+            }
+
+            LightBounds   right;
+            std::uint32_t rightCount = 0;
+            for (std::uint32_t bin = binCount - 1; bin > 0; --bin)
+            {
+                right = unite(right, bins[bin].bounds);
+                rightCount += bins[bin].count;
+                leftCount -= bins[bin].count;
+
+                const auto splitCost = leftCosts[bin - 1] + cost(right);
+                if (leftCount > 0 && rightCount > 0 && splitCost < bestCost)
+                {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin  = bin - 1;
+                }
+            }
+        }
+
+        auto middle = begin;
+        if (bestAxis >= 0)
+        {
+            middle = static_cast<std::uint32_t>(std::partition(order.begin() + begin, order.begin() + end,
+                                                               [&](const std::uint32_t emitter) {
+                                                                   return binning(centroids[emitter], bestAxis) <= bestBin;
+                                                               }) -
+                                                order.begin());
+        }
+        if (middle == begin || middle == end)
+        {
+            // All centroids coincide (or the binning couldn't separate them), which any split is as good for:
+            middle = begin + (end - begin) / 2;
+        }
+
+        self(self, begin, middle, node);
+        const auto right = self(self, middle, end, node);
+
+        m_nodes[node].index = right;
+        m_nodeBounds[node]  = unite(m_nodeBounds[node + 1], m_nodeBounds[right]);
+        writeNode(node);
+        return node;
+    };
+
+    if (emitterCount > 0)
+    {
+        buildNode(buildNode, 0, emitterCount, INVALID_INDEX);
+    }
+
+    // Every emitter now has its leaf:
+    std::fill(m_dirtyEmitters.begin(), m_dirtyEmitters.end(), true);
+
+    m_buildCost = treeCost();
+}
+
+void LightTree::refit()
+{
+    // Mark the nodes above the emitters that moved, up to the first one that is marked already:
+    for (std::uint32_t emitter = 0; emitter < m_treeEmitterCount; ++emitter)
+    {
+        if (!m_dirtyEmitters[emitter])
+        {
+            continue;
+        }
+        for (auto node = m_emitters[emitter].leaf; node != INVALID_INDEX && !m_dirtyNodes[node]; node = m_nodes[node].parent)
+        {
+            m_dirtyNodes[node] = true;
+        }
+    }
+
+    // Children come after their parents:
+    for (auto node = static_cast<std::uint32_t>(m_nodes.size()); node-- > 0;)
+    {
+        if (!m_dirtyNodes[node])
+        {
+            continue;
+        }
+
+        const auto& gpu    = m_nodes[node];
+        m_nodeBounds[node] = (gpu.flags & LIGHT_NODE_LEAF) ? m_emitterBounds[gpu.index] : unite(m_nodeBounds[node + 1], m_nodeBounds[gpu.index]);
+        writeNode(node);
+    }
+}
+
+float LightTree::treeCost() const
+{
+    float sum = 0.f;
+    for (std::size_t node = 0; node < m_nodes.size(); ++node)
+    {
+        if (!(m_nodes[node].flags & LIGHT_NODE_LEAF))
+        {
+            sum += cost(m_nodeBounds[node]);
+        }
+    }
+    return sum;
+}
+
+//
+// Update
+//
+
+void LightTree::upload(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    if (m_uploadAll)
+    {
+        m_uploader.add(&m_table, sizeof(m_table), 0);
+        m_uploader.add(m_instanceGeometries.data(), m_instanceGeometries.size() * sizeof(std::uint32_t), m_instanceGeometriesOffset);
+        m_uploader.add(m_geometryEmitters.data(), m_geometryEmitters.size() * sizeof(std::uint32_t), m_geometryEmittersOffset);
+        std::fill(m_dirtyNodes.begin(), m_dirtyNodes.end(), true);
+        std::fill(m_dirtyEmitters.begin(), m_dirtyEmitters.end(), true);
+        m_uploadAll = false;
+    }
+
+    m_stats.uploadedNodes    = m_uploader.addDirty(m_dirtyNodes, m_nodes, m_nodeOffset);
+    m_stats.uploadedEmitters = m_uploader.addDirty(m_dirtyEmitters, m_emitters, m_emitterOffset);
+
+    // The previous frame may still be sampling the tree:
+    const auto shaderStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+    m_uploader.upload(commandBuffer, frameIndex, *m_buffer, shaderStages);
+}
+
+void LightTree::update(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    m_stats = {};
+
+    if (!m_buffer)
+    {
+        return;
+    }
+
+    if (m_moved)
+    {
+        refit();
+
+        m_stats.growth = m_buildCost > 0.f ? treeCost() / m_buildCost : 1.f;
+        if (m_stats.growth > m_param.rebuildThreshold)
+        {
+            build();
+            m_stats.growth = 1.f;
+            ++m_stats.rebuilds;
+        }
+        else
+        {
+            ++m_stats.refits;
+        }
+        m_moved = false;
+    }
+
+    upload(commandBuffer, frameIndex);
+}
+
+} // namespace polar
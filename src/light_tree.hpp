@@ -0,0 +1,208 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Host side of shaders/light_tree.glsl, which the layouts below mirror (scalar block layout).
+
+constexpr std::uint32_t LIGHT_NODE_LEAF      = 1u << 0;
+constexpr std::uint32_t LIGHT_NODE_TWO_SIDED = 1u << 1;
+
+enum class EmitterType : std::uint32_t
+{
+    eTriangle,
+    ePoint,
+    eSpot,
+    eDirectional,
+};
+
+constexpr std::uint32_t EMITTER_TWO_SIDED = 1u << 8; // Flag next to the EmitterType
+
+// Bounds of the emitters below a node: where they are, which way they emit and how much. The emitters emit into directions within
+// angle acos(cosThetaE) around the normals within angle acos(cosThetaO) around axis (around -axis as well if the node is two sided).
+struct GPULightNode
+{
+    glm::vec3     boundsMin = glm::vec3(0.f);
+    float         power     = 0.f;
+    glm::vec3     boundsMax = glm::vec3(0.f);
+    float         cosThetaO = 1.f;
+    glm::vec3     axis      = glm::vec3(0.f, 0.f, 1.f);
+    float         cosThetaE = 1.f;
+    std::uint32_t index     = 0; // Leaves: the emitter, internal nodes: the right child (the left one follows the node)
+    std::uint32_t flags     = 0; // LIGHT_NODE_*
+    std::uint32_t parent    = INVALID_INDEX;
+    std::uint32_t padding   = 0;
+};
+
+// In world space. Triangles store their vertices in p0 to p2, point and spot lights their position in p0, spot and directional lights the
+// direction they shine along in p1.
+struct GPULightEmitter
+{
+    glm::vec3     p0       = glm::vec3(0.f);
+    std::uint32_t type     = 0; // EmitterType, EMITTER_TWO_SIDED
+    glm::vec3     p1       = glm::vec3(0.f);
+    std::uint32_t source   = 0; // Triangles: the index of the instance of the scene, lights: the index of the light of the scene
+    glm::vec3     p2       = glm::vec3(0.f);
+    std::uint32_t triangle = 0; // Index of the triangle in its geometry
+    glm::vec3     emission = glm::vec3(0.f); // Triangles: emissive factor (times the average of the emissive texture), lights: intensity
+    std::uint32_t geometry = 0;              // Index of the triangle's geometry in its mesh
+    float         cosInner = 1.f;            // Spot lights only
+    float         cosOuter = 0.f;            // Spot lights only
+    float         range    = 0.f;            // 0 for infinite
+    std::uint32_t leaf     = INVALID_INDEX;  // Node of the emitter, not set for directional lights
+};
+
+struct GPULightTree
+{
+    vk::DeviceAddress nodes              = 0;
+    vk::DeviceAddress emitters           = 0; // The emitters in the tree, followed by the directional lights
+    vk::DeviceAddress instanceGeometries = 0; // Per instance of the scene: its first entry of geometryEmitters, or INVALID_INDEX
+    vk::DeviceAddress geometryEmitters   = 0; // Per geometry of an instance: the emitter of its first triangle, or INVALID_INDEX
+    std::uint32_t     nodeCount          = 0;
+    std::uint32_t     treeEmitterCount   = 0;
+    std::uint32_t     directionalCount   = 0;
+    std::uint32_t     padding            = 0;
+};
+
+// Bounding volume hierarchy over the emitters of a scene, to sample lights by their (estimated) contribution to a shading point rather
+// than uniformly (Conty Estevez and Kulla, "Importance Sampling of Many Lights with Adaptive Tree Splitting"). The emitters are the
+// triangles of all instances with an emissive material and the KHR_lights_punctual lights. Every node bounds the position, the emission
+// directions (as a cone) and the power of the emitters below it, from which shaders estimate the importance of both children at every
+// level and descend into one of them at random (sampleLightTree() in shaders/light_tree.glsl). Directional lights can't be bounded and
+// are sampled next to the tree.
+// The tree is built on the host with the surface area orientation heuristic and uploaded to a single buffer. When instances or lights
+// move, only their emitters are transformed and the nodes above them refit. Once refitting has degraded the tree too much (by the
+// summed cost of its nodes), it is rebuilt instead. Either way, only the nodes and emitters that changed are uploaded.
+// The triangle emitters of an instance are those of its own mesh, never of one of its levels of detail, so LodSelector keeps the instances
+// of emissive meshes at their finest level.
+// Emissive textures are approximated by their average color, which is only known for uncompressed textures (others count as white). This
+// only affects how well the tree samples, shaders evaluate the emission at the sampled point themselves.
+class LightTree
+{
+  public:
+    struct Param
+    {
+        // Number of frames the staging buffer of a frame may still be read by the GPU.
+        std::uint32_t framesInFlight = 2;
+
+        // Candidate splits per axis when building.
+        std::uint32_t binCount = 12;
+
+        // Rebuild once the summed cost of the nodes grew by this factor since the last rebuild.
+        float rebuildThreshold = 1.5f;
+    };
+
+    // What the last update() did.
+    struct Stats
+    {
+        std::uint32_t refits           = 0;
+        std::uint32_t rebuilds         = 0;
+        std::uint32_t uploadedNodes    = 0;
+        std::uint32_t uploadedEmitters = 0;
+        float         growth           = 1.f; // Of the cost of the tree since the last rebuild
+    };
+
+    // Collects the emitters of the scene and builds the tree, which is uploaded by the first update(). The geometry of the scene has to
+    // be in memory, i.e. not paged out by GeometryResidency yet.
+    LightTree(const Context& context, const GPUAllocator& allocator, const Scene& scene, const Param& param);
+
+    LightTree(const LightTree&)            = delete;
+    LightTree(LightTree&&)                 = delete;
+    LightTree& operator=(const LightTree&) = delete;
+    LightTree& operator=(LightTree&&)      = delete;
+
+    // Moves the emitters of an instance or a light of the scene.
+    void setInstanceTransform(std::uint32_t instance, const glm::mat4& transform);
+    void setLightTransform(std::uint32_t light, const glm::mat4& transform);
+
+    // Refits or rebuilds the tree if anything moved and records the upload of what changed, followed by a barrier that makes it
+    // available to ray tracing and compute shaders.
+    void update(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    // Of the GPULightTree, 0 if the scene has no emitters.
+    vk::DeviceAddress deviceAddress() const { return m_buffer ? m_tableAddress : 0; }
+
+    std::uint32_t emitterCount() const { return static_cast<std::uint32_t>(m_emitters.size()); }
+    const Stats&  stats()        const { return m_stats; }
+
+  private:
+    // Bounds of an emitter or a node, see GPULightNode:
+    struct LightBounds
+    {
+        BoundingBox bounds;
+        float       power     = 0.f;
+        glm::vec3   axis      = glm::vec3(0.f, 0.f, 1.f);
+        float       cosThetaO = 1.f;
+        float       cosThetaE = 1.f;
+        bool        twoSided  = false;
+    };
+
+    // An instance or a light, whose emitters are transformed together:
+    struct Source
+    {
+        std::uint32_t firstEmitter = 0;
+        std::uint32_t emitterCount = 0;
+        glm::mat4     transform    = glm::mat4(1.f);
+    };
+
+    static LightBounds emitterBounds(const GPULightEmitter& emitter);
+    static LightBounds unite(const LightBounds& a, const LightBounds& b);
+    static float       cost(const LightBounds& bounds);
+
+    void  setTransform(const Source& source);
+    void  build();
+    void  refit();
+    float treeCost() const;
+    void  writeNode(std::uint32_t node);
+    void  markDirty(std::uint32_t emitter);
+
+    // Records the copies of the dirty nodes and emitters from the staging buffer of the frame:
+    void upload(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    std::vector<GPULightEmitter> m_localEmitters; // In the space of their source
+    std::vector<GPULightEmitter> m_emitters;
+    std::vector<LightBounds>     m_emitterBounds;
+    std::vector<Source>          m_instances;
+    std::vector<Source>          m_lights;
+    std::uint32_t                m_treeEmitterCount = 0;
+
+    std::vector<GPULightNode> m_nodes;
+    std::vector<LightBounds>  m_nodeBounds;
+    float                     m_buildCost = 0.f;
+
+    // The lookup tables from hit triangles to emitters, see GPULightTree:
+    std::vector<std::uint32_t> m_instanceGeometries;
+    std::vector<std::uint32_t> m_geometryEmitters;
+
+    GPUBufferUnique   m_buffer; // GPULightTree, nodes, emitters and the lookup tables
+    vk::DeviceAddress m_tableAddress = 0;
+    GPULightTree      m_table;
+    vk::DeviceSize    m_nodeOffset               = 0;
+    vk::DeviceSize    m_emitterOffset            = 0;
+    vk::DeviceSize    m_instanceGeometriesOffset = 0;
+    vk::DeviceSize    m_geometryEmittersOffset   = 0;
+    StagingUploader   m_uploader;
+
+    // Whether a node or emitter has to be uploaded:
+    std::vector<bool> m_dirtyNodes;
+    std::vector<bool> m_dirtyEmitters;
+
+    bool  m_moved     = false;
+    bool  m_uploadAll = true; // Including the table and the lookup tables
+    Stats m_stats;
+};
+
+} // namespace polar
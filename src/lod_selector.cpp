@@ -0,0 +1,108 @@
+#include "lod_selector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace polar
+{
+
+LodSelector::LodSelector(const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const Param& param) : m_param(param)
+{
+    const auto emissive = [&](const Geometry& geometry) {
+        return geometry.materialIndex != INVALID_INDEX && materials[geometry.materialIndex].emissiveFactor != glm::vec3(0.f);
+    };
+
+    m_meshes.reserve(meshes.size());
+    for (const auto& mesh : meshes)
+    {
+        m_meshes.emplace_back(LodMesh{
+            .bounds   = mesh.bounds,
+            .lods     = mesh.lods,
+            .emissive = std::ranges::any_of(mesh.geometries, emissive),
+        });
+    }
+}
+
+void LodSelector::setTransform(LodInstance& instance, const glm::mat4& transform) const
+{
+    instance.bounds = m_meshes[instance.meshIndex].bounds.transformed(transform);
+
+    // Errors are distances, so they scale with the largest axis of the transform:
+    instance.scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+}
+
+void LodSelector::setInstances(const std::vector<Instance>& instances)
+{
+    m_instances.clear();
+    m_instances.reserve(instances.size());
+    for (const auto& instance : instances)
+    {
+        auto& lodInstance     = m_instances.emplace_back();
+        lodInstance.meshIndex = instance.meshIndex;
+        setTransform(lodInstance, instance.transform);
+    }
+}
+
+void LodSelector::setTransform(const std::uint32_t instanceIndex, const glm::mat4& transform)
+{
+    setTransform(m_instances[instanceIndex], transform);
+}
+
+std::vector<std::uint32_t> LodSelector::update(const View& view)
+{
+    // Size of a pixel at unit distance:
+    const auto pixelsPerUnit = view.height / (2.f * std::tan(view.verticalFov * 0.5f));
+
+    const auto refineError  = m_param.pixelError * (1.f + m_param.hysteresis);
+    const auto coarsenError = m_param.pixelError * (1.f - m_param.hysteresis);
+
+    std::vector<std::uint32_t> changed;
+    for (std::uint32_t instanceIndex = 0; instanceIndex < m_instances.size(); ++instanceIndex)
+    {
+        auto&       instance = m_instances[instanceIndex];
+        const auto& lods     = m_meshes[instance.meshIndex].lods;
+        if (lods.empty() || m_meshes[instance.meshIndex].emissive)
+        {
+            continue;
+        }
+
+        // The closest point of the bounds is where the error projects to the most pixels. The camera being inside means infinitely many,
+        // so only the mesh itself will do (multiplying by infinity would turn levels without error into NaN, which never refines):
+        const auto distance = glm::distance(view.position, glm::clamp(view.position, instance.bounds.min, instance.bounds.max));
+
+        auto level = 0u;
+        if (distance > 0.f)
+        {
+            const auto pixelsPerError = instance.scale * pixelsPerUnit / distance;
+
+            // Level 0 is the mesh itself, which has no error:
+            const auto projectedError = [&](const std::uint32_t level) { return level == 0 ? 0.f : lods[level - 1].error * pixelsPerError; };
+
+            level = instance.level;
+            while (level > 0 && projectedError(level) > refineError)
+            {
+                --level;
+            }
+            while (level < lods.size() && projectedError(level + 1) <= coarsenError)
+            {
+                ++level;
+            }
+        }
+
+        if (level != instance.level)
+        {
+            instance.level = level;
+            changed.emplace_back(instanceIndex);
+        }
+    }
+
+    return changed;
+}
+
+std::uint32_t LodSelector::meshIndex(const std::uint32_t instanceIndex) const
+{
+    const auto& instance = m_instances[instanceIndex];
+    return instance.level == 0 ? instance.meshIndex : m_meshes[instance.meshIndex].lods[instance.level - 1].meshIndex;
+}
+
+} // namespace polar
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Picks the level of detail of every instance from the screen space error of its LODs, i.e. the object space error of the LOD
+// projected onto the screen at the distance of the instance's bounds. Each instance uses the coarsest level whose error is at most
+// pixelError pixels. To avoid popping between two levels from frame to frame, an instance only switches to a coarser level if its
+// error is below the threshold by the hysteresis margin, and only switches back once its current level exceeds the threshold by it.
+// The TLAS instances of the instances whose level changed then have to be pointed to the BLAS of their new mesh, which
+// GeometryResidency::updateLods() does (see GeometryResidency::setLodSelector()).
+// Instances of meshes with an emissive material always keep their finest level: the emitters of the light tree are the triangles of the
+// instance's own mesh (see triangleEmitter() in shaders/light_tree.glsl), which those of a coarser level don't match.
+class LodSelector
+{
+  public:
+    struct Param
+    {
+        float pixelError = 1.f;
+
+        // Relative width of the band around pixelError in which instances keep their level.
+        float hysteresis = 0.25f;
+    };
+
+    struct View
+    {
+        glm::vec3     position    = glm::vec3(0.f);
+        float         verticalFov = 1.f; // In radians
+        std::uint32_t height      = 1080;
+    };
+
+    LodSelector(const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const Param& param);
+
+    LodSelector(const LodSelector&)            = delete;
+    LodSelector(LodSelector&&)                 = delete;
+    LodSelector& operator=(const LodSelector&) = delete;
+    LodSelector& operator=(LodSelector&&)      = delete;
+
+    // Replaces all instances, which start out at their finest level.
+    void setInstances(const std::vector<Instance>& instances);
+    void setTransform(std::uint32_t instanceIndex, const glm::mat4& transform);
+
+    // Returns the instances whose level changed.
+    std::vector<std::uint32_t> update(const View& view);
+
+    // The mesh the instance currently uses, which is either its own mesh or one of its LODs.
+    std::uint32_t meshIndex(std::uint32_t instanceIndex) const;
+    std::uint32_t level(std::uint32_t instanceIndex) const { return m_instances[instanceIndex].level; }
+
+  private:
+    struct LodMesh
+    {
+        BoundingBox          bounds;
+        std::vector<MeshLod> lods;
+        bool                 emissive = false; // Keeps its finest level
+    };
+
+    struct LodInstance
+    {
+        std::uint32_t meshIndex = INVALID_INDEX;
+        BoundingBox   bounds; // In world space
+        float         scale = 1.f;
+        std::uint32_t level = 0;
+    };
+
+    void setTransform(LodInstance& instance, const glm::mat4& transform) const;
+
+    Param                    m_param;
+    std::vector<LodMesh>     m_meshes;
+    std::vector<LodInstance> m_instances;
+};
+
+} // namespace polar
@@ -0,0 +1,121 @@
+#include "material_permutations.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace polar
+{
+
+MaterialPermutations::MaterialPermutations(RayTracingPipeline& pipeline, const ShaderGroup& hitGroup, const Param& param)
+    : m_pipeline(pipeline), m_hitGroup(hitGroup), m_param(param)
+{
+    m_uberHitGroup = m_pipeline.addGroup(specialize(MaterialFeature::ALL));
+}
+
+ShaderGroup MaterialPermutations::specialize(const std::uint32_t features) const
+{
+    auto group = m_hitGroup;
+    group.specialization[m_param.featureConstantId] = features;
+
+    if ((features & (MaterialFeature::ALPHA_MASK | MaterialFeature::ALPHA_BLEND)) == 0)
+    {
+        std::erase_if(group.shaders, [](const ShaderSource& shader) { return shader.stage == vk::ShaderStageFlagBits::eAnyHitKHR; });
+    }
+
+    return group;
+}
+
+std::uint32_t MaterialPermutations::featuresOf(const std::uint32_t materialIndex) const
+{
+    return materialIndex == INVALID_INDEX ? materialFeatures(Material{}) : m_materialFeatures[materialIndex];
+}
+
+void MaterialPermutations::setMaterials(const Scene& scene)
+{
+    m_materialFeatures.clear();
+    m_materialFeatures.reserve(scene.materials.size());
+    for (const auto& material : scene.materials)
+    {
+        m_materialFeatures.emplace_back(materialFeatures(material));
+    }
+
+    auto permutations = materialFeatureHistogram(scene);
+
+    if (permutations.size() > m_param.maxPermutations)
+    {
+        spdlog::info("{} of {} material permutations use the uber hit group as they are too rare.", permutations.size() - m_param.maxPermutations,
+                     permutations.size());
+        permutations.resize(m_param.maxPermutations);
+    }
+
+    m_queue.clear();
+    for (const auto& [features, weight] : permutations)
+    {
+        if (!m_hitGroups.contains(features) && !m_failed.contains(features))
+        {
+            m_queue.emplace_back(features);
+        }
+    }
+}
+
+bool MaterialPermutations::update(const std::uint64_t frameIndex)
+{
+    const auto changed = m_pipeline.update(frameIndex);
+
+    // Groups can't be removed from the pipeline, so failed permutations become another copy of the uber hit group (which shares its
+    // library) and the pipeline is built again without them:
+    bool fellBack = false;
+    for (const auto groupIndex : m_pipeline.failedGroups())
+    {
+        const auto itr = std::find_if(m_hitGroups.begin(), m_hitGroups.end(), [&](const auto& entry) { return entry.second == groupIndex; });
+        if (itr == m_hitGroups.end())
+        {
+            continue;
+        }
+
+        spdlog::warn("Material permutation {:#x} failed to build, its materials use the uber hit group.", itr->first);
+        m_pipeline.setGroup(groupIndex, specialize(MaterialFeature::ALL));
+        m_failed.emplace(itr->first);
+        m_hitGroups.erase(itr);
+        fellBack = true;
+    }
+
+    // A build that is already running was started with the failed groups, so it's followed by another one. Otherwise the next batch
+    // below commits the change:
+    if (fellBack && (m_pipeline.building() || m_queue.empty()))
+    {
+        m_pipeline.commit();
+    }
+
+    if (!m_pipeline.building() && !m_queue.empty())
+    {
+        const auto count = std::min<std::size_t>(m_param.permutationsPerBuild, m_queue.size());
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto features = m_queue.front();
+            m_queue.pop_front();
+
+            m_hitGroups.emplace(features, m_pipeline.addGroup(specialize(features)));
+        }
+
+        spdlog::info("Building {} material permutations ({} remaining).", count, m_queue.size());
+        m_pipeline.commit();
+    }
+
+    return changed;
+}
+
+std::uint32_t MaterialPermutations::hitGroup(const std::uint32_t materialIndex) const
+{
+    // Groups are only ever appended, so the permutation is part of the pipeline once the pipeline has that many groups:
+    const auto itr = m_hitGroups.find(featuresOf(materialIndex));
+    if (itr == m_hitGroups.end() || itr->second >= m_pipeline.groupCount())
+    {
+        return m_uberHitGroup;
+    }
+
+    return itr->second;
+}
+
+} // namespace polar
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ray_tracing_pipeline.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Specializes the hit group of the materials for their feature bitmask (see materialFeatures()), so hit shaders don't pay for the
+// registers and branches of features a material doesn't use.
+// The bitmask is passed to the hit shaders as a specialization constant. The uber hit group has it set to MaterialFeature::ALL and has to
+// read the features of the material at runtime instead, while every permutation can rely on the constant alone. Permutations without
+// alpha testing also drop the any hit shader.
+// Permutations are added to the pipeline in batches, most commonly used (by triangle count) first, and materials use the uber hit group
+// until their permutation has been linked into the pipeline. A permutation that fails to build has its group replaced by the uber hit
+// group, so its materials keep using the uber hit group and the other permutations of its batch are built again without it.
+class MaterialPermutations
+{
+  public:
+    struct Param
+    {
+        // Rarer permutations keep using the uber hit group.
+        std::uint32_t maxPermutations = 64;
+
+        // Number of permutations that are added by a single build of the pipeline.
+        std::uint32_t permutationsPerBuild = 8;
+
+        std::uint32_t featureConstantId = 0;
+    };
+
+    // Adds the uber hit group to the pipeline, which is built with the next commit() of the pipeline.
+    MaterialPermutations(RayTracingPipeline& pipeline, const ShaderGroup& hitGroup, const Param& param);
+
+    MaterialPermutations(const MaterialPermutations&)            = delete;
+    MaterialPermutations(MaterialPermutations&&)                 = delete;
+    MaterialPermutations& operator=(const MaterialPermutations&) = delete;
+    MaterialPermutations& operator=(MaterialPermutations&&)      = delete;
+
+    // Determines the permutations of the materials and queues those that don't exist yet.
+    void setMaterials(const Scene& scene);
+
+    // Updates the pipeline (so it's called instead of the pipeline's update()) and starts building the next batch of permutations once the
+    // previous one is done. Returns true if the pipeline changed, in which case the shader binding table has to be rebuilt with the hit
+    // groups returned by hitGroup().
+    bool update(std::uint64_t frameIndex);
+
+    // Index of the hit group in the current pipeline that the material should use.
+    std::uint32_t hitGroup(std::uint32_t materialIndex) const;
+
+    std::uint32_t uberHitGroup() const { return m_uberHitGroup; }
+
+  private:
+    std::uint32_t featuresOf(std::uint32_t materialIndex) const;
+    ShaderGroup   specialize(std::uint32_t features) const;
+
+    RayTracingPipeline& m_pipeline;
+    ShaderGroup         m_hitGroup;
+    Param               m_param;
+
+    std::uint32_t                                    m_uberHitGroup = 0;
+    std::vector<std::uint32_t>                       m_materialFeatures;
+    std::unordered_map<std::uint32_t, std::uint32_t> m_hitGroups; // Features to the hit group of the permutation
+    std::deque<std::uint32_t>                        m_queue;     // Features of the permutations that are yet to be added
+    std::unordered_set<std::uint32_t>                m_failed;    // Features of the permutations that failed to build
+};
+
+} // namespace polar
@@ -0,0 +1,207 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace polar
+{
+
+SimplifiedMesh simplifyMesh(const Mesh& mesh, const float cellSize)
+{
+    // Cells are counted from the corner of the bounds, so their coordinates are small and non-negative and fit into 21 bits each:
+    const auto cellKey = [&](const glm::vec3& position) {
+        const auto cell = glm::min(glm::uvec3((position - mesh.bounds.min) / cellSize), glm::uvec3((1u << 21) - 1));
+        return static_cast<std::uint64_t>(cell.x) | static_cast<std::uint64_t>(cell.y) << 21 | static_cast<std::uint64_t>(cell.z) << 42;
+    };
+
+    // Cell of every vertex, and the average position of every cell over all geometries:
+    std::unordered_map<std::uint64_t, std::uint32_t> cellIndices;
+    std::vector<glm::vec3>                           cellPositions;
+    std::vector<std::uint32_t>                       cellVertexCounts;
+    std::vector<std::vector<std::uint32_t>>          vertexCells(mesh.geometries.size());
+
+    for (std::size_t i = 0; i < mesh.geometries.size(); ++i)
+    {
+        const auto& geometry = mesh.geometries[i];
+
+        vertexCells[i].reserve(geometry.vertexCount());
+        for (const auto& position : geometry.positions)
+        {
+            const auto [itr, inserted] = cellIndices.try_emplace(cellKey(position), static_cast<std::uint32_t>(cellPositions.size()));
+            if (inserted)
+            {
+                cellPositions.emplace_back(0.f);
+                cellVertexCounts.emplace_back(0);
+            }
+
+            cellPositions[itr->second]    += position;
+            cellVertexCounts[itr->second] += 1;
+            vertexCells[i].emplace_back(itr->second);
+        }
+    }
+
+    for (std::size_t cell = 0; cell < cellPositions.size(); ++cell)
+    {
+        cellPositions[cell] /= static_cast<float>(cellVertexCounts[cell]);
+    }
+
+    SimplifiedMesh result{
+        .mesh = Mesh{
+            .name       = mesh.name,
+            .buildHints = mesh.buildHints,
+        },
+    };
+
+    // Vertex of every cell in the geometry that is currently being simplified:
+    std::vector<std::uint32_t> cellVertices(cellPositions.size(), INVALID_INDEX);
+
+    for (std::size_t i = 0; i < mesh.geometries.size(); ++i)
+    {
+        const auto& geometry     = mesh.geometries[i];
+        const auto& cells        = vertexCells[i];
+        const bool  hasNormals   = !geometry.normals.empty();
+        const bool  hasTexCoords = !geometry.texCoords.empty();
+
+        Geometry simplified{
+            .materialIndex = geometry.materialIndex,
+            .opaque        = geometry.opaque,
+        };
+
+        // Attributes are averaged over the vertices of the cell that are part of this geometry:
+        std::vector<std::uint32_t> vertexCounts;
+        for (std::uint32_t vertex = 0; vertex < geometry.vertexCount(); ++vertex)
+        {
+            const auto cell = cells[vertex];
+            result.error    = std::max(result.error, glm::distance(geometry.positions[vertex], cellPositions[cell]));
+
+            if (cellVertices[cell] == INVALID_INDEX)
+            {
+                cellVertices[cell] = simplified.vertexCount();
+
+                simplified.positions.emplace_back(cellPositions[cell]);
+                simplified.bounds.extend(cellPositions[cell]);
+                vertexCounts.emplace_back(0);
+                if (hasNormals)
+                {
+                    simplified.normals.emplace_back(0.f);
+                }
+                if (hasTexCoords)
+                {
+                    simplified.texCoords.emplace_back(0.f);
+                }
+            }
+
+            const auto simplifiedVertex = cellVertices[cell];
+            vertexCounts[simplifiedVertex] += 1;
+            if (hasNormals)
+            {
+                simplified.normals[simplifiedVertex] += geometry.normals[vertex];
+            }
+            if (hasTexCoords)
+            {
+                simplified.texCoords[simplifiedVertex] += geometry.texCoords[vertex];
+            }
+        }
+
+        for (std::uint32_t vertex = 0; vertex < simplified.vertexCount(); ++vertex)
+        {
+            if (hasNormals)
+            {
+                const auto length          = glm::length(simplified.normals[vertex]);
+                simplified.normals[vertex] = length > 0.f ? simplified.normals[vertex] / length : glm::vec3(0.f, 0.f, 1.f);
+            }
+            if (hasTexCoords)
+            {
+                simplified.texCoords[vertex] /= static_cast<float>(vertexCounts[vertex]);
+            }
+        }
+
+        for (std::uint32_t triangle = 0; triangle < geometry.triangleCount(); ++triangle)
+        {
+            const auto a = cells[geometry.indices[triangle * 3 + 0]];
+            const auto b = cells[geometry.indices[triangle * 3 + 1]];
+            const auto c = cells[geometry.indices[triangle * 3 + 2]];
+            if (a == b || b == c || c == a)
+            {
+                continue;
+            }
+
+            simplified.indices.insert(simplified.indices.end(), {cellVertices[a], cellVertices[b], cellVertices[c]});
+        }
+
+        for (const auto cell : cells)
+        {
+            cellVertices[cell] = INVALID_INDEX;
+        }
+
+        // Unreferenced vertices are harmless, but a geometry without any triangles can't be built:
+        if (simplified.triangleCount() > 0)
+        {
+            result.mesh.bounds.extend(simplified.bounds);
+            result.mesh.geometries.emplace_back(std::move(simplified));
+        }
+    }
+
+    return result;
+}
+
+std::vector<SimplifiedMesh> generateLods(const Mesh& mesh, const std::uint32_t levelCount, const float reduction, const std::uint32_t minTriangles)
+{
+    std::vector<SimplifiedMesh> lods;
+
+    const auto size   = mesh.bounds.max - mesh.bounds.min;
+    const auto extent = std::max({size.x, size.y, size.z});
+    if (mesh.bounds.empty() || extent <= 0.f)
+    {
+        return lods;
+    }
+
+    // The number of cells along the largest axis is binary searched for the finest grid that meets the target triangle count. A surface
+    // with n triangles has about n / 2 vertices, so a grid much finer than the square root of that won't merge anything:
+    auto triangleCount = mesh.triangleCount();
+    auto maxResolution = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<float>(triangleCount)) * 4.f));
+
+    for (std::uint32_t level = 0; level < levelCount; ++level)
+    {
+        const auto target = static_cast<std::uint32_t>(triangleCount * reduction);
+        if (target < minTriangles)
+        {
+            break;
+        }
+
+        SimplifiedMesh best;
+        std::uint32_t  bestResolution = 0;
+
+        std::uint32_t low = 1, high = maxResolution;
+        while (low <= high)
+        {
+            const auto resolution = low + (high - low) / 2;
+
+            auto simplified = simplifyMesh(mesh, extent / resolution);
+            if (simplified.mesh.triangleCount() <= target)
+            {
+                best           = std::move(simplified);
+                bestResolution = resolution;
+                low            = resolution + 1;
+            }
+            else
+            {
+                high = resolution - 1;
+            }
+        }
+
+        if (bestResolution == 0 || best.mesh.triangleCount() < minTriangles)
+        {
+            break;
+        }
+
+        triangleCount = best.mesh.triangleCount();
+        maxResolution = bestResolution;
+        lods.emplace_back(std::move(best));
+    }
+
+    return lods;
+}
+
+} // namespace polar
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+struct SimplifiedMesh
+{
+    Mesh  mesh;
+    float error = 0.f; // Largest distance between a vertex of the source mesh and the vertex it was merged into
+};
+
+// Simplifies a mesh by vertex clustering: all vertices within the same cell of a regular grid are merged into their average, and
+// triangles that collapse are dropped. The grid is shared by all geometries of the mesh, so geometries that met at a vertex still do
+// afterwards. Geometries that collapse entirely are dropped.
+SimplifiedMesh simplifyMesh(const Mesh& mesh, float cellSize);
+
+// Generates up to levelCount successively coarser versions of the mesh, each with at most reduction times the triangles of the previous
+// one. All levels are simplified from the mesh itself, so their errors don't accumulate. Stops early once a level would have fewer than
+// minTriangles triangles or the mesh can't be simplified any further.
+std::vector<SimplifiedMesh> generateLods(const Mesh& mesh, std::uint32_t levelCount, float reduction, std::uint32_t minTriangles);
+
+} // namespace polar
@@ -0,0 +1,134 @@
+#include "mesh_splitter.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace polar
+{
+
+struct TriangleRange
+{
+    std::uint32_t begin = 0;
+    std::uint32_t end   = 0;
+};
+
+Geometry extractTriangles(const Geometry& geometry, const std::span<const std::uint32_t> triangles, std::vector<std::uint32_t>& remap)
+{
+    const bool hasNormals   = !geometry.normals.empty();
+    const bool hasTexCoords = !geometry.texCoords.empty();
+
+    Geometry result{
+        .materialIndex = geometry.materialIndex,
+        .opaque        = geometry.opaque,
+    };
+    result.indices.reserve(triangles.size() * 3);
+
+    for (const auto triangle : triangles)
+    {
+        for (std::uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const auto vertex = geometry.indices[triangle * 3 + corner];
+
+            if (remap[vertex] == INVALID_INDEX)
+            {
+                remap[vertex] = result.vertexCount();
+
+                result.positions.emplace_back(geometry.positions[vertex]);
+                result.bounds.extend(geometry.positions[vertex]);
+                if (hasNormals)
+                {
+                    result.normals.emplace_back(geometry.normals[vertex]);
+                }
+                if (hasTexCoords)
+                {
+                    result.texCoords.emplace_back(geometry.texCoords[vertex]);
+                }
+            }
+
+            result.indices.emplace_back(remap[vertex]);
+        }
+    }
+
+    // Only reset the entries we touched so that the remap table can be reused for the next call without clearing all of it:
+    for (const auto triangle : triangles)
+    {
+        for (std::uint32_t corner = 0; corner < 3; ++corner)
+        {
+            remap[geometry.indices[triangle * 3 + corner]] = INVALID_INDEX;
+        }
+    }
+
+    return result;
+}
+
+std::vector<Geometry> splitGeometry(Geometry geometry, const std::uint32_t maxTriangles)
+{
+    const auto triangleCount = geometry.triangleCount();
+
+    std::vector<Geometry> chunks;
+    if (maxTriangles == 0 || triangleCount <= maxTriangles)
+    {
+        chunks.emplace_back(std::move(geometry));
+        return chunks;
+    }
+
+    std::vector<glm::vec3> centroids;
+    centroids.reserve(triangleCount);
+    for (std::uint32_t i = 0; i < triangleCount; ++i)
+    {
+        const auto& p0 = geometry.positions[geometry.indices[i * 3 + 0]];
+        const auto& p1 = geometry.positions[geometry.indices[i * 3 + 1]];
+        const auto& p2 = geometry.positions[geometry.indices[i * 3 + 2]];
+        centroids.emplace_back((p0 + p1 + p2) * (1.f / 3.f));
+    }
+
+    std::vector<std::uint32_t> triangles(triangleCount);
+    std::iota(triangles.begin(), triangles.end(), 0);
+
+    // Recursively partition the triangles until every range fits. Splitting at the median keeps the chunks balanced, so we end up
+    // with roughly triangleCount / maxTriangles chunks of similar size:
+    std::vector<TriangleRange> leaves;
+    std::vector<TriangleRange> stack{{0, triangleCount}};
+    while (!stack.empty())
+    {
+        const auto range = stack.back();
+        stack.pop_back();
+
+        if (range.end - range.begin <= maxTriangles)
+        {
+            leaves.emplace_back(range);
+            continue;
+        }
+
+        BoundingBox centroidBounds;
+        for (std::uint32_t i = range.begin; i < range.end; ++i)
+        {
+            centroidBounds.extend(centroids[triangles[i]]);
+        }
+
+        const auto extent = centroidBounds.extent();
+        const int  axis   = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        const auto begin = triangles.begin() + range.begin;
+        const auto mid   = triangles.begin() + range.begin + (range.end - range.begin) / 2;
+        const auto end   = triangles.begin() + range.end;
+        std::nth_element(begin, mid, end, [&](const std::uint32_t a, const std::uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        const auto split = static_cast<std::uint32_t>(mid - triangles.begin());
+        stack.push_back({split, range.end});
+        stack.push_back({range.begin, split});
+    }
+
+    std::vector<std::uint32_t> remap(geometry.vertexCount(), INVALID_INDEX);
+
+    chunks.reserve(leaves.size());
+    for (const auto& leaf : leaves)
+    {
+        chunks.emplace_back(extractTriangles(geometry, std::span(triangles).subspan(leaf.begin, leaf.end - leaf.begin), remap));
+    }
+
+    return chunks;
+}
+
+} // namespace polar
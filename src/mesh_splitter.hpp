@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Splits a geometry into spatially coherent chunks of at most maxTriangles triangles each. Triangles are clustered by recursively
+// partitioning their centroids at the median of the longest axis, so every chunk is compact (which keeps the resulting BLAS tight).
+// Each chunk only carries the vertices it references. If the geometry is already small enough it is returned as is.
+std::vector<Geometry> splitGeometry(Geometry geometry, std::uint32_t maxTriangles);
+
+// Copies the given triangles into a new geometry that only carries the vertices they reference. remap needs an entry per vertex of the
+// geometry that is INVALID_INDEX, and is left that way, so it can be reused for multiple calls.
+Geometry extractTriangles(const Geometry& geometry, std::span<const std::uint32_t> triangles, std::vector<std::uint32_t>& remap);
+
+} // namespace polar
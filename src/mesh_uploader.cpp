@@ -0,0 +1,123 @@
+#include "mesh_uploader.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+
+#include <acceleration_structure.hpp>
+
+namespace polar
+{
+
+// Every attribute array starts at a multiple of this, which satisfies the alignment requirements of all of them:
+constexpr vk::DeviceSize ATTRIBUTE_ALIGNMENT = 16;
+
+struct GeometryLayout
+{
+    vk::DeviceSize positions = 0;
+    vk::DeviceSize normals   = 0;
+    vk::DeviceSize texCoords = 0;
+    vk::DeviceSize indices   = 0;
+};
+
+template <typename T>
+static vk::DeviceSize
+appendArray(std::vector<std::byte>& data, const std::vector<T>& values)
+{
+    const auto offset = alignUp(data.size(), ATTRIBUTE_ALIGNMENT);
+    data.resize(offset + values.size() * sizeof(T));
+    std::memcpy(data.data() + offset, values.data(), values.size() * sizeof(T));
+    return offset;
+}
+
+std::vector<GPUMesh> uploadMeshes(const Context& context, const GPUAllocator& allocator, const std::vector<Mesh>& meshes)
+{
+    const auto& device = context.device();
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = context.queueFamilyIndex(),
+    });
+
+    auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = *commandBuffers.front();
+
+    commandBuffer.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    std::vector<GPUMesh>         gpuMeshes;
+    std::vector<GPUBufferUnique> stagingBuffers;
+    gpuMeshes.reserve(meshes.size());
+    stagingBuffers.reserve(meshes.size());
+
+    vk::DeviceSize totalSize = 0;
+    for (const auto& mesh : meshes)
+    {
+        std::vector<std::byte>      data;
+        std::vector<GeometryLayout> layouts;
+        layouts.reserve(mesh.geometries.size());
+
+        for (const auto& geometry : mesh.geometries)
+        {
+            layouts.emplace_back(GeometryLayout{
+                .positions = appendArray(data, geometry.positions),
+                .normals   = appendArray(data, geometry.normals),
+                .texCoords = appendArray(data, geometry.texCoords),
+                .indices   = appendArray(data, geometry.indices),
+            });
+        }
+
+        GPUMesh gpuMesh{
+            .buffer      = allocator.allocate(data.size(),
+                                              vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                                  vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer |
+                                                  vk::BufferUsageFlagBits::eTransferDst,
+                                              VMA_MEMORY_USAGE_GPU_ONLY),
+            .size        = data.size(),
+            .contentHash = contentHash(mesh),
+            .buildHints  = mesh.buildHints,
+        };
+
+        const auto address = gpuMesh.buffer.deviceAddress(context);
+        for (std::size_t i = 0; i < mesh.geometries.size(); ++i)
+        {
+            const auto& geometry = mesh.geometries[i];
+            const auto& layout   = layouts[i];
+
+            gpuMesh.geometries.emplace_back(GPUGeometry{
+                .positions     = address + layout.positions,
+                .normals       = geometry.normals.empty() ? 0 : address + layout.normals,
+                .texCoords     = geometry.texCoords.empty() ? 0 : address + layout.texCoords,
+                .indices       = address + layout.indices,
+                .vertexCount   = geometry.vertexCount(),
+                .triangleCount = geometry.triangleCount(),
+                .materialIndex = geometry.materialIndex,
+                .opaque        = geometry.opaque,
+            });
+        }
+
+        stagingBuffers.emplace_back(allocator.addCopyStagingToBuffer(commandBuffer, gpuMesh.buffer, data.data(), data.size()));
+        totalSize += data.size();
+
+        gpuMeshes.emplace_back(std::move(gpuMesh));
+    }
+
+    // Make the vertex data visible to acceleration structure builds and shaders:
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eShaderRead,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR | vk::PipelineStageFlagBits::eAllCommands, {}, barrier, {}, {});
+
+    submitAndWait(context, commandBuffer, DEFAULT_FENCE_TIMEOUT, "mesh upload");
+
+    spdlog::info("Uploaded {} meshes ({} MiB).", gpuMeshes.size(), totalSize >> 20);
+
+    return gpuMeshes;
+}
+
+} // namespace polar
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Device addresses of the vertex attributes and indices of a single geometry. Attributes that aren't present have an address of 0.
+struct GPUGeometry
+{
+    vk::DeviceAddress positions     = 0;
+    vk::DeviceAddress normals       = 0;
+    vk::DeviceAddress texCoords     = 0;
+    vk::DeviceAddress indices       = 0;
+    std::uint32_t     vertexCount   = 0;
+    std::uint32_t     triangleCount = 0;
+    std::uint32_t     materialIndex = INVALID_INDEX;
+    bool              opaque        = true;
+};
+
+// All geometries of a mesh live in a single buffer.
+struct GPUMesh
+{
+    GPUBufferUnique          buffer;
+    vk::DeviceSize           size        = 0;
+    std::uint64_t            contentHash = 0; // Of the source mesh
+    BuildHints               buildHints;      // Of the source mesh
+    std::vector<GPUGeometry> geometries;
+
+    std::uint32_t triangleCount() const
+    {
+        std::uint32_t count = 0;
+        for (const auto& geometry : geometries)
+        {
+            count += geometry.triangleCount;
+        }
+        return count;
+    }
+};
+
+// Uploads the vertex and index data of all meshes. The buffers can be used as acceleration structure build input and can be accessed
+// through their device address in shaders.
+std::vector<GPUMesh> uploadMeshes(const Context& context, const GPUAllocator& allocator, const std::vector<Mesh>& meshes);
+
+} // namespace polar
@@ -0,0 +1,340 @@
+#include "mip_generator.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <stdexcept>
+
+#include <color.hpp>
+#include <util.hpp>
+
+namespace polar
+{
+
+using Level = std::vector<glm::vec4>;
+
+static bool
+isSrgb(const Texture& texture)
+{
+    // 16 bit textures don't have an sRGB format, so for those we have to go by their usage:
+    return texture.format == vk::Format::eR8G8B8A8Srgb || (texture.format == vk::Format::eR16G16B16A16Unorm && texture.usage == TextureUsage::eColor);
+}
+
+static Level
+decodeLevel(const Texture& texture, const TextureLevel& level)
+{
+    const auto srgb       = isSrgb(texture);
+    const auto texelCount = static_cast<std::size_t>(level.width) * level.height;
+
+    Level result(texelCount);
+    parallelFor(level.height, [&](const std::size_t y) {
+        for (std::size_t texel = y * level.width; texel < (y + 1) * level.width; ++texel)
+        {
+            auto& value = result[texel];
+            switch (texture.format)
+            {
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+                for (int c = 0; c < 4; ++c)
+                {
+                    value[c] = std::to_integer<int>(level.data[texel * 4 + c]) / 255.f;
+                }
+                break;
+            case vk::Format::eR16G16B16A16Unorm:
+                for (int c = 0; c < 4; ++c)
+                {
+                    std::uint16_t component;
+                    std::memcpy(&component, level.data.data() + (texel * 4 + c) * sizeof(component), sizeof(component));
+                    value[c] = component / 65535.f;
+                }
+                break;
+            default:
+                std::memcpy(&value, level.data.data() + texel * sizeof(value), sizeof(value));
+                break;
+            }
+
+            if (srgb)
+            {
+                value = glm::vec4(srgbToLinear(value.r), srgbToLinear(value.g), srgbToLinear(value.b), value.a);
+            }
+        }
+    });
+
+    return result;
+}
+
+static TextureLevel
+encodeLevel(const Texture& texture, const Level& level, const std::uint32_t width, const std::uint32_t height)
+{
+    const auto srgb = isSrgb(texture);
+
+    TextureLevel result{
+        .width  = width,
+        .height = height,
+    };
+
+    switch (texture.format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+        result.data.resize(level.size() * 4);
+        break;
+    case vk::Format::eR16G16B16A16Unorm:
+        result.data.resize(level.size() * 4 * sizeof(std::uint16_t));
+        break;
+    default:
+        result.data.resize(level.size() * sizeof(glm::vec4));
+        break;
+    }
+
+    parallelFor(height, [&](const std::size_t y) {
+        for (std::size_t texel = y * width; texel < (y + 1) * width; ++texel)
+        {
+            auto value = level[texel];
+            if (srgb)
+            {
+                value = glm::vec4(linearToSrgb(value.r), linearToSrgb(value.g), linearToSrgb(value.b), value.a);
+            }
+
+            switch (texture.format)
+            {
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+                for (int c = 0; c < 4; ++c)
+                {
+                    result.data[texel * 4 + c] = static_cast<std::byte>(std::lround(glm::clamp(value[c], 0.f, 1.f) * 255.f));
+                }
+                break;
+            case vk::Format::eR16G16B16A16Unorm:
+                for (int c = 0; c < 4; ++c)
+                {
+                    const auto component = static_cast<std::uint16_t>(std::lround(glm::clamp(value[c], 0.f, 1.f) * 65535.f));
+                    std::memcpy(result.data.data() + (texel * 4 + c) * sizeof(component), &component, sizeof(component));
+                }
+                break;
+            default:
+                std::memcpy(result.data.data() + texel * sizeof(value), &value, sizeof(value));
+                break;
+            }
+        }
+    });
+
+    return result;
+}
+
+//
+// Filters
+//
+
+// Source texels of a destination texel along one axis of the given size, weighted by how much of them its footprint covers. That is 2
+// texels along even axes, but parts of 3 along odd ones, so that no texel is skipped (as in shaders/downsample.comp).
+struct BoxTaps
+{
+    std::uint32_t        first = 0;
+    std::uint32_t        count = 0;
+    std::array<float, 3> weights{};
+};
+
+static BoxTaps
+boxTaps(const std::uint32_t index, const std::uint32_t size)
+{
+    const auto scale = static_cast<double>(size) / std::max(1u, size / 2);
+    const auto begin = index * scale;
+    const auto end   = begin + scale;
+    const auto last  = std::min(static_cast<std::uint32_t>(std::ceil(end)), size);
+
+    // Rounding can make the footprint touch a 4th texel by a tiny fraction, which is dropped and made up for by normalizing:
+    BoxTaps taps{.first = static_cast<std::uint32_t>(begin)};
+    float   sum = 0.f;
+    for (auto i = taps.first; i < last && taps.count < taps.weights.size(); ++i)
+    {
+        taps.weights[taps.count] = static_cast<float>(std::min(end, i + 1.0) - std::max(begin, static_cast<double>(i)));
+        sum                     += taps.weights[taps.count++];
+    }
+    for (auto& weight : taps.weights)
+    {
+        weight /= sum;
+    }
+    return taps;
+}
+
+static Level
+downsampleBox(const Level& src, const std::uint32_t width, const std::uint32_t height)
+{
+    const auto dstWidth  = std::max(1u, width / 2);
+    const auto dstHeight = std::max(1u, height / 2);
+
+    std::vector<BoxTaps> columns(dstWidth);
+    for (std::uint32_t x = 0; x < dstWidth; ++x)
+    {
+        columns[x] = boxTaps(x, width);
+    }
+
+    Level dst(static_cast<std::size_t>(dstWidth) * dstHeight);
+    parallelFor(dstHeight, [&](const std::size_t y) {
+        const auto rows = boxTaps(static_cast<std::uint32_t>(y), height);
+        for (std::size_t x = 0; x < dstWidth; ++x)
+        {
+            glm::vec4 sum(0.f);
+            for (std::uint32_t i = 0; i < rows.count; ++i)
+            {
+                const auto row = static_cast<std::size_t>(rows.first + i) * width;
+                for (std::uint32_t j = 0; j < columns[x].count; ++j)
+                {
+                    sum += rows.weights[i] * columns[x].weights[j] * src[row + columns[x].first + j];
+                }
+            }
+            dst[y * dstWidth + x] = sum;
+        }
+    });
+
+    return dst;
+}
+
+constexpr int   KAISER_TAPS  = 8;
+constexpr float KAISER_ALPHA = 4.f;
+
+static float
+besselI0(const float x)
+{
+    // Power series of the zeroth order modified Bessel function, which converges quickly for the arguments we use:
+    float sum = 1.f, term = 1.f;
+    for (int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2.f * k)) * (x / (2.f * k));
+        sum  += term;
+    }
+    return sum;
+}
+
+static const std::array<float, KAISER_TAPS>&
+kaiserWeights()
+{
+    static const auto weights = []() {
+        std::array<float, KAISER_TAPS> weights;
+
+        // The taps sit at half texel offsets from the center of the destination texel (in source texels):
+        float sum = 0.f;
+        for (int i = 0; i < KAISER_TAPS; ++i)
+        {
+            const auto offset = i - KAISER_TAPS / 2 + 0.5f;
+            const auto x      = offset / 2.f; // The cutoff frequency is half of the source's
+            const auto sinc   = std::sin(std::numbers::pi_v<float> * x) / (std::numbers::pi_v<float> * x);
+            const auto ratio  = offset / (KAISER_TAPS / 2);
+            const auto window = besselI0(KAISER_ALPHA * std::sqrt(std::max(0.f, 1.f - ratio * ratio))) / besselI0(KAISER_ALPHA);
+
+            weights[i] = sinc * window;
+            sum       += weights[i];
+        }
+
+        for (auto& weight : weights)
+        {
+            weight /= sum;
+        }
+
+        return weights;
+    }();
+
+    return weights;
+}
+
+// Halves the level along a single axis (if it isn't 1 texel wide along that axis already).
+static Level
+downsampleKaiserAxis(const Level& src, const std::uint32_t width, const std::uint32_t height, const bool horizontal)
+{
+    const auto size = horizontal ? width : height;
+    if (size == 1)
+    {
+        return src;
+    }
+
+    const auto dstWidth  = horizontal ? width / 2 : width;
+    const auto dstHeight = horizontal ? height : height / 2;
+    const auto& weights  = kaiserWeights();
+
+    Level dst(static_cast<std::size_t>(dstWidth) * dstHeight);
+    parallelFor(dstHeight, [&](const std::size_t y) {
+        for (std::size_t x = 0; x < dstWidth; ++x)
+        {
+            const auto center = static_cast<std::int64_t>(horizontal ? x : y) * 2;
+
+            glm::vec4 sum(0.f);
+            for (int i = 0; i < KAISER_TAPS; ++i)
+            {
+                const auto tap = static_cast<std::size_t>(std::clamp<std::int64_t>(center + i - KAISER_TAPS / 2 + 1, 0, size - 1));
+                sum += weights[i] * (horizontal ? src[y * width + tap] : src[tap * width + x]);
+            }
+            dst[y * dstWidth + x] = sum;
+        }
+    });
+
+    return dst;
+}
+
+void generateMips(Texture& texture, const MipFilter filter)
+{
+    switch (texture.format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eR16G16B16A16Unorm:
+    case vk::Format::eR32G32B32A32Sfloat:
+        break;
+    default:
+        throw std::runtime_error(fmt::format("Can't generate mips for texture {} with format {}", texture.name, vk::to_string(texture.format)));
+    }
+
+    if (texture.levels.empty())
+    {
+        return;
+    }
+
+    texture.levels.resize(1);
+
+    auto width  = texture.levels.front().width;
+    auto height = texture.levels.front().height;
+    auto level  = decodeLevel(texture, texture.levels.front());
+
+    // The negative lobes of the Kaiser filter can overshoot, which we don't want to carry over into the next level for normalized formats:
+    const auto clampLevel = texture.format != vk::Format::eR32G32B32A32Sfloat;
+
+    const auto levelCount = mipLevelCount(width, height);
+    texture.levels.reserve(levelCount);
+
+    for (std::uint32_t i = 1; i < levelCount; ++i)
+    {
+        if (filter == MipFilter::eKaiser)
+        {
+            level = downsampleKaiserAxis(level, width, height, true);
+            level = downsampleKaiserAxis(level, std::max(1u, width / 2), height, false);
+            if (clampLevel)
+            {
+                for (auto& texel : level)
+                {
+                    texel = glm::clamp(texel, 0.f, 1.f);
+                }
+            }
+        }
+        else
+        {
+            level = downsampleBox(level, width, height);
+        }
+
+        width  = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+
+        texture.levels.emplace_back(encodeLevel(texture, level, width, height));
+    }
+}
+
+std::uint32_t mipLevelCount(const std::uint32_t width, const std::uint32_t height)
+{
+    return static_cast<std::uint32_t>(std::bit_width(std::max(width, height)));
+}
+
+} // namespace polar
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Where missing mip levels of a texture get generated.
+enum class MipGeneration
+{
+    eNone, // Textures only get the levels they were imported with
+    eCpu,  // At import, see generateMips
+    eGpu,  // After upload, by a compute downsampler (see TextureUploader)
+    eAuto, // eCpu or eGpu, whichever TextureUploader::preferredMipGeneration() picks for the device
+};
+
+enum class MipFilter
+{
+    eBox,    // 2x2 box filter (with 3 weighted taps along odd axes), cheap but slightly blurry
+    eKaiser, // 8 tap Kaiser windowed sinc, keeps detail sharper for the finer levels
+};
+
+// Appends all missing levels (down to 1x1) to a texture that has its first level. Filtering happens on linear values, so sRGB encoded
+// textures are decoded before averaging and encoded again afterwards. Every level is computed from the unquantized values of the previous
+// one, with the rows of each level computed in parallel. Only uncompressed formats are supported.
+void generateMips(Texture& texture, MipFilter filter);
+
+// Returns the number of levels of a full mip chain for the given extent.
+std::uint32_t mipLevelCount(std::uint32_t width, std::uint32_t height);
+
+} // namespace polar
@@ -0,0 +1,179 @@
+#include "ray_sorter.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <filesystem>
+
+#include <acceleration_structure.hpp>
+#include <configure.hpp>
+
+namespace polar
+{
+
+// Mirrors SortConstants in shaders/wavefront/radix_sort.comp:
+struct SortConstants
+{
+    vk::DeviceAddress queues        = 0;
+    vk::DeviceAddress keysIn        = 0;
+    vk::DeviceAddress keysOut       = 0;
+    vk::DeviceAddress valuesIn      = 0;
+    vk::DeviceAddress valuesOut     = 0;
+    vk::DeviceAddress histograms    = 0;
+    std::uint32_t     bucket        = 0;
+    std::uint32_t     pathQueue     = 0;
+    std::uint32_t     shift         = 0;
+    std::uint32_t     directionBits = 0;
+};
+
+constexpr std::uint32_t RADIX_BITS     = 4;
+constexpr std::uint32_t RADIX          = 1 << RADIX_BITS;
+constexpr std::uint32_t DIRECTION_BITS = 3;
+
+static void
+memoryBarrier(const vk::CommandBuffer& commandBuffer)
+{
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+}
+
+RaySorter::RaySorter(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param)
+{
+    const auto& device = m_context.device();
+
+    const vk::PushConstantRange pushConstantRange{
+        .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        .offset     = 0,
+        .size       = sizeof(SortConstants),
+    };
+    m_layout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange,
+    });
+
+    const auto path   = std::filesystem::path(SHADER_DIRECTORY) / "wavefront" / "radix_sort.comp";
+    const auto source = [&](const char* kernel) {
+        return ShaderSource{
+            .path    = path,
+            .stage   = vk::ShaderStageFlagBits::eCompute,
+            .defines = {ShaderDefine{.name = kernel}},
+        };
+    };
+    const ShaderSource sources[] = {source("SORT_KEYS"), source("SORT_HISTOGRAM"), source("SORT_SCAN"), source("SORT_SCATTER")};
+    const auto         modules   = compiler.createModules(device, sources);
+
+    const vk::SpecializationMapEntry mapEntry{.constantID = 0, .offset = 0, .size = sizeof(std::uint32_t)};
+    const vk::SpecializationInfo specializationInfo{
+        .mapEntryCount = 1,
+        .pMapEntries   = &mapEntry,
+        .dataSize      = sizeof(std::uint32_t),
+        .pData         = &m_param.workgroupSize,
+    };
+
+    std::array<vk::UniquePipeline*, 4> pipelines = {&m_keysPipeline, &m_histogramPipeline, &m_scanPipeline, &m_scatterPipeline};
+    for (std::size_t i = 0; i < pipelines.size(); ++i)
+    {
+        const vk::ComputePipelineCreateInfo pipelineCreateInfo{
+            .stage =
+                vk::PipelineShaderStageCreateInfo{
+                    .stage               = vk::ShaderStageFlagBits::eCompute,
+                    .module              = *modules[i],
+                    .pName               = "main",
+                    .pSpecializationInfo = &specializationInfo,
+                },
+            .layout = *m_layout,
+        };
+        *pipelines[i] = device.createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+    }
+}
+
+void RaySorter::setMaterialCount(const std::uint32_t materialCount)
+{
+    const auto materialBits = static_cast<std::uint32_t>(std::bit_width(std::max(materialCount, 1u) - 1));
+    const auto keyBits      = materialBits + (m_param.sortByDirection ? DIRECTION_BITS : 0);
+
+    // An even number of passes ends up back in the bucket queues:
+    m_passCount = std::max((keyBits + RADIX_BITS - 1) / RADIX_BITS, 1u);
+    m_passCount += m_passCount % 2;
+
+    spdlog::info("Sorting rays by {} key bits in {} passes.", keyBits, m_passCount);
+}
+
+void RaySorter::resize(const std::uint32_t capacity)
+{
+    m_scratchBuffer = {};
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    const vk::DeviceSize arraySize      = alignUp(capacity * sizeof(std::uint32_t), 16);
+    const vk::DeviceSize histogramsSize = RADIX * ((capacity + m_param.workgroupSize - 1) / m_param.workgroupSize) * sizeof(std::uint32_t);
+
+    m_scratchBuffer = m_allocator.allocate(3 * arraySize + histogramsSize,
+                                           vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                           VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const auto address = m_scratchBuffer.deviceAddress(m_context);
+    m_keys[0]          = address;
+    m_keys[1]          = address + arraySize;
+    m_values           = address + 2 * arraySize;
+    m_histograms       = address + 3 * arraySize;
+}
+
+void RaySorter::sort(const vk::CommandBuffer& commandBuffer, const vk::Buffer& queueBuffer, const vk::DeviceAddress queuesAddress,
+                     const GPUWavefrontQueues& queues, const std::uint32_t pathQueue) const
+{
+    const auto dispatch = [&](const vk::Pipeline& pipeline, const SortConstants& constants, const std::uint32_t bucket) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.pushConstants(*m_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+        commandBuffer.dispatchIndirect(queueBuffer, (FIRST_BUCKET_QUEUE + bucket) * sizeof(QueueHeader) + offsetof(QueueHeader, groupCountX));
+    };
+
+    for (std::uint32_t bucket = 0; bucket < queues.bucketCount; ++bucket)
+    {
+        // The values are the path indices, which are sorted in place over an even number of passes:
+        const vk::DeviceAddress bucketValues = queues.buckets + static_cast<vk::DeviceSize>(bucket) * queues.capacity * sizeof(std::uint32_t);
+        const vk::DeviceAddress values[2]    = {bucketValues, m_values};
+
+        SortConstants constants{
+            .queues        = queuesAddress,
+            .keysOut       = m_keys[0],
+            .valuesIn      = bucketValues,
+            .histograms    = m_histograms,
+            .bucket        = bucket,
+            .pathQueue     = pathQueue,
+            .directionBits = m_param.sortByDirection ? DIRECTION_BITS : 0,
+        };
+        dispatch(*m_keysPipeline, constants, bucket);
+        memoryBarrier(commandBuffer);
+
+        for (std::uint32_t pass = 0; pass < m_passCount; ++pass)
+        {
+            constants.keysIn    = m_keys[pass % 2];
+            constants.keysOut   = m_keys[(pass + 1) % 2];
+            constants.valuesIn  = values[pass % 2];
+            constants.valuesOut = values[(pass + 1) % 2];
+            constants.shift     = pass * RADIX_BITS;
+
+            dispatch(*m_histogramPipeline, constants, bucket);
+            memoryBarrier(commandBuffer);
+
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *m_scanPipeline);
+            commandBuffer.dispatch(1, 1, 1);
+            memoryBarrier(commandBuffer);
+
+            dispatch(*m_scatterPipeline, constants, bucket);
+            memoryBarrier(commandBuffer);
+        }
+    }
+}
+
+} // namespace polar
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <integrator_interface.hpp>
+#include <shader_compiler.hpp>
+
+namespace polar
+{
+
+// Sorts the path indices in the queues of the material buckets of the wavefront integrator by material (and optionally the octant of the
+// ray direction), between trace and shade. Neighbouring shade threads then mostly run the same material, which makes them diverge less
+// and access the same material data and textures. The sort is a stable radix sort with 4 bits per pass, in compute
+// (shaders/wavefront/radix_sort.comp), which only sorts as many bits as the material indices need. Every pass is a histogram, a scan and
+// a scatter kernel, dispatched indirectly over the entries of the bucket.
+class RaySorter
+{
+  public:
+    struct Param
+    {
+        // Has to match the kernels that append to the bucket queues.
+        std::uint32_t workgroupSize = 64;
+
+        // Whether paths with the same material are also sorted by the octant of their direction.
+        bool sortByDirection = true;
+    };
+
+    RaySorter(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param);
+
+    RaySorter(const RaySorter&)            = delete;
+    RaySorter(RaySorter&&)                 = delete;
+    RaySorter& operator=(const RaySorter&) = delete;
+    RaySorter& operator=(RaySorter&&)      = delete;
+
+    // Sets the number of key bits for the given number of material indices (including the one for geometry without a material).
+    void setMaterialCount(std::uint32_t materialCount);
+
+    // Allocates the scratch memory for sorting up to capacity entries (or frees it for 0), while the GPU isn't rendering.
+    void resize(std::uint32_t capacity);
+
+    // Records the sort of the queue of every bucket. The headers of all queues are at the start of the queue buffer (for the indirect
+    // dispatches). The compute push constants have to be pushed again afterwards.
+    void sort(const vk::CommandBuffer& commandBuffer, const vk::Buffer& queueBuffer, vk::DeviceAddress queuesAddress,
+              const GPUWavefrontQueues& queues, std::uint32_t pathQueue) const;
+
+  private:
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    vk::UniquePipelineLayout m_layout;
+    vk::UniquePipeline       m_keysPipeline;
+    vk::UniquePipeline       m_histogramPipeline;
+    vk::UniquePipeline       m_scanPipeline;
+    vk::UniquePipeline       m_scatterPipeline;
+
+    GPUBufferUnique   m_scratchBuffer; // Two key arrays, a value array and the histograms
+    vk::DeviceAddress m_keys[2]    = {};
+    vk::DeviceAddress m_values     = 0;
+    vk::DeviceAddress m_histograms = 0;
+    std::uint32_t     m_passCount  = 2;
+};
+
+} // namespace polar
@@ -0,0 +1,381 @@
+#include "ray_tracing_pipeline.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <util.hpp>
+
+namespace polar
+{
+
+RayTracingPipeline::RayTracingPipeline(const Context& context, const ShaderCompiler& compiler, const vk::PipelineLayout& layout,
+                                       const Param& param)
+    : m_context(context), m_compiler(compiler), m_layout(layout), m_param(param)
+{
+}
+
+std::uint32_t RayTracingPipeline::addGroup(const ShaderGroup& group)
+{
+    m_groups.emplace_back(group);
+    return static_cast<std::uint32_t>(m_groups.size() - 1);
+}
+
+void RayTracingPipeline::setGroup(const std::uint32_t groupIndex, const ShaderGroup& group)
+{
+    if (groupIndex >= m_groups.size())
+    {
+        throw std::runtime_error(fmt::format("Shader group {} doesn't exist, the pipeline only has {}", groupIndex, m_groups.size()));
+    }
+
+    m_groups[groupIndex] = group;
+}
+
+void RayTracingPipeline::commit()
+{
+    if (m_build.valid())
+    {
+        m_pending = true;
+        return;
+    }
+
+    start();
+}
+
+void RayTracingPipeline::wait() const
+{
+    if (m_build.valid())
+    {
+        m_build.wait();
+    }
+}
+
+bool RayTracingPipeline::update(const std::uint64_t frameIndex)
+{
+    while (!m_retired.empty() && m_retired.front().frameIndex + m_param.framesInFlight <= frameIndex)
+    {
+        m_retired.pop_front();
+    }
+
+    m_failedGroups.clear();
+
+    if (!m_build.valid() || m_build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return false;
+    }
+
+    Build build;
+    try
+    {
+        build = m_build.get();
+    }
+    catch (const std::exception& exception)
+    {
+        build.error = exception.what();
+    }
+
+    if (!build.pipeline)
+    {
+        // Most likely a shader that doesn't compile while iterating on it, which shouldn't take down the renderer:
+        if (!m_pipeline)
+        {
+            throw std::runtime_error(build.error);
+        }
+
+        spdlog::error("Failed to build the ray tracing pipeline, keeping the current one: {}", build.error);
+        m_failedGroups = std::move(build.failedGroups);
+        if (m_pending)
+        {
+            start();
+        }
+        return false;
+    }
+
+    if (m_pipeline)
+    {
+        m_retired.emplace_back(RetiredPipeline{
+            .frameIndex = frameIndex,
+            .pipeline   = std::move(m_pipeline),
+            .libraries  = std::move(m_libraries),
+        });
+    }
+
+    m_pipeline  = std::move(build.pipeline);
+    m_libraries = std::move(build.libraries);
+
+    // Started after the swap so that it can reuse the libraries that were just built:
+    if (m_pending)
+    {
+        start();
+    }
+
+    return true;
+}
+
+void RayTracingPipeline::start()
+{
+    m_pending = false;
+
+    // The groups and libraries are copied so that they can be changed while the build is running:
+    m_build = std::async(std::launch::async, &RayTracingPipeline::build, this, m_groups, m_libraries);
+}
+
+RayTracingPipeline::Build RayTracingPipeline::build(const std::vector<ShaderGroup> groups, const Libraries previousLibraries) const
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // All shaders are compiled at once, so that they are compiled in parallel. Unchanged shaders come from the compiler's cache:
+    std::vector<ShaderSource> sources;
+    std::vector<std::size_t>  firstShaders;
+    std::vector<std::size_t>  sourceGroups;
+    for (std::size_t i = 0; i < groups.size(); ++i)
+    {
+        firstShaders.emplace_back(sources.size());
+        sources.insert(sources.end(), groups[i].shaders.begin(), groups[i].shaders.end());
+        sourceGroups.resize(sources.size(), i);
+    }
+
+    // Errors are kept per group, so that the caller can tell which groups keep the pipeline from building. Exceptions can't leave the
+    // worker threads, so they are collected and reported together:
+    std::vector<std::vector<std::uint32_t>> codes(sources.size());
+    std::vector<std::string>                sourceErrors(sources.size());
+    parallelFor(sources.size(), [&](const std::size_t i) {
+        try
+        {
+            codes[i] = m_compiler.compile(sources[i]);
+        }
+        catch (const std::exception& exception)
+        {
+            sourceErrors[i] = exception.what();
+        }
+    });
+
+    std::vector<std::string> errors(groups.size());
+    for (std::size_t i = 0; i < sources.size(); ++i)
+    {
+        if (!sourceErrors[i].empty())
+        {
+            errors[sourceGroups[i]] += sourceErrors[i] + "\n";
+        }
+    }
+
+    std::unordered_map<std::uint64_t, std::shared_ptr<const Library>> reusableLibraries;
+    for (const auto& library : previousLibraries)
+    {
+        reusableLibraries.emplace(library->hash, library);
+    }
+
+    Build build{
+        .libraries = Libraries(groups.size()),
+    };
+
+    std::vector<std::uint64_t> hashes(groups.size());
+    std::vector<std::size_t>   missing;
+    for (std::size_t i = 0; i < groups.size(); ++i)
+    {
+        if (!errors[i].empty())
+        {
+            continue;
+        }
+
+        for (std::size_t j = 0; j < groups[i].shaders.size(); ++j)
+        {
+            const auto  stage = static_cast<std::uint32_t>(groups[i].shaders[j].stage);
+            const auto& code  = codes[firstShaders[i] + j];
+
+            hashes[i] = hashBytes(&stage, sizeof(stage), hashes[i]);
+            hashes[i] = hashBytes(code.data(), code.size() * sizeof(std::uint32_t), hashes[i]);
+        }
+        for (const auto& constant : groups[i].specialization)
+        {
+            const std::uint32_t entry[] = {constant.first, constant.second};
+            hashes[i]                   = hashBytes(entry, sizeof(entry), hashes[i]);
+        }
+
+        const auto itr = reusableLibraries.find(hashes[i]);
+        if (itr != reusableLibraries.end())
+        {
+            build.libraries[i] = itr->second;
+        }
+        else
+        {
+            missing.emplace_back(i);
+        }
+    }
+
+    // Every missing library belongs to a different group, so they can write their errors directly:
+    parallelFor(missing.size(), [&](const std::size_t i) {
+        const auto groupIndex = missing[i];
+        try
+        {
+            const std::span<const std::vector<std::uint32_t>> groupCodes(codes.data() + firstShaders[groupIndex], groups[groupIndex].shaders.size());
+            build.libraries[groupIndex] = createLibrary(groups[groupIndex], groupCodes, hashes[groupIndex]);
+        }
+        catch (const std::exception& exception)
+        {
+            errors[groupIndex] = exception.what();
+        }
+    });
+
+    for (std::size_t i = 0; i < groups.size(); ++i)
+    {
+        if (!errors[i].empty())
+        {
+            build.failedGroups.emplace_back(static_cast<std::uint32_t>(i));
+            build.error += fmt::format("Shader group {}: {}\n", i, errors[i]);
+        }
+    }
+
+    if (!build.failedGroups.empty())
+    {
+        return build;
+    }
+
+    build.pipeline = link(build.libraries);
+
+    spdlog::info("Built ray tracing pipeline with {} groups ({} new libraries) in {:.1f} ms.", groups.size(), missing.size(),
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    return build;
+}
+
+std::unique_ptr<RayTracingPipeline::Library> RayTracingPipeline::createLibrary(const ShaderGroup& group,
+                                                                               const std::span<const std::vector<std::uint32_t>> codes,
+                                                                               const std::uint64_t hash) const
+{
+    const auto& device = m_context.device();
+
+    vk::RayTracingShaderGroupCreateInfoKHR groupCreateInfo{
+        .type               = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup,
+        .generalShader      = VK_SHADER_UNUSED_KHR,
+        .closestHitShader   = VK_SHADER_UNUSED_KHR,
+        .anyHitShader       = VK_SHADER_UNUSED_KHR,
+        .intersectionShader = VK_SHADER_UNUSED_KHR,
+    };
+
+    std::vector<vk::SpecializationMapEntry> mapEntries;
+    std::vector<std::uint32_t>              constants;
+    for (const auto& [constantId, value] : group.specialization)
+    {
+        mapEntries.emplace_back(vk::SpecializationMapEntry{
+            .constantID = constantId,
+            .offset     = static_cast<std::uint32_t>(constants.size() * sizeof(std::uint32_t)),
+            .size       = sizeof(std::uint32_t),
+        });
+        constants.emplace_back(value);
+    }
+
+    const vk::SpecializationInfo specializationInfo{
+        .mapEntryCount = static_cast<std::uint32_t>(mapEntries.size()),
+        .pMapEntries   = mapEntries.data(),
+        .dataSize      = constants.size() * sizeof(std::uint32_t),
+        .pData         = constants.data(),
+    };
+
+    std::vector<vk::UniqueShaderModule>            modules;
+    std::vector<vk::PipelineShaderStageCreateInfo> stages;
+    for (std::size_t i = 0; i < group.shaders.size(); ++i)
+    {
+        const auto& shader     = group.shaders[i];
+        const auto  stageIndex = static_cast<std::uint32_t>(i);
+
+        switch (shader.stage)
+        {
+        case vk::ShaderStageFlagBits::eRaygenKHR:
+        case vk::ShaderStageFlagBits::eMissKHR:
+        case vk::ShaderStageFlagBits::eCallableKHR:
+            groupCreateInfo.type          = vk::RayTracingShaderGroupTypeKHR::eGeneral;
+            groupCreateInfo.generalShader = stageIndex;
+            break;
+        case vk::ShaderStageFlagBits::eClosestHitKHR:
+            groupCreateInfo.closestHitShader = stageIndex;
+            break;
+        case vk::ShaderStageFlagBits::eAnyHitKHR:
+            groupCreateInfo.anyHitShader = stageIndex;
+            break;
+        case vk::ShaderStageFlagBits::eIntersectionKHR:
+            groupCreateInfo.type               = vk::RayTracingShaderGroupTypeKHR::eProceduralHitGroup;
+            groupCreateInfo.intersectionShader = stageIndex;
+            break;
+        default:
+            throw std::runtime_error(fmt::format("{} isn't a ray tracing shader", shader.path.string()));
+        }
+
+        modules.emplace_back(device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+            .codeSize = codes[i].size() * sizeof(std::uint32_t),
+            .pCode    = codes[i].data(),
+        }));
+
+        stages.emplace_back(vk::PipelineShaderStageCreateInfo{
+            .stage               = shader.stage,
+            .module              = *modules.back(),
+            .pName               = shader.entryPoint.c_str(),
+            .pSpecializationInfo = constants.empty() ? nullptr : &specializationInfo,
+        });
+    }
+
+    if (stages.empty() || (groupCreateInfo.type == vk::RayTracingShaderGroupTypeKHR::eGeneral && stages.size() != 1))
+    {
+        throw std::runtime_error("A shader group needs either a single raygen, miss or callable shader, or one or more hit shaders");
+    }
+
+    const vk::RayTracingPipelineInterfaceCreateInfoKHR interfaceCreateInfo{
+        .maxPipelineRayPayloadSize      = m_param.maxPayloadSize,
+        .maxPipelineRayHitAttributeSize = m_param.maxHitAttributeSize,
+    };
+
+    auto library = std::make_unique<Library>();
+
+    library->hash     = hash;
+    library->pipeline = device
+                            .createRayTracingPipelineKHRUnique(nullptr, nullptr,
+                                                               vk::RayTracingPipelineCreateInfoKHR{
+                                                                   .flags                        = vk::PipelineCreateFlagBits::eLibraryKHR,
+                                                                   .stageCount                   = static_cast<std::uint32_t>(stages.size()),
+                                                                   .pStages                      = stages.data(),
+                                                                   .groupCount                   = 1,
+                                                                   .pGroups                      = &groupCreateInfo,
+                                                                   .maxPipelineRayRecursionDepth = m_param.maxRecursionDepth,
+                                                                   .pLibraryInterface            = &interfaceCreateInfo,
+                                                                   .layout                       = m_layout,
+                                                               })
+                            .value;
+
+    return library;
+}
+
+vk::UniquePipeline RayTracingPipeline::link(const Libraries& libraries) const
+{
+    std::vector<vk::Pipeline> handles;
+    handles.reserve(libraries.size());
+    for (const auto& library : libraries)
+    {
+        handles.emplace_back(*library->pipeline);
+    }
+
+    const vk::PipelineLibraryCreateInfoKHR libraryCreateInfo{
+        .libraryCount = static_cast<std::uint32_t>(handles.size()),
+        .pLibraries   = handles.data(),
+    };
+
+    const vk::RayTracingPipelineInterfaceCreateInfoKHR interfaceCreateInfo{
+        .maxPipelineRayPayloadSize      = m_param.maxPayloadSize,
+        .maxPipelineRayHitAttributeSize = m_param.maxHitAttributeSize,
+    };
+
+    // The groups of the linked pipeline are those of the libraries in order, so group i is the one of library i:
+    return m_context.device()
+        .createRayTracingPipelineKHRUnique(nullptr, nullptr,
+                                           vk::RayTracingPipelineCreateInfoKHR{
+                                               .maxPipelineRayRecursionDepth = m_param.maxRecursionDepth,
+                                               .pLibraryInfo                 = &libraryCreateInfo,
+                                               .pLibraryInterface            = &interfaceCreateInfo,
+                                               .layout                       = m_layout,
+                                           })
+        .value;
+}
+
+} // namespace polar
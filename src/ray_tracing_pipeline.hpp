@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <context.hpp>
+#include <shader_compiler.hpp>
+
+namespace polar
+{
+
+// All shaders of a shader group. The type of the group follows from their stages: a single raygen, miss or callable shader is a general
+// group, an intersection shader makes it a procedural hit group, and any other combination of hit shaders a triangles hit group.
+struct ShaderGroup
+{
+    std::vector<ShaderSource> shaders;
+
+    // Constant ID to value, applied to all shaders of the group. Shaders are specialized when their library is created, so groups that only
+    // differ in their constants share the same SPIR-V.
+    std::map<std::uint32_t, std::uint32_t> specialization;
+};
+
+// Ray tracing pipeline that is linked from one pipeline library (VK_KHR_pipeline_library) per shader group, so changing or adding a group
+// only creates the library of that group before relinking. Libraries are reused based on the hash of their SPIR-V.
+// Libraries are created and linked on a background thread. The current pipeline keeps being used until the new one is ready and swapped in
+// by update(), and is freed once the frames that may still be using it have finished.
+class RayTracingPipeline
+{
+  public:
+    struct Param
+    {
+        std::uint32_t maxRecursionDepth   = 1;
+        std::uint32_t maxPayloadSize      = 64; // Bytes
+        std::uint32_t maxHitAttributeSize = 8;  // Bytes, 8 is enough for the barycentrics of triangles
+
+        // Number of frames that may still use a pipeline after it has been replaced.
+        std::uint32_t framesInFlight = 2;
+    };
+
+    RayTracingPipeline(const Context& context, const ShaderCompiler& compiler, const vk::PipelineLayout& layout, const Param& param);
+
+    RayTracingPipeline(const RayTracingPipeline&)            = delete;
+    RayTracingPipeline(RayTracingPipeline&&)                 = delete;
+    RayTracingPipeline& operator=(const RayTracingPipeline&) = delete;
+    RayTracingPipeline& operator=(RayTracingPipeline&&)      = delete;
+
+    // Adds a group and returns its index in the pipeline (which is what the shader binding table refers to). Changes only take effect
+    // after commit().
+    std::uint32_t addGroup(const ShaderGroup& group);
+    void          setGroup(std::uint32_t groupIndex, const ShaderGroup& group);
+
+    // Starts building a pipeline for the current groups in the background. If a build is already running, the new one starts after it.
+    void commit();
+
+    // Blocks until the running build (if any) has finished.
+    void wait() const;
+
+    // Swaps in the new pipeline if a build has finished and frees pipelines that are no longer used. Returns true if the pipeline changed,
+    // in which case the shader binding table has to be rebuilt. A failed build is logged and the current pipeline is kept, unless there is
+    // none yet.
+    bool update(std::uint64_t frameIndex);
+
+    // Groups whose shaders failed to compile or whose library failed to be created in the build that the last update() finished. Their
+    // groups have to be changed with setGroup() before the next commit(), as groups are never removed and every build would fail again.
+    const std::vector<std::uint32_t>& failedGroups() const { return m_failedGroups; }
+
+    // Whether a build is running, or has finished but hasn't been swapped in by update() yet.
+    bool building() const { return m_build.valid(); }
+
+    // Null until the first build has been swapped in.
+    const vk::Pipeline& pipeline()   const { return *m_pipeline; }
+    std::uint32_t       groupCount() const { return static_cast<std::uint32_t>(m_libraries.size()); }
+
+  private:
+    struct Library
+    {
+        std::uint64_t      hash = 0; // Of the SPIR-V of all its shaders and the specialization constants
+        vk::UniquePipeline pipeline;
+    };
+
+    using Libraries = std::vector<std::shared_ptr<const Library>>;
+
+    struct Build
+    {
+        vk::UniquePipeline         pipeline; // Null if any group failed
+        Libraries                  libraries; // One per group
+        std::vector<std::uint32_t> failedGroups;
+        std::string                error;
+    };
+
+    // Freed once the GPU can't be using them anymore:
+    struct RetiredPipeline
+    {
+        std::uint64_t      frameIndex = 0;
+        vk::UniquePipeline pipeline;
+        Libraries          libraries;
+    };
+
+    void start();
+
+    // Run on the background thread, so they only use what they are passed and what is constant:
+    Build                    build(std::vector<ShaderGroup> groups, Libraries previousLibraries) const;
+    std::unique_ptr<Library> createLibrary(const ShaderGroup& group, std::span<const std::vector<std::uint32_t>> codes, std::uint64_t hash) const;
+    vk::UniquePipeline       link(const Libraries& libraries) const;
+
+    const Context&        m_context;
+    const ShaderCompiler& m_compiler;
+    vk::PipelineLayout    m_layout;
+    Param                 m_param;
+
+    std::vector<ShaderGroup> m_groups;
+    bool                     m_pending = false; // commit() was called while a build was running
+
+    vk::UniquePipeline          m_pipeline;
+    Libraries                   m_libraries;
+    std::deque<RetiredPipeline> m_retired;
+    std::vector<std::uint32_t>  m_failedGroups;
+
+    // Declared last so that it's waited for before anything it uses is destroyed:
+    std::future<Build> m_build;
+};
+
+} // namespace polar
@@ -0,0 +1,172 @@
+#include "restir_di.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+
+#include <acceleration_structure.hpp>
+#include <configure.hpp>
+
+namespace polar
+{
+
+// The passes read what earlier ones (and the integrator of the previous frame) wrote:
+constexpr auto RENDER_STAGES = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+constexpr auto RENDER_ACCESS = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+static void
+memoryBarrier(const vk::CommandBuffer& commandBuffer, const vk::PipelineStageFlags srcStages, const vk::AccessFlags srcAccess,
+              const vk::PipelineStageFlags dstStages, const vk::AccessFlags dstAccess)
+{
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    commandBuffer.pipelineBarrier(srcStages, dstStages, {}, barrier, {}, {});
+}
+
+RestirDI::RestirDI(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const vk::PipelineLayout& layout,
+                   const Param& param)
+    : m_context(context), m_allocator(allocator), m_layout(layout), m_param(param)
+{
+    if (m_param.surfaceKernel.path.empty())
+    {
+        m_param.surfaceKernel = ShaderSource{
+            .path  = std::filesystem::path(SHADER_DIRECTORY) / "restir_surface.comp",
+            .stage = vk::ShaderStageFlagBits::eCompute,
+        };
+    }
+    m_param.spatialSamples = std::min(m_param.spatialSamples, MAX_SPATIAL_SAMPLES);
+
+    const auto path   = std::filesystem::path(SHADER_DIRECTORY) / "restir_di.comp";
+    const auto source = [&](const char* pass) {
+        return ShaderSource{
+            .path    = path,
+            .stage   = vk::ShaderStageFlagBits::eCompute,
+            .defines = {ShaderDefine{.name = pass}},
+        };
+    };
+    const ShaderSource sources[] = {
+        m_param.surfaceKernel, source("RESTIR_INITIAL"), source("RESTIR_TEMPORAL"), source("RESTIR_SPATIAL"), source("RESTIR_VISIBILITY"),
+    };
+    const auto modules = compiler.createModules(m_context.device(), sources);
+
+    m_surfacePipeline    = createPipeline(*modules[0]);
+    m_initialPipeline    = createPipeline(*modules[1]);
+    m_temporalPipeline   = createPipeline(*modules[2]);
+    m_spatialPipeline    = createPipeline(*modules[3]);
+    m_visibilityPipeline = createPipeline(*modules[4]);
+}
+
+vk::UniquePipeline RestirDI::createPipeline(const vk::ShaderModule& module) const
+{
+    const vk::SpecializationMapEntry mapEntry{.constantID = 0, .offset = 0, .size = sizeof(std::uint32_t)};
+    const vk::SpecializationInfo specializationInfo{
+        .mapEntryCount = 1,
+        .pMapEntries   = &mapEntry,
+        .dataSize      = sizeof(std::uint32_t),
+        .pData         = &m_param.workgroupSize,
+    };
+
+    const vk::ComputePipelineCreateInfo pipelineCreateInfo{
+        .stage =
+            vk::PipelineShaderStageCreateInfo{
+                .stage               = vk::ShaderStageFlagBits::eCompute,
+                .module              = module,
+                .pName               = "main",
+                .pSpecializationInfo = &specializationInfo,
+            },
+        .layout = m_layout,
+    };
+    return m_context.device().createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+}
+
+void RestirDI::setEnable(const bool enable)
+{
+    if (enable && !m_param.enable)
+    {
+        ++m_history;
+    }
+
+    m_param.enable = enable;
+    spdlog::info("{} ReSTIR DI.", enable ? "Enabled" : "Disabled");
+}
+
+void RestirDI::dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, const IntegratorConstants& constants) const
+{
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.pushConstants(m_layout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+    commandBuffer.dispatch((constants.extent.x * constants.extent.y + m_param.workgroupSize - 1) / m_param.workgroupSize, 1, 1);
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite, RENDER_STAGES,
+                  RENDER_ACCESS);
+}
+
+void RestirDI::render(const vk::CommandBuffer& commandBuffer, IntegratorConstants& constants, RestirState& state,
+                      const std::uint32_t capacity) const
+{
+    const vk::DeviceSize tableSize      = alignUp(sizeof(GPURestir), 16);
+    const vk::DeviceSize surfacesSize   = alignUp(capacity * sizeof(GPUSurface), 16);
+    const vk::DeviceSize reservoirsSize = alignUp(capacity * sizeof(GPUReservoir), 16);
+
+    if (!state.buffer)
+    {
+        state.buffer = m_allocator.allocate(tableSize + 2 * surfacesSize + 3 * reservoirsSize,
+                                            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                                vk::BufferUsageFlagBits::eTransferDst,
+                                            VMA_MEMORY_USAGE_GPU_ONLY);
+        state.frame  = 0;
+    }
+
+    // The buffers of this frame and the previous one swap every frame:
+    const auto address    = state.buffer.deviceAddress(m_context);
+    const auto surfaces   = address + tableSize;
+    const auto reservoirs = surfaces + 2 * surfacesSize;
+    const auto current    = state.frame % 2;
+    const auto previous   = 1 - current;
+
+    // Pixels only correspond to the same ones of the last frame within the same region:
+    const bool history = state.frame > 0 && state.history == m_history && state.offset == constants.imageOffset &&
+                         state.extent == constants.extent;
+
+    const GPURestir table{
+        .surfaces           = surfaces + current * surfacesSize,
+        .previousSurfaces   = surfaces + previous * surfacesSize,
+        .candidates         = reservoirs + 2 * reservoirsSize,
+        .reservoirs         = reservoirs + current * reservoirsSize,
+        .previousReservoirs = reservoirs + previous * reservoirsSize,
+        .tlas               = m_tlas,
+        .initialCandidates  = m_param.initialCandidates,
+        .maxHistory         = m_param.maxHistory,
+        .spatialSamples     = m_param.spatialSamples,
+        .spatialRadius      = m_param.spatialRadius,
+        .depthThreshold     = m_param.depthThreshold,
+        .normalThreshold    = m_param.normalThreshold,
+        .temporal           = m_param.temporalReuse && history ? 1u : 0u,
+        .firstSample        = constants.sampleIndex,
+    };
+
+    // The previous frame may still be reading the table:
+    memoryBarrier(commandBuffer, RENDER_STAGES, RENDER_ACCESS, vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                  vk::AccessFlagBits::eTransferWrite | RENDER_ACCESS);
+    commandBuffer.updateBuffer(*state.buffer, 0, sizeof(table), &table);
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, RENDER_STAGES, RENDER_ACCESS);
+
+    constants.restir = address;
+
+    dispatch(commandBuffer, *m_surfacePipeline, constants);
+    dispatch(commandBuffer, *m_initialPipeline, constants);
+    if (table.temporal)
+    {
+        dispatch(commandBuffer, *m_temporalPipeline, constants);
+    }
+    dispatch(commandBuffer, *m_spatialPipeline, constants);
+    dispatch(commandBuffer, *m_visibilityPipeline, constants);
+
+    state.frame += 1;
+    state.history = m_history;
+    state.offset  = constants.imageOffset;
+    state.extent  = constants.extent;
+}
+
+} // namespace polar
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <integrator_interface.hpp>
+#include <scene.hpp>
+#include <shader_compiler.hpp>
+
+namespace polar
+{
+
+// Host side of shaders/restir.glsl, which the layouts below mirror (scalar block layout).
+
+struct GPUSurface
+{
+    glm::vec3 position = glm::vec3(0.f);
+    float     depth    = 0.f; // Distance from the camera, 0 if the camera ray missed
+    glm::vec3 normal   = glm::vec3(0.f);
+    glm::vec3 albedo   = glm::vec3(0.f);
+    glm::vec2 motion   = glm::vec2(0.f); // From the pixel to where the surface was in the previous frame, in pixels
+};
+
+struct GPUReservoir
+{
+    std::uint32_t emitter     = INVALID_INDEX;
+    glm::vec2     uv          = glm::vec2(0.f);
+    float         targetPdf   = 0.f;
+    float         weightSum   = 0.f;
+    float         sampleCount = 0.f;
+    float         weight      = 0.f;
+    std::uint32_t visible     = 0; // Whether the visibility pass found the sample unoccluded at the pixel
+};
+
+struct GPURestir
+{
+    vk::DeviceAddress surfaces           = 0; // Per pixel of the rendered region, of this frame
+    vk::DeviceAddress previousSurfaces   = 0;
+    vk::DeviceAddress candidates         = 0; // Initial candidates, combined with the previous frame
+    vk::DeviceAddress reservoirs         = 0; // After spatial reuse and visibility, of this frame
+    vk::DeviceAddress previousReservoirs = 0;
+    vk::DeviceAddress tlas               = 0;
+    std::uint32_t     initialCandidates  = 0;
+    float             maxHistory         = 0.f;
+    std::uint32_t     spatialSamples     = 0;
+    float             spatialRadius      = 0.f;
+    float             depthThreshold     = 0.f;
+    float             normalThreshold    = 0.f;
+    std::uint32_t     temporal           = 0;
+    std::uint32_t     firstSample        = 0; // Sample index of the first sample of the frame, the only one that uses the reservoirs
+};
+
+constexpr std::uint32_t MAX_SPATIAL_SAMPLES = 16; // As in shaders/restir_di.comp
+
+// Surfaces and reservoirs of a render target, allocated by its first frame with ReSTIR DI. Those of the previous frame are only reused
+// while the region of the target stays the same.
+struct RestirState
+{
+    GPUBufferUnique buffer; // GPURestir, two surface buffers and three reservoir buffers
+    std::uint64_t   frame   = 0; // Frames rendered with it
+    std::uint64_t   history = 0; // RestirDI::m_history when the last frame was rendered
+    glm::uvec2      offset  = glm::uvec2(0);
+    glm::uvec2      extent  = glm::uvec2(0);
+};
+
+// Direct lighting at the primary hits by reservoir-based spatiotemporal importance resampling (Bitterli et al., "Spatiotemporal
+// reservoir resampling for real-time ray tracing with dynamic direct lighting"). Before the integrator samples a frame, a few compute
+// passes pick one light sample per pixel of the region (shaders/restir_di.comp):
+//  - surface:    the surface kernel writes the primary surface of every pixel (the same one that the first sample of the frame hits),
+//                with its motion vector
+//  - initial:    draws initialCandidates samples from the light tree and keeps one of them in the reservoir of the pixel, with a
+//                probability proportional to its unshadowed contribution
+//  - temporal:   combines the reservoir with that of the pixel's surface in the previous frame, found through its motion vector
+//  - spatial:    combines the reservoir with those of spatialSamples random neighbours with similar surfaces
+//  - visibility: traces a shadow ray to the sample and marks whether it's unoccluded
+// The first sample of the frame then takes its direct light at the primary hit from restirLightSample() instead of sampleLight(),
+// which returns the sample with a pdf that makes it a drop-in replacement. The shipped kernels of both integrators do (see useRestir()
+// in shaders/path_tracing.glsl). All other bounces and samples are unaffected: the contribution weight of a reservoir is only valid at
+// the surface of its pixel, which the other samples of the frame don't hit, and they would only be correlated by sharing its sample.
+// Combined reservoirs are normalized by the sample counts of those that could have produced the selected sample, i.e. whose surfaces
+// have a non-zero target function for it (the unbiased 1/Z weights of Bitterli et al.). Visibility isn't part of the target function,
+// so the visibility pass leaves the reservoirs intact for reuse, and occluded samples are reused without darkening their neighbours.
+class RestirDI
+{
+  public:
+    struct Param
+    {
+        bool enable = false;
+
+        // Writes the GPUSurface of every pixel of the region to constants.restir.surfaces, one thread per pixel. It has to #include
+        // <integrator.glsl>, and is only dispatched if the scene has a light tree. If the path is empty, shaders/restir_surface.comp
+        // traces the camera rays of the shipped kernels through the scene table (see SceneTable).
+        ShaderSource surfaceKernel;
+
+        std::uint32_t initialCandidates = 32;
+
+        bool  temporalReuse = true;
+        float maxHistory    = 20.f; // Sample count of the previous frame's reservoirs, relative to the initial candidates
+
+        std::uint32_t spatialSamples = 5;   // 0 disables spatial reuse, at most MAX_SPATIAL_SAMPLES
+        float         spatialRadius  = 30.f; // In pixels
+
+        // Surfaces whose depth differs by less than this fraction, and whose normals have a cosine of at least normalThreshold, may reuse
+        // each other's samples.
+        float depthThreshold  = 0.1f;
+        float normalThreshold = 0.9f;
+
+        // Specialization constant 0 of all kernels, set by Integrator.
+        std::uint32_t workgroupSize = 64;
+    };
+
+    RestirDI(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const vk::PipelineLayout& layout,
+             const Param& param);
+
+    RestirDI(const RestirDI&)            = delete;
+    RestirDI(RestirDI&&)                 = delete;
+    RestirDI& operator=(const RestirDI&) = delete;
+    RestirDI& operator=(RestirDI&&)      = delete;
+
+    bool enabled() const { return m_param.enable; }
+
+    // Enabling it starts without history, so reservoirs from before it was disabled aren't reused.
+    void setEnable(bool enable);
+
+    // Device address of the TLAS that the visibility rays are traced against.
+    void setTlas(vk::DeviceAddress tlas) { m_tlas = tlas; }
+
+    // Records the passes for the region of constants (whose light tree has to be set) and sets constants.restir. The descriptor sets of
+    // the scene have to be bound to the compute bind point already. The state holds up to capacity pixels.
+    void render(const vk::CommandBuffer& commandBuffer, IntegratorConstants& constants, RestirState& state, std::uint32_t capacity) const;
+
+  private:
+    vk::UniquePipeline createPipeline(const vk::ShaderModule& module) const;
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, const IntegratorConstants& constants) const;
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    vk::PipelineLayout  m_layout;
+    Param               m_param;
+
+    vk::UniquePipeline m_surfacePipeline;
+    vk::UniquePipeline m_initialPipeline;
+    vk::UniquePipeline m_temporalPipeline;
+    vk::UniquePipeline m_spatialPipeline;
+    vk::UniquePipeline m_visibilityPipeline;
+
+    vk::DeviceAddress m_tlas    = 0;
+    std::uint64_t     m_history = 0; // Incremented whenever the reservoirs of all targets become invalid
+};
+
+} // namespace polar
@@ -0,0 +1,233 @@
+#include "sbt_builder.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <acceleration_structure.hpp>
+
+namespace polar
+{
+
+SbtBuilder::SbtBuilder(const Context& context, const GPUAllocator& allocator, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param)
+{
+}
+
+std::uint32_t SbtBuilder::addRecord(const Region region, const Record& record)
+{
+    auto& records = m_records[static_cast<std::size_t>(region)];
+    records.emplace_back(record);
+    return static_cast<std::uint32_t>(records.size() - 1);
+}
+
+std::uint32_t SbtBuilder::addHitRecords(const std::span<const Record> records)
+{
+    auto& hitRecords = m_records[static_cast<std::size_t>(Region::eHit)];
+
+    const auto [itr, inserted] = m_hitRuns.try_emplace(std::vector<Record>(records.begin(), records.end()), static_cast<std::uint32_t>(hitRecords.size()));
+    if (inserted)
+    {
+        hitRecords.insert(hitRecords.end(), records.begin(), records.end());
+    }
+
+    return itr->second;
+}
+
+void SbtBuilder::clear()
+{
+    for (auto& records : m_records)
+    {
+        records.clear();
+    }
+    m_hitRuns.clear();
+}
+
+void SbtBuilder::build(const vk::Pipeline& pipeline, const std::uint32_t groupCount, const std::uint64_t frameIndex)
+{
+    while (!m_retired.empty() && m_retired.front().frameIndex + m_param.framesInFlight <= frameIndex)
+    {
+        m_retired.pop_front();
+    }
+
+    const auto& properties = m_context.rayTracingPipelineProperties();
+    const auto  handleSize = properties.shaderGroupHandleSize;
+
+    const auto handles = m_context.device().getRayTracingShaderGroupHandlesKHR<std::byte>(pipeline, 0, groupCount, groupCount * handleSize);
+
+    // Lay out the regions one after the other:
+    vk::DeviceSize tableSize = 0;
+    for (std::size_t region = 0; region < REGION_COUNT; ++region)
+    {
+        const auto& records = m_records[region];
+
+        std::size_t dataSize = 0;
+        for (const auto& record : records)
+        {
+            dataSize = std::max(dataSize, record.data.size());
+        }
+
+        auto& layout  = m_layouts[region];
+        layout.offset = alignUp(tableSize, properties.shaderGroupBaseAlignment);
+        layout.stride = alignUp(handleSize + dataSize, properties.shaderGroupHandleAlignment);
+
+        // The raygen region is always a single record, so its stride is free to be larger than its base alignment:
+        if (region == static_cast<std::size_t>(Region::eRaygen))
+        {
+            layout.stride = alignUp(layout.stride, properties.shaderGroupBaseAlignment);
+        }
+
+        if (layout.stride > properties.maxShaderGroupStride)
+        {
+            throw std::runtime_error(fmt::format("Shader binding table stride of {} bytes exceeds the maximum of {} bytes", layout.stride,
+                                                 properties.maxShaderGroupStride));
+        }
+
+        tableSize = layout.offset + layout.stride * records.size();
+    }
+
+    std::vector<std::byte> table(std::max<vk::DeviceSize>(tableSize, 1));
+    for (std::size_t region = 0; region < REGION_COUNT; ++region)
+    {
+        const auto& layout = m_layouts[region];
+        for (std::size_t i = 0; i < m_records[region].size(); ++i)
+        {
+            const auto& record = m_records[region][i];
+            if (record.groupIndex >= groupCount)
+            {
+                throw std::runtime_error(fmt::format("Shader binding table record references group {}, but the pipeline only has {}", record.groupIndex,
+                                                     groupCount));
+            }
+
+            auto* dst = table.data() + layout.offset + layout.stride * i;
+            std::memcpy(dst, handles.data() + record.groupIndex * handleSize, handleSize);
+            std::memcpy(dst + handleSize, record.data.data(), record.data.size());
+        }
+    }
+
+    // Frames that were recorded with the previous table may still be tracing with it:
+    if (m_buffer)
+    {
+        m_retired.emplace_back(RetiredTable{
+            .frameIndex = frameIndex,
+            .buffer     = std::move(m_buffer),
+        });
+    }
+
+    // The base address of the table has to be aligned as well, which the allocation doesn't guarantee:
+    m_buffer  = m_allocator.allocate(table.size() + properties.shaderGroupBaseAlignment,
+                                     vk::BufferUsageFlagBits::eShaderBindingTableKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                         vk::BufferUsageFlagBits::eTransferDst,
+                                     VMA_MEMORY_USAGE_GPU_ONLY);
+    m_address = alignUp(m_buffer.deviceAddress(m_context), properties.shaderGroupBaseAlignment);
+
+    const auto& device = m_context.device();
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.queueFamilyIndex(),
+    });
+
+    auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = commandBuffers.front();
+
+    commandBuffer->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    const auto stagingBuffer = m_allocator.allocate(table.size(), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+    std::memcpy(stagingBuffer.map(), table.data(), table.size());
+    stagingBuffer.unmap();
+
+    commandBuffer->copyBuffer(*stagingBuffer, *m_buffer,
+                              vk::BufferCopy{
+                                  .srcOffset = 0,
+                                  .dstOffset = m_address - m_buffer.deviceAddress(m_context),
+                                  .size      = table.size(),
+                              });
+
+    submitAndWait(m_context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "shader binding table upload");
+
+    for (std::size_t region = 0; region < REGION_COUNT; ++region)
+    {
+        const auto& layout = m_layouts[region];
+        m_regions[region]  = vk::StridedDeviceAddressRegionKHR{
+            .deviceAddress = m_records[region].empty() ? 0 : m_address + layout.offset,
+            .stride        = layout.stride,
+            .size          = layout.stride * m_records[region].size(),
+        };
+    }
+
+    spdlog::info("Built shader binding table with {} raygen, {} miss, {} hit and {} callable records ({} bytes).",
+                 m_records[static_cast<std::size_t>(Region::eRaygen)].size(), m_records[static_cast<std::size_t>(Region::eMiss)].size(),
+                 m_records[static_cast<std::size_t>(Region::eHit)].size(), m_records[static_cast<std::size_t>(Region::eCallable)].size(), tableSize);
+}
+
+void SbtBuilder::updateRecord(const vk::CommandBuffer& commandBuffer, const Region region, const std::uint32_t recordIndex,
+                              const std::span<const std::byte> data)
+{
+    const auto& layout     = m_layouts[static_cast<std::size_t>(region)];
+    const auto  handleSize = m_context.rayTracingPipelineProperties().shaderGroupHandleSize;
+
+    if (data.size() % 4 != 0 || handleSize + data.size() > layout.stride)
+    {
+        throw std::runtime_error(fmt::format("Can't update shader binding table record with {} bytes of data (stride is {} bytes)", data.size(),
+                                             layout.stride));
+    }
+
+    // Keep the host copy in sync, so that the next build() doesn't revert the update:
+    auto& record = m_records[static_cast<std::size_t>(region)][recordIndex];
+    record.data.assign(data.begin(), data.end());
+
+    // As does the run the record belongs to, so that addHitRecords() only shares it for its new content:
+    if (region == Region::eHit)
+    {
+        const auto run = std::ranges::find_if(m_hitRuns, [&](const auto& entry) {
+            return entry.second <= recordIndex && recordIndex < entry.second + entry.first.size();
+        });
+        if (run != m_hitRuns.end())
+        {
+            auto node = m_hitRuns.extract(run);
+            node.key()[recordIndex - node.mapped()].data = record.data;
+
+            // If an identical run exists already, that one keeps being shared:
+            m_hitRuns.insert(std::move(node));
+        }
+    }
+
+    const auto offset = (m_address - m_buffer.deviceAddress(m_context)) + layout.offset + layout.stride * recordIndex + handleSize;
+
+    // Traces of earlier frames may still read the record:
+    const vk::MemoryBarrier beforeUpdate{
+        .srcAccessMask = vk::AccessFlagBits::eShaderRead,
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eTransfer, {}, beforeUpdate, {}, {});
+
+    commandBuffer.updateBuffer(*m_buffer, offset, data.size(), data.data());
+
+    const vk::MemoryBarrier afterUpdate{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eRayTracingShaderKHR, {}, afterUpdate, {}, {});
+}
+
+vk::StridedDeviceAddressRegionKHR SbtBuilder::raygenRegion(const std::uint32_t recordIndex) const
+{
+    const auto& layout = m_layouts[static_cast<std::size_t>(Region::eRaygen)];
+
+    // The size of the raygen region has to be equal to its stride:
+    return vk::StridedDeviceAddressRegionKHR{
+        .deviceAddress = m_address + layout.offset + layout.stride * recordIndex,
+        .stride        = layout.stride,
+        .size          = layout.stride,
+    };
+}
+
+} // namespace polar
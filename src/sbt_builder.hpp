@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <span>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+
+namespace polar
+{
+
+// Builds the shader binding table of a ray tracing pipeline. Every record is a shader group handle followed by inline data (e.g. material
+// indices or buffer addresses) that the shaders read through their shaderRecordEXT block.
+// Each region has its own stride (the largest record of the region rounded up to shaderGroupHandleAlignment), so regions with small
+// records don't pay for the largest records of other regions, and every region starts at a multiple of shaderGroupBaseAlignment.
+// Identical runs of hit records are only stored once, so instances with the same material(s) share their records.
+// The table isn't built by the integrators that trace with it (see Integrator::render()). The application builds it once the pipeline
+// exists, and again whenever RayTracingPipeline::update() (or MaterialPermutations::update()) returns true or records were added. A
+// replaced table is freed once the frames that may still be using it have finished.
+class SbtBuilder
+{
+  public:
+    enum class Region
+    {
+        eRaygen,
+        eMiss,
+        eHit,
+        eCallable,
+    };
+
+    struct Record
+    {
+        std::uint32_t          groupIndex = 0; // Index of the shader group in the pipeline
+        std::vector<std::byte> data;
+
+        auto operator<=>(const Record&) const = default;
+    };
+
+    struct Param
+    {
+        // Number of frames that may still use a table after it has been replaced.
+        std::uint32_t framesInFlight = 2;
+    };
+
+    SbtBuilder(const Context& context, const GPUAllocator& allocator, const Param& param);
+
+    SbtBuilder(const SbtBuilder&)            = delete;
+    SbtBuilder(SbtBuilder&&)                 = delete;
+    SbtBuilder& operator=(const SbtBuilder&) = delete;
+    SbtBuilder& operator=(SbtBuilder&&)      = delete;
+
+    // Adds a record to the region and returns its index within the region.
+    std::uint32_t addRecord(Region region, const Record& record);
+
+    // Adds a run of consecutive hit records (e.g. one per geometry of a BLAS) and returns the index of the first one, which is what
+    // instances use as their SBT record offset. Returns the existing run if the same records were added before.
+    std::uint32_t addHitRecords(std::span<const Record> records);
+
+    // Removes all records (but keeps the table until the next build()).
+    void clear();
+
+    // Fetches the group handles from the pipeline and uploads the table. Has to be called again whenever records were added or the
+    // pipeline changed. The previous table is kept until framesInFlight frames after frameIndex, and earlier ones are freed.
+    void build(const vk::Pipeline& pipeline, std::uint32_t groupCount, std::uint64_t frameIndex);
+
+    // Overwrites the inline data of a single record with vkCmdUpdateBuffer, without touching the rest of the table. The size of the data
+    // has to be a multiple of 4 and fit into the stride of its region. A shared hit record changes for all instances that use it, and
+    // addHitRecords() only returns its run for the updated records from then on.
+    void updateRecord(const vk::CommandBuffer& commandBuffer, Region region, std::uint32_t recordIndex, std::span<const std::byte> data);
+
+    // Regions to pass to vkCmdTraceRaysKHR. The raygen region can only contain a single record, so it is selected by index.
+    vk::StridedDeviceAddressRegionKHR raygenRegion(std::uint32_t recordIndex = 0) const;
+    const vk::StridedDeviceAddressRegionKHR& region(Region region) const { return m_regions[static_cast<std::size_t>(region)]; }
+
+  private:
+    static constexpr std::size_t REGION_COUNT = 4;
+
+    struct Layout
+    {
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize stride = 0;
+    };
+
+    // Freed once the GPU can't be using it anymore:
+    struct RetiredTable
+    {
+        std::uint64_t   frameIndex = 0;
+        GPUBufferUnique buffer;
+    };
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    std::array<std::vector<Record>, REGION_COUNT>               m_records;
+    std::map<std::vector<Record>, std::uint32_t>                m_hitRuns; // First record of every distinct run of hit records
+    std::array<Layout, REGION_COUNT>                            m_layouts;
+    std::array<vk::StridedDeviceAddressRegionKHR, REGION_COUNT> m_regions;
+
+    GPUBufferUnique          m_buffer;
+    vk::DeviceAddress        m_address = 0;
+    std::deque<RetiredTable> m_retired;
+};
+
+} // namespace polar
@@ -0,0 +1,133 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <util.hpp>
+
+namespace polar
+{
+
+template <typename T>
+static std::uint64_t
+hashVector(const std::vector<T>& values, const std::uint64_t seed)
+{
+    const std::uint64_t size = values.size();
+    return hashBytes(values.data(), values.size() * sizeof(T), hashBytes(&size, sizeof(size), seed));
+}
+
+std::uint64_t contentHash(const Geometry& geometry)
+{
+    const std::uint32_t values[] = {geometry.materialIndex, geometry.opaque};
+
+    auto hash = hashBytes(values, sizeof(values));
+    hash      = hashVector(geometry.positions, hash);
+    hash      = hashVector(geometry.normals, hash);
+    hash      = hashVector(geometry.texCoords, hash);
+    return hashVector(geometry.indices, hash);
+}
+
+std::uint64_t contentHash(const Mesh& mesh)
+{
+    std::vector<std::uint64_t> geometryHashes;
+    geometryHashes.reserve(mesh.geometries.size());
+    for (const auto& geometry : mesh.geometries)
+    {
+        geometryHashes.emplace_back(contentHash(geometry));
+    }
+    return hashVector(geometryHashes, 0);
+}
+
+std::uint64_t contentHash(const Material& material)
+{
+    const float values[] = {
+        material.baseColorFactor.r, material.baseColorFactor.g, material.baseColorFactor.b, material.baseColorFactor.a,
+        material.emissiveFactor.r,  material.emissiveFactor.g,  material.emissiveFactor.b,  material.metallicFactor,
+        material.roughnessFactor,   material.alphaCutoff,       material.clearcoatFactor,   material.clearcoatRoughnessFactor,
+        material.transmissionFactor,
+    };
+
+    const std::uint32_t indices[] = {
+        static_cast<std::uint32_t>(material.alphaMode),
+        static_cast<std::uint32_t>(material.doubleSided),
+        material.baseColorTexture,
+        material.metallicRoughnessTexture,
+        material.normalTexture,
+        material.occlusionTexture,
+        material.emissiveTexture,
+    };
+
+    return hashBytes(indices, sizeof(indices), hashBytes(values, sizeof(values)));
+}
+
+bool sameContent(const Geometry& a, const Geometry& b)
+{
+    return a.materialIndex == b.materialIndex && a.opaque == b.opaque && a.positions == b.positions && a.normals == b.normals && a.texCoords == b.texCoords &&
+           a.indices == b.indices;
+}
+
+bool sameContent(const Mesh& a, const Mesh& b)
+{
+    return std::ranges::equal(a.geometries, b.geometries, [](const Geometry& x, const Geometry& y) { return sameContent(x, y); });
+}
+
+bool sameContent(const Material& a, const Material& b)
+{
+    return a.baseColorFactor == b.baseColorFactor && a.emissiveFactor == b.emissiveFactor && a.metallicFactor == b.metallicFactor &&
+           a.roughnessFactor == b.roughnessFactor && a.alphaCutoff == b.alphaCutoff && a.alphaMode == b.alphaMode &&
+           a.doubleSided == b.doubleSided && a.baseColorTexture == b.baseColorTexture &&
+           a.metallicRoughnessTexture == b.metallicRoughnessTexture && a.normalTexture == b.normalTexture &&
+           a.occlusionTexture == b.occlusionTexture && a.emissiveTexture == b.emissiveTexture && a.clearcoatFactor == b.clearcoatFactor &&
+           a.clearcoatRoughnessFactor == b.clearcoatRoughnessFactor && a.transmissionFactor == b.transmissionFactor;
+}
+
+std::uint32_t materialFeatures(const Material& material)
+{
+    std::uint32_t features = 0;
+
+    const auto set = [&](const bool condition, const std::uint32_t feature) {
+        if (condition)
+        {
+            features |= feature;
+        }
+    };
+
+    // An emissive texture doesn't do anything without an emissive factor:
+    const bool emissive = material.emissiveFactor != glm::vec3(0.f);
+
+    set(material.baseColorTexture != INVALID_INDEX, MaterialFeature::BASE_COLOR_TEXTURE);
+    set(material.metallicRoughnessTexture != INVALID_INDEX, MaterialFeature::METALLIC_ROUGHNESS_TEXTURE);
+    set(material.normalTexture != INVALID_INDEX, MaterialFeature::NORMAL_TEXTURE);
+    set(material.occlusionTexture != INVALID_INDEX, MaterialFeature::OCCLUSION_TEXTURE);
+    set(emissive, MaterialFeature::EMISSIVE);
+    set(emissive && material.emissiveTexture != INVALID_INDEX, MaterialFeature::EMISSIVE_TEXTURE);
+    set(material.alphaMode == AlphaMode::eMask, MaterialFeature::ALPHA_MASK);
+    set(material.alphaMode == AlphaMode::eBlend, MaterialFeature::ALPHA_BLEND);
+    set(material.doubleSided, MaterialFeature::DOUBLE_SIDED);
+    set(material.clearcoatFactor > 0.f, MaterialFeature::CLEARCOAT);
+    set(material.transmissionFactor > 0.f, MaterialFeature::TRANSMISSION);
+
+    return features;
+}
+
+std::vector<std::pair<std::uint32_t, std::uint64_t>> materialFeatureHistogram(const Scene& scene)
+{
+    std::unordered_map<std::uint32_t, std::uint64_t> triangleCounts;
+    for (const auto& instance : scene.instances)
+    {
+        for (const auto& geometry : scene.meshes[instance.meshIndex].geometries)
+        {
+            const auto& material = geometry.materialIndex == INVALID_INDEX ? Material{} : scene.materials[geometry.materialIndex];
+            triangleCounts[materialFeatures(material)] += geometry.triangleCount();
+        }
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> histogram(triangleCounts.begin(), triangleCounts.end());
+    std::ranges::sort(histogram, [](const auto& a, const auto& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+
+    return histogram;
+}
+
+} // namespace polar
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace polar
+{
+
+constexpr std::uint32_t INVALID_INDEX = std::numeric_limits<std::uint32_t>::max();
+
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    void extend(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void extend(const BoundingBox& box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool      empty()  const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return max - min; }
+
+    float surfaceArea() const
+    {
+        if (empty())
+        {
+            return 0.f;
+        }
+        const auto e = extent();
+        return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Returns the box that bounds all eight transformed corners.
+    BoundingBox transformed(const glm::mat4& transform) const
+    {
+        BoundingBox box;
+        if (empty())
+        {
+            return box;
+        }
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const glm::vec3 point((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+            box.extend(glm::vec3(transform * glm::vec4(point, 1.f)));
+        }
+        return box;
+    }
+};
+
+// A single indexed triangle list that uses a single material. Every geometry maps to one VkAccelerationStructureGeometryKHR.
+struct Geometry
+{
+    std::vector<glm::vec3>     positions;
+    std::vector<glm::vec3>     normals;
+    std::vector<glm::vec2>     texCoords;
+    std::vector<std::uint32_t> indices;
+
+    std::uint32_t materialIndex = INVALID_INDEX;
+    BoundingBox   bounds;
+
+    // Opaque geometry never invokes any-hit shaders (VK_GEOMETRY_OPAQUE_BIT_KHR), so only geometry that needs alpha testing or blending
+    // should clear this.
+    bool opaque = true;
+
+    std::uint32_t vertexCount()   const { return static_cast<std::uint32_t>(positions.size());   }
+    std::uint32_t triangleCount() const { return static_cast<std::uint32_t>(indices.size() / 3); }
+};
+
+enum class BuildPreference
+{
+    eAuto, // Left to BlasPolicy
+    eFastTrace,
+    eFastBuild,
+};
+
+// How the BLAS of a mesh is going to be used, from which BlasPolicy picks its build flags. Can be set per glTF mesh through its extras,
+// e.g. "extras": {"dynamic": true, "buildPreference": "fastBuild"}.
+struct BuildHints
+{
+    bool            dynamic    = false; // Rebuilt frequently (e.g. deformed), so its build time matters more than its trace performance
+    BuildPreference preference = BuildPreference::eAuto;
+
+    // Stand-in for the expected screen coverage: the largest fraction of the surface area of the scene's bounds covered by the bounds of
+    // an instance of the mesh.
+    float coverage = 1.f;
+
+    bool operator==(const BuildHints&) const = default;
+};
+
+// A simplified version of a mesh, which is a mesh of its own.
+struct MeshLod
+{
+    std::uint32_t meshIndex = INVALID_INDEX;
+    float         error     = 0.f; // Largest object space distance between a vertex of the original and its simplified position
+};
+
+// A collection of geometries that gets built into a single BLAS.
+struct Mesh
+{
+    std::string           name;
+    std::vector<Geometry> geometries;
+    BoundingBox           bounds;
+    BuildHints            buildHints;
+    std::vector<MeshLod>  lods; // From fine to coarse
+
+    std::uint32_t triangleCount() const
+    {
+        std::uint32_t count = 0;
+        for (const auto& geometry : geometries)
+        {
+            count += geometry.triangleCount();
+        }
+        return count;
+    }
+};
+
+struct Instance
+{
+    std::uint32_t meshIndex = INVALID_INDEX;
+    glm::mat4     transform = glm::mat4(1.f);
+};
+
+enum class AlphaMode
+{
+    eOpaque,
+    eMask,
+    eBlend,
+};
+
+struct Material
+{
+    std::string name;
+
+    glm::vec4 baseColorFactor = glm::vec4(1.f);
+    glm::vec3 emissiveFactor  = glm::vec3(0.f);
+    float     metallicFactor  = 1.f;
+    float     roughnessFactor = 1.f;
+    float     alphaCutoff     = 0.5f;
+    AlphaMode alphaMode       = AlphaMode::eOpaque;
+    bool      doubleSided     = false;
+
+    // KHR_materials_clearcoat and KHR_materials_transmission (without their textures):
+    float clearcoatFactor          = 0.f;
+    float clearcoatRoughnessFactor = 0.f;
+    float transmissionFactor       = 0.f;
+
+    std::uint32_t baseColorTexture         = INVALID_INDEX;
+    std::uint32_t metallicRoughnessTexture = INVALID_INDEX;
+    std::uint32_t normalTexture            = INVALID_INDEX;
+    std::uint32_t occlusionTexture         = INVALID_INDEX;
+    std::uint32_t emissiveTexture          = INVALID_INDEX;
+};
+
+// Features of a material that hit shaders can be specialized for, combined into a bitmask by materialFeatures().
+namespace MaterialFeature
+{
+constexpr std::uint32_t BASE_COLOR_TEXTURE         = 1u << 0;
+constexpr std::uint32_t METALLIC_ROUGHNESS_TEXTURE = 1u << 1;
+constexpr std::uint32_t NORMAL_TEXTURE             = 1u << 2;
+constexpr std::uint32_t OCCLUSION_TEXTURE          = 1u << 3;
+constexpr std::uint32_t EMISSIVE                   = 1u << 4; // Non-zero emissive factor
+constexpr std::uint32_t EMISSIVE_TEXTURE           = 1u << 5;
+constexpr std::uint32_t ALPHA_MASK                 = 1u << 6;
+constexpr std::uint32_t ALPHA_BLEND                = 1u << 7;
+constexpr std::uint32_t DOUBLE_SIDED               = 1u << 8;
+constexpr std::uint32_t CLEARCOAT                  = 1u << 9;
+constexpr std::uint32_t TRANSMISSION               = 1u << 10;
+constexpr std::uint32_t ALL                        = (1u << 11) - 1;
+} // namespace MaterialFeature
+
+// How a texture is sampled by the materials that reference it, which determines how it can be stored (sRGB, compression format, ...).
+enum class TextureUsage
+{
+    eColor,         // sRGB encoded color, e.g. base color and emissive
+    eLinear,        // Linear data in all channels, e.g. metallic-roughness
+    eNormal,        // Tangent space normals, only the red and green channels are used
+    eSingleChannel, // Only the red channel is used, e.g. occlusion
+};
+
+struct TextureLevel
+{
+    std::uint32_t          width  = 0;
+    std::uint32_t          height = 0;
+    std::vector<std::byte> data;
+};
+
+struct Texture
+{
+    std::string               name;
+    vk::Format                format       = vk::Format::eR8G8B8A8Unorm;
+    TextureUsage              usage        = TextureUsage::eLinear;
+    vk::SamplerAddressMode    addressModeU = vk::SamplerAddressMode::eRepeat; // From the glTF sampler (wrapS and wrapT)
+    vk::SamplerAddressMode    addressModeV = vk::SamplerAddressMode::eRepeat;
+    std::vector<TextureLevel> levels;
+};
+
+enum class LightType
+{
+    ePoint,
+    eSpot,
+    eDirectional,
+};
+
+// A KHR_lights_punctual light. It shines along -Z of its transform (spot and directional lights), from the origin of it (point and spot).
+struct Light
+{
+    std::string name;
+
+    LightType type      = LightType::ePoint;
+    glm::vec3 color     = glm::vec3(1.f);
+    float     intensity = 1.f; // Candela for point and spot lights, lux for directional lights
+    float     range     = 0.f; // 0 for infinite
+
+    float innerConeAngle = 0.f; // Spot lights only, in radians
+    float outerConeAngle = 0.7853981634f;
+
+    glm::mat4 transform = glm::mat4(1.f);
+};
+
+struct Scene
+{
+    std::vector<Mesh>     meshes;
+    std::vector<Instance> instances;
+    std::vector<Material> materials;
+    std::vector<Texture>  textures;
+    std::vector<Light>    lights;
+};
+
+// Hashes of everything that affects rendering (names are ignored), used to detect duplicated data:
+std::uint64_t contentHash(const Geometry& geometry);
+std::uint64_t contentHash(const Mesh& mesh);
+std::uint64_t contentHash(const Material& material);
+
+// Exact comparisons to back up the hashes above:
+bool sameContent(const Geometry& a, const Geometry& b);
+bool sameContent(const Mesh& a, const Mesh& b);
+bool sameContent(const Material& a, const Material& b);
+
+// Bitmask of MaterialFeature values.
+std::uint32_t materialFeatures(const Material& material);
+
+// The feature bitmasks in use and the number of triangles that use them over all instances, which is a decent proxy for how often they end
+// up being shaded. Sorted from most to least common.
+std::vector<std::pair<std::uint32_t, std::uint64_t>> materialFeatureHistogram(const Scene& scene);
+
+} // namespace polar
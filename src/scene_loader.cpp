@@ -0,0 +1,839 @@
+#include "scene_loader.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include <alpha_classifier.hpp>
+#include <mesh_simplifier.hpp>
+#include <mesh_splitter.hpp>
+#include <util.hpp>
+
+namespace polar
+{
+
+// Reads an unsigned integer of the given component type.
+static std::uint32_t
+readIndex(const unsigned char* data, const int componentType, const int accessorIndex)
+{
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return data[0];
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        std::uint16_t index;
+        std::memcpy(&index, data, sizeof(index));
+        return index;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+        std::uint32_t index;
+        std::memcpy(&index, data, sizeof(index));
+        return index;
+    }
+    default:
+        throw std::runtime_error(fmt::format("Index accessor {} has an unsupported component type: {}", accessorIndex, componentType));
+    }
+}
+
+// Data of every element of an accessor. Sparse accessors start out as their buffer view (or as zeros without one), of which the
+// elements at their sparse indices are replaced by their sparse values. zeros has to outlive the result.
+static std::vector<const unsigned char*>
+accessorElements(const tinygltf::Model& model, const int accessorIndex, std::vector<unsigned char>& zeros)
+{
+    const auto& accessor    = model.accessors.at(accessorIndex);
+    const auto  elementSize = static_cast<std::size_t>(tinygltf::GetComponentSizeInBytes(accessor.componentType)) *
+                              tinygltf::GetNumComponentsInType(accessor.type);
+
+    std::vector<const unsigned char*> elements(accessor.count);
+    if (accessor.bufferView >= 0)
+    {
+        const auto& bufferView = model.bufferViews.at(accessor.bufferView);
+        const auto& buffer     = model.buffers.at(bufferView.buffer);
+        const auto  stride     = static_cast<std::size_t>(std::max(accessor.ByteStride(bufferView), 0));
+        const auto  offset     = bufferView.byteOffset + accessor.byteOffset;
+        if (stride == 0 || (accessor.count > 0 && offset + (accessor.count - 1) * stride + elementSize > buffer.data.size()))
+        {
+            throw std::runtime_error(fmt::format("Accessor {} has an invalid stride or exceeds its buffer", accessorIndex));
+        }
+
+        for (std::size_t i = 0; i < accessor.count; ++i)
+        {
+            elements[i] = buffer.data.data() + offset + i * stride;
+        }
+    }
+    else
+    {
+        zeros.assign(elementSize, 0);
+        std::fill(elements.begin(), elements.end(), zeros.data());
+    }
+
+    if (!accessor.sparse.isSparse)
+    {
+        return elements;
+    }
+
+    const auto& sparse        = accessor.sparse;
+    const auto& indicesView   = model.bufferViews.at(sparse.indices.bufferView);
+    const auto& valuesView    = model.bufferViews.at(sparse.values.bufferView);
+    const auto& indicesBuffer = model.buffers.at(indicesView.buffer).data;
+    const auto& valuesBuffer  = model.buffers.at(valuesView.buffer).data;
+    const auto  indicesOffset = indicesView.byteOffset + sparse.indices.byteOffset;
+    const auto  valuesOffset  = valuesView.byteOffset + sparse.values.byteOffset;
+    const auto  indexSize     = static_cast<std::size_t>(tinygltf::GetComponentSizeInBytes(sparse.indices.componentType));
+    const auto  sparseCount   = static_cast<std::size_t>(sparse.count);
+    if (indicesOffset + sparseCount * indexSize > indicesBuffer.size() || valuesOffset + sparseCount * elementSize > valuesBuffer.size())
+    {
+        throw std::runtime_error(fmt::format("Sparse accessor {} exceeds its buffers", accessorIndex));
+    }
+
+    // Sparse indices and values are always tightly packed:
+    for (std::size_t i = 0; i < sparseCount; ++i)
+    {
+        const auto index = readIndex(indicesBuffer.data() + indicesOffset + i * indexSize, sparse.indices.componentType, accessorIndex);
+        if (index >= accessor.count)
+        {
+            throw std::runtime_error(fmt::format("Sparse accessor {} replaces element {} of {}", accessorIndex, index, accessor.count));
+        }
+        elements[index] = valuesBuffer.data() + valuesOffset + i * elementSize;
+    }
+
+    return elements;
+}
+
+// Reads every element of an accessor as floats, converting normalized integer components as described by the glTF spec.
+static std::vector<float>
+readFloatAccessor(const tinygltf::Model& model, const int accessorIndex, const int componentCount)
+{
+    const auto& accessor = model.accessors.at(accessorIndex);
+    if (tinygltf::GetNumComponentsInType(accessor.type) != componentCount)
+    {
+        throw std::runtime_error(fmt::format("Accessor {} has an unexpected number of components", accessorIndex));
+    }
+
+    std::vector<unsigned char> zeros;
+    const auto                 elements = accessorElements(model, accessorIndex, zeros);
+
+    std::vector<float> result(accessor.count * componentCount);
+    for (std::size_t i = 0; i < accessor.count; ++i)
+    {
+        const auto element = elements[i];
+        for (int c = 0; c < componentCount; ++c)
+        {
+            auto& value = result[i * componentCount + c];
+            switch (accessor.componentType)
+            {
+            case TINYGLTF_COMPONENT_TYPE_FLOAT:
+                std::memcpy(&value, element + c * sizeof(float), sizeof(float));
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                value = static_cast<float>(element[c]) / 255.f;
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                std::uint16_t component;
+                std::memcpy(&component, element + c * sizeof(std::uint16_t), sizeof(std::uint16_t));
+                value = static_cast<float>(component) / 65535.f;
+                break;
+            }
+            default:
+                throw std::runtime_error(fmt::format("Accessor {} has an unsupported component type: {}", accessorIndex, accessor.componentType));
+            }
+        }
+    }
+
+    return result;
+}
+
+static std::vector<std::uint32_t>
+readIndexAccessor(const tinygltf::Model& model, const int accessorIndex)
+{
+    const auto& accessor = model.accessors.at(accessorIndex);
+
+    std::vector<unsigned char> zeros;
+    const auto                 elements = accessorElements(model, accessorIndex, zeros);
+
+    std::vector<std::uint32_t> result(accessor.count);
+    for (std::size_t i = 0; i < accessor.count; ++i)
+    {
+        result[i] = readIndex(elements[i], accessor.componentType, accessorIndex);
+    }
+
+    return result;
+}
+
+static Geometry
+loadGeometry(const tinygltf::Model& model, const tinygltf::Primitive& primitive)
+{
+    Geometry geometry{
+        .materialIndex = primitive.material < 0 ? INVALID_INDEX : static_cast<std::uint32_t>(primitive.material),
+    };
+
+    const auto positions = readFloatAccessor(model, primitive.attributes.at("POSITION"), 3);
+    geometry.positions.resize(positions.size() / 3);
+    std::memcpy(geometry.positions.data(), positions.data(), positions.size() * sizeof(float));
+
+    if (const auto itr = primitive.attributes.find("NORMAL"); itr != primitive.attributes.end())
+    {
+        const auto normals = readFloatAccessor(model, itr->second, 3);
+        geometry.normals.resize(normals.size() / 3);
+        std::memcpy(geometry.normals.data(), normals.data(), normals.size() * sizeof(float));
+    }
+
+    if (const auto itr = primitive.attributes.find("TEXCOORD_0"); itr != primitive.attributes.end())
+    {
+        const auto texCoords = readFloatAccessor(model, itr->second, 2);
+        geometry.texCoords.resize(texCoords.size() / 2);
+        std::memcpy(geometry.texCoords.data(), texCoords.data(), texCoords.size() * sizeof(float));
+    }
+
+    if (primitive.indices >= 0)
+    {
+        geometry.indices = readIndexAccessor(model, primitive.indices);
+    }
+    else
+    {
+        geometry.indices.resize(geometry.positions.size());
+        for (std::uint32_t i = 0; i < geometry.indices.size(); ++i)
+        {
+            geometry.indices[i] = i;
+        }
+    }
+
+    // Drop any trailing indices that don't form a full triangle:
+    geometry.indices.resize(geometry.indices.size() - geometry.indices.size() % 3);
+
+    for (const auto& position : geometry.positions)
+    {
+        geometry.bounds.extend(position);
+    }
+
+    return geometry;
+}
+
+static vk::SamplerAddressMode
+loadAddressMode(const int wrap)
+{
+    switch (wrap)
+    {
+    case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+        return vk::SamplerAddressMode::eClampToEdge;
+    case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+        return vk::SamplerAddressMode::eMirroredRepeat;
+    default:
+        return vk::SamplerAddressMode::eRepeat;
+    }
+}
+
+// Textures without an image that tinygltf decoded (e.g. those that only have a KHR_texture_basisu or EXT_texture_webp source) aren't
+// supported, the material slots that use them are left empty.
+static std::optional<Texture>
+loadTexture(const tinygltf::Model& model, const std::size_t textureIndex)
+{
+    const auto& gltfTexture = model.textures[textureIndex];
+    if (gltfTexture.source < 0 || gltfTexture.source >= static_cast<int>(model.images.size()) || model.images[gltfTexture.source].image.empty())
+    {
+        spdlog::warn("Skipping texture {} ({}) without a supported image source", textureIndex, gltfTexture.name);
+        return std::nullopt;
+    }
+
+    const auto& image = model.images[gltfTexture.source];
+
+    // tinygltf always expands images to 4 components, so we only have to distinguish between 8 and 16 bit images:
+    const auto bytesPerTexel = static_cast<std::size_t>(image.component) * (image.bits / 8);
+
+    Texture texture{
+        .name   = image.name,
+        .format = image.bits == 16 ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR8G8B8A8Unorm,
+    };
+
+    TextureLevel level{
+        .width  = static_cast<std::uint32_t>(image.width),
+        .height = static_cast<std::uint32_t>(image.height),
+    };
+    level.data.resize(level.width * level.height * bytesPerTexel);
+    std::memcpy(level.data.data(), image.image.data(), level.data.size());
+
+    texture.levels.emplace_back(std::move(level));
+
+    // Without a sampler, glTF textures repeat in both directions:
+    if (gltfTexture.sampler >= 0 && gltfTexture.sampler < static_cast<int>(model.samplers.size()))
+    {
+        const auto& sampler  = model.samplers[gltfTexture.sampler];
+        texture.addressModeU = loadAddressMode(sampler.wrapS);
+        texture.addressModeV = loadAddressMode(sampler.wrapT);
+    }
+
+    return texture;
+}
+
+// textureRemap maps glTF textures to those of the scene (INVALID_INDEX for skipped ones).
+static Material
+loadMaterial(const tinygltf::Material& gltfMaterial, const std::vector<std::uint32_t>& textureRemap)
+{
+    const auto textureIndex = [&](const int index) {
+        return index < 0 || index >= static_cast<int>(textureRemap.size()) ? INVALID_INDEX : textureRemap[index];
+    };
+
+    const auto& pbr = gltfMaterial.pbrMetallicRoughness;
+
+    Material material{
+        .name                     = gltfMaterial.name,
+        .metallicFactor           = static_cast<float>(pbr.metallicFactor),
+        .roughnessFactor          = static_cast<float>(pbr.roughnessFactor),
+        .alphaCutoff              = static_cast<float>(gltfMaterial.alphaCutoff),
+        .doubleSided              = gltfMaterial.doubleSided,
+        .baseColorTexture         = textureIndex(pbr.baseColorTexture.index),
+        .metallicRoughnessTexture = textureIndex(pbr.metallicRoughnessTexture.index),
+        .normalTexture            = textureIndex(gltfMaterial.normalTexture.index),
+        .occlusionTexture         = textureIndex(gltfMaterial.occlusionTexture.index),
+        .emissiveTexture          = textureIndex(gltfMaterial.emissiveTexture.index),
+    };
+
+    if (pbr.baseColorFactor.size() == 4)
+    {
+        material.baseColorFactor = glm::vec4(pbr.baseColorFactor[0], pbr.baseColorFactor[1], pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+    }
+
+    if (gltfMaterial.emissiveFactor.size() == 3)
+    {
+        material.emissiveFactor = glm::vec3(gltfMaterial.emissiveFactor[0], gltfMaterial.emissiveFactor[1], gltfMaterial.emissiveFactor[2]);
+    }
+
+    if (gltfMaterial.alphaMode == "MASK")
+    {
+        material.alphaMode = AlphaMode::eMask;
+    }
+    else if (gltfMaterial.alphaMode == "BLEND")
+    {
+        material.alphaMode = AlphaMode::eBlend;
+    }
+
+    const auto extensionFactor = [&](const std::string& extension, const std::string& factor) {
+        const auto itr = gltfMaterial.extensions.find(extension);
+        if (itr == gltfMaterial.extensions.end() || !itr->second.Has(factor) || !itr->second.Get(factor).IsNumber())
+        {
+            return 0.f;
+        }
+        return static_cast<float>(itr->second.Get(factor).GetNumberAsDouble());
+    };
+
+    material.clearcoatFactor          = extensionFactor("KHR_materials_clearcoat", "clearcoatFactor");
+    material.clearcoatRoughnessFactor = extensionFactor("KHR_materials_clearcoat", "clearcoatRoughnessFactor");
+    material.transmissionFactor       = extensionFactor("KHR_materials_transmission", "transmissionFactor");
+
+    return material;
+}
+
+static Light
+loadLight(const tinygltf::Light& gltfLight)
+{
+    Light light{
+        .name           = gltfLight.name,
+        .intensity      = static_cast<float>(gltfLight.intensity),
+        .range          = static_cast<float>(gltfLight.range),
+        .innerConeAngle = static_cast<float>(gltfLight.spot.innerConeAngle),
+        .outerConeAngle = static_cast<float>(gltfLight.spot.outerConeAngle),
+    };
+
+    if (gltfLight.color.size() == 3)
+    {
+        light.color = glm::vec3(gltfLight.color[0], gltfLight.color[1], gltfLight.color[2]);
+    }
+
+    if (gltfLight.type == "spot")
+    {
+        light.type = LightType::eSpot;
+    }
+    else if (gltfLight.type == "directional")
+    {
+        light.type = LightType::eDirectional;
+    }
+    else if (gltfLight.type != "point")
+    {
+        throw std::runtime_error(fmt::format("Light {} has unsupported type {}", gltfLight.name, gltfLight.type));
+    }
+
+    return light;
+}
+
+// Index of the KHR_lights_punctual light of a node, or -1.
+static int
+nodeLight(const tinygltf::Node& node)
+{
+    const auto itr = node.extensions.find("KHR_lights_punctual");
+    if (itr == node.extensions.end() || !itr->second.Has("light") || !itr->second.Get("light").IsNumber())
+    {
+        return -1;
+    }
+    return itr->second.Get("light").GetNumberAsInt();
+}
+
+// Reads the build hints of a mesh from its extras, i.e. "dynamic" (bool) and "buildPreference" ("auto", "fastTrace" or "fastBuild").
+static BuildHints
+loadBuildHints(const tinygltf::Mesh& gltfMesh)
+{
+    BuildHints hints;
+
+    const auto& extras = gltfMesh.extras;
+    if (extras.Has("dynamic") && extras.Get("dynamic").IsBool())
+    {
+        hints.dynamic = extras.Get("dynamic").Get<bool>();
+    }
+
+    if (extras.Has("buildPreference") && extras.Get("buildPreference").IsString())
+    {
+        const auto& preference = extras.Get("buildPreference").Get<std::string>();
+        if (preference == "fastTrace")
+        {
+            hints.preference = BuildPreference::eFastTrace;
+        }
+        else if (preference == "fastBuild")
+        {
+            hints.preference = BuildPreference::eFastBuild;
+        }
+        else if (preference != "auto")
+        {
+            spdlog::warn("Ignoring unknown build preference {} of mesh {}", preference, gltfMesh.name);
+        }
+    }
+
+    return hints;
+}
+
+// Derives the usage of every texture from the material slots that reference it.
+static void
+assignTextureUsages(Scene& scene)
+{
+    std::vector<bool> assigned(scene.textures.size(), false);
+
+    const auto assign = [&](const std::uint32_t textureIndex, const TextureUsage usage) {
+        if (textureIndex == INVALID_INDEX)
+        {
+            return;
+        }
+
+        auto& texture = scene.textures.at(textureIndex);
+
+        // A texture that is shared between different slots (e.g. occlusion packed with metallic-roughness) has to keep all of its
+        // channels as linear data:
+        texture.usage          = assigned[textureIndex] && texture.usage != usage ? TextureUsage::eLinear : usage;
+        assigned[textureIndex] = true;
+    };
+
+    for (const auto& material : scene.materials)
+    {
+        assign(material.baseColorTexture, TextureUsage::eColor);
+        assign(material.emissiveTexture, TextureUsage::eColor);
+        assign(material.metallicRoughnessTexture, TextureUsage::eLinear);
+        assign(material.normalTexture, TextureUsage::eNormal);
+        assign(material.occlusionTexture, TextureUsage::eSingleChannel);
+    }
+
+    for (auto& texture : scene.textures)
+    {
+        if (texture.usage == TextureUsage::eColor && texture.format == vk::Format::eR8G8B8A8Unorm)
+        {
+            texture.format = vk::Format::eR8G8B8A8Srgb;
+        }
+    }
+}
+
+static glm::mat4
+nodeTransform(const tinygltf::Node& node)
+{
+    if (node.matrix.size() == 16)
+    {
+        return glm::mat4(glm::make_mat4(node.matrix.data()));
+    }
+
+    glm::mat4 transform(1.f);
+    if (node.translation.size() == 3)
+    {
+        transform[3] = glm::vec4(node.translation[0], node.translation[1], node.translation[2], 1.f);
+    }
+    if (node.rotation.size() == 4)
+    {
+        // glTF stores quaternions as xyzw while glm's constructor expects wxyz:
+        transform *= glm::mat4_cast(glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+                                              static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+    }
+    if (node.scale.size() == 3)
+    {
+        transform[0] *= static_cast<float>(node.scale[0]);
+        transform[1] *= static_cast<float>(node.scale[1]);
+        transform[2] *= static_cast<float>(node.scale[2]);
+    }
+
+    return transform;
+}
+
+SceneLoader::SceneLoader(const Param& param) : m_param(param), m_textureCompressor(param.textureCompressor)
+{
+}
+
+Scene SceneLoader::load(const std::filesystem::path& path) const
+{
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model    model;
+    std::string        err, warn;
+
+    const bool loaded = path.extension() == ".glb" ? loader.LoadBinaryFromFile(&model, &err, &warn, path.string())
+                                                   : loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
+
+    if (!warn.empty())
+    {
+        spdlog::warn("Loading {}: {}", path.string(), warn);
+    }
+
+    if (!loaded)
+    {
+        throw std::runtime_error(fmt::format("Failed to load glTF file {}: {}", path.string(), err));
+    }
+
+    Scene scene;
+
+    //
+    // Textures and Materials
+    //
+
+    std::vector<std::uint32_t> textureRemap(model.textures.size(), INVALID_INDEX);
+
+    scene.textures.reserve(model.textures.size());
+    for (std::size_t i = 0; i < model.textures.size(); ++i)
+    {
+        if (auto texture = loadTexture(model, i))
+        {
+            textureRemap[i] = static_cast<std::uint32_t>(scene.textures.size());
+            scene.textures.emplace_back(std::move(*texture));
+        }
+    }
+
+    // Identical materials are merged, which lets identical primitives that use different copies of the material be merged as well:
+    std::vector<std::uint32_t>                            materialRemap;
+    std::unordered_multimap<std::uint64_t, std::uint32_t> uniqueMaterials;
+
+    scene.materials.reserve(model.materials.size());
+    materialRemap.reserve(model.materials.size());
+    for (const auto& gltfMaterial : model.materials)
+    {
+        auto material = loadMaterial(gltfMaterial, textureRemap);
+
+        if (m_param.deduplicate)
+        {
+            const auto hash         = contentHash(material);
+            const auto [begin, end] = uniqueMaterials.equal_range(hash);
+            const auto duplicate    = std::find_if(begin, end, [&](const auto& entry) { return sameContent(scene.materials[entry.second], material); });
+            if (duplicate != end)
+            {
+                materialRemap.emplace_back(duplicate->second);
+                continue;
+            }
+            uniqueMaterials.emplace(hash, static_cast<std::uint32_t>(scene.materials.size()));
+        }
+
+        materialRemap.emplace_back(static_cast<std::uint32_t>(scene.materials.size()));
+        scene.materials.emplace_back(std::move(material));
+    }
+
+    assignTextureUsages(scene);
+
+    const auto generateCpuMips =
+        m_param.mipGeneration == MipGeneration::eCpu || (m_param.mipGeneration != MipGeneration::eNone && m_param.compressTextures);
+
+    for (auto& texture : scene.textures)
+    {
+        // The compressor only generates the mips when the texture isn't in its cache:
+        if (m_param.compressTextures)
+        {
+            m_textureCompressor.compress(texture, generateCpuMips ? std::optional(m_param.mipFilter) : std::nullopt);
+        }
+        else if (generateCpuMips)
+        {
+            generateMips(texture, m_param.mipFilter);
+        }
+    }
+
+    // Classifies against the texels as they are rendered, i.e. after compression:
+    std::optional<AlphaClassifier> alphaClassifier;
+    if (m_param.classifyAlpha)
+    {
+        alphaClassifier.emplace(scene.materials, scene.textures);
+    }
+
+    //
+    // Meshes
+    //
+
+    // A glTF mesh can turn into multiple meshes if any of its primitives had to be split:
+    std::vector<std::vector<std::uint32_t>> gltfMeshToMeshes(model.meshes.size());
+
+    // Duplicated meshes (and duplicated oversized primitives) are only added once, every node that uses them then instances the same
+    // meshes. Split primitives aren't kept around (they can be huge), instead their chunks are compared, which are identical if and only
+    // if the primitives are as splitting is deterministic:
+    std::unordered_multimap<std::uint64_t, std::uint32_t>              uniqueMeshes;
+    std::unordered_multimap<std::uint64_t, std::vector<std::uint32_t>> uniqueSplitPrimitives;
+
+    std::size_t            splitPrimitiveCount = 0, duplicateMeshCount = 0;
+    AlphaClassifier::Stats alphaStats;
+    for (std::size_t gltfMeshIndex = 0; gltfMeshIndex < model.meshes.size(); ++gltfMeshIndex)
+    {
+        const auto& gltfMesh    = model.meshes[gltfMeshIndex];
+        auto&       meshIndices = gltfMeshToMeshes[gltfMeshIndex];
+
+        Mesh mesh{
+            .name       = gltfMesh.name,
+            .buildHints = loadBuildHints(gltfMesh),
+        };
+
+        for (const auto& primitive : gltfMesh.primitives)
+        {
+            if (primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES)
+            {
+                spdlog::warn("Skipping primitive of mesh {} with unsupported mode {}", gltfMesh.name, primitive.mode);
+                continue;
+            }
+
+            auto geometry = loadGeometry(model, primitive);
+            if (geometry.materialIndex != INVALID_INDEX)
+            {
+                geometry.materialIndex = materialRemap[geometry.materialIndex];
+            }
+            geometry.opaque = geometry.materialIndex == INVALID_INDEX || scene.materials[geometry.materialIndex].alphaMode == AlphaMode::eOpaque;
+
+            std::vector<Geometry> parts;
+            if (alphaClassifier)
+            {
+                parts = alphaClassifier->classify(std::move(geometry), alphaStats);
+            }
+            else
+            {
+                parts.emplace_back(std::move(geometry));
+            }
+
+            for (auto& part : parts)
+            {
+                if (m_param.maxTrianglesPerMesh == 0 || part.triangleCount() <= m_param.maxTrianglesPerMesh)
+                {
+                    mesh.bounds.extend(part.bounds);
+                    mesh.geometries.emplace_back(std::move(part));
+                    continue;
+                }
+
+                std::uint64_t splitKey = 0;
+                if (m_param.deduplicate)
+                {
+                    const std::uint64_t counts[] = {part.vertexCount(), part.triangleCount()};
+                    splitKey = hashBytes(counts, sizeof(counts), contentHash(part));
+                }
+
+                auto chunks = splitGeometry(std::move(part), m_param.maxTrianglesPerMesh);
+
+                if (m_param.deduplicate)
+                {
+                    const auto sameChunk = [&](const std::uint32_t meshIndex, const Geometry& chunk) {
+                        const auto& other = scene.meshes[meshIndex];
+                        return other.buildHints == mesh.buildHints && sameContent(other.geometries.front(), chunk);
+                    };
+
+                    const auto [begin, end] = uniqueSplitPrimitives.equal_range(splitKey);
+                    const auto duplicate    = std::find_if(begin, end, [&](const auto& entry) {
+                        return std::ranges::equal(entry.second, chunks, sameChunk);
+                    });
+                    if (duplicate != end)
+                    {
+                        meshIndices.insert(meshIndices.end(), duplicate->second.begin(), duplicate->second.end());
+                        duplicateMeshCount += duplicate->second.size();
+                        continue;
+                    }
+                }
+
+                std::vector<std::uint32_t> chunkMeshIndices;
+                for (std::size_t i = 0; i < chunks.size(); ++i)
+                {
+                    Mesh chunkMesh{
+                        .name       = fmt::format("{}.chunk{}", gltfMesh.name, i),
+                        .bounds     = chunks[i].bounds,
+                        .buildHints = mesh.buildHints,
+                    };
+                    chunkMesh.geometries.emplace_back(std::move(chunks[i]));
+
+                    chunkMeshIndices.emplace_back(static_cast<std::uint32_t>(scene.meshes.size()));
+                    scene.meshes.emplace_back(std::move(chunkMesh));
+                }
+
+                meshIndices.insert(meshIndices.end(), chunkMeshIndices.begin(), chunkMeshIndices.end());
+                if (m_param.deduplicate)
+                {
+                    uniqueSplitPrimitives.emplace(splitKey, std::move(chunkMeshIndices));
+                }
+                ++splitPrimitiveCount;
+            }
+        }
+
+        if (mesh.geometries.empty())
+        {
+            continue;
+        }
+
+        if (m_param.deduplicate)
+        {
+            const auto hash         = contentHash(mesh);
+            const auto [begin, end] = uniqueMeshes.equal_range(hash);
+            const auto duplicate    = std::find_if(begin, end, [&](const auto& entry) {
+                const auto& other = scene.meshes[entry.second];
+                return other.buildHints == mesh.buildHints && sameContent(other, mesh);
+            });
+            if (duplicate != end)
+            {
+                meshIndices.emplace_back(duplicate->second);
+                ++duplicateMeshCount;
+                continue;
+            }
+            uniqueMeshes.emplace(hash, static_cast<std::uint32_t>(scene.meshes.size()));
+        }
+
+        meshIndices.emplace_back(static_cast<std::uint32_t>(scene.meshes.size()));
+        scene.meshes.emplace_back(std::move(mesh));
+    }
+
+    if (alphaClassifier)
+    {
+        spdlog::info("Classified alpha tested triangles: {} opaque, {} transparent (dropped), {} mixed.", alphaStats.opaqueTriangles,
+                     alphaStats.transparentTriangles, alphaStats.mixedTriangles);
+    }
+
+    if (splitPrimitiveCount > 0)
+    {
+        spdlog::info("Split {} primitives exceeding {} triangles.", splitPrimitiveCount, m_param.maxTrianglesPerMesh);
+    }
+
+    if (m_param.deduplicate)
+    {
+        spdlog::info("Merged {} duplicated materials and {} duplicated meshes.", model.materials.size() - scene.materials.size(), duplicateMeshCount);
+    }
+
+    //
+    // Levels of detail
+    //
+
+    if (m_param.lodLevelCount > 0)
+    {
+        std::size_t lodCount = 0;
+
+        // LodSelector keeps meshes with an emissive material at their finest level (as the light tree samples their triangles), so
+        // levels of them would never be used:
+        const auto emissive = [&](const Geometry& geometry) {
+            return geometry.materialIndex != INVALID_INDEX && scene.materials[geometry.materialIndex].emissiveFactor != glm::vec3(0.f);
+        };
+
+        const auto meshCount = scene.meshes.size();
+        for (std::size_t meshIndex = 0; meshIndex < meshCount; ++meshIndex)
+        {
+            if (std::ranges::any_of(scene.meshes[meshIndex].geometries, emissive))
+            {
+                continue;
+            }
+
+            auto lods = generateLods(scene.meshes[meshIndex], m_param.lodLevelCount, m_param.lodReduction, m_param.minLodTriangles);
+            for (std::size_t level = 0; level < lods.size(); ++level)
+            {
+                lods[level].mesh.name = fmt::format("{}.lod{}", scene.meshes[meshIndex].name, level + 1);
+
+                scene.meshes[meshIndex].lods.emplace_back(MeshLod{
+                    .meshIndex = static_cast<std::uint32_t>(scene.meshes.size()),
+                    .error     = lods[level].error,
+                });
+                scene.meshes.emplace_back(std::move(lods[level].mesh));
+            }
+            lodCount += lods.size();
+        }
+
+        spdlog::info("Generated {} levels of detail.", lodCount);
+    }
+
+    //
+    // Instances
+    //
+
+    const auto traverse = [&](const auto& self, const int nodeIndex, const glm::mat4& parentTransform) -> void {
+        const auto& node      = model.nodes[nodeIndex];
+        const auto  transform = parentTransform * nodeTransform(node);
+
+        if (node.mesh >= 0)
+        {
+            for (const auto meshIndex : gltfMeshToMeshes[node.mesh])
+            {
+                scene.instances.emplace_back(Instance{
+                    .meshIndex = meshIndex,
+                    .transform = transform,
+                });
+            }
+        }
+
+        const auto lightIndex = nodeLight(node);
+        if (lightIndex >= 0 && lightIndex < static_cast<int>(model.lights.size()))
+        {
+            auto& light     = scene.lights.emplace_back(loadLight(model.lights[lightIndex]));
+            light.transform = transform;
+        }
+
+        for (const auto child : node.children)
+        {
+            self(self, child, transform);
+        }
+    };
+
+    if (!model.scenes.empty())
+    {
+        const auto& gltfScene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+        for (const auto nodeIndex : gltfScene.nodes)
+        {
+            traverse(traverse, nodeIndex, glm::mat4(1.f));
+        }
+    }
+
+    // The coverage of a mesh is that of its largest instance:
+    BoundingBox              sceneBounds;
+    std::vector<BoundingBox> instanceBounds;
+    instanceBounds.reserve(scene.instances.size());
+    for (const auto& instance : scene.instances)
+    {
+        sceneBounds.extend(instanceBounds.emplace_back(scene.meshes[instance.meshIndex].bounds.transformed(instance.transform)));
+    }
+
+    for (auto& mesh : scene.meshes)
+    {
+        mesh.buildHints.coverage = 0.f;
+    }
+
+    const auto sceneArea = sceneBounds.surfaceArea();
+    for (std::size_t i = 0; i < scene.instances.size(); ++i)
+    {
+        auto& coverage = scene.meshes[scene.instances[i].meshIndex].buildHints.coverage;
+        coverage       = std::max(coverage, sceneArea > 0.f ? std::min(instanceBounds[i].surfaceArea() / sceneArea, 1.f) : 1.f);
+    }
+
+    // Levels of detail aren't instanced themselves, they replace their mesh:
+    for (auto& mesh : scene.meshes)
+    {
+        for (const auto& lod : mesh.lods)
+        {
+            scene.meshes[lod.meshIndex].buildHints.coverage = mesh.buildHints.coverage;
+        }
+    }
+
+    spdlog::info("Loaded {}: {} meshes, {} instances, {} materials, {} textures, {} lights.", path.string(), scene.meshes.size(),
+                 scene.instances.size(), scene.materials.size(), scene.textures.size(), scene.lights.size());
+
+    return scene;
+}
+
+} // namespace polar
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include <mip_generator.hpp>
+#include <scene.hpp>
+#include <texture_compressor.hpp>
+
+namespace polar
+{
+
+class SceneLoader
+{
+  public:
+    struct Param
+    {
+        // Primitives with more triangles than this are split into spatially coherent chunks, each of which becomes its own mesh (and
+        // thus its own BLAS). This bounds the scratch memory of a single build and lets the builds of large assets run in parallel.
+        // A value of 0 disables splitting.
+        std::uint32_t maxTrianglesPerMesh = 1u << 20;
+
+        // Merges materials and meshes with identical content (even if they come from different glTF meshes), so that repeated assets are
+        // stored and built only once and referenced by multiple instances.
+        bool deduplicate = true;
+
+        // Splits primitives with alpha tested materials into a part that is fully opaque and a part that still needs the alpha test,
+        // dropping triangles that are fully transparent (see AlphaClassifier). Only the latter part needs any-hit shaders.
+        bool classifyAlpha = true;
+
+        // Number of coarser levels of detail that are generated per mesh (each of which becomes a mesh of its own, see generateLods()),
+        // each with at most lodReduction times the triangles of the previous one. Meshes with fewer than minLodTriangles triangles get
+        // fewer levels or none at all, meshes with an emissive material none. A value of 0 disables LODs.
+        std::uint32_t lodLevelCount   = 3;
+        float         lodReduction    = 0.25f;
+        std::uint32_t minLodTriangles = 1024;
+
+        // Where missing mip levels are generated, which has to be the same as TextureUploader::Param::mipGeneration. Textures that get
+        // block compressed always have their mips generated on the CPU unless this is eNone, as the GPU can't filter compressed data. With
+        // eGpu and eAuto, uncompressed textures are imported with their first level only and TextureUploader generates the rest, on the
+        // CPU or the GPU as it sees fit for the device.
+        MipGeneration mipGeneration = MipGeneration::eAuto;
+        MipFilter     mipFilter     = MipFilter::eBox;
+
+        // Whether textures get block compressed at import (see TextureCompressor for the formats that are picked).
+        bool                     compressTextures = true;
+        TextureCompressor::Param textureCompressor;
+    };
+
+    SceneLoader(const Param& param);
+
+    Scene load(const std::filesystem::path& path) const;
+
+  private:
+    Param             m_param;
+    TextureCompressor m_textureCompressor;
+};
+
+} // namespace polar
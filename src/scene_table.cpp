@@ -0,0 +1,190 @@
+#include "scene_table.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#include <acceleration_structure.hpp>
+
+namespace polar
+{
+
+static GPUSceneMaterial
+sceneMaterial(const Material& material)
+{
+    std::uint32_t flags = material.doubleSided ? SCENE_MATERIAL_DOUBLE_SIDED : 0;
+    flags |= material.alphaMode == AlphaMode::eMask ? SCENE_MATERIAL_ALPHA_MASK : 0;
+    flags |= material.alphaMode == AlphaMode::eBlend ? SCENE_MATERIAL_ALPHA_BLEND : 0;
+
+    return GPUSceneMaterial{
+        .baseColorFactor = material.baseColorFactor,
+        .emissiveFactor  = material.emissiveFactor,
+        .metallicFactor  = material.metallicFactor,
+        .roughnessFactor = material.roughnessFactor,
+        .alphaCutoff     = material.alphaCutoff,
+        .flags           = flags,
+    };
+}
+
+SceneTable::SceneTable(const Context& context, const GPUAllocator& allocator, const Scene& scene, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param), m_uploader(allocator, param.framesInFlight)
+{
+    m_meshGeometries.reserve(scene.meshes.size() + 1);
+    for (const auto& mesh : scene.meshes)
+    {
+        m_meshGeometries.emplace_back(static_cast<std::uint32_t>(m_geometries.size()));
+        for (const auto& geometry : mesh.geometries)
+        {
+            m_geometries.emplace_back(GPUSceneGeometry{.materialIndex = geometry.materialIndex});
+        }
+    }
+    m_meshGeometries.emplace_back(static_cast<std::uint32_t>(m_geometries.size()));
+
+    m_instances.resize(scene.instances.size());
+    m_dirtyInstances.assign(m_instances.size(), false);
+    m_dirtyGeometries.assign(m_geometries.size(), false);
+    for (std::uint32_t instance = 0; instance < scene.instances.size(); ++instance)
+    {
+        m_instances[instance].objectToWorld = glm::mat4x3(scene.instances[instance].transform);
+        setInstanceMesh(instance, scene.instances[instance].meshIndex);
+    }
+
+    m_materials.reserve(scene.materials.size());
+    for (const auto& material : scene.materials)
+    {
+        m_materials.emplace_back(sceneMaterial(material));
+    }
+
+    // Every array is padded, so that empty ones still have an address of their own:
+    const vk::DeviceSize instancesSize  = alignUp(std::max<std::size_t>(m_instances.size(), 1) * sizeof(GPUSceneInstance), 16);
+    const vk::DeviceSize geometriesSize = alignUp(std::max<std::size_t>(m_geometries.size(), 1) * sizeof(GPUSceneGeometry), 16);
+    const vk::DeviceSize materialsSize  = alignUp(std::max<std::size_t>(m_materials.size(), 1) * sizeof(GPUSceneMaterial), 16);
+
+    m_instanceOffset = alignUp(sizeof(GPUSceneTable), 16);
+    m_geometryOffset = m_instanceOffset + instancesSize;
+    m_materialOffset = m_geometryOffset + geometriesSize;
+
+    m_buffer = m_allocator.allocate(m_materialOffset + materialsSize,
+                                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                        vk::BufferUsageFlagBits::eTransferDst,
+                                    VMA_MEMORY_USAGE_GPU_ONLY);
+
+    m_tableAddress        = m_buffer.deviceAddress(m_context);
+    m_table.instances     = m_tableAddress + m_instanceOffset;
+    m_table.geometries    = m_tableAddress + m_geometryOffset;
+    m_table.materials     = m_tableAddress + m_materialOffset;
+    m_table.materialCount = static_cast<std::uint32_t>(m_materials.size());
+}
+
+void SceneTable::setCamera(const glm::mat4& cameraToWorld, const float verticalFov)
+{
+    m_table.cameraToWorld = cameraToWorld;
+    m_table.tanHalfFovY   = std::tan(0.5f * verticalFov);
+    m_tableDirty          = true;
+}
+
+void SceneTable::setTlas(const vk::DeviceAddress tlas)
+{
+    m_table.tlas = tlas;
+    m_tableDirty = true;
+}
+
+void SceneTable::setFeedback(const vk::DeviceAddress feedback)
+{
+    m_table.feedback = feedback;
+    m_tableDirty     = true;
+}
+
+void SceneTable::setMesh(const std::uint32_t meshIndex, const GPUMesh* const mesh)
+{
+    const auto first = m_meshGeometries[meshIndex];
+    const auto count = m_meshGeometries[meshIndex + 1] - first;
+    if (mesh && mesh->geometries.size() != count)
+    {
+        throw std::runtime_error(fmt::format("Mesh {} has {} geometries, but the scene table reserved {}", meshIndex, mesh->geometries.size(),
+                                             count));
+    }
+
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        auto& geometry = m_geometries[first + i];
+        if (!mesh)
+        {
+            geometry = GPUSceneGeometry{.materialIndex = geometry.materialIndex};
+        }
+        else
+        {
+            const auto& source = mesh->geometries[i];
+            geometry           = GPUSceneGeometry{
+                .positions     = source.positions,
+                .normals       = source.normals,
+                .texCoords     = source.texCoords,
+                .indices       = source.indices,
+                .triangleCount = source.triangleCount,
+                .materialIndex = source.materialIndex,
+                .attributes    = (source.normals ? SCENE_GEOMETRY_NORMALS : 0) | (source.texCoords ? SCENE_GEOMETRY_TEX_COORDS : 0),
+            };
+        }
+        m_dirtyGeometries[first + i] = true;
+    }
+}
+
+void SceneTable::setMeshes(const std::vector<GPUMesh>& meshes)
+{
+    for (std::uint32_t meshIndex = 0; meshIndex < meshes.size(); ++meshIndex)
+    {
+        setMesh(meshIndex, &meshes[meshIndex]);
+    }
+}
+
+void SceneTable::setInstanceMesh(const std::uint32_t instance, const std::uint32_t meshIndex)
+{
+    m_instances[instance].firstGeometry = m_meshGeometries[meshIndex];
+    m_instances[instance].geometryCount = m_meshGeometries[meshIndex + 1] - m_meshGeometries[meshIndex];
+    m_dirtyInstances[instance]          = true;
+}
+
+void SceneTable::setInstanceTransform(const std::uint32_t instance, const glm::mat4& transform)
+{
+    m_instances[instance].objectToWorld = glm::mat4x3(transform);
+    m_dirtyInstances[instance]          = true;
+}
+
+void SceneTable::update(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    if (m_uploadAll)
+    {
+        m_uploader.add(m_materials.data(), m_materials.size() * sizeof(GPUSceneMaterial), m_materialOffset);
+        std::fill(m_dirtyInstances.begin(), m_dirtyInstances.end(), true);
+        std::fill(m_dirtyGeometries.begin(), m_dirtyGeometries.end(), true);
+        m_tableDirty = true;
+        m_uploadAll  = false;
+    }
+
+    if (m_table.previousWorldToCamera != m_lastWorldToCamera || m_table.previousTanHalfFovY != m_lastTanHalfFovY)
+    {
+        m_table.previousWorldToCamera = m_lastWorldToCamera;
+        m_table.previousTanHalfFovY   = m_lastTanHalfFovY;
+        m_tableDirty                  = true;
+    }
+    m_lastWorldToCamera = glm::inverse(m_table.cameraToWorld);
+    m_lastTanHalfFovY   = m_table.tanHalfFovY;
+
+    if (m_tableDirty)
+    {
+        m_uploader.add(&m_table, sizeof(m_table), 0);
+        m_tableDirty = false;
+    }
+
+    m_uploader.addDirty(m_dirtyInstances, m_instances, m_instanceOffset);
+    m_uploader.addDirty(m_dirtyGeometries, m_geometries, m_geometryOffset);
+
+    // The previous frame may still be reading the table:
+    const auto shaderStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+    m_uploader.upload(commandBuffer, frameIndex, *m_buffer, shaderStages);
+}
+
+} // namespace polar
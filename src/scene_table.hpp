@@ -0,0 +1,144 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <mesh_uploader.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Host side of shaders/scene.glsl, which the layouts below mirror (scalar block layout).
+
+constexpr std::uint32_t SCENE_GEOMETRY_NORMALS    = 1u << 0;
+constexpr std::uint32_t SCENE_GEOMETRY_TEX_COORDS = 1u << 1;
+
+constexpr std::uint32_t SCENE_MATERIAL_DOUBLE_SIDED = 1u << 0;
+constexpr std::uint32_t SCENE_MATERIAL_ALPHA_MASK   = 1u << 1;
+constexpr std::uint32_t SCENE_MATERIAL_ALPHA_BLEND  = 1u << 2;
+
+struct GPUSceneInstance
+{
+    glm::mat4x3   objectToWorld = glm::mat4x3(1.f);
+    std::uint32_t firstGeometry = 0; // Of the mesh the instance uses, in the geometries of the table
+    std::uint32_t geometryCount = 0;
+};
+
+// The addresses are 0 while the mesh of the geometry isn't resident.
+struct GPUSceneGeometry
+{
+    vk::DeviceAddress positions     = 0;
+    vk::DeviceAddress normals       = 0;
+    vk::DeviceAddress texCoords     = 0;
+    vk::DeviceAddress indices       = 0;
+    std::uint32_t     triangleCount = 0; // 0 while the mesh isn't resident
+    std::uint32_t     materialIndex = INVALID_INDEX;
+    std::uint32_t     attributes    = 0; // SCENE_GEOMETRY_*
+    std::uint32_t     padding       = 0;
+};
+
+struct GPUSceneMaterial
+{
+    glm::vec4     baseColorFactor = glm::vec4(1.f);
+    glm::vec3     emissiveFactor  = glm::vec3(0.f);
+    float         metallicFactor  = 1.f;
+    float         roughnessFactor = 1.f;
+    float         alphaCutoff     = 0.5f;
+    std::uint32_t flags           = 0; // SCENE_MATERIAL_*
+    std::uint32_t padding         = 0;
+};
+
+struct GPUSceneTable
+{
+    glm::mat4         cameraToWorld         = glm::mat4(1.f); // The camera looks along -Z, with +Y up
+    glm::mat4         previousWorldToCamera = glm::mat4(1.f); // Of the previous frame, for motion vectors
+    float             tanHalfFovY           = 0.41421356f;    // Of the vertical field of view
+    float             previousTanHalfFovY   = 0.41421356f;
+    std::uint32_t     materialCount         = 0;
+    std::uint32_t     padding               = 0;
+    vk::DeviceAddress tlas                  = 0;
+    vk::DeviceAddress instances             = 0; // Indexed by the custom index of the TLAS instances
+    vk::DeviceAddress geometries            = 0;
+    vk::DeviceAddress materials             = 0;
+    vk::DeviceAddress feedback              = 0; // See GeometryResidency::feedbackBuffer(), 0 without
+};
+
+// What the kernels that ship with the integrators (shaders/wavefront/ and shaders/megakernel/) know about the scene: the camera, the
+// TLAS, the transform and geometries of every instance and the factors of every material, all in a single buffer that they reach through
+// IntegratorConstants::scene (see Integrator::setScene()). Kernels of the application can use it as well, or ignore it.
+// Textures are bound through the descriptor sets of the application, which the shipped kernels don't know, so they only shade with the
+// factors of the materials. The instances are those of the scene, whose indices have to be the custom indices of the TLAS instances (as
+// with GeometryResidency).
+// Like the TLAS, the table is kept up to date by edits that mark what they touch as dirty, and update() only uploads the dirty records.
+class SceneTable
+{
+  public:
+    struct Param
+    {
+        // Number of frames the staging buffer of a frame may still be read by the GPU.
+        std::uint32_t framesInFlight = 2;
+    };
+
+    // Takes the materials and instances of the scene and reserves the geometries of all meshes, which have no vertex data until setMesh()
+    // (or setMeshes()) provides it. Everything is uploaded by the first update().
+    SceneTable(const Context& context, const GPUAllocator& allocator, const Scene& scene, const Param& param);
+
+    SceneTable(const SceneTable&)            = delete;
+    SceneTable(SceneTable&&)                 = delete;
+    SceneTable& operator=(const SceneTable&) = delete;
+    SceneTable& operator=(SceneTable&&)      = delete;
+
+    // The camera of the previous update() is kept as well, which motion vectors (e.g. those of ReSTIR DI) are computed against.
+    void setCamera(const glm::mat4& cameraToWorld, float verticalFov);
+    void setTlas(vk::DeviceAddress tlas);
+    void setFeedback(vk::DeviceAddress feedback);
+
+    // The vertex data of a mesh, or nullptr while it isn't resident. The mesh has to stay alive as long as the GPU may read it.
+    void setMesh(std::uint32_t meshIndex, const GPUMesh* mesh);
+    void setMeshes(const std::vector<GPUMesh>& meshes);
+
+    // The mesh an instance uses, e.g. its selected level of detail.
+    void setInstanceMesh(std::uint32_t instance, std::uint32_t meshIndex);
+    void setInstanceTransform(std::uint32_t instance, const glm::mat4& transform);
+
+    // Records the upload of what changed, followed by a barrier that makes it available to ray tracing and compute shaders.
+    void update(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    // Of the GPUSceneTable.
+    vk::DeviceAddress deviceAddress() const { return m_tableAddress; }
+
+  private:
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    std::vector<GPUSceneInstance> m_instances;
+    std::vector<GPUSceneGeometry> m_geometries;
+    std::vector<GPUSceneMaterial> m_materials;
+    std::vector<std::uint32_t>    m_meshGeometries; // Per mesh: its first geometry, followed by the end of the last mesh's
+
+    GPUBufferUnique   m_buffer; // GPUSceneTable, instances, geometries and materials
+    vk::DeviceAddress m_tableAddress = 0;
+    GPUSceneTable     m_table;
+    vk::DeviceSize    m_instanceOffset = 0;
+    vk::DeviceSize    m_geometryOffset = 0;
+    vk::DeviceSize    m_materialOffset = 0;
+    StagingUploader   m_uploader;
+
+    // Whether a record has to be uploaded:
+    std::vector<bool> m_dirtyInstances;
+    std::vector<bool> m_dirtyGeometries;
+    bool              m_tableDirty = true;
+    bool              m_uploadAll  = true; // Including the materials
+
+    // Camera of the last update(), which becomes the previous one of the next:
+    glm::mat4 m_lastWorldToCamera = glm::mat4(1.f);
+    float     m_lastTanHalfFovY   = 0.41421356f;
+};
+
+} // namespace polar
@@ -0,0 +1,326 @@
+#include "shader_compiler.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+
+#include <util.hpp>
+
+namespace polar
+{
+
+// The payload of a cache entry (see readCacheEntry()) is the SPIR-V code:
+constexpr std::uint32_t CACHE_MAGIC   = 0x56505350; // "PSPV"
+constexpr std::uint32_t CACHE_VERSION = 2;
+
+static bool
+readFile(const std::filesystem::path& path, std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool
+isHlsl(const ShaderSource& source)
+{
+    return source.path.extension() == ".hlsl";
+}
+
+static shaderc_shader_kind
+shaderKind(const vk::ShaderStageFlagBits stage)
+{
+    switch (stage)
+    {
+    case vk::ShaderStageFlagBits::eVertex:
+        return shaderc_vertex_shader;
+    case vk::ShaderStageFlagBits::eFragment:
+        return shaderc_fragment_shader;
+    case vk::ShaderStageFlagBits::eCompute:
+        return shaderc_compute_shader;
+    case vk::ShaderStageFlagBits::eRaygenKHR:
+        return shaderc_raygen_shader;
+    case vk::ShaderStageFlagBits::eMissKHR:
+        return shaderc_miss_shader;
+    case vk::ShaderStageFlagBits::eClosestHitKHR:
+        return shaderc_closesthit_shader;
+    case vk::ShaderStageFlagBits::eAnyHitKHR:
+        return shaderc_anyhit_shader;
+    case vk::ShaderStageFlagBits::eIntersectionKHR:
+        return shaderc_intersection_shader;
+    case vk::ShaderStageFlagBits::eCallableKHR:
+        return shaderc_callable_shader;
+    default:
+        throw std::runtime_error(fmt::format("Shader stage {} isn't supported", vk::to_string(stage)));
+    }
+}
+
+//
+// Includes
+//
+
+// Resolves #include "..." relative to the including file and then in the include directories, and #include <...> only in the include
+// directories.
+class Includer : public shaderc::CompileOptions::IncluderInterface
+{
+  public:
+    Includer(const std::vector<std::filesystem::path>& includeDirectories) : m_includeDirectories(includeDirectories)
+    {
+    }
+
+    shaderc_include_result* GetInclude(const char* requestedSource, const shaderc_include_type type, const char* requestingSource,
+                                       std::size_t) override
+    {
+        auto include = std::make_unique<Include>();
+
+        std::vector<std::filesystem::path> candidates;
+        if (type == shaderc_include_type_relative)
+        {
+            candidates.emplace_back(std::filesystem::path(requestingSource).parent_path() / requestedSource);
+        }
+        for (const auto& directory : m_includeDirectories)
+        {
+            candidates.emplace_back(directory / requestedSource);
+        }
+
+        for (const auto& candidate : candidates)
+        {
+            if (readFile(candidate, include->content))
+            {
+                include->name = candidate.string();
+                break;
+            }
+        }
+
+        // An empty name tells shaderc that the include failed, in which case the content is the error message:
+        if (include->name.empty())
+        {
+            include->content = fmt::format("Can't find include file {}", requestedSource);
+        }
+
+        include->result = shaderc_include_result{
+            .source_name        = include->name.data(),
+            .source_name_length = include->name.size(),
+            .content            = include->content.data(),
+            .content_length     = include->content.size(),
+            .user_data          = include.get(),
+        };
+
+        return &include.release()->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* const result) override
+    {
+        delete static_cast<Include*>(result->user_data);
+    }
+
+  private:
+    struct Include
+    {
+        std::string            name;
+        std::string            content;
+        shaderc_include_result result;
+    };
+
+    std::vector<std::filesystem::path> m_includeDirectories;
+};
+
+//
+// Cache
+//
+
+static bool
+readCache(const std::filesystem::path& path, std::vector<std::uint32_t>& code)
+{
+    std::vector<std::byte> payload;
+    if (!readCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, payload) || payload.empty() || payload.size() % sizeof(std::uint32_t) != 0)
+    {
+        return false;
+    }
+
+    code.resize(payload.size() / sizeof(std::uint32_t));
+    std::memcpy(code.data(), payload.data(), payload.size());
+    return true;
+}
+
+static void
+writeCache(const std::filesystem::path& path, const std::vector<std::uint32_t>& code)
+{
+    // Compiling the same shader on several threads or in several processes at once writes the same entry concurrently, which
+    // writeCacheEntry() handles:
+    const std::span<const std::byte> parts[] = {std::as_bytes(std::span(code))};
+    writeCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, parts);
+}
+
+//
+// ShaderCompiler
+//
+
+ShaderCompiler::ShaderCompiler(const Param& param) : m_param(param)
+{
+    if (!m_compiler.IsValid())
+    {
+        throw std::runtime_error("Failed to create the shader compiler");
+    }
+
+    if (!m_param.cacheDirectory.empty())
+    {
+        std::filesystem::create_directories(m_param.cacheDirectory);
+    }
+
+    // shaderc has no version query of its own, but it ships with the SDK, so the SDK's header version and the SPIR-V version it generates
+    // identify it well enough:
+    unsigned int spirvVersion = 0, spirvRevision = 0;
+    shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+
+    const std::uint32_t version[] = {CACHE_VERSION, spirvVersion, spirvRevision, VK_HEADER_VERSION};
+    m_versionHash                 = hashBytes(version, sizeof(version));
+}
+
+shaderc::CompileOptions ShaderCompiler::compileOptions(const ShaderSource& source) const
+{
+    shaderc::CompileOptions options;
+
+    // Ray tracing shaders need at least SPIR-V 1.4:
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+    options.SetTargetSpirv(shaderc_spirv_version_1_4);
+    options.SetSourceLanguage(isHlsl(source) ? shaderc_source_language_hlsl : shaderc_source_language_glsl);
+    options.SetOptimizationLevel(m_param.optimize ? shaderc_optimization_level_performance : shaderc_optimization_level_zero);
+    options.SetIncluder(std::make_unique<Includer>(m_param.includeDirectories));
+
+    if (m_param.debugInfo)
+    {
+        options.SetGenerateDebugInfo();
+    }
+
+    for (const auto& define : source.defines)
+    {
+        options.AddMacroDefinition(define.name, define.value);
+    }
+
+    return options;
+}
+
+std::vector<std::uint32_t> ShaderCompiler::compile(const ShaderSource& source) const
+{
+    const auto name = source.path.string();
+
+    std::string text;
+    if (!readFile(source.path, text))
+    {
+        throw std::runtime_error(fmt::format("Can't read shader {}", name));
+    }
+
+    const auto kind = shaderKind(source.stage);
+
+    // Preprocessing is cheap compared to compiling, and its output already contains all includes and has all defines applied, so it's what
+    // the cache is keyed by:
+    std::filesystem::path cachePath;
+    if (!m_param.cacheDirectory.empty())
+    {
+        const auto preprocessed = m_compiler.PreprocessGlsl(text, kind, name.c_str(), compileOptions(source));
+        if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success)
+        {
+            throw std::runtime_error(fmt::format("Failed to preprocess shader {}:\n{}", name, preprocessed.GetErrorMessage()));
+        }
+
+        const std::string   preprocessedText(preprocessed.cbegin(), preprocessed.cend());
+        const std::uint32_t description[] = {static_cast<std::uint32_t>(source.stage), isHlsl(source), m_param.optimize, m_param.debugInfo};
+
+        auto hash = hashBytes(description, sizeof(description), m_versionHash);
+        hash      = hashBytes(source.entryPoint.data(), source.entryPoint.size(), hash);
+        hash      = hashBytes(preprocessedText.data(), preprocessedText.size(), hash);
+
+        cachePath = m_param.cacheDirectory / fmt::format("{:016x}.spv", hash);
+
+        std::vector<std::uint32_t> code;
+        if (readCache(cachePath, code))
+        {
+            return code;
+        }
+    }
+
+    const auto result = m_compiler.CompileGlslToSpv(text, kind, name.c_str(), source.entryPoint.c_str(), compileOptions(source));
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        throw std::runtime_error(fmt::format("Failed to compile shader {}:\n{}", name, result.GetErrorMessage()));
+    }
+
+    if (result.GetNumWarnings() > 0)
+    {
+        spdlog::warn("Compiled shader {} with {} warnings:\n{}", name, result.GetNumWarnings(), result.GetErrorMessage());
+    }
+
+    std::vector<std::uint32_t> code(result.cbegin(), result.cend());
+
+    if (!cachePath.empty())
+    {
+        writeCache(cachePath, code);
+    }
+
+    return code;
+}
+
+std::vector<std::vector<std::uint32_t>> ShaderCompiler::compile(const std::span<const ShaderSource> sources) const
+{
+    std::vector<std::vector<std::uint32_t>> codes(sources.size());
+    std::vector<std::string>                errors(sources.size());
+
+    // Exceptions can't leave the worker threads, so they are collected and reported together:
+    parallelFor(sources.size(), [&](const std::size_t i) {
+        try
+        {
+            codes[i] = compile(sources[i]);
+        }
+        catch (const std::exception& exception)
+        {
+            errors[i] = exception.what();
+        }
+    });
+
+    std::string message;
+    for (const auto& error : errors)
+    {
+        if (!error.empty())
+        {
+            message += error + "\n";
+        }
+    }
+
+    if (!message.empty())
+    {
+        throw std::runtime_error(message);
+    }
+
+    return codes;
+}
+
+std::vector<vk::UniqueShaderModule> ShaderCompiler::createModules(const vk::Device& device, const std::span<const ShaderSource> sources) const
+{
+    const auto codes = compile(sources);
+
+    std::vector<vk::UniqueShaderModule> modules;
+    modules.reserve(codes.size());
+    for (const auto& code : codes)
+    {
+        modules.emplace_back(device.createShaderModuleUnique(vk::ShaderModuleCreateInfo{
+            .codeSize = code.size() * sizeof(std::uint32_t),
+            .pCode    = code.data(),
+        }));
+    }
+
+    return modules;
+}
+
+} // namespace polar
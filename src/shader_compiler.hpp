@@ -0,0 +1,74 @@
+#pragma once
+
+#include <shaderc/shaderc.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace polar
+{
+
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+
+    auto operator<=>(const ShaderDefine&) const = default;
+};
+
+struct ShaderSource
+{
+    // Files ending in .hlsl are compiled as HLSL, everything else as GLSL.
+    std::filesystem::path     path;
+    vk::ShaderStageFlagBits   stage      = vk::ShaderStageFlagBits::eCompute;
+    std::string               entryPoint = "main";
+    std::vector<ShaderDefine> defines;
+};
+
+// Compiles GLSL and HLSL shaders to SPIR-V at runtime with shaderc.
+// The SPIR-V is cached on disk, keyed by a hash of the preprocessed source (which covers all includes and defines), the stage, the entry
+// point, the compile options and the version of the compiler, so only the first compile of a shader (or of a permutation) is paid for.
+class ShaderCompiler
+{
+  public:
+    struct Param
+    {
+        // Directory in which compiled shaders are cached. Leave empty to disable the cache.
+        std::filesystem::path cacheDirectory;
+
+        // Searched for #include <...>. #include "..." is resolved relative to the including file first.
+        std::vector<std::filesystem::path> includeDirectories;
+
+        bool optimize  = true;
+        bool debugInfo = false;
+    };
+
+    ShaderCompiler(const Param& param);
+
+    ShaderCompiler(const ShaderCompiler&)            = delete;
+    ShaderCompiler(ShaderCompiler&&)                 = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(ShaderCompiler&&)      = delete;
+
+    std::vector<std::uint32_t> compile(const ShaderSource& source) const;
+
+    // Compiles all sources in parallel (e.g. all stages of a pipeline). Throws after all of them have finished if any failed, with the
+    // errors of all failed sources.
+    std::vector<std::vector<std::uint32_t>> compile(std::span<const ShaderSource> sources) const;
+
+    std::vector<vk::UniqueShaderModule> createModules(const vk::Device& device, std::span<const ShaderSource> sources) const;
+
+  private:
+    shaderc::CompileOptions compileOptions(const ShaderSource& source) const;
+
+    Param             m_param;
+    shaderc::Compiler m_compiler; // Thread safe
+    std::uint64_t     m_versionHash = 0;
+};
+
+} // namespace polar
@@ -0,0 +1,367 @@
+#include "texture_compressor.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include <block_compression.hpp>
+#include <color.hpp>
+#include <util.hpp>
+
+namespace polar
+{
+
+constexpr std::uint32_t CACHE_MAGIC = 0x54434250; // "PBCT"
+
+// Has to be bumped whenever the output of any of the encoders changes, otherwise stale entries would be picked up from the cache:
+constexpr std::uint32_t CACHE_VERSION = 4;
+
+// The payload of a cache entry (see readCacheEntry()): this header, followed by a level header and the data of every level.
+struct CacheHeader
+{
+    std::uint32_t format     = 0;
+    std::uint32_t levelCount = 0;
+};
+
+struct CacheLevelHeader
+{
+    std::uint32_t width  = 0;
+    std::uint32_t height = 0;
+    std::uint64_t size   = 0;
+};
+
+using BlockEncoder = void (*)(const TexelBlock&, std::byte*);
+
+static bool
+isBlockCompressed(const vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eBc4UnormBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc6HUfloatBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Bytes per 4x4 block of the formats compress() encodes to, 0 for any other:
+static std::size_t
+compressedBlockSize(const vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eBc4UnormBlock:
+        return BC4_BLOCK_SIZE;
+    case vk::Format::eBc5UnormBlock:
+        return BC5_BLOCK_SIZE;
+    case vk::Format::eBc6HUfloatBlock:
+        return BC6H_BLOCK_SIZE;
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return BC7_BLOCK_SIZE;
+    default:
+        return 0;
+    }
+}
+
+static bool
+isHighPrecision(const vk::Format format)
+{
+    return format == vk::Format::eR16G16B16A16Unorm || format == vk::Format::eR32G32B32A32Sfloat;
+}
+
+static TexelBlock
+fetchBlock(const TextureLevel& level, const vk::Format format, const std::uint32_t blockX, const std::uint32_t blockY, const bool linearize)
+{
+    TexelBlock block;
+    for (std::uint32_t y = 0; y < 4; ++y)
+    {
+        for (std::uint32_t x = 0; x < 4; ++x)
+        {
+            // Blocks that hang over the edge of the level replicate the last row / column:
+            const auto px    = std::min(blockX * 4 + x, level.width - 1);
+            const auto py    = std::min(blockY * 4 + y, level.height - 1);
+            const auto texel = static_cast<std::size_t>(py) * level.width + px;
+
+            auto& value = block[y * 4 + x];
+            switch (format)
+            {
+            case vk::Format::eR8G8B8A8Unorm:
+            case vk::Format::eR8G8B8A8Srgb:
+                for (int c = 0; c < 4; ++c)
+                {
+                    value[c] = std::to_integer<int>(level.data[texel * 4 + c]) / 255.f;
+                }
+                break;
+            case vk::Format::eR16G16B16A16Unorm:
+                for (int c = 0; c < 4; ++c)
+                {
+                    std::uint16_t component;
+                    std::memcpy(&component, level.data.data() + (texel * 4 + c) * sizeof(component), sizeof(component));
+                    value[c] = component / 65535.f;
+                }
+                break;
+            case vk::Format::eR32G32B32A32Sfloat:
+                std::memcpy(&value, level.data.data() + texel * sizeof(value), sizeof(value));
+                break;
+            default:
+                throw std::runtime_error(fmt::format("Unsupported source format for texture compression: {}", vk::to_string(format)));
+            }
+
+            if (linearize)
+            {
+                value = glm::vec4(srgbToLinear(value.r), srgbToLinear(value.g), srgbToLinear(value.b), value.a);
+            }
+        }
+    }
+
+    return block;
+}
+
+static bool
+isOpaque(const Texture& texture)
+{
+    const auto& level = texture.levels.front();
+    for (std::uint32_t y = 0; y < (level.height + 3) / 4; ++y)
+    {
+        for (std::uint32_t x = 0; x < (level.width + 3) / 4; ++x)
+        {
+            for (const auto& texel : fetchBlock(level, texture.format, x, y, false))
+            {
+                if (texel.a < 1.f)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static vk::Format
+selectFormat(const Texture& texture)
+{
+    switch (texture.usage)
+    {
+    case TextureUsage::eNormal:
+        return vk::Format::eBc5UnormBlock;
+    case TextureUsage::eSingleChannel:
+        return vk::Format::eBc4UnormBlock;
+    case TextureUsage::eColor:
+    case TextureUsage::eLinear:
+    default:
+        // BC7 only has 8 bits of precision per channel, so high precision sources are better off as BC6H if they can do without alpha:
+        if (isHighPrecision(texture.format) && isOpaque(texture))
+        {
+            return vk::Format::eBc6HUfloatBlock;
+        }
+        return texture.usage == TextureUsage::eColor ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+    }
+}
+
+// Hashes the source texture (before mips are generated) together with the filter that generates them:
+static std::uint64_t
+hashTexture(const Texture& texture, const std::optional<MipFilter> mipFilter)
+{
+    const std::uint32_t description[] = {CACHE_VERSION, static_cast<std::uint32_t>(texture.format), static_cast<std::uint32_t>(texture.usage),
+                                         static_cast<std::uint32_t>(texture.levels.size()),
+                                         mipFilter ? static_cast<std::uint32_t>(*mipFilter) + 1 : 0};
+
+    auto hash = hashBytes(description, sizeof(description));
+    for (const auto& level : texture.levels)
+    {
+        const std::uint32_t extent[] = {level.width, level.height};
+        hash = hashBytes(extent, sizeof(extent), hash);
+        hash = hashBytes(level.data.data(), level.data.size(), hash);
+    }
+    return hash;
+}
+
+// Copies the next size bytes of the payload of a cache entry, returns false if it ends before:
+static bool
+readPayload(const std::vector<std::byte>& payload, std::size_t& offset, void* const data, const std::size_t size)
+{
+    if (size > payload.size() - offset)
+    {
+        return false;
+    }
+
+    std::memcpy(data, payload.data() + offset, size);
+    offset += size;
+    return true;
+}
+
+static bool
+readCache(const std::filesystem::path& path, Texture& texture)
+{
+    std::vector<std::byte> payload;
+    if (!readCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, payload))
+    {
+        return false;
+    }
+
+    std::size_t offset = 0;
+    CacheHeader header;
+    if (!readPayload(payload, offset, &header, sizeof(header)))
+    {
+        return false;
+    }
+
+    // Only what compress() writes is valid: a chain of levels of one of the block compressed formats, each as large as its extent requires.
+    const auto format    = static_cast<vk::Format>(header.format);
+    const auto blockSize = compressedBlockSize(format);
+    if (blockSize == 0 || header.levelCount == 0 || header.levelCount > 32)
+    {
+        return false;
+    }
+
+    std::vector<TextureLevel> levels(header.levelCount);
+    for (std::uint32_t i = 0; i < header.levelCount; ++i)
+    {
+        CacheLevelHeader levelHeader;
+        if (!readPayload(payload, offset, &levelHeader, sizeof(levelHeader)) || levelHeader.width == 0 || levelHeader.height == 0)
+        {
+            return false;
+        }
+
+        const auto& previous = levels[i > 0 ? i - 1 : 0];
+        if (i > 0 && (levelHeader.width != std::max(1u, previous.width / 2) || levelHeader.height != std::max(1u, previous.height / 2)))
+        {
+            return false;
+        }
+
+        const std::uint64_t blocks = ((std::uint64_t(levelHeader.width) + 3) / 4) * ((std::uint64_t(levelHeader.height) + 3) / 4);
+        if (levelHeader.size != blocks * blockSize || levelHeader.size > payload.size() - offset)
+        {
+            return false;
+        }
+
+        auto& level  = levels[i];
+        level.width  = levelHeader.width;
+        level.height = levelHeader.height;
+        level.data.resize(levelHeader.size);
+        readPayload(payload, offset, level.data.data(), level.data.size());
+    }
+
+    if (header.levelCount > mipLevelCount(levels.front().width, levels.front().height) || offset != payload.size())
+    {
+        return false;
+    }
+
+    texture.format = format;
+    texture.levels = std::move(levels);
+
+    return true;
+}
+
+static void
+writeCache(const std::filesystem::path& path, const Texture& texture)
+{
+    const CacheHeader header{
+        .format     = static_cast<std::uint32_t>(texture.format),
+        .levelCount = static_cast<std::uint32_t>(texture.levels.size()),
+    };
+
+    std::vector<CacheLevelHeader> levelHeaders;
+    levelHeaders.reserve(texture.levels.size());
+
+    std::vector<std::span<const std::byte>> parts{std::as_bytes(std::span(&header, 1))};
+    parts.reserve(1 + 2 * texture.levels.size());
+    for (const auto& level : texture.levels)
+    {
+        levelHeaders.emplace_back(CacheLevelHeader{
+            .width  = level.width,
+            .height = level.height,
+            .size   = level.data.size(),
+        });
+        parts.emplace_back(std::as_bytes(std::span(&levelHeaders.back(), 1)));
+        parts.emplace_back(level.data);
+    }
+
+    writeCacheEntry(path, CACHE_MAGIC, CACHE_VERSION, parts);
+}
+
+TextureCompressor::TextureCompressor(const Param& param) : m_param(param)
+{
+    if (!m_param.cacheDirectory.empty())
+    {
+        std::filesystem::create_directories(m_param.cacheDirectory);
+    }
+}
+
+void TextureCompressor::compress(Texture& texture, const std::optional<MipFilter> mipFilter) const
+{
+    if (texture.levels.empty() || isBlockCompressed(texture.format))
+    {
+        return;
+    }
+
+    std::filesystem::path cachePath;
+    if (!m_param.cacheDirectory.empty())
+    {
+        cachePath = m_param.cacheDirectory / fmt::format("{:016x}.bc", hashTexture(texture, mipFilter));
+        if (readCache(cachePath, texture))
+        {
+            return;
+        }
+    }
+
+    if (mipFilter)
+    {
+        generateMips(texture, *mipFilter);
+    }
+
+    const auto format    = selectFormat(texture);
+    const auto linearize = format == vk::Format::eBc6HUfloatBlock && texture.usage == TextureUsage::eColor;
+
+    const auto blockSize = compressedBlockSize(format);
+    const auto encoder   = [&]() -> BlockEncoder {
+        switch (format)
+        {
+        case vk::Format::eBc4UnormBlock:
+            return encodeBc4Block;
+        case vk::Format::eBc5UnormBlock:
+            return encodeBc5Block;
+        case vk::Format::eBc6HUfloatBlock:
+            return encodeBc6hBlock;
+        default:
+            return encodeBc7Block;
+        }
+    }();
+
+    for (auto& level : texture.levels)
+    {
+        const auto blocksX = (level.width + 3) / 4;
+        const auto blocksY = (level.height + 3) / 4;
+
+        std::vector<std::byte> compressed(static_cast<std::size_t>(blocksX) * blocksY * blockSize);
+
+        // A row of blocks is a good unit of work: it's large enough to hide the scheduling overhead even for small levels.
+        parallelFor(blocksY, [&](const std::size_t y) {
+            for (std::uint32_t x = 0; x < blocksX; ++x)
+            {
+                const auto block = fetchBlock(level, texture.format, x, static_cast<std::uint32_t>(y), linearize);
+                encoder(block, compressed.data() + (y * blocksX + x) * blockSize);
+            }
+        });
+
+        level.data = std::move(compressed);
+    }
+
+    texture.format = format;
+
+    if (!cachePath.empty())
+    {
+        writeCache(cachePath, texture);
+    }
+}
+
+} // namespace polar
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+#include <mip_generator.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+class TextureCompressor
+{
+  public:
+    struct Param
+    {
+        // Directory in which compressed textures are cached, keyed by a hash of the source texture and the mip filter. Leave empty to
+        // disable the cache.
+        std::filesystem::path cacheDirectory;
+    };
+
+    TextureCompressor(const Param& param);
+
+    // Compresses all levels of the texture into the block compressed format that best suits its usage:
+    //  - eColor and eLinear: BC7 (sRGB for eColor), or BC6H if the source has 16 bits per channel and no alpha
+    //  - eNormal: BC5
+    //  - eSingleChannel: BC4
+    // Blocks are encoded in parallel. Textures that are already block compressed are left untouched.
+    // With a mip filter, the missing levels are generated (see generateMips()) before compressing. That only happens when the texture
+    // isn't in the cache yet, so cache hits pay for neither.
+    void compress(Texture& texture, std::optional<MipFilter> mipFilter = std::nullopt) const;
+
+  private:
+    Param m_param;
+};
+
+} // namespace polar
@@ -0,0 +1,537 @@
+#include "texture_streamer.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace polar
+{
+
+static vk::ImageSubresourceRange
+levelRange(const std::uint32_t baseLevel, const std::uint32_t levelCount)
+{
+    return vk::ImageSubresourceRange{
+        .aspectMask     = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel   = baseLevel,
+        .levelCount     = levelCount,
+        .baseArrayLayer = 0,
+        .layerCount     = 1,
+    };
+}
+
+static vk::ImageMemoryBarrier
+levelBarrier(const vk::Image& image, const std::uint32_t baseLevel, const std::uint32_t levelCount, const vk::ImageLayout oldLayout,
+             const vk::ImageLayout newLayout, const vk::AccessFlags srcAccess, const vk::AccessFlags dstAccess)
+{
+    return vk::ImageMemoryBarrier{
+        .srcAccessMask       = srcAccess,
+        .dstAccessMask       = dstAccess,
+        .oldLayout           = oldLayout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image,
+        .subresourceRange    = levelRange(baseLevel, levelCount),
+    };
+}
+
+static Texture
+createPlaceholder(const TextureUsage usage)
+{
+    // Normal maps should be flat, everything else is white so that material factors come through unchanged:
+    const std::array<std::uint8_t, 4> texel = usage == TextureUsage::eNormal ? std::array<std::uint8_t, 4>{128, 128, 255, 255}
+                                                                              : std::array<std::uint8_t, 4>{255, 255, 255, 255};
+
+    TextureLevel level{
+        .width  = 1,
+        .height = 1,
+    };
+    level.data.resize(texel.size());
+    std::memcpy(level.data.data(), texel.data(), texel.size());
+
+    Texture texture{
+        .name   = "placeholder",
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .usage  = usage,
+    };
+    texture.levels.emplace_back(std::move(level));
+
+    return texture;
+}
+
+TextureStreamer::TextureStreamer(const Context& context, const GPUAllocator& allocator, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param)
+{
+    const auto& device = m_context.device();
+
+    m_param.framesInFlight = std::max(m_param.framesInFlight, 1u);
+
+    //
+    // Bindless Descriptor Sets
+    //
+
+    // A set is only written once the frames that used it have finished, but command buffers that bound it may not have been reset yet,
+    // and textures that aren't loaded are simply left unwritten:
+    const vk::DescriptorBindingFlags bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+
+    const vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo{
+        .bindingCount  = 1,
+        .pBindingFlags = &bindingFlags,
+    };
+
+    const vk::DescriptorSetLayoutBinding binding{
+        .binding         = 0,
+        .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = m_param.maxTextureCount,
+        .stageFlags      = vk::ShaderStageFlagBits::eAll,
+    };
+
+    m_descriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+        .pNext        = &bindingFlagsCreateInfo,
+        .flags        = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+        .bindingCount = 1,
+        .pBindings    = &binding,
+    });
+
+    const vk::DescriptorPoolSize poolSize{
+        .type            = vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = m_param.maxTextureCount * m_param.framesInFlight,
+    };
+
+    m_descriptorPool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+        .flags         = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+        .maxSets       = m_param.framesInFlight,
+        .poolSizeCount = 1,
+        .pPoolSizes    = &poolSize,
+    });
+
+    const std::vector<vk::DescriptorSetLayout> setLayouts(m_param.framesInFlight, *m_descriptorSetLayout);
+    m_descriptorSets = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+        .descriptorPool     = *m_descriptorPool,
+        .descriptorSetCount = m_param.framesInFlight,
+        .pSetLayouts        = setLayouts.data(),
+    });
+    m_dirtyDescriptors.resize(m_param.framesInFlight);
+
+    m_commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.transferQueueFamilyIndex(),
+    });
+
+    //
+    // Placeholders
+    //
+
+    for (const auto usage : {TextureUsage::eColor, TextureUsage::eLinear, TextureUsage::eNormal, TextureUsage::eSingleChannel})
+    {
+        m_placeholders.emplace_back(StreamedTexture{
+            .source = createPlaceholder(usage),
+        });
+    }
+    uploadTails(m_placeholders);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (const auto& batch : m_batches)
+    {
+        (void)m_context.device().waitForFences(*batch.fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    }
+}
+
+void TextureStreamer::createImage(StreamedTexture& texture) const
+{
+    const auto& firstLevel = texture.source.levels.front();
+
+    // The levels are written by the transfer queue and read by the general and the compute queue (e.g. by the wavefront kernels):
+    const auto& queueFamilies = m_context.queueFamilyIndices();
+    const auto  concurrent    = queueFamilies.size() > 1;
+
+    texture.levelCount    = static_cast<std::uint32_t>(texture.source.levels.size());
+    texture.residentLevel = texture.levelCount;
+    texture.image         = m_allocator.allocateImage(
+        vk::ImageCreateInfo{
+            .imageType             = vk::ImageType::e2D,
+            .format                = texture.source.format,
+            .extent                = vk::Extent3D{firstLevel.width, firstLevel.height, 1},
+            .mipLevels             = texture.levelCount,
+            .arrayLayers           = 1,
+            .samples               = vk::SampleCountFlagBits::e1,
+            .tiling                = vk::ImageTiling::eOptimal,
+            .usage                 = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+            .sharingMode           = concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+            .queueFamilyIndexCount = concurrent ? static_cast<std::uint32_t>(queueFamilies.size()) : 0,
+            .pQueueFamilyIndices   = concurrent ? queueFamilies.data() : nullptr,
+            .initialLayout         = vk::ImageLayout::eUndefined,
+        },
+        VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+GPUBufferUnique TextureStreamer::recordCopies(const vk::CommandBuffer& commandBuffer, std::vector<StreamedTexture>& textures,
+                                              const std::vector<std::pair<std::uint32_t, std::uint32_t>>& levels) const
+{
+    vk::DeviceSize stagingSize = 0;
+    for (const auto& [textureIndex, level] : levels)
+    {
+        stagingSize += textures[textureIndex].source.levels[level].data.size();
+    }
+
+    if (stagingSize == 0)
+    {
+        return {};
+    }
+
+    auto stagingBuffer = m_allocator.allocate(stagingSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+    auto stagingData   = static_cast<std::byte*>(stagingBuffer.map());
+
+    std::vector<vk::ImageMemoryBarrier> barriers;
+    barriers.reserve(levels.size());
+
+    vk::DeviceSize offset = 0;
+    for (const auto& [textureIndex, level] : levels)
+    {
+        const auto& texture     = textures[textureIndex];
+        const auto& sourceLevel = texture.source.levels[level];
+
+        std::memcpy(stagingData + offset, sourceLevel.data.data(), sourceLevel.data.size());
+
+        commandBuffer.copyBufferToImage(*stagingBuffer, *texture.image, vk::ImageLayout::eTransferDstOptimal,
+                                        vk::BufferImageCopy{
+                                            .bufferOffset     = offset,
+                                            .imageSubresource = {.aspectMask     = vk::ImageAspectFlagBits::eColor,
+                                                                 .mipLevel       = level,
+                                                                 .baseArrayLayer = 0,
+                                                                 .layerCount     = 1},
+                                            .imageExtent      = vk::Extent3D{sourceLevel.width, sourceLevel.height, 1},
+                                        });
+
+        barriers.emplace_back(levelBarrier(*texture.image, level, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                                           vk::AccessFlagBits::eTransferWrite, {}));
+
+        offset += sourceLevel.data.size();
+    }
+    stagingBuffer.unmap();
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, barriers);
+
+    return stagingBuffer;
+}
+
+void TextureStreamer::uploadTails(std::vector<StreamedTexture>& textures)
+{
+    auto commandBuffers = m_context.device().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *m_commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = *commandBuffers.front();
+
+    commandBuffer.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    std::vector<vk::ImageMemoryBarrier>                  barriers;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> levels;
+    for (std::uint32_t i = 0; i < textures.size(); ++i)
+    {
+        auto& texture = textures[i];
+        if (texture.source.levels.empty())
+        {
+            continue;
+        }
+
+        createImage(texture);
+
+        // Every level stays in eTransferDstOptimal until it gets streamed in:
+        barriers.emplace_back(levelBarrier(*texture.image, 0, texture.levelCount, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                           {}, vk::AccessFlagBits::eTransferWrite));
+
+        for (std::uint32_t level = 0; level < texture.levelCount; ++level)
+        {
+            const auto& sourceLevel = texture.source.levels[level];
+            if (std::max(sourceLevel.width, sourceLevel.height) <= m_param.tailSize)
+            {
+                levels.emplace_back(i, level);
+            }
+        }
+    }
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barriers);
+
+    const auto stagingBuffer = recordCopies(commandBuffer, textures, levels);
+
+    submitAndWait(m_context, m_context.transferQueue(), commandBuffer, DEFAULT_FENCE_TIMEOUT, "texture tail upload");
+
+    for (const auto& [textureIndex, level] : levels)
+    {
+        auto& texture         = textures[textureIndex];
+        texture.residentLevel = std::min(texture.residentLevel, level);
+        texture.source.levels[level].data = {};
+    }
+
+    for (auto& texture : textures)
+    {
+        if (texture.residentLevel < texture.levelCount)
+        {
+            texture.view = createView(texture);
+        }
+    }
+}
+
+void TextureStreamer::createSampler(const Texture& texture)
+{
+    const auto key = std::pair(texture.addressModeU, texture.addressModeV);
+    if (m_samplers.contains(key))
+    {
+        return;
+    }
+
+    auto sampler = m_context.device().createSamplerUnique(vk::SamplerCreateInfo{
+        .magFilter    = vk::Filter::eLinear,
+        .minFilter    = vk::Filter::eLinear,
+        .mipmapMode   = vk::SamplerMipmapMode::eLinear,
+        .addressModeU = texture.addressModeU,
+        .addressModeV = texture.addressModeV,
+        .addressModeW = vk::SamplerAddressMode::eRepeat,
+        .minLod       = 0.f,
+        .maxLod       = VK_LOD_CLAMP_NONE,
+    });
+    m_samplers.emplace(key, std::move(sampler));
+}
+
+vk::UniqueImageView TextureStreamer::createView(const StreamedTexture& texture) const
+{
+    return m_context.device().createImageViewUnique(vk::ImageViewCreateInfo{
+        .image            = *texture.image,
+        .viewType         = vk::ImageViewType::e2D,
+        .format           = texture.source.format,
+        .subresourceRange = levelRange(texture.residentLevel, texture.levelCount - texture.residentLevel),
+    });
+}
+
+void TextureStreamer::invalidateDescriptor(const std::uint32_t textureIndex)
+{
+    for (auto& dirty : m_dirtyDescriptors)
+    {
+        dirty.emplace_back(textureIndex);
+    }
+}
+
+void TextureStreamer::writeDescriptors(const std::uint64_t frameIndex)
+{
+    const auto set   = static_cast<std::size_t>(frameIndex % m_descriptorSets.size());
+    auto&      dirty = m_dirtyDescriptors[set];
+    if (dirty.empty())
+    {
+        return;
+    }
+
+    // A texture may have changed more than once since the set was last written, its descriptor only needs its current view:
+    std::ranges::sort(dirty);
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    std::vector<vk::DescriptorImageInfo> imageInfos;
+    std::vector<vk::WriteDescriptorSet>  writes;
+    imageInfos.reserve(dirty.size());
+    writes.reserve(dirty.size());
+    for (const auto textureIndex : dirty)
+    {
+        const auto& texture = m_textures[textureIndex];
+        const auto& view    = texture.view ? texture.view : m_placeholders[static_cast<std::size_t>(texture.source.usage)].view;
+
+        imageInfos.emplace_back(vk::DescriptorImageInfo{
+            .sampler     = *m_samplers.at(std::pair(texture.source.addressModeU, texture.source.addressModeV)),
+            .imageView   = *view,
+            .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        });
+        writes.emplace_back(vk::WriteDescriptorSet{
+            .dstSet          = m_descriptorSets[set],
+            .dstBinding      = 0,
+            .dstArrayElement = textureIndex,
+            .descriptorCount = 1,
+            .descriptorType  = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo      = &imageInfos.back(),
+        });
+    }
+
+    m_context.device().updateDescriptorSets(writes, {});
+    dirty.clear();
+}
+
+std::uint64_t TextureStreamer::retiredFrameIndex() const
+{
+    // What gets replaced now stays in the sets that aren't written before the update() of the next framesInFlight - 1 frames, and
+    // is freed framesInFlight frames after the last of those (see retireBatches()):
+    return m_frameIndex + m_param.framesInFlight - 1;
+}
+
+void TextureStreamer::load(std::vector<Texture> textures)
+{
+    if (textures.size() > m_param.maxTextureCount)
+    {
+        throw std::runtime_error(fmt::format("Can't stream {} textures, the bindless array only holds {}", textures.size(), m_param.maxTextureCount));
+    }
+
+    // Uploads still in flight refer to the previous set of textures:
+    for (const auto& batch : m_batches)
+    {
+        (void)m_context.device().waitForFences(*batch.fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    }
+    m_batches.clear();
+
+    // So may frames that are still in flight, and the descriptor sets until their descriptors get replaced:
+    for (auto& texture : m_textures)
+    {
+        if (texture.image)
+        {
+            m_retired.emplace_back(RetiredTexture{
+                .frameIndex = retiredFrameIndex(),
+                .image      = std::move(texture.image),
+                .view       = std::move(texture.view),
+            });
+        }
+    }
+    m_textures.clear();
+    m_textures.reserve(textures.size());
+    for (auto& texture : textures)
+    {
+        createSampler(texture);
+        m_textures.emplace_back(StreamedTexture{
+            .source = std::move(texture),
+        });
+    }
+
+    uploadTails(m_textures);
+
+    for (auto& dirty : m_dirtyDescriptors)
+    {
+        dirty.clear();
+    }
+    for (std::uint32_t i = 0; i < m_textures.size(); ++i)
+    {
+        invalidateDescriptor(i);
+    }
+
+    spdlog::info("Bound {} textures, streaming the remaining levels.", m_textures.size());
+}
+
+void TextureStreamer::setPriority(const std::uint32_t textureIndex, const float priority)
+{
+    m_textures.at(textureIndex).priority = priority;
+}
+
+bool TextureStreamer::fullyResident() const
+{
+    return m_batches.empty() && std::ranges::all_of(m_textures, [](const StreamedTexture& texture) { return texture.residentLevel == 0 || texture.levelCount == 0; });
+}
+
+void TextureStreamer::retireBatches(const std::uint64_t frameIndex)
+{
+    while (!m_batches.empty() && m_context.device().getFenceStatus(*m_batches.front().fence) == vk::Result::eSuccess)
+    {
+        for (const auto& [textureIndex, level] : m_batches.front().levels)
+        {
+            auto& texture                     = m_textures[textureIndex];
+            texture.residentLevel             = level;
+            texture.pending                   = false;
+            texture.source.levels[level].data = {};
+
+            // The previous view might still be referenced by frames in flight and by the descriptor sets of the next ones:
+            if (texture.view)
+            {
+                m_retired.emplace_back(RetiredTexture{
+                    .frameIndex = retiredFrameIndex(),
+                    .view       = std::move(texture.view),
+                });
+            }
+            texture.view = createView(texture);
+            invalidateDescriptor(textureIndex);
+        }
+
+        m_batches.pop_front();
+    }
+
+    while (!m_retired.empty() && m_retired.front().frameIndex + m_param.framesInFlight <= frameIndex)
+    {
+        m_retired.pop_front();
+    }
+}
+
+void TextureStreamer::submitBatch()
+{
+    if (m_batches.size() >= m_param.framesInFlight)
+    {
+        return;
+    }
+
+    std::vector<std::uint32_t> candidates;
+    for (std::uint32_t i = 0; i < m_textures.size(); ++i)
+    {
+        if (!m_textures[i].pending && m_textures[i].residentLevel > 0 && m_textures[i].levelCount > 0)
+        {
+            candidates.emplace_back(i);
+        }
+    }
+
+    if (candidates.empty())
+    {
+        return;
+    }
+
+    const auto nextLevelSize = [&](const std::uint32_t textureIndex) {
+        const auto& texture = m_textures[textureIndex];
+        return texture.source.levels[texture.residentLevel - 1].data.size();
+    };
+
+    std::ranges::sort(candidates, [&](const std::uint32_t a, const std::uint32_t b) {
+        if (m_textures[a].priority != m_textures[b].priority)
+        {
+            return m_textures[a].priority > m_textures[b].priority;
+        }
+        return nextLevelSize(a) < nextLevelSize(b);
+    });
+
+    UploadBatch    batch;
+    vk::DeviceSize batchSize = 0;
+    for (const auto textureIndex : candidates)
+    {
+        const auto size = nextLevelSize(textureIndex);
+        if (!batch.levels.empty() && batchSize + size > m_param.bytesPerUpdate)
+        {
+            break;
+        }
+
+        batch.levels.emplace_back(textureIndex, m_textures[textureIndex].residentLevel - 1);
+        m_textures[textureIndex].pending = true;
+        batchSize += size;
+    }
+
+    auto commandBuffers = m_context.device().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *m_commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    batch.commandBuffer = std::move(commandBuffers.front());
+    batch.fence         = m_context.device().createFenceUnique(vk::FenceCreateInfo());
+
+    batch.commandBuffer->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    batch.stagingBuffer = recordCopies(*batch.commandBuffer, m_textures, batch.levels);
+    batch.commandBuffer->end();
+
+    m_context.transferQueue().submit(vk::SubmitInfo().setCommandBuffers(*batch.commandBuffer), *batch.fence);
+
+    m_batches.emplace_back(std::move(batch));
+}
+
+void TextureStreamer::update(const std::uint64_t frameIndex)
+{
+    m_frameIndex = frameIndex;
+    retireBatches(frameIndex);
+    writeDescriptors(frameIndex);
+    submitBatch();
+}
+
+} // namespace polar
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+// Makes textures available for rendering as soon as their smallest levels are resident and streams in the finer levels afterwards.
+// All textures are exposed through a bindless descriptor array (binding 0, indexed by texture index), each combined with a sampler that
+// has the address modes of the texture. Whenever a texture gains a level, its descriptor is pointed to a view that includes it.
+// Frames in flight must not see their descriptors change, so there is one descriptor set per frame in flight, and the set of a frame
+// only gets the descriptors that changed since it was last used when update() is called for that frame.
+class TextureStreamer
+{
+  public:
+    struct Param
+    {
+        // Size of the bindless texture array.
+        std::uint32_t maxTextureCount = 4096;
+
+        // Levels whose larger side is at most this many texels are uploaded in load(). Textures without such levels are bound to a
+        // 1x1 placeholder until their first level arrives.
+        std::uint32_t tailSize = 64;
+
+        // Upper bound on the amount of texel data that is submitted by a single update() (at least one level is always submitted).
+        vk::DeviceSize bytesPerUpdate = 64ull << 20;
+
+        // Number of frames that may be in flight, which is the number of descriptor sets.
+        std::uint32_t framesInFlight = 2;
+    };
+
+    TextureStreamer(const Context& context, const GPUAllocator& allocator, const Param& param);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&)            = delete;
+    TextureStreamer(TextureStreamer&&)                 = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(TextureStreamer&&)      = delete;
+
+    // Creates images for all textures and uploads their mip tails. Every texture is bound, and can be rendered with, from the next
+    // update() on. The level data of a texture is released once the level is resident on the GPU. The images of a previous load() are
+    // kept alive until no frame in flight can sample them anymore.
+    void load(std::vector<Texture> textures);
+
+    // Textures with a higher priority get their finer levels streamed first, e.g. based on their screen coverage or on the number of
+    // hits per texture in the last frame. Ties are broken by streaming smaller levels first.
+    void setPriority(std::uint32_t textureIndex, float priority);
+
+    // Retires finished uploads (pointing the descriptors of textures that gained a level to their new views), brings the descriptor set
+    // of the frame up to date and submits the next uploads to the transfer queue. Has to be called once per frame, before the frame is
+    // recorded and after the frame that last used its descriptor set (framesInFlight frames earlier) has finished on the GPU.
+    void update(std::uint64_t frameIndex);
+
+    bool fullyResident() const;
+
+    const vk::DescriptorSetLayout& descriptorSetLayout() const { return *m_descriptorSetLayout; }
+
+    // The set to bind when recording a frame, once update() was called for it.
+    const vk::DescriptorSet& descriptorSet(std::uint64_t frameIndex) const { return m_descriptorSets[frameIndex % m_descriptorSets.size()]; }
+
+  private:
+    struct StreamedTexture
+    {
+        Texture             source;
+        GPUImageUnique      image;
+        vk::UniqueImageView view;
+        std::uint32_t       levelCount    = 0;
+        std::uint32_t       residentLevel = 0; // Most detailed resident level, levelCount if none are resident
+        bool                pending       = false;
+        float               priority      = 0.f;
+    };
+
+    // Freed once the GPU can't be using them anymore. Views are retired on their own when a texture gains a level, images with their
+    // views when load() replaces the textures:
+    struct RetiredTexture
+    {
+        std::uint64_t       frameIndex = 0;
+        GPUImageUnique      image;
+        vk::UniqueImageView view;
+    };
+
+    struct UploadBatch
+    {
+        vk::UniqueCommandBuffer                              commandBuffer;
+        vk::UniqueFence                                      fence;
+        GPUBufferUnique                                      stagingBuffer;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> levels; // (texture index, level)
+    };
+
+    void            createSampler(const Texture& texture);
+    void            createImage(StreamedTexture& texture) const;
+    GPUBufferUnique recordCopies(const vk::CommandBuffer& commandBuffer, std::vector<StreamedTexture>& textures,
+                                 const std::vector<std::pair<std::uint32_t, std::uint32_t>>& levels) const;
+    void            uploadTails(std::vector<StreamedTexture>& textures);
+
+    vk::UniqueImageView createView(const StreamedTexture& texture) const;
+    void                invalidateDescriptor(std::uint32_t textureIndex);
+    void                writeDescriptors(std::uint64_t frameIndex);
+    std::uint64_t       retiredFrameIndex() const;
+
+    void retireBatches(std::uint64_t frameIndex);
+    void submitBatch();
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    // One per combination of address modes, which come from the glTF samplers:
+    std::map<std::pair<vk::SamplerAddressMode, vk::SamplerAddressMode>, vk::UniqueSampler> m_samplers;
+
+    vk::UniqueDescriptorSetLayout           m_descriptorSetLayout;
+    vk::UniqueDescriptorPool                m_descriptorPool;
+    std::vector<vk::DescriptorSet>          m_descriptorSets;   // One per frame in flight
+    std::vector<std::vector<std::uint32_t>> m_dirtyDescriptors; // Per descriptor set, the textures whose descriptors it doesn't have yet
+    vk::UniqueCommandPool                   m_commandPool;
+
+    // One placeholder per TextureUsage, so that e.g. normal maps are flat until their first level arrives:
+    std::vector<StreamedTexture> m_placeholders;
+
+    std::vector<StreamedTexture> m_textures;
+    std::deque<UploadBatch>      m_batches;
+    std::deque<RetiredTexture>   m_retired;
+    std::uint64_t                m_frameIndex = 0; // Of the last update()
+};
+
+} // namespace polar
@@ -0,0 +1,510 @@
+#include "texture_uploader.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+
+#include <configure.hpp>
+
+namespace polar
+{
+
+// Mirrors DownsampleConstants in shaders/downsample.comp:
+struct DownsampleConstants
+{
+    std::uint32_t srgb = 0;
+};
+
+constexpr std::uint32_t DOWNSAMPLE_GROUP_SIZE = 8;
+
+static void
+transitionLevels(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const std::uint32_t baseLevel, const std::uint32_t levelCount,
+                 const vk::ImageLayout oldLayout, const vk::ImageLayout newLayout, const vk::AccessFlags srcAccess, const vk::AccessFlags dstAccess,
+                 const vk::PipelineStageFlags srcStage, const vk::PipelineStageFlags dstStage)
+{
+    const vk::ImageMemoryBarrier barrier{
+        .srcAccessMask       = srcAccess,
+        .dstAccessMask       = dstAccess,
+        .oldLayout           = oldLayout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image,
+        .subresourceRange    = {
+            .aspectMask     = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel   = baseLevel,
+            .levelCount     = levelCount,
+            .baseArrayLayer = 0,
+            .layerCount     = 1,
+        },
+    };
+
+    commandBuffer.pipelineBarrier(srcStage, dstStage, {}, {}, {}, barrier);
+}
+
+static void
+recordBlitChain(const vk::CommandBuffer& commandBuffer, const vk::Image& image, const vk::Extent2D extent, const std::uint32_t levelCount)
+{
+    auto width  = static_cast<std::int32_t>(extent.width);
+    auto height = static_cast<std::int32_t>(extent.height);
+
+    for (std::uint32_t level = 1; level < levelCount; ++level)
+    {
+        transitionLevels(commandBuffer, image, level - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
+                         vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer,
+                         vk::PipelineStageFlagBits::eTransfer);
+
+        const auto nextWidth  = std::max(1, width / 2);
+        const auto nextHeight = std::max(1, height / 2);
+
+        const vk::ImageBlit blit{
+            .srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level - 1, .baseArrayLayer = 0, .layerCount = 1},
+            .srcOffsets     = std::array{vk::Offset3D{0, 0, 0}, vk::Offset3D{width, height, 1}},
+            .dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1},
+            .dstOffsets     = std::array{vk::Offset3D{0, 0, 0}, vk::Offset3D{nextWidth, nextHeight, 1}},
+        };
+
+        commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+        width  = nextWidth;
+        height = nextHeight;
+    }
+
+    // All but the last level are now the source of a blit:
+    transitionLevels(commandBuffer, image, 0, levelCount - 1, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::AccessFlagBits::eTransferRead, {}, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands);
+    transitionLevels(commandBuffer, image, levelCount - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::AccessFlagBits::eTransferWrite, {}, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands);
+}
+
+TextureUploader::TextureUploader(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param)
+{
+    const auto& device = m_context.device();
+
+    m_mipGeneration          = m_param.mipGeneration == MipGeneration::eAuto ? preferredMipGeneration() : m_param.mipGeneration;
+    m_extendedStorageFormats = m_context.physicalDevice().getFeatures().shaderStorageImageExtendedFormats;
+
+    const std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+        vk::DescriptorSetLayoutBinding{
+            .binding         = 0,
+            .descriptorType  = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 1,
+            .stageFlags      = vk::ShaderStageFlagBits::eCompute,
+        },
+        vk::DescriptorSetLayoutBinding{
+            .binding         = 1,
+            .descriptorType  = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 1,
+            .stageFlags      = vk::ShaderStageFlagBits::eCompute,
+        },
+    };
+    m_downsampleSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+        .bindingCount = static_cast<std::uint32_t>(bindings.size()),
+        .pBindings    = bindings.data(),
+    });
+
+    const vk::PushConstantRange pushConstantRange{
+        .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        .offset     = 0,
+        .size       = sizeof(DownsampleConstants),
+    };
+    m_downsampleLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &*m_downsampleSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange,
+    });
+
+    const auto path   = std::filesystem::path(SHADER_DIRECTORY) / "downsample.comp";
+    const auto source = [&](const char* format) {
+        return ShaderSource{
+            .path    = path,
+            .stage   = vk::ShaderStageFlagBits::eCompute,
+            .defines = {ShaderDefine{.name = "STORAGE_FORMAT", .value = format}},
+        };
+    };
+
+    // Indexed like m_downsamplePipelines, the rgba16 one is only built if mipPath() can select it:
+    std::vector<std::size_t>  pipelines;
+    std::vector<ShaderSource> sources;
+    for (const auto [pipeline, format] : {std::pair{0, "rgba8"}, std::pair{1, "rgba16"}, std::pair{2, "rgba32f"}})
+    {
+        if (pipeline != 1 || m_extendedStorageFormats)
+        {
+            pipelines.emplace_back(pipeline);
+            sources.emplace_back(source(format));
+        }
+    }
+    const auto modules = compiler.createModules(device, sources);
+
+    for (std::size_t i = 0; i < modules.size(); ++i)
+    {
+        const vk::ComputePipelineCreateInfo pipelineCreateInfo{
+            .stage =
+                vk::PipelineShaderStageCreateInfo{
+                    .stage  = vk::ShaderStageFlagBits::eCompute,
+                    .module = *modules[i],
+                    .pName  = "main",
+                },
+            .layout = *m_downsampleLayout,
+        };
+        m_downsamplePipelines[pipelines[i]] = device.createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+    }
+}
+
+MipGeneration TextureUploader::preferredMipGeneration() const
+{
+    return m_context.transferQueueFamilyIndex() != m_context.queueFamilyIndex() ? MipGeneration::eCpu : MipGeneration::eGpu;
+}
+
+TextureUploader::StorageFormat TextureUploader::storageFormat(const vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+        return {.pipeline = 0, .format = vk::Format::eR8G8B8A8Unorm};
+    case vk::Format::eR8G8B8A8Srgb:
+        return {.pipeline = 0, .format = vk::Format::eR8G8B8A8Unorm, .srgb = true};
+    case vk::Format::eR16G16B16A16Unorm:
+        return {.pipeline = 1, .format = vk::Format::eR16G16B16A16Unorm};
+    case vk::Format::eR32G32B32A32Sfloat:
+        return {.pipeline = 2, .format = vk::Format::eR32G32B32A32Sfloat};
+    default:
+        return {};
+    }
+}
+
+TextureUploader::MipPath TextureUploader::mipPath(const Texture& texture) const
+{
+    const auto& level = texture.levels.front();
+    if (m_mipGeneration == MipGeneration::eNone || texture.levels.size() > 1 || mipLevelCount(level.width, level.height) == 1)
+    {
+        return MipPath::eNone;
+    }
+
+    // generateMips() supports the same formats as the downsampler:
+    const auto storage  = storageFormat(texture.format);
+    const auto fallback = storage.format != vk::Format::eUndefined ? MipPath::eCpu : MipPath::eNone;
+    if (m_mipGeneration == MipGeneration::eCpu)
+    {
+        return fallback;
+    }
+
+    if (storage.format != vk::Format::eUndefined && (storage.pipeline != 1 || m_extendedStorageFormats))
+    {
+        const auto storageFeatures = m_context.physicalDevice().getFormatProperties(storage.format).optimalTilingFeatures;
+        if (storageFeatures & vk::FormatFeatureFlagBits::eStorageImage)
+        {
+            return MipPath::eCompute;
+        }
+    }
+
+    const auto requiredFeatures =
+        vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    const auto formatProperties = m_context.physicalDevice().getFormatProperties(texture.format);
+
+    return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures ? MipPath::eBlit : fallback;
+}
+
+void TextureUploader::recordDownsampleChain(const vk::CommandBuffer& commandBuffer, const GPUTexture& texture, const vk::DescriptorPool& pool,
+                                            std::vector<vk::UniqueImageView>& views) const
+{
+    const auto& device  = m_context.device();
+    const auto  storage = storageFormat(texture.format);
+
+    // Storage views of every level, which are UNORM for sRGB textures (see the mutable format flag of the image):
+    const auto firstView = views.size();
+    for (std::uint32_t level = 0; level < texture.levelCount; ++level)
+    {
+        views.emplace_back(device.createImageViewUnique(vk::ImageViewCreateInfo{
+            .image            = *texture.image,
+            .viewType         = vk::ImageViewType::e2D,
+            .format           = storage.format,
+            .subresourceRange = {
+                .aspectMask     = vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel   = level,
+                .levelCount     = 1,
+                .baseArrayLayer = 0,
+                .layerCount     = 1,
+            },
+        }));
+    }
+
+    transitionLevels(commandBuffer, *texture.image, 0, texture.levelCount, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral,
+                     vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                     vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader);
+
+    const DownsampleConstants constants{.srgb = storage.srgb ? 1u : 0u};
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *m_downsamplePipelines[storage.pipeline]);
+    commandBuffer.pushConstants(*m_downsampleLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+
+    auto width  = texture.extent.width;
+    auto height = texture.extent.height;
+    for (std::uint32_t level = 1; level < texture.levelCount; ++level)
+    {
+        const auto descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+            .descriptorPool     = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts        = &*m_downsampleSetLayout,
+        }).front();
+
+        const std::array<vk::DescriptorImageInfo, 2> imageInfos = {
+            vk::DescriptorImageInfo{.imageView = *views[firstView + level - 1], .imageLayout = vk::ImageLayout::eGeneral},
+            vk::DescriptorImageInfo{.imageView = *views[firstView + level], .imageLayout = vk::ImageLayout::eGeneral},
+        };
+        const std::array<vk::WriteDescriptorSet, 2> writes = {
+            vk::WriteDescriptorSet{
+                .dstSet          = descriptorSet,
+                .dstBinding      = 0,
+                .descriptorCount = 1,
+                .descriptorType  = vk::DescriptorType::eStorageImage,
+                .pImageInfo      = &imageInfos[0],
+            },
+            vk::WriteDescriptorSet{
+                .dstSet          = descriptorSet,
+                .dstBinding      = 1,
+                .descriptorCount = 1,
+                .descriptorType  = vk::DescriptorType::eStorageImage,
+                .pImageInfo      = &imageInfos[1],
+            },
+        };
+        device.updateDescriptorSets(writes, {});
+
+        width  = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *m_downsampleLayout, 0, descriptorSet, {});
+        const auto groupsX = (width + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE;
+        const auto groupsY = (height + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE;
+        commandBuffer.dispatch(groupsX, groupsY, 1);
+
+        // The next level is computed from this one:
+        const vk::MemoryBarrier barrier{
+            .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+    }
+
+    transitionLevels(commandBuffer, *texture.image, 0, texture.levelCount, vk::ImageLayout::eGeneral, vk::ImageLayout::eShaderReadOnlyOptimal,
+                     vk::AccessFlagBits::eShaderWrite, {}, vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eAllCommands);
+}
+
+std::vector<GPUTexture> TextureUploader::upload(const std::vector<Texture>& textures) const
+{
+    const auto& device = m_context.device();
+
+    std::vector<MipPath> mipPaths;
+    mipPaths.reserve(textures.size());
+    std::uint32_t downsampledLevelCount = 0;
+    for (const auto& texture : textures)
+    {
+        mipPaths.emplace_back(texture.levels.empty() ? MipPath::eNone : mipPath(texture));
+        if (mipPaths.back() == MipPath::eCompute)
+        {
+            const auto& level = texture.levels.front();
+            downsampledLevelCount += mipLevelCount(level.width, level.height) - 1;
+        }
+    }
+
+    // Dispatches and blits require the general queue, so only go through the (possibly dedicated) transfer queue if we don't need them:
+    const auto generatesMips =
+        std::ranges::any_of(mipPaths, [](const MipPath path) { return path == MipPath::eCompute || path == MipPath::eBlit; });
+
+    const auto  queueFamilyIndex = generatesMips ? m_context.queueFamilyIndex() : m_context.transferQueueFamilyIndex();
+    const auto& queue            = generatesMips ? m_context.queue() : m_context.transferQueue();
+
+    // The textures are read by the general and the compute queue afterwards, so they have to be shared if there is more than one family:
+    const auto& sharedQueueFamilies = m_context.queueFamilyIndices();
+    const auto  concurrent          = sharedQueueFamilies.size() > 1;
+
+    // One descriptor set per downsampled level, which reads the previous level and writes this one:
+    vk::UniqueDescriptorPool downsamplePool;
+    if (downsampledLevelCount > 0)
+    {
+        const vk::DescriptorPoolSize poolSize{
+            .type            = vk::DescriptorType::eStorageImage,
+            .descriptorCount = 2 * downsampledLevelCount,
+        };
+        downsamplePool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+            .maxSets       = downsampledLevelCount,
+            .poolSizeCount = 1,
+            .pPoolSizes    = &poolSize,
+        });
+    }
+    std::vector<vk::UniqueImageView> downsampleViews;
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = queueFamilyIndex,
+    });
+
+    auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = *commandBuffers.front();
+
+    commandBuffer.begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    std::vector<GPUTexture>      gpuTextures;
+    std::vector<GPUBufferUnique> stagingBuffers;
+    gpuTextures.reserve(textures.size());
+    stagingBuffers.reserve(textures.size());
+
+    std::size_t generatedTextureCount = 0;
+    std::size_t cpuTextureCount       = 0;
+    for (std::size_t textureIndex = 0; textureIndex < textures.size(); ++textureIndex)
+    {
+        if (textures[textureIndex].levels.empty())
+        {
+            gpuTextures.emplace_back();
+            continue;
+        }
+
+        const auto path = mipPaths[textureIndex];
+
+        // Only the copy of the texture that is uploaded gets the levels:
+        Texture cpuMips;
+        if (path == MipPath::eCpu)
+        {
+            cpuMips.name   = textures[textureIndex].name;
+            cpuMips.format = textures[textureIndex].format;
+            cpuMips.levels = {textures[textureIndex].levels.front()};
+            generateMips(cpuMips, m_param.mipFilter);
+            ++cpuTextureCount;
+        }
+
+        const auto& texture    = path == MipPath::eCpu ? cpuMips : textures[textureIndex];
+        const auto& firstLevel = texture.levels.front();
+        const auto  gpuMips    = path == MipPath::eCompute || path == MipPath::eBlit;
+
+        GPUTexture gpuTexture{
+            .format = texture.format,
+            .extent = vk::Extent2D{firstLevel.width, firstLevel.height},
+            .levelCount =
+                gpuMips ? mipLevelCount(firstLevel.width, firstLevel.height) : static_cast<std::uint32_t>(texture.levels.size()),
+        };
+
+        // sRGB formats can't be storage images, the downsampler writes them through UNORM views of the same image:
+        auto flags = vk::ImageCreateFlags{};
+        auto usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+        if (path == MipPath::eCompute)
+        {
+            usage |= vk::ImageUsageFlagBits::eStorage;
+            if (storageFormat(texture.format).format != texture.format)
+            {
+                flags |= vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
+            }
+        }
+
+        gpuTexture.image = m_allocator.allocateImage(
+            vk::ImageCreateInfo{
+                .flags                 = flags,
+                .imageType             = vk::ImageType::e2D,
+                .format                = texture.format,
+                .extent                = vk::Extent3D{firstLevel.width, firstLevel.height, 1},
+                .mipLevels             = gpuTexture.levelCount,
+                .arrayLayers           = 1,
+                .samples               = vk::SampleCountFlagBits::e1,
+                .tiling                = vk::ImageTiling::eOptimal,
+                .usage                 = usage,
+                .sharingMode           = concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                .queueFamilyIndexCount = concurrent ? static_cast<std::uint32_t>(sharedQueueFamilies.size()) : 0,
+                .pQueueFamilyIndices   = concurrent ? sharedQueueFamilies.data() : nullptr,
+                .initialLayout         = vk::ImageLayout::eUndefined,
+            },
+            VMA_MEMORY_USAGE_GPU_ONLY);
+
+        // All levels share a single staging buffer:
+        std::size_t stagingSize = 0;
+        for (const auto& level : texture.levels)
+        {
+            stagingSize += level.data.size();
+        }
+
+        auto stagingBuffer = m_allocator.allocate(stagingSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+        auto stagingData   = static_cast<std::byte*>(stagingBuffer.map());
+
+        std::vector<vk::BufferImageCopy> regions;
+        regions.reserve(texture.levels.size());
+
+        vk::DeviceSize offset = 0;
+        for (std::uint32_t i = 0; i < texture.levels.size(); ++i)
+        {
+            const auto& level = texture.levels[i];
+            std::memcpy(stagingData + offset, level.data.data(), level.data.size());
+
+            regions.emplace_back(vk::BufferImageCopy{
+                .bufferOffset     = offset,
+                .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = i, .baseArrayLayer = 0, .layerCount = 1},
+                .imageExtent      = vk::Extent3D{level.width, level.height, 1},
+            });
+
+            offset += level.data.size();
+        }
+        stagingBuffer.unmap();
+
+        transitionLevels(commandBuffer, *gpuTexture.image, 0, gpuTexture.levelCount, vk::ImageLayout::eUndefined,
+                         vk::ImageLayout::eTransferDstOptimal, {}, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTopOfPipe,
+                         vk::PipelineStageFlagBits::eTransfer);
+
+        commandBuffer.copyBufferToImage(*stagingBuffer, *gpuTexture.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+        switch (path)
+        {
+        case MipPath::eCompute:
+            recordDownsampleChain(commandBuffer, gpuTexture, *downsamplePool, downsampleViews);
+            ++generatedTextureCount;
+            break;
+        case MipPath::eBlit:
+            recordBlitChain(commandBuffer, *gpuTexture.image, gpuTexture.extent, gpuTexture.levelCount);
+            ++generatedTextureCount;
+            break;
+        case MipPath::eNone:
+        case MipPath::eCpu:
+            transitionLevels(commandBuffer, *gpuTexture.image, 0, gpuTexture.levelCount, vk::ImageLayout::eTransferDstOptimal,
+                             vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eTransferWrite, {}, vk::PipelineStageFlagBits::eTransfer,
+                             vk::PipelineStageFlagBits::eAllCommands);
+            break;
+        }
+
+        stagingBuffers.emplace_back(std::move(stagingBuffer));
+        gpuTextures.emplace_back(std::move(gpuTexture));
+    }
+
+    submitAndWait(m_context, queue, commandBuffer, DEFAULT_FENCE_TIMEOUT, "texture upload");
+
+    for (auto& gpuTexture : gpuTextures)
+    {
+        if (!gpuTexture.image)
+        {
+            continue;
+        }
+
+        gpuTexture.view = device.createImageViewUnique(vk::ImageViewCreateInfo{
+            .image            = *gpuTexture.image,
+            .viewType         = vk::ImageViewType::e2D,
+            .format           = gpuTexture.format,
+            .subresourceRange = {
+                .aspectMask     = vk::ImageAspectFlagBits::eColor,
+                .baseMipLevel   = 0,
+                .levelCount     = gpuTexture.levelCount,
+                .baseArrayLayer = 0,
+                .layerCount     = 1,
+            },
+        });
+    }
+
+    spdlog::info("Uploaded {} textures ({} with mips generated on the GPU, {} on the CPU).", gpuTextures.size(), generatedTextureCount,
+                 cpuTextureCount);
+
+    return gpuTextures;
+}
+
+} // namespace polar
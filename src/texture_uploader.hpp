@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <mip_generator.hpp>
+#include <scene.hpp>
+#include <shader_compiler.hpp>
+
+namespace polar
+{
+
+struct GPUTexture
+{
+    GPUImageUnique      image;
+    vk::UniqueImageView view;
+    vk::Format          format     = vk::Format::eUndefined;
+    vk::Extent2D        extent     = {};
+    std::uint32_t       levelCount = 0;
+};
+
+class TextureUploader
+{
+  public:
+    struct Param
+    {
+        // Has to be the same as SceneLoader::Param::mipGeneration, eAuto is resolved by preferredMipGeneration(). Unless this is eNone,
+        // textures that only have their first level get the rest generated by upload().
+        MipGeneration mipGeneration = MipGeneration::eAuto;
+
+        // Of the levels generated on the CPU (see generateMips()).
+        MipFilter mipFilter = MipFilter::eBox;
+    };
+
+    TextureUploader(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const Param& param);
+
+    TextureUploader(const TextureUploader&)            = delete;
+    TextureUploader(TextureUploader&&)                 = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+    TextureUploader& operator=(TextureUploader&&)      = delete;
+
+    // Returns the cheapest way of generating mips given the queues of the device. If there is a dedicated transfer queue, uploads go
+    // through it so that they don't stall the general queue. As transfer queues can neither dispatch nor blit, we are better off
+    // generating the mips on the CPU in that case. Otherwise, generating them on the GPU after upload is cheaper. This is what
+    // MipGeneration::eAuto resolves to.
+    MipGeneration preferredMipGeneration() const;
+
+    // What Param::mipGeneration resolved to.
+    MipGeneration mipGeneration() const { return m_mipGeneration; }
+
+    // Uploads all textures and transitions them to eShaderReadOnlyOptimal. With MipGeneration::eGpu, uncompressed textures that only
+    // have their first level get their remaining levels generated by a compute downsampler (shaders/downsample.comp), which box filters
+    // every level from the previous one, on linear values for sRGB formats, and weights the texels along odd dimensions by their overlap.
+    // Formats that can't be storage images fall back to a chain of linear blits if they support it, and to generateMips() otherwise.
+    // With MipGeneration::eCpu, those textures get their levels from generateMips() before upload (the loader already generated them
+    // for textures it imported with eCpu).
+    std::vector<GPUTexture> upload(const std::vector<Texture>& textures) const;
+
+  private:
+    enum class MipPath
+    {
+        eNone,
+        eCpu, // Before upload, see generateMips()
+        eCompute,
+        eBlit,
+    };
+
+    // Index into m_downsamplePipelines and the format of the storage views of a texture format, if it has one:
+    struct StorageFormat
+    {
+        std::uint32_t pipeline = 0;
+        vk::Format    format   = vk::Format::eUndefined;
+        bool          srgb     = false;
+    };
+
+    static StorageFormat storageFormat(vk::Format format);
+
+    MipPath mipPath(const Texture& texture) const;
+
+    // Records the downsampling of every level after the first one, whose views and descriptor sets are kept in views and pool:
+    void recordDownsampleChain(const vk::CommandBuffer& commandBuffer, const GPUTexture& texture, const vk::DescriptorPool& pool,
+                               std::vector<vk::UniqueImageView>& views) const;
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+    MipGeneration       m_mipGeneration = MipGeneration::eNone; // Param::mipGeneration, with eAuto resolved
+
+    // Formats with the rgba16 qualifier are only supported with shaderStorageImageExtendedFormats:
+    bool m_extendedStorageFormats = false;
+
+    vk::UniqueDescriptorSetLayout     m_downsampleSetLayout;
+    vk::UniquePipelineLayout          m_downsampleLayout;
+    std::array<vk::UniquePipeline, 3> m_downsamplePipelines; // rgba8, rgba16 (only with m_extendedStorageFormats) and rgba32f
+};
+
+} // namespace polar
@@ -0,0 +1,180 @@
+#include "tiled_renderer.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace polar
+{
+
+TiledRenderer::TiledRenderer(const Context& context, const GPUAllocator& allocator, Integrator& integrator, const Param& param)
+    : m_context(context), m_allocator(allocator), m_integrator(integrator), m_param(param)
+{
+    if (m_param.imageExtent.x == 0 || m_param.imageExtent.y == 0 || m_param.tileSize.x == 0 || m_param.tileSize.y == 0)
+    {
+        throw std::runtime_error(fmt::format("Invalid tiled render of {}x{} pixels in tiles of {}x{}", m_param.imageExtent.x,
+                                             m_param.imageExtent.y, m_param.tileSize.x, m_param.tileSize.y));
+    }
+
+    m_param.tileSize        = glm::min(m_param.tileSize, m_param.imageExtent);
+    m_param.concurrentTiles = std::max(m_param.concurrentTiles, 1u);
+    m_param.samplesPerVisit = std::max(m_param.samplesPerVisit, 1u);
+    m_tileCount             = (m_param.imageExtent + m_param.tileSize - 1u) / m_param.tileSize;
+}
+
+void TiledRenderer::assignTile(Slot& slot, const std::uint32_t tileIndex) const
+{
+    const glm::uvec2 tile(tileIndex % m_tileCount.x, tileIndex / m_tileCount.x);
+
+    slot.tileIndex          = tileIndex;
+    slot.seconds            = 0.0;
+    slot.active             = true;
+    slot.target.imageExtent = m_param.imageExtent;
+    slot.target.offset      = tile * m_param.tileSize;
+    slot.target.extent      = glm::min(m_param.tileSize, m_param.imageExtent - slot.target.offset);
+    Integrator::reset(slot.target);
+}
+
+void TiledRenderer::writeTile(std::fstream& file, const std::uint64_t dataOffset, const Slot& slot) const
+{
+    const auto& device = m_context.device();
+    const auto& target = slot.target;
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.queueFamilyIndex(),
+    });
+
+    auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = commandBuffers.front();
+
+    commandBuffer->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    const vk::BufferCopy region{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size      = static_cast<vk::DeviceSize>(target.extent.x) * target.extent.y * sizeof(glm::vec4),
+    };
+    commandBuffer->copyBuffer(*target.accumulation, *slot.readbackBuffer, region);
+    submitAndWait(m_context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "tile readback");
+
+    // PFM stores the rows bottom to top:
+    const auto             accumulation = static_cast<const glm::vec4*>(slot.readbackBuffer.map());
+    std::vector<glm::vec3> row(target.extent.x);
+    for (std::uint32_t y = 0; y < target.extent.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < target.extent.x; ++x)
+        {
+            const auto& value = accumulation[y * target.extent.x + x];
+            row[x]            = value.w > 0.0f ? glm::vec3(value) / value.w : glm::vec3(0.0f);
+        }
+
+        const std::uint64_t imageRow = m_param.imageExtent.y - 1 - (target.offset.y + y);
+        file.seekp(static_cast<std::streamoff>(dataOffset + (imageRow * m_param.imageExtent.x + target.offset.x) * sizeof(glm::vec3)));
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(glm::vec3)));
+    }
+    slot.readbackBuffer.unmap();
+}
+
+void TiledRenderer::render(const std::filesystem::path& path, const RayTracingPipeline& pipeline, const SbtBuilder& sbt,
+                           std::span<const vk::DescriptorSet> descriptorSets)
+{
+    const auto start     = std::chrono::steady_clock::now();
+    const auto tileCount = m_tileCount.x * m_tileCount.y;
+
+    // The image is allocated on disk up front, so tiles can be written wherever they are as soon as they finish:
+    const auto header     = fmt::format("PF\n{} {}\n-1.0\n", m_param.imageExtent.x, m_param.imageExtent.y);
+    const auto dataOffset = static_cast<std::uint64_t>(header.size());
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(header.data(), static_cast<std::streamsize>(header.size()));
+        if (!file)
+        {
+            throw std::runtime_error(fmt::format("Failed to create image {}", path.string()));
+        }
+    }
+    const auto pixelCount = static_cast<std::uint64_t>(m_param.imageExtent.x) * m_param.imageExtent.y;
+    std::filesystem::resize_file(path, dataOffset + pixelCount * sizeof(glm::vec3));
+
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+
+    // The integrator may be reserved for the interactive resolution:
+    const auto reservedPixels = m_integrator.reservedPixels();
+    const auto tilePixels     = m_param.tileSize.x * m_param.tileSize.y;
+    m_integrator.reserve(tilePixels);
+
+    std::vector<Slot> slots(std::min(m_param.concurrentTiles, tileCount));
+    for (std::uint32_t i = 0; i < slots.size(); ++i)
+    {
+        slots[i].target         = m_integrator.createTarget(tilePixels);
+        slots[i].readbackBuffer = m_allocator.allocate(tilePixels * sizeof(glm::vec4), vk::BufferUsageFlagBits::eTransferDst,
+                                                       VMA_MEMORY_USAGE_CPU_ONLY);
+        assignTile(slots[i], i);
+    }
+
+    auto nextTile = static_cast<std::uint32_t>(slots.size());
+    for (bool rendering = true; rendering;)
+    {
+        rendering = false;
+        for (auto& slot : slots)
+        {
+            if (!slot.active)
+            {
+                continue;
+            }
+            rendering = true;
+
+            const double remainingTime = m_param.tile.timeBudget > 0.0 ? std::max(m_param.tile.timeBudget - slot.seconds, 1e-3) : 0.0;
+
+            // Sequential tiles are rendered in one go:
+            const auto visitSamples = slots.size() == 1 ? m_param.tile.maxSamples : m_param.samplesPerVisit;
+            const auto result       = m_integrator.renderBatch(
+                Integrator::BatchParam{
+                    .maxSamples = std::min(slot.target.sampleIndex + visitSamples, m_param.tile.maxSamples),
+                    .timeBudget = remainingTime,
+                },
+                slot.target, pipeline, sbt, descriptorSets);
+            slot.seconds += result.seconds;
+
+            const bool outOfTime = m_param.tile.timeBudget > 0.0 && slot.seconds >= m_param.tile.timeBudget;
+            if (!result.converged && !outOfTime && slot.target.sampleIndex < m_param.tile.maxSamples)
+            {
+                continue;
+            }
+
+            writeTile(file, dataOffset, slot);
+            spdlog::info("Finished tile {} of {} with {} samples per pixel in {:.2f} s ({} pixels unconverged).", slot.tileIndex + 1,
+                         tileCount, slot.target.sampleIndex, slot.seconds, slot.target.activePixelCount);
+
+            if (nextTile < tileCount)
+            {
+                assignTile(slot, nextTile++);
+            }
+            else
+            {
+                slot.active = false;
+            }
+        }
+    }
+
+    m_integrator.reserve(reservedPixels);
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::format("Failed to write image {}", path.string()));
+    }
+
+    spdlog::info("Rendered {}x{} pixels in {} tiles to {} in {:.2f} s.", m_param.imageExtent.x, m_param.imageExtent.y, tileCount,
+                 path.string(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace polar
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <integrator.hpp>
+
+namespace polar
+{
+
+// Renders images of any resolution in tiles, so that the GPU memory it needs only depends on the tile size. A small pool of render
+// targets (one per concurrent tile) is recycled: whenever a tile finishes, it is read back, written to the output file and its target
+// takes on the next tile. With a single concurrent tile the tiles are rendered one after another, with more the integrator rotates
+// round-robin between them, a few samples at a time, so that the image converges more evenly when the render is cut short.
+// The image is written as a PFM (32 bit float RGB), which tiles are written into in place.
+class TiledRenderer
+{
+  public:
+    struct Param
+    {
+        glm::uvec2 imageExtent = glm::uvec2(0);
+        glm::uvec2 tileSize    = glm::uvec2(512);
+
+        std::uint32_t concurrentTiles = 1;
+        std::uint32_t samplesPerVisit = 16; // Samples per pixel a tile takes before the next one is rendered (round-robin only)
+
+        // When a tile is finished, if it doesn't converge before (with adaptive sampling, see Integrator::AdaptiveParam).
+        Integrator::BatchParam tile;
+    };
+
+    TiledRenderer(const Context& context, const GPUAllocator& allocator, Integrator& integrator, const Param& param);
+
+    TiledRenderer(const TiledRenderer&)            = delete;
+    TiledRenderer(TiledRenderer&&)                 = delete;
+    TiledRenderer& operator=(const TiledRenderer&) = delete;
+    TiledRenderer& operator=(TiledRenderer&&)      = delete;
+
+    // Renders all tiles and writes the image to the given path. The GPU must not be rendering anything else. As with Integrator::render(),
+    // the shader binding table has to be built for the pipeline already.
+    void render(const std::filesystem::path& path, const RayTracingPipeline& pipeline, const SbtBuilder& sbt,
+                std::span<const vk::DescriptorSet> descriptorSets);
+
+  private:
+    struct Slot
+    {
+        RenderTarget    target;
+        GPUBufferUnique readbackBuffer;
+        std::uint32_t   tileIndex = 0;
+        double          seconds   = 0.0;
+        bool            active    = false;
+    };
+
+    void assignTile(Slot& slot, std::uint32_t tileIndex) const;
+    void writeTile(std::fstream& file, std::uint64_t dataOffset, const Slot& slot) const;
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Integrator&         m_integrator;
+    Param               m_param;
+
+    glm::uvec2 m_tileCount = glm::uvec2(0);
+};
+
+} // namespace polar
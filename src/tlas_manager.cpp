@@ -0,0 +1,370 @@
+#include "tlas_manager.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace polar
+{
+
+static vk::TransformMatrixKHR
+toTransformMatrix(const glm::mat4& transform)
+{
+    // Vulkan expects the top three rows in row major order, glm stores columns:
+    vk::TransformMatrixKHR result;
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            result.matrix[row][column] = transform[column][row];
+        }
+    }
+    return result;
+}
+
+static vk::AccelerationStructureGeometryKHR
+instanceGeometry(const vk::DeviceAddress instanceAddress)
+{
+    return vk::AccelerationStructureGeometryKHR{
+        .geometryType = vk::GeometryTypeKHR::eInstances,
+        .geometry     = {.instances =
+                         vk::AccelerationStructureGeometryInstancesDataKHR{
+                             .arrayOfPointers = VK_FALSE,
+                             .data            = {.deviceAddress = instanceAddress},
+                         }},
+    };
+}
+
+TlasManager::TlasManager(const Context& context, const GPUAllocator& allocator, const Param& param)
+    : m_context(context), m_allocator(allocator), m_param(param), m_uploader(allocator, param.framesInFlight)
+{
+    m_param.buildFlags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+
+    const auto geometry = instanceGeometry(0);
+
+    const vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+        .type          = vk::AccelerationStructureTypeKHR::eTopLevel,
+        .flags         = m_param.buildFlags,
+        .mode          = vk::BuildAccelerationStructureModeKHR::eBuild,
+        .geometryCount = 1,
+        .pGeometries   = &geometry,
+    };
+
+    const auto sizes =
+        m_context.device().getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, m_param.maxInstanceCount);
+
+    m_tlas = createAccelerationStructure(m_context, m_allocator, vk::AccelerationStructureTypeKHR::eTopLevel, sizes.accelerationStructureSize);
+
+    // The base address of the scratch buffer has to be aligned as well, which the allocation doesn't guarantee:
+    const vk::DeviceSize scratchAlignment = m_context.accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    m_scratchBuffer  = m_allocator.allocate(std::max(sizes.buildScratchSize, sizes.updateScratchSize) + scratchAlignment,
+                                            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                            VMA_MEMORY_USAGE_GPU_ONLY);
+    m_scratchAddress = alignUp(m_scratchBuffer.deviceAddress(m_context), scratchAlignment);
+
+    m_instanceBuffer = m_allocator.allocate(m_param.maxInstanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
+                                            vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                                vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                                            VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+//
+// Instance table
+//
+
+void TlasManager::markDirty(const std::uint32_t slot)
+{
+    // Edits tend to touch consecutive slots, so try to extend the last range first:
+    if (!m_dirtyRanges.empty() && m_dirtyRanges.back().second == slot)
+    {
+        ++m_dirtyRanges.back().second;
+        return;
+    }
+    m_dirtyRanges.emplace_back(slot, slot + 1);
+}
+
+void TlasManager::writeRecord(const std::uint32_t slot)
+{
+    const auto& instance = m_instances[slot];
+
+    // Removed slots are masked out, but keep their BLAS until the next rebuild so that they stay active:
+    m_records[slot] = vk::AccelerationStructureInstanceKHR{
+        .transform                              = toTransformMatrix(instance.transform),
+        .instanceCustomIndex                    = instance.customIndex,
+        .mask                                   = m_used[slot] ? instance.mask : std::uint8_t(0),
+        .instanceShaderBindingTableRecordOffset = instance.sbtRecordOffset,
+        .flags                                  = 0,
+        .accelerationStructureReference         = instance.blasAddress,
+    };
+
+    markDirty(slot);
+}
+
+void TlasManager::setInstances(const std::vector<TlasInstance>& instances)
+{
+    if (instances.size() > m_param.maxInstanceCount)
+    {
+        throw std::runtime_error(fmt::format("TLAS has {} instances, but only {} are supported", instances.size(), m_param.maxInstanceCount));
+    }
+
+    m_instances.clear();
+    m_records.clear();
+    m_used.clear();
+    m_activeInBuild.clear();
+    m_rebuildBounds.clear();
+    m_freeSlots.clear();
+    m_dirtyRanges.clear();
+
+    for (const auto& instance : instances)
+    {
+        addInstance(instance);
+    }
+
+    m_needsRebuild = true;
+}
+
+std::uint32_t TlasManager::addInstance(const TlasInstance& instance)
+{
+    std::uint32_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        if (m_instances.size() >= m_param.maxInstanceCount)
+        {
+            throw std::runtime_error(fmt::format("Can't add another instance to the TLAS, only {} are supported", m_param.maxInstanceCount));
+        }
+
+        slot = static_cast<std::uint32_t>(m_instances.size());
+        m_instances.emplace_back();
+        m_records.emplace_back();
+        m_used.emplace_back(false);
+        m_activeInBuild.emplace_back(false);
+        m_rebuildBounds.emplace_back();
+    }
+
+    m_instances[slot] = instance;
+    m_used[slot]      = true;
+    writeRecord(slot);
+
+    // A refit can neither change the number of instances nor whether an instance is active:
+    if (slot >= m_builtSlotCount || (instance.blasAddress != 0) != m_activeInBuild[slot])
+    {
+        m_needsRebuild = true;
+    }
+
+    return slot;
+}
+
+void TlasManager::removeInstance(const std::uint32_t slot)
+{
+    m_used[slot] = false;
+    m_freeSlots.emplace_back(slot);
+    writeRecord(slot);
+}
+
+void TlasManager::updateInstance(const std::uint32_t slot, const TlasInstance& instance)
+{
+    m_instances[slot] = instance;
+    writeRecord(slot);
+
+    // E.g. a BLAS that got evicted (activeness can't change in a refit):
+    if (slot < m_builtSlotCount && (instance.blasAddress != 0) != m_activeInBuild[slot])
+    {
+        m_needsRebuild = true;
+    }
+}
+
+void TlasManager::setTransform(const std::uint32_t slot, const glm::mat4& transform)
+{
+    m_instances[slot].transform = transform;
+    writeRecord(slot);
+}
+
+void TlasManager::trimFreeSlots()
+{
+    while (!m_used.empty() && !m_used.back())
+    {
+        m_instances.pop_back();
+        m_records.pop_back();
+        m_used.pop_back();
+        m_activeInBuild.pop_back();
+        m_rebuildBounds.pop_back();
+    }
+
+    const auto slotCount = static_cast<std::uint32_t>(m_instances.size());
+    std::erase_if(m_freeSlots, [&](const std::uint32_t slot) { return slot >= slotCount; });
+    for (auto& range : m_dirtyRanges)
+    {
+        range.second = std::min(range.second, slotCount);
+    }
+    std::erase_if(m_dirtyRanges, [](const auto& range) { return range.first >= range.second; });
+}
+
+float TlasManager::estimateGrowth() const
+{
+    float rebuildArea = 0.f, area = 0.f;
+    for (std::size_t i = 0; i < m_instances.size(); ++i)
+    {
+        if (!m_used[i])
+        {
+            continue;
+        }
+
+        auto bounds = m_instances[i].bounds.transformed(m_instances[i].transform);
+        bounds.extend(m_rebuildBounds[i]);
+
+        rebuildArea += m_rebuildBounds[i].surfaceArea();
+        area        += bounds.surfaceArea();
+    }
+
+    return rebuildArea > 0.f ? area / rebuildArea : 1.f;
+}
+
+//
+// Update
+//
+
+std::uint32_t TlasManager::uploadDirtyRanges(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    std::ranges::sort(m_dirtyRanges);
+
+    // Merge overlapping and adjacent ranges, so that every slot is uploaded at most once:
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+    for (const auto& range : m_dirtyRanges)
+    {
+        if (!ranges.empty() && range.first <= ranges.back().second)
+        {
+            ranges.back().second = std::max(ranges.back().second, range.second);
+        }
+        else
+        {
+            ranges.emplace_back(range);
+        }
+    }
+    m_dirtyRanges.clear();
+
+    constexpr auto RECORD_SIZE = sizeof(vk::AccelerationStructureInstanceKHR);
+
+    std::uint32_t uploadCount = 0;
+    for (const auto& [begin, end] : ranges)
+    {
+        m_uploader.add(m_records.data() + begin, (end - begin) * RECORD_SIZE, begin * RECORD_SIZE);
+        uploadCount += end - begin;
+    }
+
+    // The barriers around the upload are recorded by update(), as they also cover the build:
+    m_uploader.upload(commandBuffer, frameIndex, *m_instanceBuffer);
+
+    return uploadCount;
+}
+
+void TlasManager::update(const vk::CommandBuffer& commandBuffer, const std::uint64_t frameIndex)
+{
+    m_stats = {};
+
+    if (!m_needsRebuild && m_dirtyRanges.empty())
+    {
+        return;
+    }
+
+    auto rebuild = m_needsRebuild;
+    if (!rebuild)
+    {
+        m_stats.growth = estimateGrowth();
+        rebuild        = m_stats.growth > m_param.rebuildThreshold;
+    }
+
+    if (rebuild)
+    {
+        trimFreeSlots();
+
+        // A rebuild may deactivate the free slots, which releases their BLAS:
+        for (std::uint32_t slot = 0; slot < m_instances.size(); ++slot)
+        {
+            if (!m_used[slot] && m_instances[slot].blasAddress != 0)
+            {
+                m_instances[slot].blasAddress = 0;
+                writeRecord(slot);
+            }
+        }
+    }
+
+    const auto traceStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+
+    // The previous frame may still be tracing rays against the TLAS, or building it (which reads the instance buffer and uses the same
+    // scratch memory):
+    const vk::MemoryBarrier beforeUpload{
+        .srcAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                         vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+    };
+    commandBuffer.pipelineBarrier(traceStages | vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, beforeUpload,
+                                  {}, {});
+
+    m_stats.uploadedInstances = uploadDirtyRanges(commandBuffer, frameIndex);
+
+    const vk::MemoryBarrier beforeBuild{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eShaderRead,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, beforeBuild,
+                                  {}, {});
+
+    const auto geometry = instanceGeometry(m_instanceBuffer.deviceAddress(m_context));
+
+    const vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{
+        .type                     = vk::AccelerationStructureTypeKHR::eTopLevel,
+        .flags                    = m_param.buildFlags,
+        .mode                     = rebuild ? vk::BuildAccelerationStructureModeKHR::eBuild : vk::BuildAccelerationStructureModeKHR::eUpdate,
+        .srcAccelerationStructure = rebuild ? vk::AccelerationStructureKHR() : *m_tlas.handle,
+        .dstAccelerationStructure = *m_tlas.handle,
+        .geometryCount            = 1,
+        .pGeometries              = &geometry,
+        .scratchData              = {.deviceAddress = m_scratchAddress},
+    };
+
+    const vk::AccelerationStructureBuildRangeInfoKHR buildRange{
+        .primitiveCount  = static_cast<std::uint32_t>(m_instances.size()),
+        .primitiveOffset = 0,
+        .firstVertex     = 0,
+        .transformOffset = 0,
+    };
+
+    const auto buildRanges = &buildRange;
+    commandBuffer.buildAccelerationStructuresKHR(buildInfo, buildRanges);
+
+    const vk::MemoryBarrier afterBuild{
+        .srcAccessMask = vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+        .dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, traceStages, {}, afterBuild, {}, {});
+
+    if (rebuild)
+    {
+        for (std::size_t slot = 0; slot < m_instances.size(); ++slot)
+        {
+            const auto& instance  = m_instances[slot];
+            m_activeInBuild[slot] = instance.blasAddress != 0;
+            m_rebuildBounds[slot] = m_used[slot] ? instance.bounds.transformed(instance.transform) : BoundingBox();
+        }
+        m_builtSlotCount = static_cast<std::uint32_t>(m_instances.size());
+
+        m_stats.growth = 1.f;
+        ++m_stats.rebuilds;
+    }
+    else
+    {
+        ++m_stats.refits;
+    }
+
+    m_needsRebuild = false;
+}
+
+} // namespace polar
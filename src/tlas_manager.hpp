@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <acceleration_structure.hpp>
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <scene.hpp>
+
+namespace polar
+{
+
+struct TlasInstance
+{
+    vk::DeviceAddress blasAddress = 0;
+    BoundingBox       bounds;                      // Object space bounds of the BLAS
+    glm::mat4         transform       = glm::mat4(1.f);
+    std::uint32_t     customIndex     = 0;         // Only the lower 24 bits are available
+    std::uint32_t     sbtRecordOffset = 0;         // Only the lower 24 bits are available
+    std::uint8_t      mask            = 0xFF;
+};
+
+// Owns the TLAS and keeps it up to date with as little work as possible.
+// Instances live in stable slots of an instance table, which mirrors the instance buffer on the device. Edits only mark the slots they
+// touch as dirty, and only the dirty ranges are uploaded. Removed slots are kept in a free list and are reused by later additions.
+// The TLAS is refit in place whenever the update rules allow it, i.e. if the number of slots didn't change and no slot changed from
+// inactive to active. A removed slot is only masked out (rather than made inactive) until the next rebuild, so that it can still be
+// reused without one. Refits are abandoned in favor of a rebuild once the instances have moved so far from where they were at the last
+// rebuild that the quality of the tree suffers. This is estimated by how much the instance bounds would have to grow to cover both their
+// old and new positions (which is a lower bound for the growth of the nodes above them).
+class TlasManager
+{
+  public:
+    struct Param
+    {
+        // The TLAS is allocated for this many instances, so that it never has to be reallocated.
+        std::uint32_t maxInstanceCount = 1u << 16;
+
+        // Number of frames the staging buffer of a frame may still be read by the GPU.
+        std::uint32_t framesInFlight = 2;
+
+        // Rebuild once the summed surface area of the instance bounds (covering their positions at the last rebuild) grew by this factor.
+        float rebuildThreshold = 1.5f;
+
+        vk::BuildAccelerationStructureFlagsKHR buildFlags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+    };
+
+    // What the last update() did.
+    struct Stats
+    {
+        std::uint32_t refits            = 0;
+        std::uint32_t rebuilds          = 0;
+        std::uint32_t uploadedInstances = 0;
+        float         growth            = 1.f; // Estimated bounding volume growth since the last rebuild
+    };
+
+    TlasManager(const Context& context, const GPUAllocator& allocator, const Param& param);
+
+    TlasManager(const TlasManager&)            = delete;
+    TlasManager(TlasManager&&)                 = delete;
+    TlasManager& operator=(const TlasManager&) = delete;
+    TlasManager& operator=(TlasManager&&)      = delete;
+
+    // Replaces all instances, which are assigned the slots 0 to instances.size() - 1.
+    void setInstances(const std::vector<TlasInstance>& instances);
+
+    // Returns the slot of the new instance, which stays valid until it is removed.
+    std::uint32_t addInstance(const TlasInstance& instance);
+
+    // The BLAS of a removed instance may still be referenced by the TLAS until the slot is reused or the TLAS is rebuilt.
+    void removeInstance(std::uint32_t slot);
+
+    void updateInstance(std::uint32_t slot, const TlasInstance& instance);
+    void setTransform(std::uint32_t slot, const glm::mat4& transform);
+
+    // Uploads the dirty slots and records the rebuild or refit (if anything changed) into the command buffer, followed by a barrier that
+    // makes the TLAS available to ray tracing and compute shaders.
+    void update(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    const AccelerationStructure& tlas()  const { return m_tlas;  }
+    const Stats&                 stats() const { return m_stats; }
+
+  private:
+    void  markDirty(std::uint32_t slot);
+    void  writeRecord(std::uint32_t slot);
+    void  trimFreeSlots();
+    float estimateGrowth() const;
+
+    std::uint32_t uploadDirtyRanges(const vk::CommandBuffer& commandBuffer, std::uint64_t frameIndex);
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    Param               m_param;
+
+    AccelerationStructure m_tlas;
+    GPUBufferUnique       m_scratchBuffer;
+    vk::DeviceAddress     m_scratchAddress = 0;
+    GPUBufferUnique       m_instanceBuffer;
+    StagingUploader       m_uploader;
+
+    // The instance table, indexed by slot:
+    std::vector<TlasInstance>                         m_instances;
+    std::vector<vk::AccelerationStructureInstanceKHR> m_records;
+    std::vector<bool>                                 m_used;
+    std::vector<bool>                                 m_activeInBuild; // Whether the slot had a BLAS at the last rebuild
+    std::vector<BoundingBox>                          m_rebuildBounds; // World space bounds of the slot at the last rebuild
+    std::vector<std::uint32_t>                        m_freeSlots;
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> m_dirtyRanges; // [begin, end) slot ranges
+
+    std::uint32_t m_builtSlotCount = 0;
+    bool          m_needsRebuild   = true;
+    Stats         m_stats;
+};
+
+} // namespace polar
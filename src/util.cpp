@@ -1,7 +1,17 @@
 #include "util.hpp"
 
 #include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <random>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 namespace polar
 {
@@ -17,4 +27,164 @@ void vkCallImplementation(VkResult result, const char* command, const char* file
         fmt::format("Vulkan operation: {} failed with code: {} in file: {} in function: {} on line: {}", command, result, file, function, line));
 }
 
+std::uint64_t hashBytes(const void* const data, const std::size_t size, const std::uint64_t seed)
+{
+    constexpr std::uint64_t m = 0xc6a4a7935bd1e995ull;
+    constexpr int           r = 47;
+
+    const auto bytes = static_cast<const unsigned char*>(data);
+
+    std::uint64_t hash = seed ^ (size * m);
+
+    const auto blockCount = size / 8;
+    for (std::size_t i = 0; i < blockCount; ++i)
+    {
+        std::uint64_t k;
+        std::memcpy(&k, bytes + i * 8, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        hash ^= k;
+        hash *= m;
+    }
+
+    const auto tail = bytes + blockCount * 8;
+    switch (size & 7)
+    {
+    case 7: hash ^= std::uint64_t(tail[6]) << 48; [[fallthrough]];
+    case 6: hash ^= std::uint64_t(tail[5]) << 40; [[fallthrough]];
+    case 5: hash ^= std::uint64_t(tail[4]) << 32; [[fallthrough]];
+    case 4: hash ^= std::uint64_t(tail[3]) << 24; [[fallthrough]];
+    case 3: hash ^= std::uint64_t(tail[2]) << 16; [[fallthrough]];
+    case 2: hash ^= std::uint64_t(tail[1]) << 8;  [[fallthrough]];
+    case 1: hash ^= std::uint64_t(tail[0]);
+            hash *= m;
+    }
+
+    hash ^= hash >> r;
+    hash *= m;
+    hash ^= hash >> r;
+
+    return hash;
+}
+
+struct CacheEntryHeader
+{
+    std::uint32_t magic       = 0;
+    std::uint32_t version     = 0;
+    std::uint64_t payloadSize = 0;
+};
+
+bool readCacheEntry(const std::filesystem::path& path, const std::uint32_t magic, const std::uint32_t version, std::vector<std::byte>& payload)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    CacheEntryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != magic || header.version != version)
+    {
+        return false;
+    }
+
+    // A truncated or corrupt entry must not make us allocate whatever its header claims, so the payload has to fill the rest of the file:
+    std::error_code error;
+    const auto      fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize < sizeof(header) || header.payloadSize != fileSize - sizeof(header))
+    {
+        return false;
+    }
+
+    payload.resize(header.payloadSize);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size())));
+}
+
+// Returns a temporary file name next to path that no other write, from this or another process, uses at the same time:
+static std::filesystem::path
+uniqueTempPath(const std::filesystem::path& path)
+{
+    static const auto processSuffix = [] {
+        std::random_device random;
+        return (static_cast<std::uint64_t>(random()) << 32) | random();
+    }();
+    static std::atomic<std::uint64_t> writeCount = 0;
+
+    auto tempPath = path;
+    tempPath += fmt::format(".{:016x}.{}.tmp", processSuffix, writeCount++);
+    return tempPath;
+}
+
+void writeCacheEntry(const std::filesystem::path& path, const std::uint32_t magic, const std::uint32_t version,
+                     const std::span<const std::span<const std::byte>> parts)
+{
+    const auto tempPath = uniqueTempPath(path);
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+        CacheEntryHeader header{.magic = magic, .version = version};
+        for (const auto part : parts)
+        {
+            header.payloadSize += part.size();
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto part : parts)
+        {
+            file.write(reinterpret_cast<const char*>(part.data()), static_cast<std::streamsize>(part.size()));
+        }
+
+        if (!file)
+        {
+            spdlog::warn("Failed to write cache entry {}", tempPath.string());
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+    {
+        spdlog::warn("Failed to write cache entry {}: {}", path.string(), error.message());
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+void parallelFor(const std::size_t count, const std::function<void(std::size_t)>& func)
+{
+    const auto threadCount = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    if (threadCount <= 1)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    // Work is handed out dynamically as the cost of each item can vary quite a bit (e.g. uniform vs. noisy texture blocks):
+    std::atomic<std::size_t> next = 0;
+    const auto worker = [&]() {
+        for (auto i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+        {
+            func(i);
+        }
+    };
+
+    std::vector<std::jthread> threads;
+    threads.reserve(threadCount - 1);
+    for (std::size_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+}
+
 } // namespace polar
\ No newline at end of file
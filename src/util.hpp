@@ -2,7 +2,13 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <span>
+#include <vector>
 
 namespace polar
 {
@@ -30,6 +36,22 @@ template <typename F> class Defer
     F m_func;
 };
 
+// Non-cryptographic 64 bit hash (MurmurHash64A) used for content addressing, e.g. for the on-disk caches.
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t seed = 0);
+
+// Entries of the on-disk caches (shaders, textures and BLAS): a header with the magic and version of the cache and the size of the
+// payload. readCacheEntry() returns false for missing, stale, truncated or corrupt entries, and never allocates more than the file holds.
+bool readCacheEntry(const std::filesystem::path& path, std::uint32_t magic, std::uint32_t version, std::vector<std::byte>& payload);
+
+// Writes the payload, concatenated from its parts, to a temporary file of its own that is renamed to path once it's complete, so that
+// neither an interrupted write nor concurrent writes of the same entry (from this or another process) leave a partial entry behind. A
+// failed write is logged and its temporary file removed.
+void writeCacheEntry(const std::filesystem::path& path, std::uint32_t magic, std::uint32_t version,
+                     std::span<const std::span<const std::byte>> parts);
+
+// Calls func(i) for every i in [0, count) on all available hardware threads and blocks until all calls have returned.
+void parallelFor(std::size_t count, const std::function<void(std::size_t)>& func);
+
 template <typename T, auto F> using CustomUniquePtr = std::unique_ptr<T, std::integral_constant<decltype(F), F>>;
 
 } // namespace polar
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "wavefront_integrator.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#include <acceleration_structure.hpp>
+#include <configure.hpp>
+
+namespace polar
+{
+
+// Any kernel may read and write the queues of any earlier one, and read the dispatch arguments they appended:
+constexpr auto KERNEL_STAGES = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect;
+constexpr auto KERNEL_ACCESS = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead;
+
+// Offset of the dispatch arguments in a queue header:
+constexpr vk::DeviceSize DISPATCH_OFFSET = offsetof(QueueHeader, groupCountX);
+
+// Timestamps per bounce:
+constexpr std::uint32_t TRACE_TIMESTAMP     = 0;
+constexpr std::uint32_t SORT_TIMESTAMP      = 1;
+constexpr std::uint32_t SHADE_TIMESTAMP     = 2;
+constexpr std::uint32_t SHADE_END_TIMESTAMP = 3;
+constexpr std::uint32_t TIMESTAMPS          = 4;
+
+static void
+memoryBarrier(const vk::CommandBuffer& commandBuffer, const vk::PipelineStageFlags srcStages, const vk::AccessFlags srcAccess,
+              const vk::PipelineStageFlags dstStages, const vk::AccessFlags dstAccess)
+{
+    const vk::MemoryBarrier barrier{
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+    };
+    commandBuffer.pipelineBarrier(srcStages, dstStages, {}, barrier, {}, {});
+}
+
+WavefrontIntegrator::WavefrontIntegrator(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler,
+                                         const vk::PipelineLayout& layout, const Param& param)
+    : m_context(context), m_allocator(allocator), m_layout(layout), m_param(param),
+      m_sorter(context, allocator, compiler,
+               RaySorter::Param{
+                   .workgroupSize   = param.workgroupSize,
+                   .sortByDirection = param.sortByDirection,
+               })
+{
+    const auto kernel = [](const ShaderSource& source, const char* name) {
+        if (!source.path.empty())
+        {
+            return source;
+        }
+        return ShaderSource{
+            .path  = std::filesystem::path(SHADER_DIRECTORY) / "wavefront" / name,
+            .stage = vk::ShaderStageFlagBits::eCompute,
+        };
+    };
+
+    const ShaderSource sources[] = {
+        kernel(m_param.generateKernel, "generate.comp"),
+        kernel(m_param.traceKernel, "trace.comp"),
+        kernel(m_param.shadeKernel, "shade.comp"),
+        kernel(m_param.shadowKernel, "shadow.comp"),
+        kernel({}, "accumulate.comp"),
+    };
+
+    auto modules = compiler.createModules(m_context.device(), sources);
+
+    m_generatePipeline   = createPipeline(*modules[0]);
+    m_tracePipeline      = createPipeline(*modules[1]);
+    m_shadeModule        = std::move(modules[2]);
+    m_shadowPipeline     = createPipeline(*modules[3]);
+    m_accumulatePipeline = createPipeline(*modules[4]);
+
+    m_tableBuffer  = m_allocator.allocate(sizeof(GPUWavefrontQueues),
+                                          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                              vk::BufferUsageFlagBits::eTransferDst,
+                                          VMA_MEMORY_USAGE_GPU_ONLY);
+    m_tableAddress = m_tableBuffer.deviceAddress(m_context);
+
+    m_timestampPool = m_context.device().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+        .queryType  = vk::QueryType::eTimestamp,
+        .queryCount = m_param.framesInFlight * m_param.maxPathLength * TIMESTAMPS,
+    });
+    m_timedBounces.resize(m_param.framesInFlight);
+    m_timestampPeriod = m_context.physicalDevice().getProperties().limits.timestampPeriod;
+}
+
+vk::UniquePipeline WavefrontIntegrator::createPipeline(const vk::ShaderModule& module, const std::uint32_t features, const std::uint32_t bucket) const
+{
+    const std::array<std::uint32_t, 3> constants = {m_param.workgroupSize, features, bucket};
+
+    const std::array<vk::SpecializationMapEntry, 3> mapEntries = {
+        vk::SpecializationMapEntry{.constantID = 0, .offset = 0 * sizeof(std::uint32_t), .size = sizeof(std::uint32_t)},
+        vk::SpecializationMapEntry{.constantID = 1, .offset = 1 * sizeof(std::uint32_t), .size = sizeof(std::uint32_t)},
+        vk::SpecializationMapEntry{.constantID = 2, .offset = 2 * sizeof(std::uint32_t), .size = sizeof(std::uint32_t)},
+    };
+
+    const vk::SpecializationInfo specializationInfo{
+        .mapEntryCount = static_cast<std::uint32_t>(mapEntries.size()),
+        .pMapEntries   = mapEntries.data(),
+        .dataSize      = constants.size() * sizeof(std::uint32_t),
+        .pData         = constants.data(),
+    };
+
+    return m_context.device()
+        .createComputePipelineUnique(nullptr,
+                                     vk::ComputePipelineCreateInfo{
+                                         .stage =
+                                             vk::PipelineShaderStageCreateInfo{
+                                                 .stage               = vk::ShaderStageFlagBits::eCompute,
+                                                 .module              = module,
+                                                 .pName               = "main",
+                                                 .pSpecializationInfo = &specializationInfo,
+                                             },
+                                         .layout = m_layout,
+                                     })
+        .value;
+}
+
+void WavefrontIntegrator::setMaterials(const Scene& scene)
+{
+    const auto histogram   = materialFeatureHistogram(scene);
+    const auto bucketCount = std::clamp<std::uint32_t>(static_cast<std::uint32_t>(histogram.size()), 1, m_param.maxBuckets);
+
+    // The last bucket is shared by all remaining feature combinations if there are more than buckets:
+    std::vector<std::uint32_t> bucketFeatures;
+    for (std::uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        const bool shared = bucket == bucketCount - 1 && histogram.size() != bucketCount;
+        bucketFeatures.emplace_back(shared ? MaterialFeature::ALL : histogram[bucket].first);
+    }
+
+    const auto bucketOf = [&](const Material& material) {
+        const auto itr = std::ranges::find(bucketFeatures, materialFeatures(material));
+        return itr == bucketFeatures.end() ? bucketCount - 1 : static_cast<std::uint32_t>(itr - bucketFeatures.begin());
+    };
+
+    // The entry after the last material is for geometry without a material:
+    std::vector<std::uint32_t> materialBuckets;
+    materialBuckets.reserve(scene.materials.size() + 1);
+    for (const auto& material : scene.materials)
+    {
+        materialBuckets.emplace_back(bucketOf(material));
+    }
+    materialBuckets.emplace_back(bucketOf(Material{}));
+
+    const auto& device = m_context.device();
+
+    m_materialBucketBuffer = m_allocator.allocate(materialBuckets.size() * sizeof(std::uint32_t),
+                                                  vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                                      vk::BufferUsageFlagBits::eTransferDst,
+                                                  VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const auto commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_context.queueFamilyIndex(),
+    });
+
+    auto commandBuffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+        .commandPool        = *commandPool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    const auto& commandBuffer = commandBuffers.front();
+
+    commandBuffer->begin(vk::CommandBufferBeginInfo{.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    const auto stagingBuffer = m_allocator.addCopyStagingToBuffer(*commandBuffer, m_materialBucketBuffer, materialBuckets.data(),
+                                                                  materialBuckets.size() * sizeof(std::uint32_t));
+    submitAndWait(m_context, *commandBuffer, DEFAULT_FENCE_TIMEOUT, "material bucket upload");
+
+    m_shadePipelines.clear();
+    for (std::uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        m_shadePipelines.emplace_back(createPipeline(*m_shadeModule, bucketFeatures[bucket], bucket));
+    }
+
+    m_queues.materialBuckets = m_materialBucketBuffer.deviceAddress(m_context);
+    m_queues.bucketCount     = bucketCount;
+    m_tableDirty             = true;
+
+    m_sorter.setMaterialCount(static_cast<std::uint32_t>(materialBuckets.size()));
+
+    spdlog::info("Assigned {} material feature combinations to {} shading buckets.", histogram.size(), bucketCount);
+}
+
+void WavefrontIntegrator::resize(const std::uint32_t capacity)
+{
+    m_queueBuffer     = {};
+    m_queues.capacity = capacity;
+    m_tableDirty      = true;
+    m_sorter.resize(m_param.sortRays ? capacity : 0);
+
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    // All streams live in a single buffer, after the headers of the queues. Every stream starts at a multiple of 16 bytes:
+    constexpr vk::DeviceSize STREAM_ALIGNMENT = 16;
+
+    vk::DeviceSize size          = headerOffset(FIRST_BUCKET_QUEUE + m_param.maxBuckets);
+    const auto     reserveStream = [&](const vk::DeviceSize elementSize) {
+        const auto offset = alignUp(size, STREAM_ALIGNMENT);
+        size              = offset + elementSize * capacity;
+        return offset;
+    };
+
+    std::array<GPUPathQueue, 2> paths;
+    for (auto& path : paths)
+    {
+        path.origins     = reserveStream(4 * sizeof(float));
+        path.directions  = reserveStream(4 * sizeof(float));
+        path.throughputs = reserveStream(4 * sizeof(float));
+        path.states      = reserveStream(4 * sizeof(std::uint32_t));
+    }
+
+    const auto hits      = reserveStream(4 * sizeof(std::uint32_t));
+    const auto materials = reserveStream(sizeof(std::uint32_t));
+    const auto buckets   = reserveStream(m_param.maxBuckets * sizeof(std::uint32_t));
+
+    GPUShadowQueue shadows{
+        .origins       = reserveStream(4 * sizeof(float)),
+        .directions    = reserveStream(4 * sizeof(float)),
+        .contributions = reserveStream(4 * sizeof(float)),
+    };
+
+    const auto radiance = reserveStream(4 * sizeof(float));
+
+    m_queueBuffer = m_allocator.allocate(size,
+                                         vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                             vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                         VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // The offsets above become addresses:
+    const auto address = m_queueBuffer.deviceAddress(m_context);
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        m_queues.paths[i] = GPUPathQueue{
+            .origins     = address + paths[i].origins,
+            .directions  = address + paths[i].directions,
+            .throughputs = address + paths[i].throughputs,
+            .states      = address + paths[i].states,
+        };
+    }
+
+    m_queues.headers   = address;
+    m_queues.hits      = address + hits;
+    m_queues.materials = address + materials;
+    m_queues.buckets   = address + buckets;
+    m_queues.shadows = GPUShadowQueue{
+        .origins       = address + shadows.origins,
+        .directions    = address + shadows.directions,
+        .contributions = address + shadows.contributions,
+    };
+    m_queues.radiance = address + radiance;
+
+    spdlog::info("Allocated wavefront queues for {} paths ({:.1f} MiB).", capacity, size / (1024.0 * 1024.0));
+}
+
+void WavefrontIntegrator::setSortRays(const bool sortRays)
+{
+    m_param.sortRays = sortRays;
+    m_sorter.resize(sortRays ? m_queues.capacity : 0);
+    m_stageStats = {};
+
+    spdlog::info("{} ray sorting.", sortRays ? "Enabled" : "Disabled");
+}
+
+void WavefrontIntegrator::beginFrame(const vk::CommandBuffer& commandBuffer, const std::uint32_t slot)
+{
+    const auto firstQuery = slot * m_param.maxPathLength * TIMESTAMPS;
+    if (const auto bounces = std::exchange(m_timedBounces[slot], 0); bounces > 0)
+    {
+        const auto timestamps = m_context.device().getQueryPoolResults<std::uint64_t>(
+            *m_timestampPool, firstQuery, bounces * TIMESTAMPS, bounces * TIMESTAMPS * sizeof(std::uint64_t), sizeof(std::uint64_t),
+            vk::QueryResultFlagBits::e64);
+
+        if (timestamps.result == vk::Result::eSuccess)
+        {
+            const auto milliseconds = [&](const std::uint32_t bounce, const std::uint32_t first, const std::uint32_t last) {
+                const auto& values = timestamps.value;
+                return (values[bounce * TIMESTAMPS + last] - values[bounce * TIMESTAMPS + first]) * m_timestampPeriod * 1e-6;
+            };
+
+            double traceMilliseconds = 0.0;
+            m_stageStats.samples += 1;
+            for (std::uint32_t bounce = 0; bounce < bounces; ++bounce)
+            {
+                traceMilliseconds += milliseconds(bounce, TRACE_TIMESTAMP, SORT_TIMESTAMP);
+                m_stageStats.sortMilliseconds += milliseconds(bounce, SORT_TIMESTAMP, SHADE_TIMESTAMP);
+                m_stageStats.shadeMilliseconds += milliseconds(bounce, SHADE_TIMESTAMP, SHADE_END_TIMESTAMP);
+            }
+            m_stageStats.traceMilliseconds += traceMilliseconds;
+
+            if (m_blasPolicy)
+            {
+                m_blasPolicy->recordTrace(traceMilliseconds);
+            }
+        }
+    }
+
+    commandBuffer.resetQueryPool(*m_timestampPool, firstQuery, m_param.maxPathLength * TIMESTAMPS);
+    m_timedSlot = slot;
+}
+
+void WavefrontIntegrator::writeTimestamp(const vk::CommandBuffer& commandBuffer, const std::uint32_t bounce, const std::uint32_t stage) const
+{
+    if (m_timedSlot == ~0u || bounce >= m_param.maxPathLength)
+    {
+        return;
+    }
+
+    const auto query = (m_timedSlot * m_param.maxPathLength + bounce) * TIMESTAMPS + stage;
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, *m_timestampPool, query);
+}
+
+void WavefrontIntegrator::dispatchQueue(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, const std::uint32_t queue) const
+{
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.dispatchIndirect(*m_queueBuffer, headerOffset(queue) + DISPATCH_OFFSET);
+}
+
+void WavefrontIntegrator::dispatchPixels(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, const std::uint32_t groupCount,
+                                         const vk::Buffer& activePixels) const
+{
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    if (activePixels)
+    {
+        commandBuffer.dispatchIndirect(activePixels, offsetof(ActivePixelsHeader, pixels) + DISPATCH_OFFSET);
+    }
+    else
+    {
+        commandBuffer.dispatch(groupCount, 1, 1);
+    }
+}
+
+void WavefrontIntegrator::render(const vk::CommandBuffer& commandBuffer, IntegratorConstants constants, const vk::Buffer& activePixels)
+{
+    const auto pixelCount = constants.extent.x * constants.extent.y;
+    const auto groupCount = (pixelCount + m_param.workgroupSize - 1) / m_param.workgroupSize;
+
+    if (pixelCount > m_queues.capacity || m_shadePipelines.empty())
+    {
+        throw std::runtime_error(fmt::format("Wavefront queues hold {} paths and {} buckets, but {} pixels were rendered", m_queues.capacity,
+                                             m_shadePipelines.size(), pixelCount));
+    }
+
+    if (m_tableDirty)
+    {
+        commandBuffer.updateBuffer(*m_tableBuffer, 0, sizeof(m_queues), &m_queues);
+        m_tableDirty = false;
+    }
+
+    // All queues start out empty, except for the camera paths that the generate kernel writes:
+    std::vector<QueueHeader> headers(FIRST_BUCKET_QUEUE + m_queues.bucketCount);
+    headers[PATH_QUEUE_0] = QueueHeader{
+        .count       = pixelCount,
+        .groupCountX = groupCount,
+    };
+
+    // The previous sample may still be using the queues:
+    memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+    commandBuffer.updateBuffer(*m_queueBuffer, 0, headers.size() * sizeof(QueueHeader), headers.data());
+    if (constants.adaptive)
+    {
+        // Only the active pixels get a camera path, the count and dispatch size of the list are the first fields of its header:
+        const vk::BufferCopy region{
+            .srcOffset = offsetof(ActivePixelsHeader, pixels),
+            .dstOffset = headerOffset(PATH_QUEUE_0),
+            .size      = sizeof(QueueHeader),
+        };
+        commandBuffer.copyBuffer(activePixels, *m_queueBuffer, region);
+    }
+    memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, KERNEL_STAGES, KERNEL_ACCESS);
+
+    constants.queues = m_tableAddress;
+    constants.bounce = 0;
+    commandBuffer.pushConstants(m_layout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+
+    dispatchPixels(commandBuffer, *m_generatePipeline, groupCount, constants.adaptive ? activePixels : vk::Buffer());
+    memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, KERNEL_STAGES, KERNEL_ACCESS);
+
+    for (std::uint32_t bounce = 0; bounce < constants.maxPathLength; ++bounce)
+    {
+        const auto pathQueue     = bounce % 2 == 0 ? PATH_QUEUE_0 : PATH_QUEUE_1;
+        const auto nextPathQueue = bounce % 2 == 0 ? PATH_QUEUE_1 : PATH_QUEUE_0;
+
+        // The queues this bounce appends to still hold the entries of the previous one:
+        if (bounce > 0)
+        {
+            memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+            commandBuffer.updateBuffer(*m_queueBuffer, headerOffset(nextPathQueue), sizeof(QueueHeader), &headers[PATH_QUEUE_1]);
+            commandBuffer.updateBuffer(*m_queueBuffer, headerOffset(SHADOW_QUEUE), (headers.size() - SHADOW_QUEUE) * sizeof(QueueHeader),
+                                       &headers[SHADOW_QUEUE]);
+            memoryBarrier(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, KERNEL_STAGES, KERNEL_ACCESS);
+        }
+
+        constants.bounce = bounce;
+        commandBuffer.pushConstants(m_layout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+
+        writeTimestamp(commandBuffer, bounce, TRACE_TIMESTAMP);
+        dispatchQueue(commandBuffer, *m_tracePipeline, pathQueue);
+        memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, KERNEL_STAGES, KERNEL_ACCESS);
+        writeTimestamp(commandBuffer, bounce, SORT_TIMESTAMP);
+
+        if (m_param.sortRays)
+        {
+            m_sorter.sort(commandBuffer, *m_queueBuffer, m_tableAddress, m_queues, pathQueue);
+            commandBuffer.pushConstants(m_layout, vk::ShaderStageFlagBits::eAll, 0, sizeof(constants), &constants);
+        }
+        writeTimestamp(commandBuffer, bounce, SHADE_TIMESTAMP);
+
+        // Buckets that no path hit dispatch zero workgroups:
+        for (std::uint32_t bucket = 0; bucket < m_shadePipelines.size(); ++bucket)
+        {
+            dispatchQueue(commandBuffer, *m_shadePipelines[bucket], FIRST_BUCKET_QUEUE + bucket);
+        }
+        memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, KERNEL_STAGES, KERNEL_ACCESS);
+        writeTimestamp(commandBuffer, bounce, SHADE_END_TIMESTAMP);
+
+        dispatchQueue(commandBuffer, *m_shadowPipeline, SHADOW_QUEUE);
+        memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, KERNEL_STAGES, KERNEL_ACCESS);
+    }
+
+    dispatchPixels(commandBuffer, *m_accumulatePipeline, groupCount, constants.adaptive ? activePixels : vk::Buffer());
+    memoryBarrier(commandBuffer, KERNEL_STAGES, KERNEL_ACCESS, KERNEL_STAGES, KERNEL_ACCESS);
+
+    // Only the first sample of a frame is timed:
+    if (m_timedSlot != ~0u)
+    {
+        m_timedBounces[m_timedSlot] = std::min(constants.maxPathLength, m_param.maxPathLength);
+        m_timedSlot                 = ~0u;
+    }
+}
+
+} // namespace polar
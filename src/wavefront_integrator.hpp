@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <blas_policy.hpp>
+#include <context.hpp>
+#include <gpu_allocator.hpp>
+#include <integrator_interface.hpp>
+#include <ray_sorter.hpp>
+#include <scene.hpp>
+#include <shader_compiler.hpp>
+
+namespace polar
+{
+
+// Path tracer that splits every bounce into separate compute kernels, which communicate through queues (structure of arrays, see
+// shaders/integrator.glsl). Every kernel only runs over the entries of its queue with an indirect dispatch, which the kernels that append
+// to the queue keep up to date, so no pass over the counts is needed in between. Per sample:
+//  - generate:   one thread per pixel (or per active pixel with adaptive sampling, see launchPixel()), writes the camera path of the pixel
+//                to paths[0] (at the launch index) and clears its radiance
+//  - per bounce:
+//    - trace:    one thread per path of paths[bounce % 2], traces it with a ray query and writes hits[i] and materials[i]. Hits are
+//                appended to the queue of the bucket of their material, misses add the environment to the radiance of their pixel
+//    - sort:     optionally sorts the queue of every bucket by material and direction, see RaySorter
+//    - shade:    one dispatch per material bucket, with a shade kernel specialized for the bucket. Adds emission, appends a shadow ray for
+//                next event estimation and appends the continued path to paths[(bounce + 1) % 2]
+//    - shadow:   one thread per shadow ray, adds its contribution to the radiance of its pixel if it's unoccluded
+//  - accumulate: one thread per (active) pixel, adds the radiance of the sample to the accumulation
+// Separating the stages keeps divergent material code out of tracing and lets every material bucket run its own specialized kernel.
+// The queues hold one entry per pixel (about 240 bytes per pixel with 8 buckets).
+class WavefrontIntegrator
+{
+  public:
+    struct Param
+    {
+        // The kernels that depend on the scene, those that ship in shaders/wavefront/ if the path is empty. The shipped ones path trace the
+        // scene table (see SceneTable), kernels of the application have to #define WAVEFRONT_KERNEL and #include <integrator.glsl>, so
+        // SHADER_DIRECTORY has to be an include directory of the compiler. The accumulate kernel always ships with the shaders.
+        ShaderSource generateKernel;
+        ShaderSource traceKernel;
+        ShaderSource shadeKernel;
+        ShaderSource shadowKernel;
+
+        // The most common material feature bitmasks (see materialFeatureHistogram()) get a bucket of their own, all others share the last
+        // one. The shade kernel is specialized per bucket with its features as constant 1 (MaterialFeature::ALL for the shared bucket) and
+        // its index as constant 2.
+        std::uint32_t maxBuckets = 8;
+
+        // Specialization constant 0 of all kernels.
+        std::uint32_t workgroupSize = 64;
+
+        bool sortRays        = false;
+        bool sortByDirection = true;
+
+        // Set by Integrator. The stages of the first sample of every frame are timed, for up to maxPathLength bounces.
+        std::uint32_t framesInFlight = 2;
+        std::uint32_t maxPathLength  = 8;
+    };
+
+    // GPU time of every stage, summed over all bounces of the timed samples.
+    struct StageStats
+    {
+        std::uint64_t samples           = 0;
+        double        traceMilliseconds = 0.0;
+        double        sortMilliseconds  = 0.0;
+        double        shadeMilliseconds = 0.0;
+    };
+
+    WavefrontIntegrator(const Context& context, const GPUAllocator& allocator, const ShaderCompiler& compiler, const vk::PipelineLayout& layout,
+                        const Param& param);
+
+    WavefrontIntegrator(const WavefrontIntegrator&)            = delete;
+    WavefrontIntegrator(WavefrontIntegrator&&)                 = delete;
+    WavefrontIntegrator& operator=(const WavefrontIntegrator&) = delete;
+    WavefrontIntegrator& operator=(WavefrontIntegrator&&)      = delete;
+
+    // Assigns the materials to buckets and creates the shade kernel of every bucket. Has to be called before rendering, while the GPU
+    // isn't rendering.
+    void setMaterials(const Scene& scene);
+
+    // Allocates the queues for the given number of pixels (or frees them for 0), while the GPU isn't rendering.
+    void          resize(std::uint32_t capacity);
+    std::uint32_t capacity() const { return m_queues.capacity; }
+
+    // Toggles ray sorting, while the GPU isn't rendering. The stage stats are reset, so they only cover one setting.
+    void setSortRays(bool sortRays);
+    bool sortRays() const { return m_param.sortRays; }
+
+    // Reads back the stage timestamps of the last frame that used the slot (which has to be finished) and times the stages of the next
+    // sample that is rendered.
+    void beginFrame(const vk::CommandBuffer& commandBuffer, std::uint32_t slot);
+
+    // Records a single sample per pixel. The descriptor sets of the scene have to be bound to the compute bind point already. If
+    // constants.adaptive is set, only the pixels in activePixels (the buffer at constants.activePixels) are sampled.
+    void render(const vk::CommandBuffer& commandBuffer, IntegratorConstants constants, const vk::Buffer& activePixels = {});
+
+    const StageStats& stageStats() const { return m_stageStats; }
+
+    // The trace time of every timed sample is also reported to the policy, if there is one.
+    void setBlasPolicy(BlasPolicy* policy) { m_blasPolicy = policy; }
+
+  private:
+    vk::UniquePipeline createPipeline(const vk::ShaderModule& module, std::uint32_t features = 0, std::uint32_t bucket = 0) const;
+
+    // The headers of all queues are at the start of the queue buffer:
+    static vk::DeviceSize headerOffset(std::uint32_t queue) { return queue * sizeof(QueueHeader); }
+
+    void dispatchQueue(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, std::uint32_t queue) const;
+
+    // Writes a stage timestamp of the bounce, if the current sample is timed:
+    void writeTimestamp(const vk::CommandBuffer& commandBuffer, std::uint32_t bounce, std::uint32_t stage) const;
+
+    // Dispatches over all pixels, or indirectly over the active pixels if given:
+    void dispatchPixels(const vk::CommandBuffer& commandBuffer, const vk::Pipeline& pipeline, std::uint32_t groupCount,
+                        const vk::Buffer& activePixels) const;
+
+    const Context&      m_context;
+    const GPUAllocator& m_allocator;
+    vk::PipelineLayout  m_layout;
+    Param               m_param;
+
+    vk::UniqueShaderModule          m_shadeModule;
+    vk::UniquePipeline              m_generatePipeline;
+    vk::UniquePipeline              m_tracePipeline;
+    vk::UniquePipeline              m_shadowPipeline;
+    vk::UniquePipeline              m_accumulatePipeline;
+    std::vector<vk::UniquePipeline> m_shadePipelines; // One per bucket
+
+    GPUBufferUnique    m_queueBuffer; // Headers and all streams
+    GPUBufferUnique    m_materialBucketBuffer;
+    GPUBufferUnique    m_tableBuffer; // GPUWavefrontQueues
+    vk::DeviceAddress  m_tableAddress = 0;
+    GPUWavefrontQueues m_queues;
+    bool               m_tableDirty = true;
+
+    RaySorter m_sorter;
+
+    // Four timestamps per bounce (before trace, sort and shade and after shade) per frame in flight:
+    vk::UniqueQueryPool        m_timestampPool;
+    std::vector<std::uint32_t> m_timedBounces; // Per slot, 0 if nothing was timed
+    std::uint32_t              m_timedSlot       = ~0u;
+    double                     m_timestampPeriod = 1.0;
+    StageStats                 m_stageStats;
+    BlasPolicy*                m_blasPolicy = nullptr;
+};
+
+} // namespace polar